@@ -0,0 +1,362 @@
+/*
+ * Copyright (c) 2016, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+
+#include "jsonstream.h"
+#include <string.h>
+
+enum {
+  STATE_VALUE,
+  STATE_VALUE_OR_END,
+  STATE_NAME,
+  STATE_NAME_OR_END,
+  STATE_COLON,
+  STATE_AFTER_VALUE,
+  STATE_STRING,
+  STATE_ESCAPE,
+  STATE_UNICODE,
+  STATE_NUMBER,
+  STATE_LITERAL,
+  STATE_DONE,
+  STATE_ERROR
+};
+/*--------------------------------------------------------------------*/
+static void
+emit(struct jsonstream_state *state, int type, const char *value, int len,
+     uint8_t done)
+{
+  if(len > 0 || done) {
+    state->flags = done ? JSONSTREAM_FLAG_VALUE_DONE : 0;
+    state->callback(state, type, value, len);
+  }
+}
+/*--------------------------------------------------------------------*/
+static int
+in_object(struct jsonstream_state *state)
+{
+  uint8_t top = state->depth - 1;
+
+  return (state->stack[top / 8] & (1 << (top % 8))) != 0;
+}
+/*--------------------------------------------------------------------*/
+static void
+error(struct jsonstream_state *state, char error)
+{
+  state->error = error;
+  state->state = STATE_ERROR;
+}
+/*--------------------------------------------------------------------*/
+static void
+after_value(struct jsonstream_state *state)
+{
+  state->state = state->depth == 0 ? STATE_DONE : STATE_AFTER_VALUE;
+}
+/*--------------------------------------------------------------------*/
+static void
+push(struct jsonstream_state *state, char c)
+{
+  if(state->depth == JSONSTREAM_MAX_DEPTH) {
+    error(state, JSON_ERROR_TOO_DEEP);
+    return;
+  }
+  emit(state, c, NULL, 0, 1);
+  if(c == JSON_TYPE_OBJECT) {
+    state->stack[state->depth / 8] |= 1 << (state->depth % 8);
+    state->state = STATE_NAME_OR_END;
+  } else {
+    state->stack[state->depth / 8] &= ~(1 << (state->depth % 8));
+    state->state = STATE_VALUE_OR_END;
+  }
+  state->depth++;
+}
+/*--------------------------------------------------------------------*/
+static void
+pop(struct jsonstream_state *state, char c)
+{
+  state->depth--;
+  emit(state, c, NULL, 0, 1);
+  after_value(state);
+}
+/*--------------------------------------------------------------------*/
+static const char *
+literal(char type)
+{
+  switch(type) {
+  case JSON_TYPE_TRUE:  return "true";
+  case JSON_TYPE_FALSE: return "false";
+  default:              return "null";
+  }
+}
+/*--------------------------------------------------------------------*/
+static int
+is_number(char c)
+{
+  return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' ||
+    c == 'e' || c == 'E';
+}
+/*--------------------------------------------------------------------*/
+static int
+hex_value(char c)
+{
+  if(c >= '0' && c <= '9') {
+    return c - '0';
+  } else if(c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  } else if(c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+/*--------------------------------------------------------------------*/
+/* encodes a \u escape as UTF-8, surrogates are encoded one by one */
+static int
+encode_unicode(struct jsonstream_state *state)
+{
+  uint16_t u = state->unicode;
+
+  if(u < 0x80) {
+    state->decoded[0] = u;
+    return 1;
+  } else if(u < 0x800) {
+    state->decoded[0] = 0xc0 | (u >> 6);
+    state->decoded[1] = 0x80 | (u & 0x3f);
+    return 2;
+  }
+  state->decoded[0] = 0xe0 | (u >> 12);
+  state->decoded[1] = 0x80 | ((u >> 6) & 0x3f);
+  state->decoded[2] = 0x80 | (u & 0x3f);
+  return 3;
+}
+/*--------------------------------------------------------------------*/
+static char
+unescape(char c)
+{
+  switch(c) {
+  case '"':  return '"';
+  case '\\': return '\\';
+  case '/':  return '/';
+  case 'b':  return '\b';
+  case 'f':  return '\f';
+  case 'n':  return '\n';
+  case 'r':  return '\r';
+  case 't':  return '\t';
+  default:   return 0;
+  }
+}
+/*--------------------------------------------------------------------*/
+/* handles a byte outside of names and atomic values */
+static void
+structure(struct jsonstream_state *state, char c)
+{
+  if(c == ' ' || c == '\n' || c == '\r' || c == '\t') {
+    return;
+  }
+
+  switch(state->state) {
+  case STATE_NAME_OR_END:
+  case STATE_NAME:
+    if(c == '"') {
+      state->vtype = JSON_TYPE_PAIR_NAME;
+      state->state = STATE_STRING;
+    } else if(c == '}' && state->state == STATE_NAME_OR_END) {
+      pop(state, c);
+    } else {
+      error(state, JSON_ERROR_SYNTAX);
+    }
+    return;
+  case STATE_COLON:
+    if(c == ':') {
+      state->state = STATE_VALUE;
+    } else {
+      error(state, JSON_ERROR_SYNTAX);
+    }
+    return;
+  case STATE_AFTER_VALUE:
+    if(c == ',') {
+      state->state = in_object(state) ? STATE_NAME : STATE_VALUE;
+    } else if(c == '}' && in_object(state)) {
+      pop(state, c);
+    } else if(c == ']' && !in_object(state)) {
+      pop(state, c);
+    } else if(c == '}') {
+      error(state, JSON_ERROR_UNEXPECTED_END_OF_OBJECT);
+    } else if(c == ']') {
+      error(state, JSON_ERROR_UNEXPECTED_END_OF_ARRAY);
+    } else {
+      error(state, JSON_ERROR_SYNTAX);
+    }
+    return;
+  case STATE_VALUE_OR_END:
+    if(c == ']') {
+      pop(state, c);
+      return;
+    }
+    /* fall through */
+  case STATE_VALUE:
+    if(c == '{' || c == '[') {
+      push(state, c);
+    } else if(c == '"') {
+      state->vtype = JSON_TYPE_STRING;
+      state->state = STATE_STRING;
+    } else if(c == '-' || (c >= '0' && c <= '9')) {
+      state->vtype = JSON_TYPE_NUMBER;
+      state->state = STATE_NUMBER;
+    } else if(c == 't' || c == 'f' || c == 'n') {
+      state->vtype = c;
+      state->count = 1;
+      state->state = STATE_LITERAL;
+    } else {
+      error(state, JSON_ERROR_SYNTAX);
+    }
+    return;
+  default:
+    error(state, JSON_ERROR_SYNTAX);
+    return;
+  }
+}
+/*--------------------------------------------------------------------*/
+void
+jsonstream_init(struct jsonstream_state *state,
+                jsonstream_callback_t callback, void *ptr)
+{
+  memset(state, 0, sizeof(*state));
+  state->callback = callback;
+  state->ptr = ptr;
+  state->state = STATE_VALUE;
+}
+/*--------------------------------------------------------------------*/
+int
+jsonstream_feed(struct jsonstream_state *state, const char *data, int len)
+{
+  int i;
+  int start;
+  char c;
+  int v;
+
+  /* a name or value continued from the previous fragment starts here */
+  start = 0;
+
+  for(i = 0; i < len && state->state != STATE_ERROR; i++) {
+    c = data[i];
+
+    switch(state->state) {
+    case STATE_STRING:
+      if(c == '"') {
+        emit(state, state->vtype, &data[start], i - start, 1);
+        if(state->vtype == JSON_TYPE_PAIR_NAME) {
+          state->state = STATE_COLON;
+        } else {
+          after_value(state);
+        }
+      } else if(c == '\\') {
+        emit(state, state->vtype, &data[start], i - start, 0);
+        state->state = STATE_ESCAPE;
+      } else if((unsigned char)c < 0x20) {
+        error(state, JSON_ERROR_SYNTAX);
+      }
+      break;
+    case STATE_ESCAPE:
+      if(c == 'u') {
+        state->unicode = 0;
+        state->count = 0;
+        state->state = STATE_UNICODE;
+      } else if((state->decoded[0] = unescape(c)) != 0) {
+        emit(state, state->vtype, state->decoded, 1, 0);
+        state->state = STATE_STRING;
+        start = i + 1;
+      } else {
+        error(state, JSON_ERROR_SYNTAX);
+      }
+      break;
+    case STATE_UNICODE:
+      v = hex_value(c);
+      if(v < 0) {
+        error(state, JSON_ERROR_SYNTAX);
+        break;
+      }
+      state->unicode = (state->unicode << 4) | v;
+      if(++state->count == 4) {
+        emit(state, state->vtype, state->decoded, encode_unicode(state), 0);
+        state->state = STATE_STRING;
+        start = i + 1;
+      }
+      break;
+    case STATE_NUMBER:
+      if(!is_number(c)) {
+        emit(state, JSON_TYPE_NUMBER, &data[start], i - start, 1);
+        after_value(state);
+        structure(state, c);
+      }
+      break;
+    case STATE_LITERAL:
+      if(c != literal(state->vtype)[state->count]) {
+        error(state, JSON_ERROR_SYNTAX);
+      } else if(literal(state->vtype)[++state->count] == 0) {
+        emit(state, state->vtype, literal(state->vtype), state->count, 1);
+        after_value(state);
+      }
+      break;
+    default:
+      structure(state, c);
+      start = i + 1;
+      if(state->state == STATE_NUMBER) {
+        /* the first digit or sign is part of the value */
+        start = i;
+      }
+      break;
+    }
+  }
+
+  if(state->state == STATE_ERROR) {
+    state->pos += i - 1;
+    return state->error;
+  }
+
+  /* pass on what we have of a name or value that goes on */
+  if(state->state == STATE_STRING || state->state == STATE_NUMBER) {
+    emit(state, state->vtype, &data[start], len - start, 0);
+  }
+  state->pos += len;
+  return JSON_ERROR_OK;
+}
+/*--------------------------------------------------------------------*/
+int
+jsonstream_end(struct jsonstream_state *state)
+{
+  if(state->state == STATE_NUMBER) {
+    emit(state, JSON_TYPE_NUMBER, NULL, 0, 1);
+    after_value(state);
+  }
+  if(state->state != STATE_DONE && state->state != STATE_ERROR) {
+    error(state, JSON_ERROR_SYNTAX);
+  }
+  return state->error;
+}
+/*--------------------------------------------------------------------*/
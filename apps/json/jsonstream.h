@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2016, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+
+/**
+ * \file
+ *         A streaming JSON parser. Data is fed in fragments of any
+ *         size, such as the payloads of TCP segments, and the parser
+ *         calls back for every token. Values are passed as slices of
+ *         the fed data whenever possible, so the parser never holds
+ *         more than its own fixed-size state.
+ */
+
+#ifndef JSONSTREAM_H_
+#define JSONSTREAM_H_
+
+#include "contiki-conf.h"
+#include "json.h"
+
+#ifdef JSONSTREAM_CONF_MAX_DEPTH
+#define JSONSTREAM_MAX_DEPTH JSONSTREAM_CONF_MAX_DEPTH
+#else
+#define JSONSTREAM_MAX_DEPTH 32
+#endif
+
+struct jsonstream_state;
+
+/**
+ * \brief      Callback for the tokens of a JSON document
+ * \param state The parser state
+ * \param type The type of the token, one of JSON_TYPE_OBJECT, '}',
+ *             JSON_TYPE_ARRAY, ']', JSON_TYPE_PAIR_NAME,
+ *             JSON_TYPE_STRING, JSON_TYPE_NUMBER, JSON_TYPE_TRUE,
+ *             JSON_TYPE_FALSE or JSON_TYPE_NULL
+ * \param value Part of the value of a name or an atomic value, or NULL
+ * \param len  The length of the part
+ *
+ *             Names and atomic values may be passed in several
+ *             parts, for instance when they span two fragments or
+ *             contain escapes, which are passed decoded. The last
+ *             part, which may be empty, is passed with
+ *             jsonstream_value_done() true. The parts are only valid
+ *             during the call.
+ */
+typedef void (* jsonstream_callback_t)(struct jsonstream_state *state,
+                                       int type, const char *value, int len);
+
+/* Set while the last part of a value is passed to the callback */
+#define JSONSTREAM_FLAG_VALUE_DONE 0x01
+
+struct jsonstream_state {
+  jsonstream_callback_t callback;
+  void *ptr;
+  unsigned long pos;
+  uint8_t state;
+  uint8_t depth;
+  uint8_t flags;
+  uint8_t count;
+  uint16_t unicode;
+  char vtype;
+  char error;
+  char decoded[3];
+  /* One bit per level, set for objects */
+  uint8_t stack[(JSONSTREAM_MAX_DEPTH + 7) / 8];
+};
+
+/**
+ * \brief      Initialize a streaming JSON parser state.
+ * \param state A pointer to a JSON parser state
+ * \param callback The function to call for every token
+ * \param ptr  A user-defined pointer, kept in state->ptr
+ */
+void jsonstream_init(struct jsonstream_state *state,
+                     jsonstream_callback_t callback, void *ptr);
+
+/**
+ * \brief      Parse the next fragment of a JSON document.
+ * \param state A pointer to a JSON parser state
+ * \param data The fragment
+ * \param len  The length of the fragment
+ * \return     JSON_ERROR_OK, or the error that stopped the parser
+ *
+ *             Once an error has been found, the parser ignores any
+ *             further data. state->pos is then the offset of the
+ *             offending byte in the document.
+ */
+int jsonstream_feed(struct jsonstream_state *state, const char *data,
+                    int len);
+
+/**
+ * \brief      Tell the parser that the document is complete.
+ * \param state A pointer to a JSON parser state
+ * \return     JSON_ERROR_OK if a whole JSON value has been parsed
+ */
+int jsonstream_end(struct jsonstream_state *state);
+
+/* true while the callback is passed the last part of a value */
+#define jsonstream_value_done(state) \
+  (((state)->flags & JSONSTREAM_FLAG_VALUE_DONE) != 0)
+
+/* the nesting depth of the token passed to the callback */
+#define jsonstream_get_depth(state) ((state)->depth)
+
+#endif /* JSONSTREAM_H_ */
@@ -50,32 +50,67 @@
 #define PRINTF(...)
 #endif
 
+/*---------------------------------------------------------------------------*/
+static void
+output(const struct jsontree_context *js_ctx, const char *data, int len)
+{
+  /* The write functions take a const context but move its position */
+  struct jsontree_context *ctx = (struct jsontree_context *)js_ctx;
+  uint32_t end;
+  uint32_t skip;
+  int i;
+
+  if(ctx->buf != NULL) {
+    end = ctx->offset + ctx->buf_size;
+    if(ctx->pos >= ctx->offset && ctx->pos + len <= end) {
+      /* The whole token fits, as all but the first and last ones do */
+      if(len == 1) {
+        ctx->buf[ctx->pos - ctx->offset] = *data;
+      } else {
+        memcpy(&ctx->buf[ctx->pos - ctx->offset], data, len);
+      }
+    } else if(ctx->pos + len > ctx->offset && ctx->pos < end) {
+      /* Copy the part of the token that falls inside the buffer */
+      skip = ctx->pos < ctx->offset ? ctx->offset - ctx->pos : 0;
+      i = len - skip;
+      if(ctx->pos + len > end) {
+        i -= ctx->pos + len - end;
+      }
+      memcpy(&ctx->buf[ctx->pos + skip - ctx->offset], &data[skip], i);
+    }
+  } else if(ctx->putchar != NULL) {
+    for(i = 0; i < len; i++) {
+      ctx->putchar(data[i]);
+    }
+  }
+  ctx->pos += len;
+}
 /*---------------------------------------------------------------------------*/
 void
 jsontree_write_atom(const struct jsontree_context *js_ctx, const char *text)
 {
   if(text == NULL) {
-    js_ctx->putchar('0');
+    output(js_ctx, "0", 1);
   } else {
-    while(*text != '\0') {
-      js_ctx->putchar(*text++);
-    }
+    output(js_ctx, text, strlen(text));
   }
 }
 /*---------------------------------------------------------------------------*/
 void
 jsontree_write_string(const struct jsontree_context *js_ctx, const char *text)
 {
-  js_ctx->putchar('"');
+  const char *quote;
+
+  output(js_ctx, "\"", 1);
   if(text != NULL) {
-    while(*text != '\0') {
-      if(*text == '"') {
-        js_ctx->putchar('\\');
-      }
-      js_ctx->putchar(*text++);
+    while((quote = strchr(text, '"')) != NULL) {
+      output(js_ctx, text, quote - text);
+      output(js_ctx, "\\\"", 2);
+      text = quote + 1;
     }
+    output(js_ctx, text, strlen(text));
   }
-  js_ctx->putchar('"');
+  output(js_ctx, "\"", 1);
 }
 /*---------------------------------------------------------------------------*/
 void
@@ -90,16 +125,15 @@ jsontree_write_uint(const struct jsontree_context *js_ctx, unsigned int value)
     value /= 10;
   } while(value > 0 && l >= 0);
 
-  while(++l < sizeof(buf)) {
-    js_ctx->putchar(buf[l]);
-  }
+  l++;
+  output(js_ctx, &buf[l], sizeof(buf) - l);
 }
 /*---------------------------------------------------------------------------*/
 void
 jsontree_write_int(const struct jsontree_context *js_ctx, int value)
 {
   if(value < 0) {
-    js_ctx->putchar('-');
+    output(js_ctx, "-", 1);
     value = -value;
   }
 
@@ -121,6 +155,11 @@ jsontree_reset(struct jsontree_context *js_ctx)
 {
   js_ctx->depth = 0;
   js_ctx->index[0] = 0;
+  js_ctx->buf = NULL;
+  js_ctx->done = 0;
+  js_ctx->offset = 0;
+  js_ctx->step_offset = 0;
+  js_ctx->pos = 0;
 }
 /*---------------------------------------------------------------------------*/
 const char *
@@ -138,6 +177,7 @@ jsontree_print_next(struct jsontree_context *js_ctx)
 {
   struct jsontree_value *v;
   int index;
+  char c;
 #if JSONTREE_PRETTY
   int indent;
 #endif
@@ -153,46 +193,48 @@ jsontree_print_next(struct jsontree_context *js_ctx)
 
     index = js_ctx->index[js_ctx->depth];
     if(index == 0) {
-      js_ctx->putchar(v->type);
+      c = v->type;
+      output(js_ctx, &c, 1);
 #if JSONTREE_PRETTY
-      js_ctx->putchar('\n');
+      output(js_ctx, "\n", 1);
 #endif
     }
     if(index >= o->count) {
 #if JSONTREE_PRETTY
-      js_ctx->putchar('\n');
+      output(js_ctx, "\n", 1);
       indent = js_ctx->depth;
       while (indent--) {
-        js_ctx->putchar(' ');
-        js_ctx->putchar(' ');
+        output(js_ctx, "  ", 2);
       }
 #endif
-      js_ctx->putchar(v->type + 2);
+      c = v->type + 2;
+      output(js_ctx, &c, 1);
       /* Default operation: back up one level! */
       break;
     }
 
     if(index > 0) {
-      js_ctx->putchar(',');
 #if JSONTREE_PRETTY
-      js_ctx->putchar('\n');
+      output(js_ctx, ",\n", 2);
+#else
+      output(js_ctx, ",", 1);
 #endif
     }
 
 #if JSONTREE_PRETTY
     indent = js_ctx->depth + 1;
     while (indent--) {
-      js_ctx->putchar(' ');
-      js_ctx->putchar(' ');
+      output(js_ctx, "  ", 2);
     }
 #endif
 
     if(v->type == JSON_TYPE_OBJECT) {
       jsontree_write_string(js_ctx,
                             ((struct jsontree_object *)o)->pairs[index].name);
-      js_ctx->putchar(':');
 #if JSONTREE_PRETTY
-      js_ctx->putchar(' ');
+      output(js_ctx, ": ", 2);
+#else
+      output(js_ctx, ":", 1);
 #endif
       ov = ((struct jsontree_object *)o)->pairs[index].value;
     } else {
@@ -333,3 +375,67 @@ jsontree_find_next(struct jsontree_context *js_ctx, int type)
   return js_ctx->path < js_ctx->depth ? v : NULL;
 }
 /*---------------------------------------------------------------------------*/
+int
+jsontree_print_buf(struct jsontree_context *js_ctx, uint32_t offset,
+                   char *buf, int size)
+{
+  uint8_t depth;
+  uint16_t index;
+  uint16_t parent_index;
+  int callback_state;
+  int more;
+
+  if(offset < js_ctx->step_offset) {
+    return -1;
+  }
+
+  js_ctx->buf = buf;
+  js_ctx->buf_size = size;
+  js_ctx->offset = offset;
+  while(!js_ctx->done && js_ctx->step_offset < offset + size) {
+    /* Everything a print step changes, to undo it */
+    depth = js_ctx->depth;
+    index = js_ctx->index[depth];
+    parent_index = depth > 0 ? js_ctx->index[depth - 1] : 0;
+    callback_state = js_ctx->callback_state;
+
+    js_ctx->pos = js_ctx->step_offset;
+    more = jsontree_print_next(js_ctx) && js_ctx->path <= js_ctx->depth;
+    if(js_ctx->pos > offset + size) {
+      /* The step did not fit: the next block starts by repeating it */
+      js_ctx->depth = depth;
+      js_ctx->index[depth] = index;
+      if(depth > 0) {
+        js_ctx->index[depth - 1] = parent_index;
+      }
+      js_ctx->callback_state = callback_state;
+      break;
+    }
+    js_ctx->step_offset = js_ctx->pos;
+    js_ctx->done = !more;
+  }
+  js_ctx->buf = NULL;
+
+  if(js_ctx->done && js_ctx->step_offset < offset + size) {
+    size = js_ctx->step_offset > offset ? js_ctx->step_offset - offset : 0;
+  }
+  js_ctx->offset = offset + size;
+  return size;
+}
+/*---------------------------------------------------------------------------*/
+uint32_t
+jsontree_size(const struct jsontree_context *js_ctx)
+{
+  struct jsontree_context ctx;
+
+  /* Walk a copy of the context without output, just counting */
+  memcpy(&ctx, js_ctx, sizeof(ctx));
+  ctx.buf = NULL;
+  ctx.putchar = NULL;
+  ctx.pos = ctx.step_offset;
+  if(!ctx.done) {
+    while(jsontree_print_next(&ctx) && ctx.path <= ctx.depth);
+  }
+  return ctx.pos;
+}
+/*---------------------------------------------------------------------------*/
@@ -62,6 +62,14 @@ struct jsontree_context {
   uint8_t depth;
   uint8_t path;
   int callback_state;
+
+  /* Buffered output, see jsontree_print_buf() */
+  char *buf;
+  uint16_t buf_size;
+  uint8_t done;
+  uint32_t offset;      /* Output offset of buf[0], then of the next byte */
+  uint32_t step_offset; /* Output offset of the pending print step */
+  uint32_t pos;         /* Output offset of the next byte written */
 };
 
 struct jsontree_value {
@@ -154,6 +162,43 @@ void jsontree_write_atom(const struct jsontree_context *js_ctx,
 void jsontree_write_string(const struct jsontree_context *js_ctx,
                            const char *text);
 int jsontree_print_next(struct jsontree_context *js_ctx);
+
+/**
+ * \brief      Serialize the tree into a buffer, one block at a time
+ * \param js_ctx The context, set up as for jsontree_print_next()
+ * \param offset The output offset of the first byte to write to buf
+ * \param buf    The buffer
+ * \param size   The size of the buffer
+ * \return       The number of bytes written, or -1 if offset precedes
+ *               the current position of the context
+ *
+ *             Whole tokens are copied into the buffer. The buffer is
+ *             filled completely unless the output ends in it. The
+ *             context remembers where the block ended, so a call with
+ *             offset jsontree_print_offset() continues without
+ *             rendering the tree again. A larger offset skips
+ *             ahead. To go back, the context must be set up again.
+ *
+ *             The last print step of a block may be repeated in the
+ *             next call, so callback output must depend only on
+ *             callback_state.
+ */
+int jsontree_print_buf(struct jsontree_context *js_ctx, uint32_t offset,
+                       char *buf, int size);
+
+/** The output offset where the next jsontree_print_buf() call continues */
+#define jsontree_print_offset(js_ctx) ((js_ctx)->offset)
+
+/**
+ * \brief      Compute the serialized size of the tree
+ * \param js_ctx The context, set up as for jsontree_print_next()
+ * \return       The total number of bytes in the output
+ *
+ *             The context is not changed. The output of callbacks must
+ *             be the same as when the tree is printed.
+ */
+uint32_t jsontree_size(const struct jsontree_context *js_ctx);
+
 struct jsontree_value *jsontree_find_next(struct jsontree_context *js_ctx,
                                           int type);
 
@@ -58,6 +58,9 @@
 #include "lib/assert.h"
 #include "lib/list.h"
 #include "sys/cc.h"
+#if MQTT_OUTBOX_CFS || MQTT_FILE_PAYLOAD
+#include "cfs/cfs.h"
+#endif /* MQTT_OUTBOX_CFS || MQTT_FILE_PAYLOAD */
 
 #include <stdlib.h>
 #include <stdio.h>
@@ -127,6 +130,56 @@ typedef enum {
 /*---------------------------------------------------------------------------*/
 #define INCREMENT_MID(conn)   (conn)->mid_counter += 2
 #define MQTT_STRING_LENGTH(s) (((s)->length) == 0 ? 0 : (MQTT_STRING_LEN_SIZE + (s)->length))
+/* Total length of an incoming message, once the remaining length is known */
+#define PACKET_LENGTH(p)      (MQTT_FHDR_SIZE + (p)->remaining_length_bytes + \
+                               (p)->remaining_length)
+/*---------------------------------------------------------------------------*/
+#if MQTT_OUTBOX_SIZE
+/*
+ * Outbox records. Each record is a header followed by the topic and the
+ * payload. The header holds the record state, the PUBLISH fixed header byte,
+ * the MID, and the topic and payload lengths. The MID and the lengths are
+ * stored big endian, so that the topic length, topic and MID can be written
+ * to the broker straight from the record.
+ */
+#define OUTBOX_NONE                 0xffff
+#define OUTBOX_RECORD_HDR_SIZE      8
+
+#define OUTBOX_RECORD(conn, offset) (&(conn)->outbox.data[(offset)])
+#define CURRENT_RECORD(conn)        OUTBOX_RECORD(conn, (conn)->outbox.current)
+
+#define RECORD_STATE(r)             ((r)[0])
+#define RECORD_FHDR(r)              ((r)[1])
+#define RECORD_MID(r)               (((r)[2] << 8) | (r)[3])
+#define RECORD_TOPIC_LENGTH(r)      (((r)[4] << 8) | (r)[5])
+#define RECORD_PAYLOAD_LENGTH(r)    (((r)[6] << 8) | (r)[7])
+#define RECORD_PAYLOAD(r)           (&(r)[OUTBOX_RECORD_HDR_SIZE + \
+                                          RECORD_TOPIC_LENGTH(r)])
+#define RECORD_SIZE(r)              (OUTBOX_RECORD_HDR_SIZE + \
+                                     RECORD_TOPIC_LENGTH(r) + \
+                                     RECORD_PAYLOAD_LENGTH(r))
+
+typedef enum {
+  OUTBOX_QUEUED,        /* PUBLISH not sent yet */
+  OUTBOX_WAIT_PUBACK,   /* QoS 1 PUBLISH sent */
+  OUTBOX_WAIT_PUBREC,   /* QoS 2 PUBLISH sent */
+  OUTBOX_SEND_PUBREL,   /* Got PUBREC, PUBREL not sent yet */
+  OUTBOX_WAIT_PUBCOMP,  /* PUBREL sent */
+  OUTBOX_DONE,
+} outbox_state_t;
+
+#define OUTBOX_IN_FLIGHT(state) \
+  ((state) != OUTBOX_QUEUED && (state) != OUTBOX_DONE)
+
+#if MQTT_OUTBOX_CFS
+/* The journal is rewritten when it gets longer than this */
+#define OUTBOX_JOURNAL_MAX_LENGTH (4UL * MQTT_OUTBOX_SIZE)
+
+/* Journal entries: a full record, or the new state of the record with a MID */
+#define OUTBOX_JOURNAL_RECORD 'R'
+#define OUTBOX_JOURNAL_STATE  'S'
+#endif /* MQTT_OUTBOX_CFS */
+#endif /* MQTT_OUTBOX_SIZE */
 /*---------------------------------------------------------------------------*/
 /* Protothread send macros */
 #define PT_MQTT_WRITE_BYTES(conn, data, len)                                   \
@@ -169,6 +222,7 @@ static process_event_t mqtt_do_disconnect_mqtt_event;
 static process_event_t mqtt_do_subscribe_event;
 static process_event_t mqtt_do_unsubscribe_event;
 static process_event_t mqtt_do_publish_event;
+static process_event_t mqtt_do_outbox_event;
 static process_event_t mqtt_do_pingreq_event;
 static process_event_t mqtt_continue_send_event;
 static process_event_t mqtt_abort_now_event;
@@ -221,6 +275,8 @@ abort_connection(struct mqtt_connection *conn)
 {
   conn->out_buffer_ptr = conn->out_buffer;
   conn->out_queue_full = 0;
+  conn->publish_pending = 0;
+  ctimer_stop(&conn->batch_timer);
 
   /* Reset outgoing packet */
   memset(&conn->out_packet, 0, sizeof(conn->out_packet));
@@ -263,6 +319,9 @@ disconnect_tcp(struct mqtt_connection *conn)
 static void
 send_out_buffer(struct mqtt_connection *conn)
 {
+  /* Anything batched goes out with this */
+  ctimer_stop(&conn->batch_timer);
+
   if(conn->out_buffer_ptr - conn->out_buffer == 0) {
     conn->out_buffer_sent = 1;
     return;
@@ -277,6 +336,55 @@ send_out_buffer(struct mqtt_connection *conn)
 }
 /*---------------------------------------------------------------------------*/
 static void
+batch_timeout(void *ptr)
+{
+  struct mqtt_connection *conn = ptr;
+
+  if(conn->out_buffer_sent == 1 &&
+     conn->state == MQTT_CONN_STATE_CONNECTED_TO_BROKER) {
+    DBG("MQTT - Batch delay passed\n");
+    send_out_buffer(conn);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Sends the out buffer, or leaves the PUBLISH messages in it for up to the
+ * batch delay so that more messages can join them in the same TCP segment.
+ */
+static void
+send_or_batch(struct mqtt_connection *conn)
+{
+  if(conn->batch_delay == 0 ||
+     conn->out_buffer_ptr - conn->out_buffer >= conn->max_segment_size) {
+    send_out_buffer(conn);
+  } else if(ctimer_expired(&conn->batch_timer)) {
+    ctimer_set(&conn->batch_timer, conn->batch_delay, batch_timeout, conn);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Reads a QoS 0 payload straight into an outgoing TCP segment */
+static int
+read_payload(struct tcp_socket *s, void *ptr, uint32_t offset, uint8_t *buf,
+             int len)
+{
+  struct mqtt_connection *conn = ptr;
+
+#if MQTT_FILE_PAYLOAD
+  if(conn->out_packet.payload == NULL) {
+    if(cfs_seek(conn->out_packet.payload_fd,
+                conn->out_packet.payload_offset + offset,
+                CFS_SEEK_SET) == -1) {
+      return -1;
+    }
+    return cfs_read(conn->out_packet.payload_fd, buf, len);
+  }
+#endif /* MQTT_FILE_PAYLOAD */
+
+  memcpy(buf, &conn->out_packet.payload[offset], len);
+  return len;
+}
+/*---------------------------------------------------------------------------*/
+static void
 string_to_mqtt_string(struct mqtt_string *mqtt_string, char *string)
 {
   if(mqtt_string == NULL) {
@@ -356,6 +464,254 @@ encode_remaining_length(uint8_t *remaining_length,
   DBG("MQTT - remaining_length_bytes %u\n", *remaining_length_bytes);
 }
 /*---------------------------------------------------------------------------*/
+#if MQTT_OUTBOX_SIZE
+static uint16_t
+outbox_next(struct mqtt_outbox *outbox, uint16_t offset)
+{
+  if(offset == OUTBOX_NONE) {
+    return outbox->count > 0 ? outbox->head : OUTBOX_NONE;
+  }
+
+  offset += RECORD_SIZE(&outbox->data[offset]);
+  if(outbox->wrap != 0 && offset == outbox->wrap) {
+    offset = 0;
+  }
+  return offset == outbox->tail ? OUTBOX_NONE : offset;
+}
+/*---------------------------------------------------------------------------*/
+static uint16_t
+outbox_alloc(struct mqtt_outbox *outbox, uint16_t size)
+{
+  uint16_t offset;
+
+  if(outbox->count == 0) {
+    outbox->head = outbox->tail = outbox->wrap = 0;
+  }
+
+  if(outbox->wrap == 0 && MQTT_OUTBOX_SIZE - outbox->tail >= size) {
+    offset = outbox->tail;
+  } else if(outbox->wrap == 0 && outbox->head >= size) {
+    /* No room at the end, continue from the start of the buffer */
+    outbox->wrap = outbox->tail;
+    offset = 0;
+  } else if(outbox->wrap != 0 && outbox->head - outbox->tail >= size) {
+    offset = outbox->tail;
+  } else {
+    return OUTBOX_NONE;
+  }
+
+  outbox->tail = offset + size;
+  outbox->count++;
+  return offset;
+}
+/*---------------------------------------------------------------------------*/
+static uint16_t
+outbox_find(struct mqtt_connection *conn, uint16_t mid)
+{
+  uint16_t offset;
+  uint8_t *record;
+
+  for(offset = outbox_next(&conn->outbox, OUTBOX_NONE);
+      offset != OUTBOX_NONE;
+      offset = outbox_next(&conn->outbox, offset)) {
+    record = OUTBOX_RECORD(conn, offset);
+    if(RECORD_MID(record) == mid && RECORD_STATE(record) != OUTBOX_DONE) {
+      return offset;
+    }
+  }
+  return OUTBOX_NONE;
+}
+/*---------------------------------------------------------------------------*/
+#if MQTT_OUTBOX_CFS
+static void
+journal_write(struct mqtt_connection *conn, uint8_t type,
+              uint8_t *data, uint16_t len)
+{
+  int fd;
+
+  fd = cfs_open(conn->outbox.filename, CFS_WRITE | CFS_APPEND);
+  if(fd < 0) {
+    PRINTF("MQTT - Could not open outbox journal\n");
+    return;
+  }
+  if(cfs_write(fd, &type, 1) != 1 || cfs_write(fd, data, len) != len) {
+    PRINTF("MQTT - Could not write outbox journal\n");
+  }
+  cfs_close(fd);
+  conn->outbox.journal_length += 1 + len;
+}
+/*---------------------------------------------------------------------------*/
+static void
+journal_record(struct mqtt_connection *conn, uint16_t offset)
+{
+  if(conn->outbox.filename != NULL) {
+    journal_write(conn, OUTBOX_JOURNAL_RECORD, OUTBOX_RECORD(conn, offset),
+                  RECORD_SIZE(OUTBOX_RECORD(conn, offset)));
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+journal_state(struct mqtt_connection *conn, uint16_t offset)
+{
+  if(conn->outbox.filename != NULL) {
+    /* MID followed by the state, as stored in the record */
+    uint8_t entry[MQTT_MID_SIZE + 1];
+
+    entry[0] = OUTBOX_RECORD(conn, offset)[2];
+    entry[1] = OUTBOX_RECORD(conn, offset)[3];
+    entry[2] = RECORD_STATE(OUTBOX_RECORD(conn, offset));
+    journal_write(conn, OUTBOX_JOURNAL_STATE, entry, sizeof(entry));
+  }
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Replaces the journal with one record entry per message in the outbox.
+ * Messages are lost if the node resets while this is being done.
+ */
+static void
+journal_compact(struct mqtt_connection *conn)
+{
+  uint16_t offset;
+
+  cfs_remove(conn->outbox.filename);
+  conn->outbox.journal_length = 0;
+
+  for(offset = outbox_next(&conn->outbox, OUTBOX_NONE);
+      offset != OUTBOX_NONE;
+      offset = outbox_next(&conn->outbox, offset)) {
+    if(RECORD_STATE(OUTBOX_RECORD(conn, offset)) != OUTBOX_DONE) {
+      journal_record(conn, offset);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+journal_sync(struct mqtt_connection *conn)
+{
+  if(conn->outbox.filename == NULL || conn->outbox.journal_length == 0) {
+    return;
+  }
+
+  if(conn->outbox.count == 0) {
+    cfs_remove(conn->outbox.filename);
+    conn->outbox.journal_length = 0;
+  } else if(conn->outbox.journal_length > OUTBOX_JOURNAL_MAX_LENGTH) {
+    journal_compact(conn);
+  }
+}
+#else /* MQTT_OUTBOX_CFS */
+#define journal_record(conn, offset)
+#define journal_state(conn, offset)
+#define journal_sync(conn)
+#endif /* MQTT_OUTBOX_CFS */
+/*---------------------------------------------------------------------------*/
+static void
+outbox_set_state(struct mqtt_connection *conn, uint16_t offset,
+                 outbox_state_t state)
+{
+  uint8_t *record = OUTBOX_RECORD(conn, offset);
+
+  conn->outbox.in_flight += OUTBOX_IN_FLIGHT(state) -
+    OUTBOX_IN_FLIGHT(RECORD_STATE(record));
+  RECORD_STATE(record) = state;
+  journal_state(conn, offset);
+}
+/*---------------------------------------------------------------------------*/
+/* Removes acknowledged messages from the head of the outbox */
+static void
+outbox_pop(struct mqtt_connection *conn)
+{
+  struct mqtt_outbox *outbox = &conn->outbox;
+  uint8_t *record;
+
+  while(outbox->count > 0) {
+    record = OUTBOX_RECORD(conn, outbox->head);
+    if(RECORD_STATE(record) != OUTBOX_DONE) {
+      break;
+    }
+    outbox->head += RECORD_SIZE(record);
+    outbox->count--;
+    if(outbox->wrap != 0 && outbox->head == outbox->wrap) {
+      outbox->head = 0;
+      outbox->wrap = 0;
+    }
+  }
+
+  if(outbox->count == 0) {
+    outbox->head = outbox->tail = outbox->wrap = 0;
+  }
+  journal_sync(conn);
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Prepares the outbox for a new connection. Messages that were sent but not
+ * acknowledged are sent again with the DUP flag set, and PUBRELs that were
+ * not completed are repeated.
+ */
+static void
+outbox_rewind(struct mqtt_connection *conn)
+{
+  uint16_t offset;
+  uint8_t *record;
+
+  conn->outbox.in_flight = 0;
+  for(offset = outbox_next(&conn->outbox, OUTBOX_NONE);
+      offset != OUTBOX_NONE;
+      offset = outbox_next(&conn->outbox, offset)) {
+    record = OUTBOX_RECORD(conn, offset);
+    switch(RECORD_STATE(record)) {
+    case OUTBOX_WAIT_PUBACK:
+    case OUTBOX_WAIT_PUBREC:
+      RECORD_STATE(record) = OUTBOX_QUEUED;
+      RECORD_FHDR(record) |= MQTT_FHDR_DUP_FLAG;
+      break;
+    case OUTBOX_WAIT_PUBCOMP:
+      RECORD_STATE(record) = OUTBOX_SEND_PUBREL;
+      /* Fall through */
+    case OUTBOX_SEND_PUBREL:
+      conn->outbox.in_flight++;
+      break;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Returns the next record after offset that can be written now. Messages
+ * are always sent in order, so nothing can be sent after a message that has
+ * to wait for room in the in-flight window.
+ */
+static uint16_t
+outbox_next_to_send(struct mqtt_connection *conn, uint16_t offset)
+{
+  uint8_t *record;
+
+  while((offset = outbox_next(&conn->outbox, offset)) != OUTBOX_NONE) {
+    record = OUTBOX_RECORD(conn, offset);
+    if(RECORD_STATE(record) == OUTBOX_SEND_PUBREL) {
+      return offset;
+    }
+    if(RECORD_STATE(record) == OUTBOX_QUEUED) {
+      if(conn->outbox.in_flight < conn->outbox.max_in_flight) {
+        return offset;
+      }
+      return OUTBOX_NONE;
+    }
+  }
+  return OUTBOX_NONE;
+}
+/*---------------------------------------------------------------------------*/
+static void
+outbox_kick(struct mqtt_connection *conn)
+{
+  if(outbox_next_to_send(conn, OUTBOX_NONE) != OUTBOX_NONE) {
+    process_post(&mqtt_process, mqtt_do_outbox_event, conn);
+  }
+}
+#else /* MQTT_OUTBOX_SIZE */
+#define outbox_rewind(conn)
+#define outbox_kick(conn)
+#endif /* MQTT_OUTBOX_SIZE */
+/*---------------------------------------------------------------------------*/
 static void
 keep_alive_callback(void *ptr)
 {
@@ -417,16 +773,16 @@ PT_THREAD(connect_pt(struct pt *pt, struct mqtt_connection *conn))
   PT_MQTT_WRITE_BYTE(conn, conn->connect_vhdr_flags);
   PT_MQTT_WRITE_BYTE(conn, (conn->keep_alive >> 8));
   PT_MQTT_WRITE_BYTE(conn, (conn->keep_alive & 0x00FF));
-  PT_MQTT_WRITE_BYTE(conn, conn->client_id.length << 8);
+  PT_MQTT_WRITE_BYTE(conn, conn->client_id.length >> 8);
   PT_MQTT_WRITE_BYTE(conn, conn->client_id.length & 0x00FF);
   PT_MQTT_WRITE_BYTES(conn, (uint8_t *)conn->client_id.string,
                       conn->client_id.length);
   if(conn->connect_vhdr_flags & MQTT_VHDR_WILL_FLAG) {
-    PT_MQTT_WRITE_BYTE(conn, conn->will.topic.length << 8);
+    PT_MQTT_WRITE_BYTE(conn, conn->will.topic.length >> 8);
     PT_MQTT_WRITE_BYTE(conn, conn->will.topic.length & 0x00FF);
     PT_MQTT_WRITE_BYTES(conn, (uint8_t *)conn->will.topic.string,
                         conn->will.topic.length);
-    PT_MQTT_WRITE_BYTE(conn, conn->will.message.length << 8);
+    PT_MQTT_WRITE_BYTE(conn, conn->will.message.length >> 8);
     PT_MQTT_WRITE_BYTE(conn, conn->will.message.length & 0x00FF);
     PT_MQTT_WRITE_BYTES(conn, (uint8_t *)conn->will.message.string,
                         conn->will.message.length);
@@ -437,14 +793,14 @@ PT_THREAD(connect_pt(struct pt *pt, struct mqtt_connection *conn))
         conn->will.message.length);
   }
   if(conn->connect_vhdr_flags & MQTT_VHDR_USERNAME_FLAG) {
-    PT_MQTT_WRITE_BYTE(conn, conn->credentials.username.length << 8);
+    PT_MQTT_WRITE_BYTE(conn, conn->credentials.username.length >> 8);
     PT_MQTT_WRITE_BYTE(conn, conn->credentials.username.length & 0x00FF);
     PT_MQTT_WRITE_BYTES(conn,
                         (uint8_t *)conn->credentials.username.string,
                         conn->credentials.username.length);
   }
   if(conn->connect_vhdr_flags & MQTT_VHDR_PASSWORD_FLAG) {
-    PT_MQTT_WRITE_BYTE(conn, conn->credentials.password.length << 8);
+    PT_MQTT_WRITE_BYTE(conn, conn->credentials.password.length >> 8);
     PT_MQTT_WRITE_BYTE(conn, conn->credentials.password.length & 0x00FF);
     PT_MQTT_WRITE_BYTES(conn,
                         (uint8_t *)conn->credentials.password.string,
@@ -535,7 +891,7 @@ PT_THREAD(subscribe_pt(struct pt *pt, struct mqtt_connection *conn))
                       conn->out_packet.remaining_length_enc,
                       conn->out_packet.remaining_length_enc_bytes);
   /* Write Variable Header */
-  PT_MQTT_WRITE_BYTE(conn, (conn->out_packet.mid << 8));
+  PT_MQTT_WRITE_BYTE(conn, (conn->out_packet.mid >> 8));
   PT_MQTT_WRITE_BYTE(conn, (conn->out_packet.mid & 0x00FF));
   /* Write Payload */
   PT_MQTT_WRITE_BYTE(conn, (conn->out_packet.topic_length >> 8));
@@ -597,7 +953,7 @@ PT_THREAD(unsubscribe_pt(struct pt *pt, struct mqtt_connection *conn))
   PT_MQTT_WRITE_BYTES(conn, (uint8_t *)conn->out_packet.remaining_length_enc,
                       conn->out_packet.remaining_length_enc_bytes);
   /* Write Variable Header */
-  PT_MQTT_WRITE_BYTE(conn, (conn->out_packet.mid << 8));
+  PT_MQTT_WRITE_BYTE(conn, (conn->out_packet.mid >> 8));
   PT_MQTT_WRITE_BYTE(conn, (conn->out_packet.mid & 0x00FF));
   /* Write Payload */
   PT_MQTT_WRITE_BYTE(conn, (conn->out_packet.topic_length >> 8));
@@ -639,7 +995,7 @@ PT_THREAD(publish_pt(struct pt *pt, struct mqtt_connection *conn))
   DBG("MQTT - Buffer space is %i \n",
       &conn->out_buffer[MQTT_TCP_OUTPUT_BUFF_SIZE] - conn->out_buffer_ptr);
 
-  /* Set up FHDR */
+  /* Set up FHDR, QoS 1 and 2 messages that fit are sent from the outbox */
   conn->out_packet.fhdr = MQTT_FHDR_MSG_TYPE_PUBLISH |
     conn->out_packet.qos << 1;
   if(conn->out_packet.retain == MQTT_RETAIN_ON) {
@@ -670,44 +1026,63 @@ PT_THREAD(publish_pt(struct pt *pt, struct mqtt_connection *conn))
   PT_MQTT_WRITE_BYTES(conn, (uint8_t *)conn->out_packet.topic,
                       conn->out_packet.topic_length);
   if(conn->out_packet.qos > MQTT_QOS_LEVEL_0) {
-    PT_MQTT_WRITE_BYTE(conn, (conn->out_packet.mid << 8));
+    PT_MQTT_WRITE_BYTE(conn, (conn->out_packet.mid >> 8));
     PT_MQTT_WRITE_BYTE(conn, (conn->out_packet.mid & 0x00FF));
   }
-  /* Write Payload */
-  PT_MQTT_WRITE_BYTES(conn,
-                      conn->out_packet.payload,
-                      conn->out_packet.payload_size);
 
-  send_out_buffer(conn);
+  if(conn->out_packet.payload == NULL ||
+     conn->out_packet.payload_size > MQTT_ZERO_COPY_THRESHOLD) {
+    /* Read the payload into the TCP segments, it must stay until acked */
+    send_out_buffer(conn);
+    tcp_socket_send_from(&conn->socket, read_payload,
+                         conn->out_packet.payload_size);
+    PT_WAIT_UNTIL(pt, conn->out_buffer_sent);
+  } else {
+    /* Write Payload */
+    PT_MQTT_WRITE_BYTES(conn,
+                        conn->out_packet.payload,
+                        conn->out_packet.payload_size);
+
+    send_or_batch(conn);
+  }
+
   timer_set(&conn->t, RESPONSE_WAIT_TIMEOUT);
 
   /*
-   * If QoS is zero then wait until the message has been sent, since there is
-   * no ACK to wait for.
-   *
-   * Also notify the app will not be notified via PUBACK or PUBCOMP
+   * There is no ACK to wait for with QoS 0, and the app will not be notified
+   * via PUBACK or PUBCOMP
    */
-  if(conn->out_packet.qos == 0) {
+  if(conn->out_packet.qos == MQTT_QOS_LEVEL_0) {
     process_post(conn->app_process, mqtt_update_event, NULL);
-  } else if(conn->out_packet.qos == 1) {
+  } else if(conn->out_packet.qos == MQTT_QOS_LEVEL_1) {
     /* Wait for PUBACK */
-    reset_packet(&conn->in_packet);
     PT_WAIT_UNTIL(pt, conn->out_packet.qos_state == MQTT_QOS_STATE_GOT_ACK ||
                   timer_expired(&conn->t));
     if(timer_expired(&conn->t)) {
       DBG("Timeout waiting for PUBACK\n");
     }
-    if(conn->in_packet.mid != conn->out_packet.mid) {
-      DBG("MQTT - Warning, got PUBACK with none matching MID. Currently there "
-          "is no support for several concurrent PUBLISH messages.\n");
+  } else {
+    /* Wait for PUBREC */
+    PT_WAIT_UNTIL(pt, conn->out_packet.qos_state == MQTT_QOS_STATE_GOT_REC ||
+                  timer_expired(&conn->t));
+    if(conn->out_packet.qos_state == MQTT_QOS_STATE_GOT_REC) {
+      PT_MQTT_WRITE_BYTE(conn, MQTT_FHDR_MSG_TYPE_PUBREL |
+                         MQTT_FHDR_QOS_LEVEL_1);
+      PT_MQTT_WRITE_BYTE(conn, MQTT_MID_SIZE);
+      PT_MQTT_WRITE_BYTE(conn, (conn->out_packet.mid >> 8));
+      PT_MQTT_WRITE_BYTE(conn, (conn->out_packet.mid & 0x00FF));
+      send_out_buffer(conn);
+
+      /* Wait for PUBCOMP */
+      timer_set(&conn->t, RESPONSE_WAIT_TIMEOUT);
+      PT_WAIT_UNTIL(pt, conn->out_packet.qos_state == MQTT_QOS_STATE_GOT_ACK ||
+                    timer_expired(&conn->t));
+    }
+    if(timer_expired(&conn->t)) {
+      DBG("Timeout waiting for PUBREC or PUBCOMP\n");
     }
-  } else if(conn->out_packet.qos == 2) {
-    DBG("MQTT - QoS not implemented yet.\n");
-    /* Should wait for PUBREC, send PUBREL and then wait for PUBCOMP */
   }
 
-  reset_packet(&conn->in_packet);
-
   /* This is clear after the entire transaction is complete */
   conn->out_queue_full = 0;
 
@@ -716,6 +1091,69 @@ PT_THREAD(publish_pt(struct pt *pt, struct mqtt_connection *conn))
   PT_END(pt);
 }
 /*---------------------------------------------------------------------------*/
+#if MQTT_OUTBOX_SIZE
+/*
+ * Writes the PUBLISH and PUBREL messages of the outbox that may be sent now,
+ * as many as the in-flight window allows, and sends them in one go. The
+ * record being written is not moved or removed while this protothread
+ * waits, since only acknowledged records are removed.
+ */
+static
+PT_THREAD(outbox_pt(struct pt *pt, struct mqtt_connection *conn))
+{
+  PT_BEGIN(pt);
+
+  conn->outbox.current = outbox_next_to_send(conn, OUTBOX_NONE);
+  while(conn->outbox.current != OUTBOX_NONE) {
+    if(RECORD_STATE(CURRENT_RECORD(conn)) == OUTBOX_SEND_PUBREL) {
+      DBG("MQTT - Sending PUBREL, mid %u\n", RECORD_MID(CURRENT_RECORD(conn)));
+
+      PT_MQTT_WRITE_BYTE(conn, MQTT_FHDR_MSG_TYPE_PUBREL |
+                         MQTT_FHDR_QOS_LEVEL_1);
+      PT_MQTT_WRITE_BYTE(conn, MQTT_MID_SIZE);
+      PT_MQTT_WRITE_BYTES(conn, &CURRENT_RECORD(conn)[2], MQTT_MID_SIZE);
+
+      outbox_set_state(conn, conn->outbox.current, OUTBOX_WAIT_PUBCOMP);
+    } else {
+      DBG("MQTT - Sending PUBLISH from outbox, mid %u\n",
+          RECORD_MID(CURRENT_RECORD(conn)));
+
+      encode_remaining_length(conn->outbox.remaining_length_enc,
+                              &conn->outbox.remaining_length_enc_bytes,
+                              MQTT_STRING_LEN_SIZE +
+                              RECORD_TOPIC_LENGTH(CURRENT_RECORD(conn)) +
+                              MQTT_MID_SIZE +
+                              RECORD_PAYLOAD_LENGTH(CURRENT_RECORD(conn)));
+
+      /* Write Fixed Header */
+      PT_MQTT_WRITE_BYTE(conn, RECORD_FHDR(CURRENT_RECORD(conn)));
+      PT_MQTT_WRITE_BYTES(conn, conn->outbox.remaining_length_enc,
+                          conn->outbox.remaining_length_enc_bytes);
+      /* Write Variable Header, topic length and topic are stored in order */
+      PT_MQTT_WRITE_BYTES(conn, &CURRENT_RECORD(conn)[4],
+                          MQTT_STRING_LEN_SIZE +
+                          RECORD_TOPIC_LENGTH(CURRENT_RECORD(conn)));
+      PT_MQTT_WRITE_BYTES(conn, &CURRENT_RECORD(conn)[2], MQTT_MID_SIZE);
+      /* Write Payload */
+      PT_MQTT_WRITE_BYTES(conn, RECORD_PAYLOAD(CURRENT_RECORD(conn)),
+                          RECORD_PAYLOAD_LENGTH(CURRENT_RECORD(conn)));
+
+      if((RECORD_FHDR(CURRENT_RECORD(conn)) & MQTT_FHDR_QOS_LEVEL_2) != 0) {
+        outbox_set_state(conn, conn->outbox.current, OUTBOX_WAIT_PUBREC);
+      } else {
+        outbox_set_state(conn, conn->outbox.current, OUTBOX_WAIT_PUBACK);
+      }
+    }
+
+    conn->outbox.current = outbox_next_to_send(conn, conn->outbox.current);
+  }
+
+  send_or_batch(conn);
+
+  PT_END(pt);
+}
+#endif /* MQTT_OUTBOX_SIZE */
+/*---------------------------------------------------------------------------*/
 static
 PT_THREAD(pingreq_pt(struct pt *pt, struct mqtt_connection *conn))
 {
@@ -765,6 +1203,10 @@ handle_connack(struct mqtt_connection *conn)
   ctimer_set(&conn->keep_alive_timer, conn->keep_alive * CLOCK_SECOND,
              keep_alive_callback, conn);
 
+  /* Resend what the broker did not acknowledge on the previous connection */
+  outbox_rewind(conn);
+  outbox_kick(conn);
+
   /* Always reset packet before callback since it might be used directly */
   conn->state = MQTT_CONN_STATE_CONNECTED_TO_BROKER;
   call_event(conn, MQTT_EVENT_CONNECTED, NULL);
@@ -822,19 +1264,134 @@ handle_unsuback(struct mqtt_connection *conn)
   call_event(conn, MQTT_EVENT_UNSUBACK, &conn->in_packet.mid);
 }
 /*---------------------------------------------------------------------------*/
+/*
+ * Whether the acknowledgement just received is for the QoS 1 or 2 message
+ * being sent by publish_pt(), rather than for one in the outbox.
+ */
+static int
+acks_out_packet(struct mqtt_connection *conn, mqtt_qos_level_t qos)
+{
+  return conn->out_queue_full &&
+         (conn->out_packet.fhdr & 0xF0) == MQTT_FHDR_MSG_TYPE_PUBLISH &&
+         conn->out_packet.qos == qos &&
+         conn->out_packet.mid == conn->in_packet.mid;
+}
+/*---------------------------------------------------------------------------*/
 static void
 handle_puback(struct mqtt_connection *conn)
 {
+#if MQTT_OUTBOX_SIZE
+  uint16_t offset;
+#endif /* MQTT_OUTBOX_SIZE */
+
   DBG("MQTT - Got PUBACK\n");
 
-  conn->out_packet.qos_state = MQTT_QOS_STATE_GOT_ACK;
   conn->in_packet.mid = (conn->in_packet.payload[0] << 8) |
     (conn->in_packet.payload[1]);
 
+  if(acks_out_packet(conn, MQTT_QOS_LEVEL_1)) {
+    conn->out_packet.qos_state = MQTT_QOS_STATE_GOT_ACK;
+  } else {
+#if MQTT_OUTBOX_SIZE
+    offset = outbox_find(conn, conn->in_packet.mid);
+    if(offset == OUTBOX_NONE ||
+       RECORD_STATE(OUTBOX_RECORD(conn, offset)) != OUTBOX_WAIT_PUBACK) {
+      DBG("MQTT - Warning, got PUBACK with unknown MID %u\n",
+          conn->in_packet.mid);
+      return;
+    }
+
+    outbox_set_state(conn, offset, OUTBOX_DONE);
+    outbox_pop(conn);
+    outbox_kick(conn);
+#else /* MQTT_OUTBOX_SIZE */
+    DBG("MQTT - Warning, got PUBACK with unknown MID %u\n",
+        conn->in_packet.mid);
+    return;
+#endif /* MQTT_OUTBOX_SIZE */
+  }
+
   call_event(conn, MQTT_EVENT_PUBACK, &conn->in_packet.mid);
 }
 /*---------------------------------------------------------------------------*/
 static void
+handle_pubrec(struct mqtt_connection *conn)
+{
+#if MQTT_OUTBOX_SIZE
+  uint16_t offset;
+#endif /* MQTT_OUTBOX_SIZE */
+
+  DBG("MQTT - Got PUBREC\n");
+
+  conn->in_packet.mid = (conn->in_packet.payload[0] << 8) |
+    (conn->in_packet.payload[1]);
+
+  if(acks_out_packet(conn, MQTT_QOS_LEVEL_2)) {
+    /* publish_pt() sends the PUBREL */
+    if(conn->out_packet.qos_state == MQTT_QOS_STATE_NO_ACK) {
+      conn->out_packet.qos_state = MQTT_QOS_STATE_GOT_REC;
+    }
+    return;
+  }
+
+#if MQTT_OUTBOX_SIZE
+  offset = outbox_find(conn, conn->in_packet.mid);
+  if(offset == OUTBOX_NONE ||
+     (RECORD_STATE(OUTBOX_RECORD(conn, offset)) != OUTBOX_WAIT_PUBREC &&
+      RECORD_STATE(OUTBOX_RECORD(conn, offset)) != OUTBOX_WAIT_PUBCOMP)) {
+    DBG("MQTT - Warning, got PUBREC with unknown MID %u\n",
+        conn->in_packet.mid);
+    return;
+  }
+
+  /* A repeated PUBREC is answered with a new PUBREL */
+  outbox_set_state(conn, offset, OUTBOX_SEND_PUBREL);
+  outbox_kick(conn);
+#else /* MQTT_OUTBOX_SIZE */
+  DBG("MQTT - Warning, got PUBREC with unknown MID %u\n",
+      conn->in_packet.mid);
+#endif /* MQTT_OUTBOX_SIZE */
+}
+/*---------------------------------------------------------------------------*/
+static void
+handle_pubcomp(struct mqtt_connection *conn)
+{
+#if MQTT_OUTBOX_SIZE
+  uint16_t offset;
+#endif /* MQTT_OUTBOX_SIZE */
+
+  DBG("MQTT - Got PUBCOMP\n");
+
+  conn->in_packet.mid = (conn->in_packet.payload[0] << 8) |
+    (conn->in_packet.payload[1]);
+
+  if(acks_out_packet(conn, MQTT_QOS_LEVEL_2) &&
+     conn->out_packet.qos_state == MQTT_QOS_STATE_GOT_REC) {
+    conn->out_packet.qos_state = MQTT_QOS_STATE_GOT_ACK;
+  } else {
+#if MQTT_OUTBOX_SIZE
+    offset = outbox_find(conn, conn->in_packet.mid);
+    if(offset == OUTBOX_NONE ||
+       RECORD_STATE(OUTBOX_RECORD(conn, offset)) != OUTBOX_WAIT_PUBCOMP) {
+      DBG("MQTT - Warning, got PUBCOMP with unknown MID %u\n",
+          conn->in_packet.mid);
+      return;
+    }
+
+    outbox_set_state(conn, offset, OUTBOX_DONE);
+    outbox_pop(conn);
+    outbox_kick(conn);
+#else /* MQTT_OUTBOX_SIZE */
+    DBG("MQTT - Warning, got PUBCOMP with unknown MID %u\n",
+        conn->in_packet.mid);
+    return;
+#endif /* MQTT_OUTBOX_SIZE */
+  }
+
+  call_event(conn, MQTT_EVENT_PUBCOMP, &conn->in_packet.mid);
+}
+/*---------------------------------------------------------------------------*/
+static void
 handle_publish(struct mqtt_connection *conn)
 {
   DBG("MQTT - Got PUBLISH, called once per manageable chunk of message.\n");
@@ -914,21 +1471,19 @@ parse_publish_vhdr(struct mqtt_connection *conn,
   }
 }
 /*---------------------------------------------------------------------------*/
+/*
+ * Reads input up to the end of the current message, handling the message if
+ * it is complete. Returns the number of bytes read.
+ */
 static int
-tcp_input(struct tcp_socket *s,
-          void *ptr,
-          const uint8_t *input_data_ptr,
-          int input_data_len)
+input_packet(struct mqtt_connection *conn,
+             const uint8_t *input_data_ptr,
+             int input_data_len)
 {
-  struct mqtt_connection *conn = ptr;
   uint32_t pos = 0;
   uint32_t copy_bytes = 0;
   uint8_t byte;
 
-  if(input_data_len == 0) {
-    return 0;
-  }
-
   if(conn->in_packet.packet_received) {
     reset_packet(&conn->in_packet);
   }
@@ -943,7 +1498,7 @@ tcp_input(struct tcp_socket *s,
     DBG("MQTT - Read VHDR '%02X'\n", conn->in_packet.fhdr);
 
     if(pos >= input_data_len) {
-      return 0;
+      return pos;
     }
   }
 
@@ -951,7 +1506,7 @@ tcp_input(struct tcp_socket *s,
   if(!conn->in_packet.has_remaining_length) {
     do {
       if(pos >= input_data_len) {
-        return 0;
+        return pos;
       }
 
       byte = input_data_ptr[pos++];
@@ -962,7 +1517,7 @@ tcp_input(struct tcp_socket *s,
       if(conn->in_packet.byte_counter > 5) {
         call_event(conn, MQTT_EVENT_ERROR, NULL);
         DBG("Received more then 4 byte 'remaining lenght'.");
-        return 0;
+        return input_data_len;
       }
 
       conn->in_packet.remaining_length +=
@@ -985,12 +1540,16 @@ tcp_input(struct tcp_socket *s,
 
     PRINTF("MQTT - Error, unsupported payload size for non-PUBLISH message\n");
 
-    conn->in_packet.byte_counter += input_data_len;
-    if(conn->in_packet.byte_counter >=
-       (MQTT_FHDR_SIZE + conn->in_packet.remaining_length)) {
+    /* Skip this message only, the segment may hold more after it */
+    copy_bytes = MIN(input_data_len - pos,
+                     PACKET_LENGTH(&conn->in_packet) -
+                     conn->in_packet.byte_counter);
+    conn->in_packet.byte_counter += copy_bytes;
+    pos += copy_bytes;
+    if(conn->in_packet.byte_counter >= PACKET_LENGTH(&conn->in_packet)) {
       conn->in_packet.packet_received = 1;
     }
-    return 0;
+    return pos;
   }
 
   /*
@@ -999,17 +1558,19 @@ tcp_input(struct tcp_socket *s,
    * Note: There will always be at least one byte left to read when we enter
    *       this loop.
    */
-  while(conn->in_packet.byte_counter <
-        (MQTT_FHDR_SIZE + conn->in_packet.remaining_length)) {
+  while(conn->in_packet.byte_counter < PACKET_LENGTH(&conn->in_packet)) {
 
     if((conn->in_packet.fhdr & 0xF0) == MQTT_FHDR_MSG_TYPE_PUBLISH &&
        conn->in_packet.topic_received == 0) {
       parse_publish_vhdr(conn, &pos, input_data_ptr, input_data_len);
     }
 
-    /* Read in as much as we can into the packet payload */
+    /* Read in as much as we can of this message into the packet payload */
     copy_bytes = MIN(input_data_len - pos,
                      MQTT_INPUT_BUFF_SIZE - conn->in_packet.payload_pos);
+    copy_bytes = MIN(copy_bytes,
+                     PACKET_LENGTH(&conn->in_packet) -
+                     conn->in_packet.byte_counter);
     DBG("- Copied %lu payload bytes\n", copy_bytes);
     memcpy(&conn->in_packet.payload[conn->in_packet.payload_pos],
            &input_data_ptr[pos],
@@ -1038,8 +1599,8 @@ tcp_input(struct tcp_socket *s,
     }
 
     if(pos >= input_data_len &&
-       (conn->in_packet.byte_counter < (MQTT_FHDR_SIZE + conn->in_packet.remaining_length))) {
-      return 0;
+       conn->in_packet.byte_counter < PACKET_LENGTH(&conn->in_packet)) {
+      return pos;
     }
   }
 
@@ -1066,6 +1627,12 @@ tcp_input(struct tcp_socket *s,
   case MQTT_FHDR_MSG_TYPE_PUBACK:
     handle_puback(conn);
     break;
+  case MQTT_FHDR_MSG_TYPE_PUBREC:
+    handle_pubrec(conn);
+    break;
+  case MQTT_FHDR_MSG_TYPE_PUBCOMP:
+    handle_pubcomp(conn);
+    break;
   case MQTT_FHDR_MSG_TYPE_SUBACK:
     handle_suback(conn);
     break;
@@ -1076,10 +1643,8 @@ tcp_input(struct tcp_socket *s,
     handle_pingresp(conn);
     break;
 
-  /* QoS 2 not implemented yet */
-  case MQTT_FHDR_MSG_TYPE_PUBREC:
+  /* Incoming QoS 2 not implemented yet */
   case MQTT_FHDR_MSG_TYPE_PUBREL:
-  case MQTT_FHDR_MSG_TYPE_PUBCOMP:
     call_event(conn, MQTT_EVENT_NOT_IMPLEMENTED_ERROR, NULL);
     PRINTF("MQTT - Got unhandled MQTT Message Type '%i'",
            (conn->in_packet.fhdr & 0xF0));
@@ -1093,6 +1658,25 @@ tcp_input(struct tcp_socket *s,
 
   conn->in_packet.packet_received = 1;
 
+  return pos;
+}
+/*---------------------------------------------------------------------------*/
+static int
+tcp_input(struct tcp_socket *s,
+          void *ptr,
+          const uint8_t *input_data_ptr,
+          int input_data_len)
+{
+  struct mqtt_connection *conn = ptr;
+  int pos = 0;
+
+  /* A segment may hold several messages, such as one PUBACK for each PUBLISH
+     in flight */
+  while(pos < input_data_len &&
+        conn->state > MQTT_CONN_STATE_NOT_CONNECTED) {
+    pos += input_packet(conn, &input_data_ptr[pos], input_data_len - pos);
+  }
+
   return 0;
 }
 /*---------------------------------------------------------------------------*/
@@ -1119,9 +1703,12 @@ tcp_event(struct tcp_socket *s, void *ptr, tcp_socket_event_t event)
     call_event(conn, MQTT_EVENT_DISCONNECTED, &event);
     abort_connection(conn);
 
-    /* If connecting retry */
+    /*
+     * If connecting retry. This is posted after the abort event, which would
+     * otherwise tear down the new connection.
+     */
     if(conn->auto_reconnect == 1) {
-      connect_tcp(conn);
+      process_post(&mqtt_process, mqtt_do_connect_tcp_event, conn);
     }
     break;
   }
@@ -1135,9 +1722,14 @@ tcp_event(struct tcp_socket *s, void *ptr, tcp_socket_event_t event)
   case TCP_SOCKET_DATA_SENT: {
     DBG("MQTT - Got TCP_DATA_SENT\n");
 
-    if(conn->socket.output_data_len == 0) {
+    if(tcp_socket_queuelen(&conn->socket) == 0) {
       conn->out_buffer_sent = 1;
       conn->out_buffer_ptr = conn->out_buffer;
+      outbox_kick(conn);
+      if(conn->publish_pending) {
+        conn->publish_pending = 0;
+        process_post(&mqtt_process, mqtt_do_publish_event, conn);
+      }
     }
 
     ctimer_restart(&conn->keep_alive_timer);
@@ -1254,8 +1846,27 @@ PROCESS_THREAD(mqtt_process, ev, data)
               publish_pt(&conn->out_proto_thread, conn) < PT_EXITED) {
           PT_MQTT_WAIT_SEND();
         }
+      } else if(conn->state == MQTT_CONN_STATE_CONNECTED_TO_BROKER) {
+        /* Posted again when the data in flight has been sent */
+        conn->publish_pending = 1;
+      }
+    }
+#if MQTT_OUTBOX_SIZE
+    if(ev == mqtt_do_outbox_event) {
+      conn = data;
+      DBG("MQTT - Got mqtt_do_outbox_event!\n");
+
+      /* Skipped if busy, the outbox is kicked again when the data is sent */
+      if(conn->out_buffer_sent == 1 &&
+         conn->state == MQTT_CONN_STATE_CONNECTED_TO_BROKER) {
+        PT_INIT(&conn->out_proto_thread);
+        while(conn->state == MQTT_CONN_STATE_CONNECTED_TO_BROKER &&
+              outbox_pt(&conn->out_proto_thread, conn) < PT_EXITED) {
+          PT_MQTT_WAIT_SEND();
+        }
       }
     }
+#endif /* MQTT_OUTBOX_SIZE */
   }
   PROCESS_END();
 }
@@ -1273,6 +1884,7 @@ mqtt_init(void)
     mqtt_do_subscribe_event = process_alloc_event();
     mqtt_do_unsubscribe_event = process_alloc_event();
     mqtt_do_publish_event = process_alloc_event();
+    mqtt_do_outbox_event = process_alloc_event();
     mqtt_do_pingreq_event = process_alloc_event();
     mqtt_update_event = process_alloc_event();
     mqtt_abort_now_event = process_alloc_event();
@@ -1302,6 +1914,10 @@ mqtt_register(struct mqtt_connection *conn, struct process *app_process,
   conn->app_process = app_process;
   conn->auto_reconnect = 1;
   conn->max_segment_size = max_segment_size;
+#if MQTT_OUTBOX_SIZE
+  conn->outbox.max_in_flight = MQTT_MAX_IN_FLIGHT;
+#endif /* MQTT_OUTBOX_SIZE */
+  conn->batch_delay = MQTT_BATCH_DELAY;
   reset_defaults(conn);
 
   mqtt_init();
@@ -1419,6 +2035,78 @@ mqtt_unsubscribe(struct mqtt_connection *conn, uint16_t *mid, char *topic)
   return MQTT_STATUS_OK;
 }
 /*----------------------------------------------------------------------------*/
+static int
+publish_mid_in_use(struct mqtt_connection *conn, uint16_t mid)
+{
+  if(conn->out_queue_full &&
+     (conn->out_packet.fhdr & 0xF0) == MQTT_FHDR_MSG_TYPE_PUBLISH &&
+     conn->out_packet.qos > MQTT_QOS_LEVEL_0 && conn->out_packet.mid == mid) {
+    return 1;
+  }
+#if MQTT_OUTBOX_SIZE
+  return outbox_find(conn, mid) != OUTBOX_NONE;
+#else /* MQTT_OUTBOX_SIZE */
+  return 0;
+#endif /* MQTT_OUTBOX_SIZE */
+}
+/*----------------------------------------------------------------------------*/
+/* Returns a new MID that no message awaiting acknowledgement uses */
+static uint16_t
+next_publish_mid(struct mqtt_connection *conn)
+{
+  do {
+    INCREMENT_MID(conn);
+  } while(publish_mid_in_use(conn, conn->mid_counter));
+  return conn->mid_counter;
+}
+/*----------------------------------------------------------------------------*/
+#if MQTT_OUTBOX_SIZE
+static mqtt_status_t
+outbox_add(struct mqtt_connection *conn, uint16_t *mid, char *topic,
+           uint8_t *payload, uint32_t payload_size,
+           mqtt_qos_level_t qos_level, mqtt_retain_t retain)
+{
+  uint16_t topic_length;
+  uint16_t offset;
+  uint16_t new_mid;
+  uint8_t *record;
+
+  topic_length = strlen(topic);
+  new_mid = next_publish_mid(conn);
+
+  offset = outbox_alloc(&conn->outbox,
+                        OUTBOX_RECORD_HDR_SIZE + topic_length + payload_size);
+  if(offset == OUTBOX_NONE) {
+    DBG("MQTT - Not accepted, outbox full!\n");
+    return MQTT_STATUS_OUT_QUEUE_FULL;
+  }
+  DBG("MQTT - Accepted into outbox!\n");
+
+  record = OUTBOX_RECORD(conn, offset);
+  RECORD_STATE(record) = OUTBOX_QUEUED;
+  RECORD_FHDR(record) = MQTT_FHDR_MSG_TYPE_PUBLISH | qos_level << 1;
+  if(retain == MQTT_RETAIN_ON) {
+    RECORD_FHDR(record) |= MQTT_FHDR_RETAIN_FLAG;
+  }
+  record[2] = new_mid >> 8;
+  record[3] = new_mid & 0x00FF;
+  record[4] = topic_length >> 8;
+  record[5] = topic_length & 0x00FF;
+  record[6] = payload_size >> 8;
+  record[7] = payload_size & 0x00FF;
+  memcpy(&record[OUTBOX_RECORD_HDR_SIZE], topic, topic_length);
+  memcpy(RECORD_PAYLOAD(record), payload, payload_size);
+  journal_record(conn, offset);
+
+  if(mid != NULL) {
+    *mid = new_mid;
+  }
+
+  outbox_kick(conn);
+  return MQTT_STATUS_OK;
+}
+#endif /* MQTT_OUTBOX_SIZE */
+/*----------------------------------------------------------------------------*/
 mqtt_status_t
 mqtt_publish(struct mqtt_connection *conn, uint16_t *mid, char *topic,
              uint8_t *payload, uint32_t payload_size,
@@ -1430,15 +2118,25 @@ mqtt_publish(struct mqtt_connection *conn, uint16_t *mid, char *topic,
 
   DBG("MQTT - Call to mqtt_publish...\n");
 
+#if MQTT_OUTBOX_SIZE
+  /* Larger messages are sent from the buffer of the application instead */
+  if(qos_level > MQTT_QOS_LEVEL_0 &&
+     OUTBOX_RECORD_HDR_SIZE + strlen(topic) + payload_size <=
+     MQTT_OUTBOX_SIZE) {
+    return outbox_add(conn, mid, topic, payload, payload_size, qos_level,
+                      retain);
+  }
+#endif /* MQTT_OUTBOX_SIZE */
+
   /* Currently don't have a queue, so only one item at a time */
   if(conn->out_queue_full) {
     DBG("MQTT - Not accepted!\n");
     return MQTT_STATUS_OUT_QUEUE_FULL;
   }
-  conn->out_queue_full = 1;
   DBG("MQTT - Accepted!\n");
 
-  conn->out_packet.mid = INCREMENT_MID(conn);
+  conn->out_packet.mid = next_publish_mid(conn);
+  conn->out_queue_full = 1;
   conn->out_packet.retain = retain;
   conn->out_packet.topic = topic;
   conn->out_packet.topic_length = strlen(topic);
@@ -1446,11 +2144,50 @@ mqtt_publish(struct mqtt_connection *conn, uint16_t *mid, char *topic,
   conn->out_packet.payload_size = payload_size;
   conn->out_packet.qos = qos_level;
   conn->out_packet.qos_state = MQTT_QOS_STATE_NO_ACK;
+  if(mid != NULL) {
+    *mid = conn->out_packet.mid;
+  }
 
   process_post(&mqtt_process, mqtt_do_publish_event, conn);
   return MQTT_STATUS_OK;
 }
 /*----------------------------------------------------------------------------*/
+#if MQTT_FILE_PAYLOAD
+mqtt_status_t
+mqtt_publish_file(struct mqtt_connection *conn, uint16_t *mid, char *topic,
+                  int fd, uint32_t payload_size, mqtt_retain_t retain)
+{
+  cfs_offset_t offset;
+  mqtt_status_t status;
+
+  offset = cfs_seek(fd, 0, CFS_SEEK_CUR);
+  if(offset == -1) {
+    return MQTT_STATUS_INVALID_ARGS_ERROR;
+  }
+
+  /* A NULL payload is read from the file */
+  status = mqtt_publish(conn, mid, topic, NULL, payload_size,
+                        MQTT_QOS_LEVEL_0, retain);
+  if(status == MQTT_STATUS_OK) {
+    conn->out_packet.payload_fd = fd;
+    conn->out_packet.payload_offset = offset;
+  }
+  return status;
+}
+#endif /* MQTT_FILE_PAYLOAD */
+/*----------------------------------------------------------------------------*/
+void
+mqtt_set_batch_delay(struct mqtt_connection *conn, clock_time_t delay)
+{
+  conn->batch_delay = delay;
+
+  /* Without a delay, a waiting batch is sent right away */
+  if(delay == 0 && !ctimer_expired(&conn->batch_timer)) {
+    ctimer_stop(&conn->batch_timer);
+    batch_timeout(conn);
+  }
+}
+/*----------------------------------------------------------------------------*/
 void
 mqtt_set_username_password(struct mqtt_connection *conn, char *username,
                            char *password)
@@ -1489,4 +2226,85 @@ mqtt_set_last_will(struct mqtt_connection *conn, char *topic, char *message,
   }
 }
 /*----------------------------------------------------------------------------*/
+void
+mqtt_set_max_in_flight(struct mqtt_connection *conn, uint8_t max_in_flight)
+{
+#if MQTT_OUTBOX_SIZE
+  conn->outbox.max_in_flight = MAX(max_in_flight, 1);
+  outbox_kick(conn);
+#endif /* MQTT_OUTBOX_SIZE */
+}
+/*----------------------------------------------------------------------------*/
+#if MQTT_OUTBOX_CFS
+mqtt_status_t
+mqtt_set_outbox_file(struct mqtt_connection *conn, const char *filename)
+{
+  mqtt_status_t status = MQTT_STATUS_OK;
+  uint8_t type;
+  uint8_t entry[OUTBOX_RECORD_HDR_SIZE];
+  uint16_t offset;
+  uint16_t size;
+  int fd;
+
+  if(filename == NULL) {
+    return MQTT_STATUS_INVALID_ARGS_ERROR;
+  }
+  conn->outbox.filename = filename;
+
+  fd = cfs_open(filename, CFS_READ);
+  if(fd < 0) {
+    /* No journal, nothing to restore */
+    return MQTT_STATUS_OK;
+  }
+
+  while(cfs_read(fd, &type, 1) == 1) {
+    if(type == OUTBOX_JOURNAL_RECORD) {
+      if(cfs_read(fd, entry, OUTBOX_RECORD_HDR_SIZE) != OUTBOX_RECORD_HDR_SIZE) {
+        break;
+      }
+      if((uint32_t)OUTBOX_RECORD_HDR_SIZE + RECORD_TOPIC_LENGTH(entry) +
+         RECORD_PAYLOAD_LENGTH(entry) > MQTT_OUTBOX_SIZE) {
+        status = MQTT_STATUS_ERROR;
+        break;
+      }
+      size = RECORD_SIZE(entry);
+      offset = outbox_alloc(&conn->outbox, size);
+      if(offset == OUTBOX_NONE) {
+        status = MQTT_STATUS_ERROR;
+        break;
+      }
+      memcpy(OUTBOX_RECORD(conn, offset), entry, OUTBOX_RECORD_HDR_SIZE);
+      if(cfs_read(fd, OUTBOX_RECORD(conn, offset) + OUTBOX_RECORD_HDR_SIZE,
+                  size - OUTBOX_RECORD_HDR_SIZE) !=
+         size - OUTBOX_RECORD_HDR_SIZE) {
+        /* Cut short by a reset while it was written */
+        RECORD_STATE(OUTBOX_RECORD(conn, offset)) = OUTBOX_DONE;
+        break;
+      }
+    } else if(type == OUTBOX_JOURNAL_STATE) {
+      if(cfs_read(fd, entry, MQTT_MID_SIZE + 1) != MQTT_MID_SIZE + 1) {
+        break;
+      }
+      offset = outbox_find(conn, (entry[0] << 8) | entry[1]);
+      if(offset != OUTBOX_NONE) {
+        RECORD_STATE(OUTBOX_RECORD(conn, offset)) = entry[2];
+      }
+    } else {
+      status = MQTT_STATUS_ERROR;
+      break;
+    }
+  }
+  cfs_close(fd);
+
+  PRINTF("MQTT - Restored %u messages from outbox journal\n",
+         conn->outbox.count);
+
+  outbox_pop(conn);
+  outbox_rewind(conn);
+  journal_compact(conn);
+
+  return status;
+}
+#endif /* MQTT_OUTBOX_CFS */
+/*----------------------------------------------------------------------------*/
 /** @} */
@@ -35,7 +35,8 @@
  * \defgroup mqtt-engine An implementation of MQTT v3.1
  * @{
  *
- * This application is an engine for MQTT v3.1. It supports QoS Levels 0 and 1.
+ * This application is an engine for MQTT v3.1. It supports QoS Levels 0, 1
+ * and 2 for outgoing PUBLISH messages.
  *
  * MQTT is a Client Server publish/subscribe messaging transport protocol.
  * It is light weight, open, simple, and designed so as to be easy to implement.
@@ -60,8 +61,7 @@
  *  can occur.
  *  -- "Exactly once" (2), where message are assured to arrive exactly once.
  *  This level could be used, for example, with billing systems where duplicate
- *  or lost messages could lead to incorrect charges being applied. This QoS
- *  level is currently not supported in this implementation.
+ *  or lost messages could lead to incorrect charges being applied.
  *
  * - A small transport overhead and protocol exchanges minimized to reduce
  *   network traffic.
@@ -117,6 +117,78 @@
 #define MQTT_PROTOCOL_VERSION 3
 #define MQTT_PROTOCOL_NAME "MQIsdp"
 #define MQTT_TOPIC_MAX_LENGTH 128
+
+/*
+ * Default number of QoS 1 and 2 PUBLISH messages that may be awaiting
+ * acknowledgement at the same time. Can be changed per connection with
+ * mqtt_set_max_in_flight().
+ */
+#ifdef MQTT_CONF_MAX_IN_FLIGHT
+#define MQTT_MAX_IN_FLIGHT MQTT_CONF_MAX_IN_FLIGHT
+#else
+#define MQTT_MAX_IN_FLIGHT 1
+#endif
+
+/*
+ * Size in bytes of the per connection outbox, or zero for none. QoS 1 and 2
+ * PUBLISH messages are copied into the outbox and stay there until they have
+ * been fully acknowledged. Each message takes 8 bytes plus topic and payload.
+ *
+ * The outbox is part of struct mqtt_connection, so this is RAM that every
+ * connection takes. Messages that take more than the whole outbox, and all
+ * of them without an outbox, are sent one at a time from the buffer of the
+ * application instead.
+ */
+#ifdef MQTT_CONF_OUTBOX_SIZE
+#define MQTT_OUTBOX_SIZE MQTT_CONF_OUTBOX_SIZE
+#else
+#define MQTT_OUTBOX_SIZE 0
+#endif
+
+/*
+ * Set to 1 to allow the outbox to be journaled to a CFS file, so that
+ * unacknowledged messages survive a reboot. See mqtt_set_outbox_file().
+ */
+#ifdef MQTT_CONF_OUTBOX_CFS
+#define MQTT_OUTBOX_CFS MQTT_CONF_OUTBOX_CFS
+#else
+#define MQTT_OUTBOX_CFS 0
+#endif
+
+#if MQTT_OUTBOX_CFS && MQTT_OUTBOX_SIZE == 0
+#error "MQTT_CONF_OUTBOX_CFS requires MQTT_CONF_OUTBOX_SIZE > 0"
+#endif
+
+/*
+ * Default time PUBLISH messages may be held back so that several of them go
+ * out in one TCP segment. Zero sends each message right away. Can be changed
+ * per connection with mqtt_set_batch_delay().
+ */
+#ifdef MQTT_CONF_BATCH_DELAY
+#define MQTT_BATCH_DELAY MQTT_CONF_BATCH_DELAY
+#else
+#define MQTT_BATCH_DELAY 0
+#endif
+
+/*
+ * QoS 0 payloads larger than this are read straight into the outgoing TCP
+ * segments instead of being copied through the output buffer.
+ */
+#ifdef MQTT_CONF_ZERO_COPY_THRESHOLD
+#define MQTT_ZERO_COPY_THRESHOLD MQTT_CONF_ZERO_COPY_THRESHOLD
+#else
+#define MQTT_ZERO_COPY_THRESHOLD 64
+#endif
+
+/*
+ * Set to 1 to allow payloads to be published from a CFS file. See
+ * mqtt_publish_file().
+ */
+#ifdef MQTT_CONF_FILE_PAYLOAD
+#define MQTT_FILE_PAYLOAD MQTT_CONF_FILE_PAYLOAD
+#else
+#define MQTT_FILE_PAYLOAD 0
+#endif
 /*---------------------------------------------------------------------------*/
 /*
  * Debug configuration, this is similar but not exactly like the Debugging
@@ -151,6 +223,7 @@ typedef enum {
   MQTT_EVENT_UNSUBACK,
   MQTT_EVENT_PUBLISH,
   MQTT_EVENT_PUBACK,
+  MQTT_EVENT_PUBCOMP,
 
   /* Errors */
   MQTT_EVENT_ERROR = 0x80,
@@ -182,8 +255,7 @@ typedef enum {
 typedef enum {
   MQTT_QOS_STATE_NO_ACK,
   MQTT_QOS_STATE_GOT_ACK,
-
-  /* Expand for QoS 2 */
+  MQTT_QOS_STATE_GOT_REC,
 } mqtt_qos_state_t;
 /*---------------------------------------------------------------------------*/
 /*
@@ -279,10 +351,39 @@ struct mqtt_out_packet {
   uint16_t topic_length;
   uint8_t *payload;
   uint32_t payload_size;
+#if MQTT_FILE_PAYLOAD
+  int payload_fd;
+  uint32_t payload_offset;
+#endif /* MQTT_FILE_PAYLOAD */
   mqtt_qos_level_t qos;
   mqtt_qos_state_t qos_state;
   mqtt_retain_t retain;
 };
+
+#if MQTT_OUTBOX_SIZE
+/*
+ * Ring buffer of QoS 1 and 2 PUBLISH messages. Messages are sent in the order
+ * they were published and removed once acknowledged. If the records wrap,
+ * they occupy [head, wrap) followed by [0, tail); otherwise wrap is zero and
+ * they occupy [head, tail).
+ */
+struct mqtt_outbox {
+  uint16_t head;
+  uint16_t tail;
+  uint16_t wrap;
+  uint16_t current;
+  uint16_t count;
+  uint8_t in_flight;
+  uint8_t max_in_flight;
+  uint8_t remaining_length_enc[MQTT_MAX_REMAINING_LENGTH_BYTES];
+  uint8_t remaining_length_enc_bytes;
+#if MQTT_OUTBOX_CFS
+  const char *filename;
+  uint32_t journal_length;
+#endif /* MQTT_OUTBOX_CFS */
+  uint8_t data[MQTT_OUTBOX_SIZE];
+};
+#endif /* MQTT_OUTBOX_SIZE */
 /*---------------------------------------------------------------------------*/
 /**
  * \brief           MQTT event callback function
@@ -343,7 +444,13 @@ struct mqtt_connection {
   uint8_t *out_buffer_ptr;
   uint8_t out_buffer[MQTT_TCP_OUTPUT_BUFF_SIZE];
   uint8_t out_buffer_sent;
+  uint8_t publish_pending;
+  clock_time_t batch_delay;
+  struct ctimer batch_timer;
   struct mqtt_out_packet out_packet;
+#if MQTT_OUTBOX_SIZE
+  struct mqtt_outbox outbox;
+#endif /* MQTT_OUTBOX_SIZE */
   struct pt out_proto_thread;
   uint32_t out_write_pos;
   uint16_t max_segment_size;
@@ -442,7 +549,7 @@ mqtt_status_t mqtt_unsubscribe(struct mqtt_connection *conn,
  * \param topic A pointer to the topic to subscribe to.
  * \param payload A pointer to the topic payload.
  * \param payload_size Payload size.
- * \param qos_level Quality Of Service level to use. Currently supports 0, 1.
+ * \param qos_level Quality Of Service level to use. Supports 0, 1 and 2.
  * \param retain If the RETAIN flag is set to 1, in a PUBLISH Packet sent by a
  *        Client to a Server, the Server MUST store the Application Message
  *        and its QoS, so that it can be delivered to future subscribers whose
@@ -450,6 +557,20 @@ mqtt_status_t mqtt_unsubscribe(struct mqtt_connection *conn,
  * \return MQTT_STATUS_OK or some error status
  *
  * This function publishes to a topic on a MQTT broker.
+ *
+ * QoS 0 messages are sent straight from \e payload, which must stay valid
+ * until mqtt_ready() is true again. Payloads larger than
+ * MQTT_ZERO_COPY_THRESHOLD are read directly into the outgoing TCP segments,
+ * smaller ones may be held back with other messages for up to the batch
+ * delay, see mqtt_set_batch_delay(). QoS 1 and 2 messages are copied into
+ * the outbox, if there is one, so \e topic and \e payload can be reused as
+ * soon as the call returns. MQTT_STATUS_OUT_QUEUE_FULL is returned if there
+ * is no room in the outbox. Messages still unacknowledged when the connection
+ * is lost are resent, in order, with the DUP flag set after reconnecting.
+ * QoS 1 and 2 messages larger than the whole outbox are sent like QoS 0
+ * ones, and mqtt_ready() is false until the broker has acknowledged them.
+ * The application is notified with MQTT_EVENT_PUBACK or MQTT_EVENT_PUBCOMP
+ * once the broker has acknowledged a message.
  */
 mqtt_status_t mqtt_publish(struct mqtt_connection *conn,
                            uint16_t *mid,
@@ -459,6 +580,31 @@ mqtt_status_t mqtt_publish(struct mqtt_connection *conn,
                            mqtt_qos_level_t qos_level,
                            mqtt_retain_t retain);
 /*---------------------------------------------------------------------------*/
+#if MQTT_FILE_PAYLOAD
+/**
+ * \brief Publish the contents of a CFS file to a MQTT topic.
+ * \param conn A pointer to the MQTT connection.
+ * \param mid A pointer to message ID.
+ * \param topic A pointer to the topic to publish to.
+ * \param fd A CFS file descriptor open for reading.
+ * \param payload_size The number of bytes to publish, starting at the current
+ *        position of \e fd.
+ * \param retain The RETAIN flag, as for mqtt_publish().
+ * \return MQTT_STATUS_OK or some error status
+ *
+ * The message is published with QoS 0, and the payload is read from the file
+ * straight into the outgoing TCP segments, so it may be larger than any
+ * buffer of the MQTT engine. The file must stay open until mqtt_ready() is
+ * true again.
+ */
+mqtt_status_t mqtt_publish_file(struct mqtt_connection *conn,
+                                uint16_t *mid,
+                                char *topic,
+                                int fd,
+                                uint32_t payload_size,
+                                mqtt_retain_t retain);
+#endif /* MQTT_FILE_PAYLOAD */
+/*---------------------------------------------------------------------------*/
 /**
  * \brief Set the user name and password for a MQTT client.
  * \param conn A pointer to the MQTT connection.
@@ -493,6 +639,50 @@ void mqtt_set_last_will(struct mqtt_connection *conn,
                         char *topic,
                         char *message,
                         mqtt_qos_level_t qos);
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief Set the number of QoS 1 and 2 messages that may be in flight.
+ * \param conn A pointer to the MQTT connection.
+ * \param max_in_flight The number of PUBLISH messages that may be awaiting
+ *        acknowledgement at the same time, at least 1.
+ *
+ * Messages in flight are limited both by this number and by the room in the
+ * outbox. The default is MQTT_MAX_IN_FLIGHT. Without an outbox, only one
+ * message is ever in flight.
+ */
+void mqtt_set_max_in_flight(struct mqtt_connection *conn,
+                            uint8_t max_in_flight);
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief Set how long PUBLISH messages may be held back for batching.
+ * \param conn A pointer to the MQTT connection.
+ * \param delay The longest time a message waits for others to join it in
+ *        one TCP segment, or zero to send each message right away.
+ *
+ * A batch is sent when the delay of its first message has passed, when it
+ * fills a segment of the size given to mqtt_register(), or when any other
+ * MQTT message is sent. The default is MQTT_BATCH_DELAY.
+ */
+void mqtt_set_batch_delay(struct mqtt_connection *conn, clock_time_t delay);
+/*---------------------------------------------------------------------------*/
+#if MQTT_OUTBOX_CFS
+/**
+ * \brief Journal the outbox of a MQTT client to a file.
+ * \param conn A pointer to the MQTT connection.
+ * \param filename The name of the CFS file to use.
+ * \return MQTT_STATUS_OK or MQTT_STATUS_ERROR
+ *
+ * Messages found in the file from a previous run are restored into the
+ * outbox and sent once connected. After this call, every change to the
+ * outbox is appended to the file. The file is removed when the outbox
+ * becomes empty, and rewritten when it grows too long.
+ *
+ * This function shall be called after mqtt_register() and before
+ * mqtt_connect().
+ */
+mqtt_status_t mqtt_set_outbox_file(struct mqtt_connection *conn,
+                                   const char *filename);
+#endif /* MQTT_OUTBOX_CFS */
 
 #define mqtt_connected(conn) \
   ((conn)->state == MQTT_CONN_STATE_CONNECTED_TO_BROKER ? 1 : 0)
@@ -79,6 +79,13 @@
 #define MAX_OBJECTS 10
 #endif /* LWM2M_ENGINE_CONF_MAX_OBJECTS */
 
+/* The largest resource in an instance or object read */
+#ifdef LWM2M_ENGINE_CONF_MAX_RECORD_SIZE
+#define MAX_RECORD_SIZE LWM2M_ENGINE_CONF_MAX_RECORD_SIZE
+#else /* LWM2M_ENGINE_CONF_MAX_RECORD_SIZE */
+#define MAX_RECORD_SIZE 96
+#endif /* LWM2M_ENGINE_CONF_MAX_RECORD_SIZE */
+
 #define REMOTE_PORT        UIP_HTONS(COAP_DEFAULT_PORT)
 #define BS_REMOTE_PORT     UIP_HTONS(5685)
 
@@ -86,6 +93,28 @@ static const lwm2m_object_t *objects[MAX_OBJECTS];
 static char endpoint[32];
 static char rd_data[128]; /* allocate some data for the RD */
 
+/* The record before the resources of an instance */
+#define RECORD_HEADER 0xffff
+
+/*
+ * Instance and object reads are output as a sequence of records: the
+ * header of an instance, one resource each, and the end. A block ends
+ * somewhere in a record, so the cursor stays at that record and the
+ * next block renders it again, keeping only the part after the block.
+ */
+static struct {
+  const lwm2m_object_t *object;
+  unsigned int content_type;
+  uint16_t instance_id;
+  uint16_t instance_index;
+  uint16_t resource_index;
+  uint8_t level;
+  uint8_t has_entries;
+  uint32_t record_offset;
+  uint32_t offset;
+} read_cursor;
+static uint8_t record[MAX_RECORD_SIZE];
+
 PROCESS(lwm2m_rd_client, "LWM2M Engine");
 
 static uip_ipaddr_t server_ipaddr;
@@ -488,6 +517,7 @@ lwm2m_engine_parse_context(const lwm2m_object_t *object,
   ret += parse_next(&path, &path_len, &context->object_id);
   ret += parse_next(&path, &path_len, &context->object_instance_id);
   ret += parse_next(&path, &path_len, &context->resource_id);
+  context->level = ret;
 
   /* Set default reader/writer */
   context->reader = &lwm2m_plain_text_reader;
@@ -650,97 +680,248 @@ write_rd_link_data(const lwm2m_object_t *object,
   return rdlen;
 }
 /*---------------------------------------------------------------------------*/
+/**
+ * @brief Write the value of a resource with the writer of the context
+ *
+ * @return The length, 0 if the resource has no value to read, or -1 if
+ *         the value does not fit
+ */
 static int
-write_rd_json_data(const lwm2m_context_t *context,
-                   const lwm2m_object_t *object,
-                   const lwm2m_instance_t *instance,
-                   char *buffer, size_t size)
+write_resource(lwm2m_context_t *context, const lwm2m_resource_t *resource,
+               uint8_t *buffer, size_t size)
 {
-  const lwm2m_resource_t *resource;
-  const char *s = "";
-  int len, rdlen, i;
-
-  PRINTF("{\"e\":[");
-  rdlen = snprintf(buffer, size, "{\"e\":[");
-  if(rdlen < 0 || rdlen >= size) {
-    return -1;
+  size_t len = 0;
+
+  context->resource_id = resource->id;
+  if(lwm2m_object_is_resource_string(resource)) {
+    const uint8_t *value;
+    value = lwm2m_object_get_resource_string(resource, context);
+    if(value == NULL) {
+      return 0;
+    }
+    len = context->writer->write_string(context, buffer, size,
+                                        (const char *)value,
+                                        lwm2m_object_get_resource_strlen(resource, context));
+  } else if(lwm2m_object_is_resource_int(resource)) {
+    int32_t value;
+    if(!lwm2m_object_get_resource_int(resource, context, &value)) {
+      return 0;
+    }
+    len = context->writer->write_int(context, buffer, size, value);
+  } else if(lwm2m_object_is_resource_floatfix(resource)) {
+    int32_t value;
+    if(!lwm2m_object_get_resource_floatfix(resource, context, &value)) {
+      return 0;
+    }
+    len = context->writer->write_float32fix(context, buffer, size,
+                                            value, LWM2M_FLOAT32_BITS);
+  } else if(lwm2m_object_is_resource_boolean(resource)) {
+    int value;
+    if(!lwm2m_object_get_resource_boolean(resource, context, &value)) {
+      return 0;
+    }
+    len = context->writer->write_boolean(context, buffer, size, value);
+  } else if(lwm2m_object_is_resource_callback(resource)) {
+    int res = 0;
+    if(resource->value.callback.read != NULL) {
+      res = resource->value.callback.read(context, buffer, size);
+    }
+    return res > 0 ? res : 0;
+  } else {
+    return 0;
   }
+  return len > 0 ? len : -1;
+}
+/*---------------------------------------------------------------------------*/
+/* Render the record at the read cursor, -1 if it does not fit */
+static int
+write_record(lwm2m_context_t *context)
+{
+  const lwm2m_object_t *object = read_cursor.object;
+  const lwm2m_instance_t *instance;
+  oma_tlv_t tlv;
+  int len, i;
 
-  for(i = 0, len = 0; i < instance->count; i++) {
-    resource = &instance->resources[i];
+  if(read_cursor.instance_index >= object->count) {
+    if(read_cursor.content_type == LWM2M_TLV) {
+      return 0;
+    }
+    /* The end of the document, which is empty if there was no instance */
     len = 0;
-    if(lwm2m_object_is_resource_string(resource)) {
-      const uint8_t *value;
-      uint16_t slen;
-      value = lwm2m_object_get_resource_string(resource, context);
-      slen = lwm2m_object_get_resource_strlen(resource, context);
-      if(value != NULL) {
-        PRINTF("%s{\"n\":\"%u\",\"sv\":\"%.*s\"}", s,
-               resource->id, slen, value);
-        len = snprintf(&buffer[rdlen], size - rdlen,
-                       "%s{\"n\":\"%u\",\"sv\":\"%.*s\"}", s,
-                       resource->id, slen, value);
-      }
-    } else if(lwm2m_object_is_resource_int(resource)) {
-      int32_t value;
-      if(lwm2m_object_get_resource_int(resource, context, &value)) {
-        PRINTF("%s{\"n\":\"%u\",\"v\":%" PRId32 "}", s,
-               resource->id, value);
-        len = snprintf(&buffer[rdlen], size - rdlen,
-                       "%s{\"n\":\"%u\",\"v\":%" PRId32 "}", s,
-                       resource->id, value);
-      }
-    } else if(lwm2m_object_is_resource_floatfix(resource)) {
-      int32_t value;
-      if(lwm2m_object_get_resource_floatfix(resource, context, &value)) {
-        PRINTF("%s{\"n\":\"%u\",\"v\":%" PRId32 "}", s, resource->id,
-               value / LWM2M_FLOAT32_FRAC);
-        len = snprintf(&buffer[rdlen], size - rdlen,
-                       "%s{\"n\":\"%u\",\"v\":", s, resource->id);
-        rdlen += len;
-        if(len < 0 || rdlen >= size) {
-          return -1;
-        }
+    if(read_cursor.record_offset == 0) {
+      memcpy(record, LWM2M_JSON_BEGIN, LWM2M_JSON_BEGIN_LEN);
+      len = LWM2M_JSON_BEGIN_LEN;
+    }
+    memcpy(&record[len], LWM2M_JSON_END, LWM2M_JSON_END_LEN);
+    return len + LWM2M_JSON_END_LEN;
+  }
 
-        len = lwm2m_plain_text_write_float32fix((uint8_t *)&buffer[rdlen],
-                                                size - rdlen,
-                                                value, LWM2M_FLOAT32_BITS);
-        if(len == 0) {
-          return -1;
-        }
-        rdlen += len;
+  instance = &object->instances[read_cursor.instance_index];
+  context->object_instance_id = instance->id;
+  context->object_instance_index = read_cursor.instance_index;
 
-        if(rdlen < size) {
-          buffer[rdlen] = '}';
-        }
-        len = 1;
+  if(read_cursor.resource_index == RECORD_HEADER) {
+    if(read_cursor.content_type != LWM2M_TLV) {
+      /* The start of the document, before the first instance */
+      if(read_cursor.record_offset > 0) {
+        return 0;
       }
-    } else if(lwm2m_object_is_resource_boolean(resource)) {
-      int value;
-      if(lwm2m_object_get_resource_boolean(resource, context, &value)) {
-        PRINTF("%s{\"n\":\"%u\",\"bv\":%s}", s, resource->id,
-               value ? "true" : "false");
-        len = snprintf(&buffer[rdlen], size - rdlen,
-                       "%s{\"n\":\"%u\",\"bv\":%s}", s, resource->id,
-                       value ? "true" : "false");
+      memcpy(record, LWM2M_JSON_BEGIN, LWM2M_JSON_BEGIN_LEN);
+      return LWM2M_JSON_BEGIN_LEN;
+    }
+    if(read_cursor.level > 1) {
+      return 0;
+    }
+    /* Object reads wrap the resources of each instance in a TLV */
+    tlv.type = OMA_TLV_TYPE_OBJECT_INSTANCE;
+    tlv.id = instance->id;
+    tlv.length = 0;
+    for(i = 0; i < instance->count; i++) {
+      len = write_resource(context, &instance->resources[i],
+                           record, sizeof(record));
+      if(len < 0) {
+        return -1;
       }
+      tlv.length += len;
     }
-    rdlen += len;
-    if(len < 0 || rdlen >= size) {
+    return oma_tlv_write_header(&tlv, record, sizeof(record));
+  }
+
+  context->resource_index = read_cursor.resource_index;
+  if(read_cursor.content_type == LWM2M_TLV) {
+    return write_resource(context,
+                          &instance->resources[read_cursor.resource_index],
+                          record, sizeof(record));
+  }
+
+  /* JSON entries are separated by commas */
+  len = write_resource(context,
+                       &instance->resources[read_cursor.resource_index],
+                       &record[1], sizeof(record) - 1);
+  if(len <= 0) {
+    return len;
+  }
+  if(read_cursor.has_entries) {
+    record[0] = ',';
+    return len + 1;
+  }
+  memmove(record, &record[1], len);
+  return len;
+}
+/*---------------------------------------------------------------------------*/
+static void
+next_instance(uint16_t index)
+{
+  const lwm2m_object_t *object = read_cursor.object;
+
+  read_cursor.resource_index = RECORD_HEADER;
+  if(read_cursor.level > 1) {
+    /* Only the requested instance */
+    read_cursor.instance_index = object->count;
+    return;
+  }
+  while(index < object->count &&
+        (object->instances[index].flag & LWM2M_INSTANCE_FLAG_USED) == 0) {
+    index++;
+  }
+  read_cursor.instance_index = index;
+}
+/*---------------------------------------------------------------------------*/
+static void
+next_record(void)
+{
+  const lwm2m_object_t *object = read_cursor.object;
+
+  if(read_cursor.instance_index >= object->count) {
+    /* Past the end */
+    read_cursor.instance_index = object->count + 1;
+    return;
+  }
+  if(read_cursor.resource_index == RECORD_HEADER) {
+    read_cursor.resource_index = 0;
+  } else {
+    read_cursor.resource_index++;
+  }
+  if(read_cursor.resource_index >=
+     object->instances[read_cursor.instance_index].count) {
+    next_instance(read_cursor.instance_index + 1);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * @brief Write one block of an instance or object read
+ *
+ * A block that starts where the previous one ended continues from the
+ * read cursor. Any other block starts over from the first record.
+ *
+ * @param[in,out] offset  The offset of the block, set to the offset of
+ *                        the next block or -1 after the last block
+ *
+ * @return The length of the block, or -1 if a record does not fit
+ */
+static int
+write_read_block(const lwm2m_object_t *object, lwm2m_context_t *context,
+                 unsigned int content_type, uint8_t *buffer, uint16_t size,
+                 int32_t *offset)
+{
+  uint32_t start = *offset;
+  uint32_t skip;
+  int pos, len;
+
+  if(read_cursor.object != object ||
+     read_cursor.content_type != content_type ||
+     read_cursor.level != context->level ||
+     read_cursor.instance_id != context->object_instance_id ||
+     read_cursor.offset != start || start == 0) {
+    read_cursor.object = object;
+    read_cursor.content_type = content_type;
+    read_cursor.level = context->level;
+    read_cursor.instance_id = context->object_instance_id;
+    read_cursor.has_entries = 0;
+    read_cursor.record_offset = 0;
+    if(context->level > 1) {
+      read_cursor.instance_index = context->object_instance_index;
+      read_cursor.resource_index = RECORD_HEADER;
+    } else {
+      next_instance(0);
+    }
+  }
+
+  pos = 0;
+  while(pos < size && read_cursor.instance_index <= object->count) {
+    len = write_record(context);
+    if(len < 0) {
+      /* Start over with the next request */
+      read_cursor.object = NULL;
       return -1;
     }
-    if(len > 0) {
-      s = ",";
+    if(read_cursor.record_offset + len > start) {
+      skip = start > read_cursor.record_offset ?
+        start - read_cursor.record_offset : 0;
+      if(len - skip > size - pos) {
+        /* The record continues in the next block */
+        memcpy(&buffer[pos], &record[skip], size - pos);
+        read_cursor.offset = start + size;
+        *offset = read_cursor.offset;
+        return size;
+      }
+      memcpy(&buffer[pos], &record[skip], len - skip);
+      pos += len - skip;
     }
-  }
-  PRINTF("]}\n");
-  len = snprintf(&buffer[rdlen], size - rdlen, "]}");
-  rdlen += len;
-  if(len < 0 || rdlen >= size) {
-    return -1;
+    read_cursor.record_offset += len;
+    if(len > 0 && read_cursor.resource_index != RECORD_HEADER) {
+      read_cursor.has_entries = 1;
+    }
+    next_record();
   }
 
-  return rdlen;
+  read_cursor.offset = start + pos;
+  if(read_cursor.instance_index > object->count) {
+    *offset = -1;
+  } else {
+    *offset = read_cursor.offset;
+  }
+  return pos;
 }
 /*---------------------------------------------------------------------------*/
 /**
@@ -1070,9 +1251,17 @@ lwm2m_engine_handler(const lwm2m_object_t *object,
       if(accept == APPLICATION_LINK_FORMAT) {
         rdlen = write_rd_link_data(object, instance,
                                    (char *)buffer, preferred_size);
+        content_type = REST.type.APPLICATION_LINK_FORMAT;
       } else {
-        rdlen = write_rd_json_data(&context, object, instance,
-                                   (char *)buffer, preferred_size);
+        if(accept == LWM2M_TLV) {
+          content_type = LWM2M_TLV;
+          context.writer = &oma_tlv_writer;
+        } else {
+          content_type = LWM2M_JSON;
+          context.writer = &lwm2m_json_entry_writer;
+        }
+        rdlen = write_read_block(object, &context, content_type,
+                                 buffer, preferred_size, offset);
       }
       if(rdlen < 0) {
         PRINTF("Failed to generate instance response\n");
@@ -1080,11 +1269,7 @@ lwm2m_engine_handler(const lwm2m_object_t *object,
         return;
       }
       REST.set_response_payload(response, buffer, rdlen);
-      if(accept == APPLICATION_LINK_FORMAT) {
-        REST.set_header_content_type(response, REST.type.APPLICATION_LINK_FORMAT);
-      } else {
-        REST.set_header_content_type(response, LWM2M_JSON);
-      }
+      REST.set_header_content_type(response, content_type);
     }
   } else if(depth == 1) {
     /* produce a list of instances */
@@ -1092,15 +1277,30 @@ lwm2m_engine_handler(const lwm2m_object_t *object,
       REST.set_response_status(response, METHOD_NOT_ALLOWED_4_05);
     } else {
       int rdlen;
-      PRINTF("Sending instance list for object %u\n", object->id);
-      /* TODO: if(accept == APPLICATION_LINK_FORMAT) { */
-      rdlen = write_object_instances_link(object, (char *)buffer, preferred_size);
+      if(accept == LWM2M_TLV || accept == LWM2M_JSON ||
+         accept == APPLICATION_JSON) {
+        PRINTF("Sending all instances of object %u\n", object->id);
+        if(accept == LWM2M_TLV) {
+          content_type = LWM2M_TLV;
+          context.writer = &oma_tlv_writer;
+        } else {
+          content_type = LWM2M_JSON;
+          context.writer = &lwm2m_json_entry_writer;
+        }
+        rdlen = write_read_block(object, &context, content_type,
+                                 buffer, preferred_size, offset);
+      } else {
+        PRINTF("Sending instance list for object %u\n", object->id);
+        rdlen = write_object_instances_link(object, (char *)buffer,
+                                            preferred_size);
+        content_type = REST.type.APPLICATION_LINK_FORMAT;
+      }
       if(rdlen < 0) {
         PRINTF("Failed to generate object response\n");
         REST.set_response_status(response, SERVICE_UNAVAILABLE_5_03);
         return;
       }
-      REST.set_header_content_type(response, REST.type.APPLICATION_LINK_FORMAT);
+      REST.set_header_content_type(response, content_type);
       REST.set_response_payload(response, buffer, rdlen);
     }
   }
@@ -44,6 +44,7 @@
 #include "lwm2m-json.h"
 #include "lwm2m-plain-text.h"
 #include <stdio.h>
+#include <string.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <inttypes.h>
@@ -56,11 +57,20 @@
 #endif
 
 /*---------------------------------------------------------------------------*/
+/* Write the start of an entry, up to the value */
 static size_t
-write_boolean(const lwm2m_context_t *ctx, uint8_t *outbuf, size_t outlen,
-              int value)
+write_name(const lwm2m_context_t *ctx, uint8_t *outbuf, size_t outlen,
+           const char *value_name)
 {
-  int len = snprintf((char *)outbuf, outlen, "{\"e\":[{\"n\":\"%u\",\"bv\":%s}]}\n", ctx->resource_id, value ? "true" : "false");
+  int len;
+  if(ctx->level == 1) {
+    /* Object reads name the resources of all instances */
+    len = snprintf((char *)outbuf, outlen, "{\"n\":\"%u/%u\",\"%s\":",
+                   ctx->object_instance_id, ctx->resource_id, value_name);
+  } else {
+    len = snprintf((char *)outbuf, outlen, "{\"n\":\"%u\",\"%s\":",
+                   ctx->resource_id, value_name);
+  }
   if((len < 0) || (len >= outlen)) {
     return 0;
   }
@@ -68,55 +78,76 @@ write_boolean(const lwm2m_context_t *ctx, uint8_t *outbuf, size_t outlen,
 }
 /*---------------------------------------------------------------------------*/
 static size_t
-write_int(const lwm2m_context_t *ctx, uint8_t *outbuf, size_t outlen,
-          int32_t value)
+write_boolean_entry(const lwm2m_context_t *ctx, uint8_t *outbuf,
+                    size_t outlen, int value)
 {
-  int len = snprintf((char *)outbuf, outlen, "{\"e\":[{\"n\":\"%u\",\"v\":%" PRId32 "}]}\n", ctx->resource_id, value);
-  if((len < 0) || (len >= outlen)) {
+  size_t len;
+  int res;
+  len = write_name(ctx, outbuf, outlen, "bv");
+  if(len == 0) {
     return 0;
   }
-  return len;
+  res = snprintf((char *)&outbuf[len], outlen - len, "%s}",
+                 value ? "true" : "false");
+  if((res < 0) || (res >= outlen - len)) {
+    return 0;
+  }
+  return len + res;
 }
 /*---------------------------------------------------------------------------*/
 static size_t
-write_float32fix(const lwm2m_context_t *ctx, uint8_t *outbuf, size_t outlen,
-                 int32_t value, int bits)
+write_int_entry(const lwm2m_context_t *ctx, uint8_t *outbuf, size_t outlen,
+                int32_t value)
 {
-  size_t len = 0;
+  size_t len;
   int res;
-  res = snprintf((char *)outbuf, outlen, "{\"e\":[{\"n\":\"%u\",\"v\":", ctx->resource_id);
-  if(res <= 0 || res >= outlen) {
+  len = write_name(ctx, outbuf, outlen, "v");
+  if(len == 0) {
     return 0;
   }
-  len += res;
-  outlen -= res;
-  res = lwm2m_plain_text_write_float32fix(&outbuf[len], outlen, value, bits);
-  if((res <= 0) || (res >= outlen)) {
+  res = snprintf((char *)&outbuf[len], outlen - len, "%" PRId32 "}", value);
+  if((res < 0) || (res >= outlen - len)) {
     return 0;
   }
-  len += res;
-  outlen -= res;
-  res = snprintf((char *)&outbuf[len], outlen, "}]}\n");
-  if((res <= 0) || (res >= outlen)) {
+  return len + res;
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+write_float32fix_entry(const lwm2m_context_t *ctx, uint8_t *outbuf,
+                       size_t outlen, int32_t value, int bits)
+{
+  size_t len;
+  int res;
+  len = write_name(ctx, outbuf, outlen, "v");
+  if(len == 0) {
+    return 0;
+  }
+  res = lwm2m_plain_text_write_float32fix(&outbuf[len], outlen - len,
+                                          value, bits);
+  if((res <= 0) || (res >= outlen - len)) {
     return 0;
   }
   len += res;
+  if(len + 1 >= outlen) {
+    return 0;
+  }
+  outbuf[len++] = '}';
   return len;
 }
 /*---------------------------------------------------------------------------*/
 static size_t
-write_string(const lwm2m_context_t *ctx, uint8_t *outbuf, size_t outlen,
-             const char *value, size_t stringlen)
+write_string_entry(const lwm2m_context_t *ctx, uint8_t *outbuf,
+                   size_t outlen, const char *value, size_t stringlen)
 {
   size_t i;
-  size_t len = 0;
+  size_t len;
   int res;
-  PRINTF("{\"e\":[{\"n\":\"%u\",\"sv\":\"", ctx->resource_id);
-  res = snprintf((char *)outbuf, outlen, "{\"e\":[{\"n\":\"%u\",\"sv\":\"", ctx->resource_id);
-  if(res < 0 || res >= outlen) {
+  len = write_name(ctx, outbuf, outlen, "sv");
+  if(len == 0 || len + 1 >= outlen) {
     return 0;
   }
-  len += res;
+  PRINTF("{\"n\":\"%u\",\"sv\":\"", ctx->resource_id);
+  outbuf[len++] = '"';
   for (i = 0; i < stringlen && len < outlen; ++i) {
     /* Escape special characters */
     /* TODO: Handle UTF-8 strings */
@@ -143,13 +174,83 @@ write_string(const lwm2m_context_t *ctx, uint8_t *outbuf, size_t outlen,
       return 0;
     }
   }
-  PRINTF("\"}]}\n");
-  res = snprintf((char *)&outbuf[len], outlen - len, "\"}]}\n");
+  PRINTF("\"}");
+  res = snprintf((char *)&outbuf[len], outlen - len, "\"}");
   if((res < 0) || (res >= (outlen - len))) {
     return 0;
   }
-  len += res;
-  return len;
+  return len + res;
+}
+/*---------------------------------------------------------------------------*/
+/* Wrap a single entry in a document */
+static size_t
+write_document(uint8_t *outbuf, size_t outlen, size_t entry_len)
+{
+  size_t len;
+  if(entry_len == 0) {
+    return 0;
+  }
+  len = LWM2M_JSON_BEGIN_LEN + entry_len;
+  if(len + LWM2M_JSON_END_LEN + 1 >= outlen) {
+    return 0;
+  }
+  memcpy(outbuf, LWM2M_JSON_BEGIN, LWM2M_JSON_BEGIN_LEN);
+  memcpy(&outbuf[len], LWM2M_JSON_END "\n", LWM2M_JSON_END_LEN + 1);
+  return len + LWM2M_JSON_END_LEN + 1;
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+write_boolean(const lwm2m_context_t *ctx, uint8_t *outbuf, size_t outlen,
+              int value)
+{
+  if(outlen <= LWM2M_JSON_BEGIN_LEN) {
+    return 0;
+  }
+  return write_document(outbuf, outlen,
+                        write_boolean_entry(ctx,
+                                            &outbuf[LWM2M_JSON_BEGIN_LEN],
+                                            outlen - LWM2M_JSON_BEGIN_LEN,
+                                            value));
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+write_int(const lwm2m_context_t *ctx, uint8_t *outbuf, size_t outlen,
+          int32_t value)
+{
+  if(outlen <= LWM2M_JSON_BEGIN_LEN) {
+    return 0;
+  }
+  return write_document(outbuf, outlen,
+                        write_int_entry(ctx, &outbuf[LWM2M_JSON_BEGIN_LEN],
+                                        outlen - LWM2M_JSON_BEGIN_LEN,
+                                        value));
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+write_float32fix(const lwm2m_context_t *ctx, uint8_t *outbuf, size_t outlen,
+                 int32_t value, int bits)
+{
+  if(outlen <= LWM2M_JSON_BEGIN_LEN) {
+    return 0;
+  }
+  return write_document(outbuf, outlen,
+                        write_float32fix_entry(ctx,
+                                               &outbuf[LWM2M_JSON_BEGIN_LEN],
+                                               outlen - LWM2M_JSON_BEGIN_LEN,
+                                               value, bits));
+}
+/*---------------------------------------------------------------------------*/
+static size_t
+write_string(const lwm2m_context_t *ctx, uint8_t *outbuf, size_t outlen,
+             const char *value, size_t stringlen)
+{
+  if(outlen <= LWM2M_JSON_BEGIN_LEN) {
+    return 0;
+  }
+  return write_document(outbuf, outlen,
+                        write_string_entry(ctx, &outbuf[LWM2M_JSON_BEGIN_LEN],
+                                           outlen - LWM2M_JSON_BEGIN_LEN,
+                                           value, stringlen));
 }
 /*---------------------------------------------------------------------------*/
 const lwm2m_writer_t lwm2m_json_writer = {
@@ -159,4 +260,11 @@ const lwm2m_writer_t lwm2m_json_writer = {
   write_boolean
 };
 /*---------------------------------------------------------------------------*/
+const lwm2m_writer_t lwm2m_json_entry_writer = {
+  write_int_entry,
+  write_string_entry,
+  write_float32fix_entry,
+  write_boolean_entry
+};
+/*---------------------------------------------------------------------------*/
 /** @} */
@@ -45,7 +45,17 @@
 
 #include "lwm2m-object.h"
 
+/* The start and end of a document, around the entries */
+#define LWM2M_JSON_BEGIN     "{\"e\":["
+#define LWM2M_JSON_BEGIN_LEN 6
+#define LWM2M_JSON_END       "]}"
+#define LWM2M_JSON_END_LEN   2
+
+/* Writes complete documents with one entry */
 extern const lwm2m_writer_t lwm2m_json_writer;
 
+/* Writes only the entry, for documents with several resources */
+extern const lwm2m_writer_t lwm2m_json_entry_writer;
+
 #endif /* LWM2M_JSON_H_ */
 /** @} */
@@ -96,6 +96,7 @@ typedef struct lwm2m_context {
   uint8_t object_instance_index;
   uint8_t resource_index;
   /* TODO - add uint16_t resource_instance_id */
+  uint8_t level; /* 1 for an object, 2 for an instance, 3 for a resource */
 
   const struct lwm2m_reader *reader;
   const struct lwm2m_writer *writer;
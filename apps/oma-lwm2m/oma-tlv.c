@@ -118,17 +118,17 @@ oma_tlv_get_size(const oma_tlv_t *tlv)
 }
 /*---------------------------------------------------------------------------*/
 size_t
-oma_tlv_write(const oma_tlv_t *tlv, uint8_t *buffer, size_t len)
+oma_tlv_write_header(const oma_tlv_t *tlv, uint8_t *buffer, size_t len)
 {
   int pos;
   uint8_t len_type;
 
   /* len type is the same as number of bytes required for length */
   len_type = get_len_type(tlv);
-  pos = 1 + len_type;
+  pos = 1 + len_type + (tlv->id > 255 ? 2 : 1);
   /* ensure that we do not write too much */
-  if(len < tlv->length + pos) {
-    PRINTF("OMA-TLV: Could not write the TLV - buffer overflow.\n");
+  if(len < pos) {
+    PRINTF("OMA-TLV: Could not write the TLV header - buffer overflow.\n");
     return 0;
   }
 
@@ -154,6 +154,21 @@ oma_tlv_write(const oma_tlv_t *tlv, uint8_t *buffer, size_t len)
   if(len_type > 0) {
     buffer[pos++] = tlv->length & 0xff;
   }
+  return pos;
+}
+/*---------------------------------------------------------------------------*/
+size_t
+oma_tlv_write(const oma_tlv_t *tlv, uint8_t *buffer, size_t len)
+{
+  int pos;
+
+  /* ensure that we do not write too much */
+  if(len < oma_tlv_get_size(tlv)) {
+    PRINTF("OMA-TLV: Could not write the TLV - buffer overflow.\n");
+    return 0;
+  }
+
+  pos = oma_tlv_write_header(tlv, buffer, len);
 
   /* finally add the value */
   memcpy(&buffer[pos], tlv->value, tlv->length);
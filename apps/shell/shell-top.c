@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2016, Thingsquare, http://www.thingsquare.com/.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file
+ *         A shell command that lists the processes and rtimer callbacks
+ *         that have used the most CPU time
+ */
+
+#include "contiki.h"
+#include "shell-top.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifndef SHELL_TOP_CONF_ENTRIES
+#define SHELL_TOP_ENTRIES 8
+#else
+#define SHELL_TOP_ENTRIES SHELL_TOP_CONF_ENTRIES
+#endif
+
+/*---------------------------------------------------------------------------*/
+PROCESS(shell_top_process, "top");
+SHELL_COMMAND(top_command,
+	      "top",
+	      "top [reset]: list the processes that have used the most CPU time",
+	      &shell_top_process);
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(shell_top_process, ev, data)
+{
+#if ENERGEST_ACCOUNTING
+  static struct energest_account top[SHELL_TOP_ENTRIES];
+  char buf[40];
+  int i, n;
+#endif /* ENERGEST_ACCOUNTING */
+  PROCESS_BEGIN();
+
+#if ENERGEST_ACCOUNTING
+  if(data != NULL && strcmp(data, "reset") == 0) {
+    energest_accounting_reset();
+    PROCESS_EXIT();
+  }
+
+  n = energest_accounting_top(top, SHELL_TOP_ENTRIES);
+  snprintf(buf, sizeof(buf), "%lu ticks per second",
+           (unsigned long)ENERGEST_ACCOUNTING_SECOND);
+  shell_output_str(&top_command, buf, "");
+  shell_output_str(&top_command, "     ticks      calls name", "");
+  for(i = 0; i < n; i++) {
+    snprintf(buf, sizeof(buf), "%10lu %10lu ", top[i].time, top[i].count);
+    if(top[i].process != NULL) {
+      shell_output_str(&top_command, buf,
+                       PROCESS_NAME_STRING(top[i].process));
+    } else {
+      snprintf(buf + strlen(buf), sizeof(buf) - strlen(buf),
+               "rtimer %p", (void *)(uintptr_t)top[i].callback);
+      shell_output_str(&top_command, buf, "");
+    }
+  }
+#else /* ENERGEST_ACCOUNTING */
+  shell_output_str(&top_command,
+                   "top: compiled without ENERGEST_CONF_ACCOUNTING", "");
+#endif /* ENERGEST_ACCOUNTING */
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+void
+shell_top_init(void)
+{
+  shell_register_command(&top_command);
+}
+/*---------------------------------------------------------------------------*/
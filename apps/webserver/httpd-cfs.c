@@ -71,24 +71,37 @@ MEMB(conns, struct httpd_state, CONNS);
 #define ISO_period  0x2e
 #define ISO_slash   0x2f
 
+/*---------------------------------------------------------------------------*/
+static unsigned short
+generate(void *state)
+{
+  struct httpd_state *s = (struct httpd_state *)state;
+
+  /* Read the next segment straight into the packet buffer. The
+     segment is read again from the same offset if it has to be
+     retransmitted. */
+  if(cfs_seek(s->fd, s->offset, CFS_SEEK_SET) != s->offset) {
+    s->len = 0;
+  } else {
+    s->len = cfs_read(s->fd, uip_appdata, uip_mss());
+    if(s->len < 0) {
+      s->len = 0;
+    }
+  }
+  return s->len;
+}
 /*---------------------------------------------------------------------------*/
 static
 PT_THREAD(send_file(struct httpd_state *s))
 {
   PSOCK_BEGIN(&s->sout);
-  
-  do {
-    /* Read data from file system into buffer */
-    s->len = cfs_read(s->fd, s->outputbuf, sizeof(s->outputbuf));
 
-    /* If there is data in the buffer, send it */
-    if(s->len > 0) {
-      PSOCK_SEND(&s->sout, (uint8_t *)s->outputbuf, s->len);
-    } else {
-      break;
-    }
+  s->offset = 0;
+  do {
+    PSOCK_GENERATOR_SEND(&s->sout, generate, s);
+    s->offset += s->len;
   } while(s->len > 0);
-      
+
   PSOCK_END(&s->sout);
 }
 /*---------------------------------------------------------------------------*/
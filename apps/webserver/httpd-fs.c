@@ -32,6 +32,8 @@
  *
  */
 
+#include <string.h>
+
 #include "contiki-net.h"
 #include "httpd.h"
 #include "httpd-fs.h"
@@ -39,8 +41,25 @@
 
 #include "httpd-fsdata.c"
 
+#ifdef WEBSERVER_CONF_FS_HASH
+#define FS_HASH WEBSERVER_CONF_FS_HASH
+#else /* WEBSERVER_CONF_FS_HASH */
+#define FS_HASH 1
+#endif /* WEBSERVER_CONF_FS_HASH */
+
+/* Older fsdata files come without the hash index */
+#ifndef HTTPD_FS_HASH_SIZE
+#undef FS_HASH
+#define FS_HASH 0
+#endif /* HTTPD_FS_HASH_SIZE */
+
 #if HTTPD_FS_STATISTICS
+#if FS_HASH
+/* Counts are kept per hash slot, which is unique to each file */
+static uint16_t count[HTTPD_FS_HASH_SIZE];
+#else /* FS_HASH */
 static uint16_t count[HTTPD_FS_NUMFILES];
+#endif /* FS_HASH */
 #endif /* HTTPD_FS_STATISTICS */
 
 /*-----------------------------------------------------------------------------------*/
@@ -65,32 +84,77 @@ loop:
   goto loop;
 }
 /*-----------------------------------------------------------------------------------*/
-int
-httpd_fs_open(const char *name, struct httpd_fs_file *file)
+#if FS_HASH
+/* Must match namehash() in tools/makefsdata. The length of the name
+   is returned in len. */
+static uint16_t
+httpd_fs_hash(const char *name, uint8_t *len)
+{
+  uint16_t h;
+  uint8_t i;
+
+  h = HTTPD_FS_HASH_SEED;
+  for(i = 0; name[i] != 0 && name[i] != '\r' && name[i] != '\n'; i++) {
+    h = (h << 5) + h + (uint8_t)name[i];
+  }
+  *len = i;
+  return (h ^ (h >> 8)) & (HTTPD_FS_HASH_SIZE - 1);
+}
+#endif /* FS_HASH */
+/*-----------------------------------------------------------------------------------*/
+static struct httpd_fsdata_file_noconst *
+httpd_fs_find(const char *name, uint16_t *index)
 {
-#if HTTPD_FS_STATISTICS
-  uint16_t i = 0;
-#endif /* HTTPD_FS_STATISTICS */
   struct httpd_fsdata_file_noconst *f;
+  uint16_t i;
+#if FS_HASH
+  uint8_t len;
+
+  /* Names are looked up in the index that makefsdata generated. Names
+     that only start with the name of a file, such as names followed
+     by a query string, miss it and are found by walking the list. */
+  i = httpd_fs_hash(name, &len);
+  f = (struct httpd_fsdata_file_noconst *)httpd_fsdata_hash[i];
+  if(f != NULL && strncmp(name, f->name, len) == 0 && f->name[len] == 0) {
+    *index = i;
+    return f;
+  }
+#endif /* FS_HASH */
 
+  i = 0;
   for(f = (struct httpd_fsdata_file_noconst *)HTTPD_FS_ROOT;
       f != NULL;
       f = (struct httpd_fsdata_file_noconst *)f->next) {
 
     if(httpd_fs_strcmp(name, f->name) == 0) {
-      file->data = f->data;
-      file->len = f->len;
-#if HTTPD_FS_STATISTICS
-      ++count[i];
-#endif /* HTTPD_FS_STATISTICS */
-      return 1;
+#if FS_HASH
+      *index = httpd_fs_hash(f->name, &len);
+#else /* FS_HASH */
+      *index = i;
+#endif /* FS_HASH */
+      return f;
     }
-#if HTTPD_FS_STATISTICS
     ++i;
-#endif /* HTTPD_FS_STATISTICS */
+  }
+  return NULL;
+}
+/*-----------------------------------------------------------------------------------*/
+int
+httpd_fs_open(const char *name, struct httpd_fs_file *file)
+{
+  struct httpd_fsdata_file_noconst *f;
+  uint16_t i;
 
+  f = httpd_fs_find(name, &i);
+  if(f == NULL) {
+    return 0;
   }
-  return 0;
+  file->data = f->data;
+  file->len = f->len;
+#if HTTPD_FS_STATISTICS
+  ++count[i];
+#endif /* HTTPD_FS_STATISTICS */
+  return 1;
 }
 /*-----------------------------------------------------------------------------------*/
 void
@@ -98,7 +162,7 @@ httpd_fs_init(void)
 {
 #if HTTPD_FS_STATISTICS
   uint16_t i;
-  for(i = 0; i < HTTPD_FS_NUMFILES; i++) {
+  for(i = 0; i < sizeof(count) / sizeof(count[0]); i++) {
     count[i] = 0;
   }
 #endif /* HTTPD_FS_STATISTICS */
@@ -108,20 +172,12 @@ httpd_fs_init(void)
 uint16_t
 httpd_fs_count(char *name)
 {
-  struct httpd_fsdata_file_noconst *f;
   uint16_t i;
 
-  i = 0;
-  for(f = (struct httpd_fsdata_file_noconst *)HTTPD_FS_ROOT;
-      f != NULL;
-      f = (struct httpd_fsdata_file_noconst *)f->next) {
-
-    if(httpd_fs_strcmp(name, f->name) == 0) {
-      return count[i];
-    }
-    ++i;
+  if(httpd_fs_find(name, &i) == NULL) {
+    return 0;
   }
-  return 0;
+  return count[i];
 }
 #endif /* HTTPD_FS_STATISTICS */
 /*-----------------------------------------------------------------------------------*/
@@ -673,3 +673,25 @@ const struct httpd_fsdata_file       file_style_css[] ={{       file_404_html, d
 #define HTTPD_FS_ROOT  file_style_css
 #define HTTPD_FS_NUMFILES  10
 #define HTTPD_FS_SIZE 6166
+
+#define HTTPD_FS_HASH_SEED 70
+#define HTTPD_FS_HASH_SIZE 16
+
+const struct httpd_fsdata_file *const httpd_fsdata_hash[HTTPD_FS_HASH_SIZE] = {
+  file_tcp_shtml,
+  file_status_shtml,
+  NULL,
+  NULL,
+  file_footer_html,
+  NULL,
+  file_upload_html,
+  file_header_html,
+  NULL,
+  file_processes_shtml,
+  file_index_html,
+  file_404_html,
+  file_files_shtml,
+  NULL,
+  NULL,
+  file_style_css
+};
@@ -32,8 +32,6 @@
 #include "dev/serial-line.h"
 #include <string.h> /* for memcpy() */
 
-#include "lib/ringbuf.h"
-
 #ifdef SERIAL_LINE_CONF_BUFSIZE
 #define BUFSIZE SERIAL_LINE_CONF_BUFSIZE
 #else /* SERIAL_LINE_CONF_BUFSIZE */
@@ -45,6 +43,17 @@
 #error Change SERIAL_LINE_CONF_BUFSIZE in contiki-conf.h.
 #endif
 
+/* The ringbuf library holds at most 128 bytes */
+#if BUFSIZE > 128
+#include "lib/ringbuf16.h"
+#define ringbuf ringbuf16
+#define ringbuf_init ringbuf16_init
+#define ringbuf_put ringbuf16_put
+#define ringbuf_get ringbuf16_get
+#else /* BUFSIZE > 128 */
+#include "lib/ringbuf.h"
+#endif /* BUFSIZE > 128 */
+
 #define IGNORE_CHAR(c) (c == 0x0d)
 #define END 0x0a
 
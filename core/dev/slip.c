@@ -154,6 +154,54 @@ rxbuf_init(void)
   state = STATE_OK;
 }
 /*---------------------------------------------------------------------------*/
+/*
+ * Decodes a span of a packet in rxbuf to outbuf at len. Runs of bytes
+ * without escapes are copied at once. Returns the new length, or -1
+ * if the packet does not fit in blen bytes.
+ */
+static int
+unslip(const uint8_t *span, uint16_t n, uint8_t *outbuf, int len,
+       uint16_t blen, uint8_t *esc)
+{
+  const uint8_t *end;
+  const uint8_t *next;
+
+  if(len < 0) {
+    return len;
+  }
+  end = span + n;
+  while(span < end) {
+    if(*esc) {
+      if(len == blen) {
+        return -1;
+      }
+      if(*span == SLIP_ESC_ESC) {
+        outbuf[len++] = SLIP_ESC;
+      } else if(*span == SLIP_ESC_END) {
+        outbuf[len++] = SLIP_END;
+      }
+      *esc = 0;
+      span++;
+      continue;
+    }
+    next = memchr(span, SLIP_ESC, end - span);
+    if(next == NULL) {
+      next = end;
+    }
+    if(next - span > blen - len) {
+      return -1;
+    }
+    memcpy(&outbuf[len], span, next - span);
+    len += next - span;
+    if(next < end) {
+      *esc = 1;
+      next++;
+    }
+    span = next;
+  }
+  return len;
+}
+/*---------------------------------------------------------------------------*/
 /* Upper half does the polling. */
 static uint16_t
 slip_poll_handler(uint8_t *outbuf, uint16_t blen)
@@ -209,80 +257,21 @@ slip_poll_handler(uint8_t *outbuf, uint16_t blen)
    * If pkt_end != begin it will not change again.
    */
   if(begin != pkt_end) {
-    uint16_t len;
+    int len;
     uint16_t cur_next_free;
     uint16_t cur_ptr;
-    int esc = 0;
+    uint8_t esc = 0;
 
+    /* The packet is at most two spans: up to the end of rxbuf and
+       from its start. */
     if(begin < pkt_end) {
-      uint16_t i;
-      len = 0;
-      for(i = begin; i < pkt_end; ++i) {
-        if(len > blen) {
-          len = 0;
-          break;
-        }
-        if (esc) {
-          if(rxbuf[i] == SLIP_ESC_ESC) {
-            outbuf[len] = SLIP_ESC;
-            len++;
-          } else if(rxbuf[i] == SLIP_ESC_END) {
-            outbuf[len] = SLIP_END;
-            len++;
-          }
-          esc = 0;
-        } else if(rxbuf[i] == SLIP_ESC) {
-          esc = 1;
-        } else {
-          outbuf[len] = rxbuf[i];
-          len++;
-        }
-      }
+      len = unslip(&rxbuf[begin], pkt_end - begin, outbuf, 0, blen, &esc);
     } else {
-      uint16_t i;
+      len = unslip(&rxbuf[begin], RX_BUFSIZE - begin, outbuf, 0, blen, &esc);
+      len = unslip(rxbuf, pkt_end, outbuf, len, blen, &esc);
+    }
+    if(len < 0) {
       len = 0;
-      for(i = begin; i < RX_BUFSIZE; ++i) {
-        if(len > blen) {
-          len = 0;
-          break;
-        }
-        if (esc) {
-          if(rxbuf[i] == SLIP_ESC_ESC) {
-            outbuf[len] = SLIP_ESC;
-            len++;
-          } else if(rxbuf[i] == SLIP_ESC_END) {
-            outbuf[len] = SLIP_END;
-            len++;
-          }
-          esc = 0;
-        } else if(rxbuf[i] == SLIP_ESC) {
-          esc = 1;
-        } else {
-          outbuf[len] = rxbuf[i];
-          len++;
-        }
-      }
-      for(i = 0; i < pkt_end; ++i) {
-        if(len > blen) {
-          len = 0;
-          break;
-        }
-        if (esc) {
-          if(rxbuf[i] == SLIP_ESC_ESC) {
-            outbuf[len] = SLIP_ESC;
-            len++;
-          } else if(rxbuf[i] == SLIP_ESC_END) {
-            outbuf[len] = SLIP_END;
-            len++;
-          }
-          esc = 0;
-        } else if(rxbuf[i] == SLIP_ESC) {
-          esc = 1;
-        } else {
-          outbuf[len] = rxbuf[i];
-          len++;
-        }
-      }
     }
 
     /* Remove data from buffer together with the copied packet. */
@@ -457,3 +446,63 @@ slip_input_byte(unsigned char c)
   return 0;
 }
 /*---------------------------------------------------------------------------*/
+#ifndef SLIP_CONF_MICROSOFT_CHAT
+/* Returns the number of bytes before the first SLIP_END or SLIP_ESC */
+static uint16_t
+plain(const uint8_t *data, uint16_t len)
+{
+  const uint8_t *p;
+
+  p = memchr(data, SLIP_END, len);
+  if(p != NULL) {
+    len = p - data;
+  }
+  p = memchr(data, SLIP_ESC, len);
+  if(p != NULL) {
+    len = p - data;
+  }
+  return len;
+}
+#endif /* SLIP_CONF_MICROSOFT_CHAT */
+/*---------------------------------------------------------------------------*/
+int
+slip_input(const uint8_t *data, uint16_t len)
+{
+  const uint8_t *end;
+#ifndef SLIP_CONF_MICROSOFT_CHAT
+  uint16_t room;
+  uint16_t n;
+#endif /* SLIP_CONF_MICROSOFT_CHAT */
+  int ret;
+
+  ret = 0;
+  end = data + len;
+  while(data < end) {
+#ifndef SLIP_CONF_MICROSOFT_CHAT
+    if(state == STATE_OK) {
+      /* Copy the run of plain bytes that fits before the end of rxbuf
+         and before begin, leaving the byte that fills the buffer to
+         slip_input_byte() */
+      if(next_free >= begin) {
+        room = RX_BUFSIZE - next_free - (begin == 0);
+      } else {
+        room = begin - next_free - 1;
+      }
+      n = end - data < room ? end - data : room;
+      n = plain(data, n);
+      if(n > 0) {
+        memcpy(&rxbuf[next_free], data, n);
+        next_free += n;
+        if(next_free == RX_BUFSIZE) {
+          next_free = 0;
+        }
+        data += n;
+        continue;
+      }
+    }
+#endif /* SLIP_CONF_MICROSOFT_CHAT */
+    ret |= slip_input_byte(*data++);
+  }
+  return ret;
+}
+/*---------------------------------------------------------------------------*/
@@ -62,6 +62,21 @@ uint8_t slip_send(void);
  */
 int slip_input_byte(unsigned char c);
 
+/**
+ * Input a span of SLIP bytes.
+ *
+ * This function is the same as calling slip_input_byte() for each
+ * byte, but copies runs of bytes that need no decoding at once. It is
+ * meant for drivers that receive many bytes at a time, such as from
+ * DMA or a FIFO, and can be called from an interrupt context.
+ *
+ * \param data The bytes
+ * \param len The number of bytes
+ *
+ * \return Non-zero if the CPU should be powered up, zero otherwise.
+ */
+int slip_input(const uint8_t *data, uint16_t len);
+
 uint8_t slip_write(const void *ptr, int len);
 
 /* Did we receive any bytes lately? */
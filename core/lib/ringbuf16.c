@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) 2016, Thingsquare, http://www.thingsquare.com/.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file
+ *         Ring buffer library with 16-bit sizes
+ */
+
+#include "lib/ringbuf16.h"
+#include "sys/cc.h"
+
+#include <string.h>
+
+#define POSITION(ptr) CC_ACCESS_NOW(uint16_t, ptr)
+/*---------------------------------------------------------------------------*/
+void
+ringbuf16_init(struct ringbuf16 *r, uint8_t *dataptr, uint16_t size)
+{
+  r->data = dataptr;
+  r->mask = size - 1;
+  r->put_ptr = 0;
+  r->get_ptr = 0;
+}
+/*---------------------------------------------------------------------------*/
+int
+ringbuf16_put(struct ringbuf16 *r, uint8_t c)
+{
+  uint16_t put;
+
+  put = r->put_ptr;
+  if((uint16_t)(put - POSITION(r->get_ptr)) > r->mask) {
+    return 0;
+  }
+  /* The byte must be in the buffer before the reader sees the new
+     position. The barrier also keeps the read of the get position
+     before the write, so that the byte is not written before the
+     reader is done with it. */
+  CC_MEMORY_BARRIER();
+  r->data[put & r->mask] = c;
+  CC_MEMORY_BARRIER();
+  POSITION(r->put_ptr) = put + 1;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+ringbuf16_get(struct ringbuf16 *r)
+{
+  uint16_t get;
+  uint8_t c;
+
+  get = r->get_ptr;
+  if(POSITION(r->put_ptr) == get) {
+    return -1;
+  }
+  /* The byte must be read after the put position, and before the
+     writer sees the new get position. */
+  CC_MEMORY_BARRIER();
+  c = r->data[get & r->mask];
+  CC_MEMORY_BARRIER();
+  POSITION(r->get_ptr) = get + 1;
+  return c;
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+ringbuf16_peek_put(struct ringbuf16 *r, uint8_t **ptr)
+{
+  uint16_t put, len, end;
+
+  put = r->put_ptr;
+  len = r->mask + 1 - (uint16_t)(put - POSITION(r->get_ptr));
+  end = r->mask + 1 - (put & r->mask);
+  CC_MEMORY_BARRIER();
+  *ptr = &r->data[put & r->mask];
+  return len < end ? len : end;
+}
+/*---------------------------------------------------------------------------*/
+void
+ringbuf16_commit_put(struct ringbuf16 *r, uint16_t len)
+{
+  CC_MEMORY_BARRIER();
+  POSITION(r->put_ptr) = r->put_ptr + len;
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+ringbuf16_peek_get(struct ringbuf16 *r, const uint8_t **ptr)
+{
+  uint16_t get, len, end;
+
+  get = r->get_ptr;
+  len = POSITION(r->put_ptr) - get;
+  end = r->mask + 1 - (get & r->mask);
+  CC_MEMORY_BARRIER();
+  *ptr = &r->data[get & r->mask];
+  return len < end ? len : end;
+}
+/*---------------------------------------------------------------------------*/
+void
+ringbuf16_commit_get(struct ringbuf16 *r, uint16_t len)
+{
+  CC_MEMORY_BARRIER();
+  POSITION(r->get_ptr) = r->get_ptr + len;
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+ringbuf16_put_n(struct ringbuf16 *r, const uint8_t *data, uint16_t len)
+{
+  uint8_t *ptr;
+  uint16_t n, done;
+
+  /* At most two contiguous regions: up to the end of the buffer and
+     from its start */
+  for(done = 0; done < len; done += n) {
+    n = ringbuf16_peek_put(r, &ptr);
+    if(n == 0) {
+      break;
+    }
+    if(n > len - done) {
+      n = len - done;
+    }
+    memcpy(ptr, &data[done], n);
+    ringbuf16_commit_put(r, n);
+  }
+  return done;
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+ringbuf16_get_n(struct ringbuf16 *r, uint8_t *data, uint16_t len)
+{
+  const uint8_t *ptr;
+  uint16_t n, done;
+
+  for(done = 0; done < len; done += n) {
+    n = ringbuf16_peek_get(r, &ptr);
+    if(n == 0) {
+      break;
+    }
+    if(n > len - done) {
+      n = len - done;
+    }
+    memcpy(&data[done], ptr, n);
+    ringbuf16_commit_get(r, n);
+  }
+  return done;
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+ringbuf16_size(const struct ringbuf16 *r)
+{
+  return r->mask + 1;
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+ringbuf16_elements(const struct ringbuf16 *r)
+{
+  return POSITION(r->put_ptr) - POSITION(r->get_ptr);
+}
+/*---------------------------------------------------------------------------*/
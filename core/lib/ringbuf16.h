@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2016, Thingsquare, http://www.thingsquare.com/.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file
+ *         Header file for the 16-bit ring buffer library
+ */
+
+/** \addtogroup lib
+ * @{ */
+
+/**
+ * \defgroup ringbuf16 Ring buffer library with 16-bit sizes
+ * @{
+ *
+ * The ringbuf16 library is a ring buffer of bytes for one writer and
+ * one reader, such as a UART interrupt handler and a process. Unlike
+ * the \ref ringbuf "ringbuf" library, the buffer can be up to 32768
+ * bytes, it uses all of its bytes, and bytes can be written and read
+ * many at a time. A DMA-fed driver can get the contiguous free space
+ * at the write position with ringbuf16_peek_put(), have the DMA fill
+ * it, and then add it with ringbuf16_commit_put(). The reader can do
+ * the same with ringbuf16_peek_get() and ringbuf16_commit_get().
+ *
+ * The writer only changes the put position and the reader only the
+ * get position, and each is changed after the data is written or
+ * read, with a CC_MEMORY_BARRIER() in between. Each position must be
+ * read and written atomically, which holds for 16-bit values on
+ * 16-bit and 32-bit CPUs. On 8-bit CPUs, the writer or the reader
+ * must run with interrupts disabled.
+ */
+
+#ifndef RINGBUF16_H_
+#define RINGBUF16_H_
+
+#include "contiki-conf.h"
+
+/**
+ * \brief      Structure that holds the state of a ring buffer.
+ *
+ *             The positions run freely and are masked when the
+ *             buffer is accessed, so that a full buffer can be told
+ *             apart from an empty one.
+ */
+struct ringbuf16 {
+  uint8_t *data;
+  uint16_t mask;
+  uint16_t put_ptr, get_ptr;
+};
+
+/**
+ * \brief      Initialize a ring buffer
+ * \param r    A pointer to a struct ringbuf16 to hold the state of the ring buffer
+ * \param a    A pointer to an array to hold the data in the buffer
+ * \param size_power_of_two The size of the ring buffer, a power of two of at most 32768
+ */
+void ringbuf16_init(struct ringbuf16 *r, uint8_t *a,
+                    uint16_t size_power_of_two);
+
+/**
+ * \brief      Insert a byte into the ring buffer
+ * \param r    A pointer to a struct ringbuf16
+ * \param c    The byte to be written to the buffer
+ * \return     Non-zero if the byte could be written, or zero if the buffer was full
+ */
+int ringbuf16_put(struct ringbuf16 *r, uint8_t c);
+
+/**
+ * \brief      Get a byte from the ring buffer
+ * \param r    A pointer to a struct ringbuf16
+ * \return     The byte, or -1 if the buffer was empty
+ */
+int ringbuf16_get(struct ringbuf16 *r);
+
+/**
+ * \brief      Insert bytes into the ring buffer
+ * \param r    A pointer to a struct ringbuf16
+ * \param data The bytes to be written
+ * \param len  The number of bytes
+ * \return     The number of bytes written, less than len if the buffer got full
+ */
+uint16_t ringbuf16_put_n(struct ringbuf16 *r, const uint8_t *data,
+                         uint16_t len);
+
+/**
+ * \brief      Get bytes from the ring buffer
+ * \param r    A pointer to a struct ringbuf16
+ * \param data A buffer for the bytes
+ * \param len  The most bytes to get
+ * \return     The number of bytes copied to data
+ */
+uint16_t ringbuf16_get_n(struct ringbuf16 *r, uint8_t *data, uint16_t len);
+
+/**
+ * \brief      Get the contiguous free space at the put position
+ * \param r    A pointer to a struct ringbuf16
+ * \param ptr  Set to the start of the space
+ * \return     The number of bytes that can be written at *ptr
+ *
+ *             The bytes are added to the buffer by
+ *             ringbuf16_commit_put(). Only the writer may call this.
+ */
+uint16_t ringbuf16_peek_put(struct ringbuf16 *r, uint8_t **ptr);
+
+/**
+ * \brief      Add bytes written at the put position to the buffer
+ * \param r    A pointer to a struct ringbuf16
+ * \param len  The number of bytes, at most what ringbuf16_peek_put() returned
+ */
+void ringbuf16_commit_put(struct ringbuf16 *r, uint16_t len);
+
+/**
+ * \brief      Get the contiguous bytes at the get position
+ * \param r    A pointer to a struct ringbuf16
+ * \param ptr  Set to the first byte
+ * \return     The number of bytes that can be read at *ptr
+ *
+ *             The bytes stay in the buffer until they are removed by
+ *             ringbuf16_commit_get(). Only the reader may call this.
+ */
+uint16_t ringbuf16_peek_get(struct ringbuf16 *r, const uint8_t **ptr);
+
+/**
+ * \brief      Remove bytes from the get position
+ * \param r    A pointer to a struct ringbuf16
+ * \param len  The number of bytes, at most what ringbuf16_peek_get() returned
+ */
+void ringbuf16_commit_get(struct ringbuf16 *r, uint16_t len);
+
+/**
+ * \brief      Get the size of a ring buffer
+ * \param r    A pointer to a struct ringbuf16
+ * \return     The size of the buffer
+ */
+uint16_t ringbuf16_size(const struct ringbuf16 *r);
+
+/**
+ * \brief      Get the number of bytes currently in the ring buffer
+ * \param r    A pointer to a struct ringbuf16
+ * \return     The number of bytes in the buffer
+ */
+uint16_t ringbuf16_elements(const struct ringbuf16 *r);
+
+#endif /* RINGBUF16_H_ */
+
+/** @}*/
+/** @}*/
@@ -0,0 +1,915 @@
+/*
+ * Copyright (c) 2016, Thingsquare, http://www.thingsquare.com/.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file
+ *         Log-structured backend for the settings manager
+ *
+ *         Values are appended to a log in one of two banks of the
+ *         settings area. A value that is set again or deleted is
+ *         superseded by a later record instead of being rewritten in
+ *         place, and an index in RAM points at the record of every
+ *         current value. When a bank fills up, the current values are
+ *         copied to the other bank, which then becomes the active one.
+ */
+
+#ifdef SETTINGS_CONF_SKIP_CONVENIENCE_FUNCS
+#undef SETTINGS_CONF_SKIP_CONVENIENCE_FUNCS
+#endif
+
+#define SETTINGS_CONF_SKIP_CONVENIENCE_FUNCS 1
+
+#include "contiki.h"
+#include "settings.h"
+#include "dev/eeprom.h"
+
+#if CONTIKI_CONF_SETTINGS_MANAGER && SETTINGS_CONF_LOG
+
+#if !EEPROM_CONF_SIZE
+#error CONTIKI_CONF_SETTINGS_MANAGER has been set, but EEPROM_CONF_SIZE hasnt!
+#endif
+
+#ifndef SETTINGS_MAX_SIZE
+/** The maximum amount EEPROM dedicated to settings, both banks. */
+#define SETTINGS_MAX_SIZE	(256)  /**< Defaults to 256 bytes */
+#endif
+
+#ifndef SETTINGS_TOP_ADDR
+/** The top address in EEPROM that settings should use. Inclusive. */
+#define SETTINGS_TOP_ADDR	(settings_iter_t)(EEPROM_END_ADDR)
+#endif
+
+#ifndef SETTINGS_BOTTOM_ADDR
+/** The lowest address in EEPROM that settings should use. Inclusive. */
+#define SETTINGS_BOTTOM_ADDR	(SETTINGS_TOP_ADDR + 1 - SETTINGS_MAX_SIZE)
+#endif
+
+/* The number of values that the store holds */
+#ifdef SETTINGS_CONF_INDEX_SIZE
+#define INDEX_SIZE SETTINGS_CONF_INDEX_SIZE
+#else
+#define INDEX_SIZE 32
+#endif
+
+/* The number of values that the background compaction copies before
+   it lets other processes run */
+#ifdef SETTINGS_CONF_COMPACT_STEP
+#define COMPACT_STEP SETTINGS_CONF_COMPACT_STEP
+#else
+#define COMPACT_STEP 4
+#endif
+
+#define BANK_SIZE      (SETTINGS_MAX_SIZE / 2)
+#define BANK_START(b)  (SETTINGS_BOTTOM_ADDR + (b) * BANK_SIZE)
+#define BANK_END(b)    (BANK_START(b) + BANK_SIZE)
+#define BANK_FIRST(b)  (BANK_START(b) + sizeof(bank_header_t))
+
+#define BANK_MAGIC     0x4c53  /* "SL" */
+#define BANK_PENDING   0x4c50  /* "PL", a compaction to the bank is going on */
+
+/* Record flags */
+#define RECORD_DELETE  0x01    /* The value is deleted */
+#define RECORD_TXN     0x02    /* Written in a transaction */
+#define RECORD_COMMIT  0x04    /* Commits the transaction before it */
+#define RECORD_ABORT   0x08    /* Discards the transaction before it */
+
+/* The key of commit and abort records */
+#define MARKER_KEY     0
+
+#define COPY_CHUNK     16
+
+#define DEBUG 0
+#if DEBUG
+#include <stdio.h>
+#define PRINTF(...) printf(__VA_ARGS__)
+#else
+#define PRINTF(...)
+#endif
+
+/* Written at the start of a bank when it becomes the active one. The
+   bank with the latest generation is the active one. A compaction
+   marks the bank it copies to as pending, with the generation that it
+   gives the copies. */
+typedef struct {
+  uint16_t magic;
+  uint16_t generation;
+  uint16_t check;
+} bank_header_t;
+
+/* Written after the value, so that a record whose value was not
+   completely written is not seen. The check includes the generation
+   of the bank, so that records left over from an earlier use of the
+   bank are not seen either. */
+typedef struct {
+  settings_key_t key;
+  settings_length_t size;
+  uint8_t order;               /* Orders the values of a key */
+  uint8_t flags;
+  uint16_t check;
+} record_header_t;
+
+/* The index, sorted by key and order */
+struct index_entry {
+  settings_key_t key;
+  eeprom_addr_t addr;
+  settings_length_t size;
+  uint8_t order;
+};
+
+static struct index_entry entries[INDEX_SIZE];
+static uint8_t entries_len;
+
+static uint8_t initialized;
+static uint8_t bank;
+static uint16_t generation;
+static eeprom_addr_t head;
+static settings_length_t live;
+static uint16_t writes;
+
+static uint8_t transaction;
+static uint8_t transaction_written;
+
+static uint8_t compacting;
+static uint8_t compact_pos;
+static uint8_t compact_order;
+static eeprom_addr_t compact_head;
+static uint16_t compact_generation;
+static uint16_t compact_writes;
+
+static struct settings_stats stats;
+
+PROCESS(settings_compact_process, "Settings compaction");
+/*---------------------------------------------------------------------------*/
+static uint16_t
+bank_check(const bank_header_t *h)
+{
+  return ~(h->magic ^ h->generation);
+}
+/*---------------------------------------------------------------------------*/
+static uint16_t
+record_check(const record_header_t *h, uint16_t gen)
+{
+  return ~(h->key ^ h->size ^ ((h->order << 8) | h->flags) ^ gen);
+}
+/*---------------------------------------------------------------------------*/
+/* Reads the record at addr. Returns 0 at the end of the log. */
+static uint8_t
+read_record(eeprom_addr_t addr, record_header_t *h)
+{
+  if(addr + sizeof(*h) > BANK_END(bank)) {
+    return 0;
+  }
+  eeprom_read(addr, (unsigned char *)h, sizeof(*h));
+  return h->check == record_check(h, generation) &&
+    addr + sizeof(*h) + h->size <= BANK_END(bank);
+}
+/*---------------------------------------------------------------------------*/
+/* Returns the position of the first entry that is not before key and
+   order */
+static uint8_t
+lower_bound(settings_key_t key, uint8_t order)
+{
+  uint8_t lo, hi, mid;
+
+  lo = 0;
+  hi = entries_len;
+  while(lo < hi) {
+    mid = (lo + hi) / 2;
+    if(entries[mid].key < key ||
+       (entries[mid].key == key && entries[mid].order < order)) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+/*---------------------------------------------------------------------------*/
+/* Returns the position of value number index of key, or -1 */
+static int
+lookup(settings_key_t key, uint8_t index)
+{
+  int pos;
+
+  pos = lower_bound(key, 0) + index;
+  if(pos < entries_len && entries[pos].key == key) {
+    return pos;
+  }
+  return -1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+lookup_addr(eeprom_addr_t addr)
+{
+  int pos;
+
+  for(pos = 0; pos < entries_len; pos++) {
+    if(entries[pos].addr == addr) {
+      return pos;
+    }
+  }
+  return -1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+index_remove(uint8_t pos)
+{
+  live -= sizeof(record_header_t) + entries[pos].size;
+  memmove(&entries[pos], &entries[pos + 1],
+          (entries_len - pos - 1) * sizeof(entries[0]));
+  entries_len--;
+}
+/*---------------------------------------------------------------------------*/
+/* Points the index at the record of a value, which supersedes the
+   record of the same key and order. Returns 0 if the index is full. */
+static uint8_t
+index_put(settings_key_t key, uint8_t order, eeprom_addr_t addr,
+          settings_length_t size)
+{
+  uint8_t pos;
+
+  pos = lower_bound(key, order);
+  if(pos < entries_len &&
+     entries[pos].key == key && entries[pos].order == order) {
+    live -= sizeof(record_header_t) + entries[pos].size;
+  } else {
+    if(entries_len == INDEX_SIZE) {
+      return 0;
+    }
+    memmove(&entries[pos + 1], &entries[pos],
+            (entries_len - pos) * sizeof(entries[0]));
+    entries_len++;
+    entries[pos].key = key;
+    entries[pos].order = order;
+  }
+  entries[pos].addr = addr;
+  entries[pos].size = size;
+  live += sizeof(record_header_t) + size;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+apply_record(eeprom_addr_t addr, const record_header_t *h)
+{
+  uint8_t pos;
+
+  if(h->flags & RECORD_DELETE) {
+    pos = lower_bound(h->key, h->order);
+    if(pos < entries_len &&
+       entries[pos].key == h->key && entries[pos].order == h->order) {
+      index_remove(pos);
+    }
+  } else if(!index_put(h->key, h->order, addr, h->size)) {
+    PRINTF("settings: no room in the index for 0x%04x\n", h->key);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Tells if the transaction that starts at addr was committed */
+static uint8_t
+committed(eeprom_addr_t addr)
+{
+  record_header_t h;
+
+  while(read_record(addr, &h)) {
+    if(!(h.flags & RECORD_TXN)) {
+      return (h.flags & RECORD_COMMIT) != 0;
+    }
+    addr += sizeof(h) + h.size;
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Rebuilds the index from the log of the active bank. Returns 1 if
+   the log ends with a transaction that was not committed. */
+static uint8_t
+replay(void)
+{
+  record_header_t h;
+  eeprom_addr_t addr;
+  uint8_t in_transaction;
+  uint8_t apply;
+
+  entries_len = 0;
+  live = 0;
+  in_transaction = 0;
+  apply = 1;
+
+  for(addr = BANK_FIRST(bank); read_record(addr, &h);
+      addr += sizeof(h) + h.size) {
+    if(h.flags & RECORD_TXN) {
+      if(!in_transaction) {
+        in_transaction = 1;
+        apply = committed(addr);
+      }
+      if(apply) {
+        apply_record(addr, &h);
+      }
+    } else {
+      in_transaction = 0;
+      if(h.key != MARKER_KEY) {
+        apply_record(addr, &h);
+      }
+    }
+  }
+  head = addr;
+  return in_transaction && !apply;
+}
+/*---------------------------------------------------------------------------*/
+static void
+write_bank_header(uint8_t b, uint16_t magic, uint16_t gen)
+{
+  bank_header_t h;
+
+  h.magic = magic;
+  h.generation = gen;
+  h.check = bank_check(&h);
+  eeprom_write(BANK_START(b), (unsigned char *)&h, sizeof(h));
+  stats.bytes_written += sizeof(h);
+}
+/*---------------------------------------------------------------------------*/
+/* Takes a generation for the other bank that is newer than that of
+   every record in it. The records of a compaction that did not finish
+   carry the generation of its pending header, so the next one takes a
+   newer one, even after a reboot. */
+static uint16_t
+new_generation(void)
+{
+  bank_header_t h;
+  uint16_t gen;
+
+  gen = generation + 1;
+  eeprom_read(BANK_START(bank ^ 1), (unsigned char *)&h, sizeof(h));
+  if(h.magic == BANK_PENDING && h.check == bank_check(&h) &&
+     (int16_t)(h.generation - generation) > 0) {
+    gen = h.generation + 1;
+  }
+  write_bank_header(bank ^ 1, BANK_PENDING, gen);
+  return gen;
+}
+/*---------------------------------------------------------------------------*/
+/* Makes the other bank the active one, with the given contents */
+static void
+switch_bank(eeprom_addr_t end, uint16_t gen)
+{
+  bank ^= 1;
+  generation = gen;
+  write_bank_header(bank, BANK_MAGIC, generation);
+  replay();
+  if(head != end) {
+    PRINTF("settings: log ends at 0x%04x, expected 0x%04x\n", head, end);
+  }
+  stats.compactions++;
+}
+/*---------------------------------------------------------------------------*/
+static void
+append(settings_key_t key, uint8_t order, uint8_t flags,
+       const uint8_t *value, settings_length_t size)
+{
+  record_header_t h;
+
+  if(transaction) {
+    flags |= RECORD_TXN;
+    transaction_written = 1;
+  }
+
+  h.key = key;
+  h.size = size;
+  h.order = order;
+  h.flags = flags;
+  h.check = record_check(&h, generation);
+
+  if(size > 0) {
+    eeprom_write(head + sizeof(h), (unsigned char *)value, size);
+  }
+  eeprom_write(head, (unsigned char *)&h, sizeof(h));
+
+  head += sizeof(h) + size;
+  stats.bytes_written += sizeof(h) + size;
+  writes++;
+}
+/*---------------------------------------------------------------------------*/
+static void
+append_marker(uint8_t flags)
+{
+  uint8_t t;
+
+  t = transaction;
+  transaction = 0;
+  append(MARKER_KEY, 0, flags, NULL, 0);
+  transaction = t;
+}
+/*---------------------------------------------------------------------------*/
+static void
+init(void)
+{
+  bank_header_t h[2];
+  uint8_t valid[2];
+  uint8_t b;
+
+  if(initialized) {
+    return;
+  }
+  initialized = 1;
+
+  for(b = 0; b < 2; b++) {
+    eeprom_read(BANK_START(b), (unsigned char *)&h[b], sizeof(h[b]));
+    valid[b] = h[b].magic == BANK_MAGIC && h[b].check == bank_check(&h[b]);
+  }
+
+  if(valid[0] && valid[1]) {
+    bank = (int16_t)(h[1].generation - h[0].generation) > 0;
+  } else if(valid[0] || valid[1]) {
+    bank = valid[1];
+  } else {
+    /* A new store */
+    PRINTF("settings: formatting\n");
+    bank = 0;
+    write_bank_header(bank, BANK_MAGIC, 0);
+    h[bank].generation = 0;
+  }
+  generation = h[bank].generation;
+  stats.generation = generation;
+
+  if(replay()) {
+    /* A transaction was interrupted. Mark it, so that a later commit
+       does not commit it. */
+    append_marker(RECORD_ABORT);
+  }
+  PRINTF("settings: bank %u generation %u, %u values, %u of %u bytes used\n",
+         bank, generation, entries_len, head - BANK_START(bank), BANK_SIZE);
+}
+/*---------------------------------------------------------------------------*/
+static void
+compact_start(void)
+{
+  compacting = 1;
+  compact_pos = 0;
+  compact_order = 0;
+  compact_head = BANK_FIRST(bank ^ 1);
+  compact_generation = new_generation();
+  compact_writes = writes;
+}
+/*---------------------------------------------------------------------------*/
+/* Copies up to n values to the other bank. Returns 1 if there is more
+   to do. */
+static uint8_t
+compact_step(uint8_t n)
+{
+  record_header_t h;
+  eeprom_addr_t from;
+  settings_length_t offset, len;
+  uint8_t buf[COPY_CHUNK];
+
+  if(!compacting) {
+    return 0;
+  }
+  if(compact_writes != writes) {
+    /* The log changed since the compaction started */
+    compact_start();
+  }
+
+  for(; n > 0 && compact_pos < entries_len; n--, compact_pos++) {
+    from = entries[compact_pos].addr;
+    eeprom_read(from, (unsigned char *)&h, sizeof(h));
+
+    /* The orders of the values of each key start from zero again */
+    if(compact_pos > 0 &&
+       entries[compact_pos - 1].key == entries[compact_pos].key) {
+      compact_order++;
+    } else {
+      compact_order = 0;
+    }
+
+    for(offset = 0; offset < h.size; offset += len) {
+      len = MIN(h.size - offset, COPY_CHUNK);
+      eeprom_read(from + sizeof(h) + offset, buf, len);
+      eeprom_write(compact_head + sizeof(h) + offset, buf, len);
+    }
+    h.order = compact_order;
+    h.flags = 0;
+    h.check = record_check(&h, compact_generation);
+    eeprom_write(compact_head, (unsigned char *)&h, sizeof(h));
+
+    compact_head += sizeof(h) + h.size;
+    stats.bytes_written += sizeof(h) + h.size;
+  }
+
+  if(compact_pos < entries_len) {
+    return 1;
+  }
+
+  compacting = 0;
+  switch_bank(compact_head, compact_generation);
+  PRINTF("settings: compacted to bank %u, %u of %u bytes used\n",
+         bank, head - BANK_START(bank), BANK_SIZE);
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+compact(void)
+{
+  compact_start();
+  while(compact_step(INDEX_SIZE));
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+fits(settings_length_t size)
+{
+  /* There is always room left for the marker of a transaction */
+  return head + 2 * sizeof(record_header_t) + size <= BANK_END(bank);
+}
+/*---------------------------------------------------------------------------*/
+/* Makes room for a value of the given size, compacting the log if it
+   must. Compactions are not done during a transaction, since they
+   would write its values as committed. */
+static settings_status_t
+make_room(settings_length_t size)
+{
+  if(size > SETTINGS_MAX_VALUE_SIZE) {
+    return SETTINGS_STATUS_VALUE_TOO_BIG;
+  }
+  if(!fits(size)) {
+    if(transaction) {
+      return SETTINGS_STATUS_OUT_OF_SPACE;
+    }
+    compact();
+    if(!fits(size)) {
+      return SETTINGS_STATUS_OUT_OF_SPACE;
+    }
+  }
+  return SETTINGS_STATUS_OK;
+}
+/*---------------------------------------------------------------------------*/
+/* Compacts in the background when less than a quarter of the bank is
+   free and at least as much is taken by records that are no longer
+   needed */
+static void
+maybe_compact(void)
+{
+  settings_length_t used;
+
+  used = head - BANK_FIRST(bank);
+  if(transaction || BANK_END(bank) - head > BANK_SIZE / 4 ||
+     used - live < BANK_SIZE / 4) {
+    return;
+  }
+
+  if(!process_is_running(&settings_compact_process)) {
+    if(PROCESS_CURRENT() == NULL) {
+      /* The scheduler is not running yet. The log is compacted when
+         it fills up. */
+      return;
+    }
+    process_start(&settings_compact_process, NULL);
+  }
+  process_poll(&settings_compact_process);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(settings_compact_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL);
+    if(transaction) {
+      continue;
+    }
+    compact_start();
+    while(compact_step(COMPACT_STEP)) {
+      PROCESS_PAUSE();
+      if(transaction) {
+        /* Polled again when the transaction is committed */
+        compacting = 0;
+        break;
+      }
+    }
+  }
+
+  PROCESS_END();
+}
+/*****************************************************************************/
+// MARK: - Public Travesal Functions
+/*****************************************************************************/
+
+/*---------------------------------------------------------------------------*/
+settings_iter_t
+settings_iter_begin()
+{
+  init();
+  return entries_len > 0 ? entries[0].addr : SETTINGS_INVALID_ITER;
+}
+
+/*---------------------------------------------------------------------------*/
+settings_iter_t
+settings_iter_next(settings_iter_t iter)
+{
+  int pos;
+
+  pos = lookup_addr(iter);
+  if(pos >= 0 && pos + 1 < entries_len) {
+    return entries[pos + 1].addr;
+  }
+  return SETTINGS_INVALID_ITER;
+}
+
+/*---------------------------------------------------------------------------*/
+uint8_t
+settings_iter_is_valid(settings_iter_t iter)
+{
+  init();
+  return iter != SETTINGS_INVALID_ITER && lookup_addr(iter) >= 0;
+}
+
+/*---------------------------------------------------------------------------*/
+settings_key_t
+settings_iter_get_key(settings_iter_t iter)
+{
+  int pos;
+
+  pos = lookup_addr(iter);
+  return pos >= 0 ? entries[pos].key : SETTINGS_INVALID_KEY;
+}
+
+/*---------------------------------------------------------------------------*/
+settings_length_t
+settings_iter_get_value_length(settings_iter_t iter)
+{
+  int pos;
+
+  pos = lookup_addr(iter);
+  return pos >= 0 ? entries[pos].size : 0;
+}
+
+/*---------------------------------------------------------------------------*/
+eeprom_addr_t
+settings_iter_get_value_addr(settings_iter_t iter)
+{
+  return iter + sizeof(record_header_t);
+}
+
+/*---------------------------------------------------------------------------*/
+settings_length_t
+settings_iter_get_value_bytes(settings_iter_t iter, void *bytes,
+                              settings_length_t max_length)
+{
+  max_length = MIN(max_length, settings_iter_get_value_length(iter));
+
+  eeprom_read(settings_iter_get_value_addr(iter), bytes, max_length);
+
+  return max_length;
+}
+
+/*---------------------------------------------------------------------------*/
+settings_status_t
+settings_iter_delete(settings_iter_t iter)
+{
+  int pos;
+
+  pos = lookup_addr(iter);
+  if(pos < 0) {
+    return SETTINGS_STATUS_NOT_FOUND;
+  }
+  return settings_delete(entries[pos].key,
+                         pos - lower_bound(entries[pos].key, 0));
+}
+
+/*****************************************************************************/
+// MARK: - Public Functions
+/*****************************************************************************/
+
+/*---------------------------------------------------------------------------*/
+uint8_t
+settings_check(settings_key_t key, uint8_t index)
+{
+  init();
+  return lookup(key, index) >= 0;
+}
+
+/*---------------------------------------------------------------------------*/
+settings_status_t
+settings_get(settings_key_t key, uint8_t index, uint8_t *value,
+             settings_length_t * value_size)
+{
+  int pos;
+
+  init();
+  if(index == SETTINGS_LAST_INDEX) {
+    pos = lower_bound(key + 1, 0) - 1;
+    if(pos < 0 || entries[pos].key != key) {
+      pos = -1;
+    }
+  } else {
+    pos = lookup(key, index);
+  }
+  if(pos < 0) {
+    return SETTINGS_STATUS_NOT_FOUND;
+  }
+  *value_size = MIN(*value_size, entries[pos].size);
+  eeprom_read(entries[pos].addr + sizeof(record_header_t), value,
+              *value_size);
+  return SETTINGS_STATUS_OK;
+}
+
+/*---------------------------------------------------------------------------*/
+settings_status_t
+settings_add(settings_key_t key, const uint8_t *value,
+             settings_length_t value_size)
+{
+  settings_status_t ret;
+  eeprom_addr_t addr;
+  int pos;
+  uint8_t order;
+
+  init();
+  if(key == MARKER_KEY || key == SETTINGS_INVALID_KEY) {
+    return SETTINGS_STATUS_INVALID_ARGUMENT;
+  }
+  if(entries_len == INDEX_SIZE) {
+    return SETTINGS_STATUS_OUT_OF_SPACE;
+  }
+  ret = make_room(value_size);
+  if(ret != SETTINGS_STATUS_OK) {
+    return ret;
+  }
+
+  /* The new value goes after the values that the key has */
+  pos = lower_bound(key + 1, 0) - 1;
+  if(pos >= 0 && entries[pos].key == key) {
+    if(entries[pos].order == 0xff) {
+      if(transaction) {
+        return SETTINGS_STATUS_OUT_OF_SPACE;
+      }
+      /* Compacting numbers the values from zero again */
+      compact();
+      pos = lower_bound(key + 1, 0) - 1;
+    }
+    order = entries[pos].order + 1;
+  } else {
+    order = 0;
+  }
+
+  addr = head;
+  append(key, order, 0, value, value_size);
+  index_put(key, order, addr, value_size);
+  maybe_compact();
+  return SETTINGS_STATUS_OK;
+}
+
+/*---------------------------------------------------------------------------*/
+settings_status_t
+settings_set(settings_key_t key, const uint8_t *value,
+             settings_length_t value_size)
+{
+  settings_status_t ret;
+  eeprom_addr_t addr;
+  uint8_t order;
+
+  init();
+  if(key == MARKER_KEY || key == SETTINGS_INVALID_KEY) {
+    return SETTINGS_STATUS_INVALID_ARGUMENT;
+  }
+  if(lookup(key, 0) < 0) {
+    return settings_add(key, value, value_size);
+  }
+  ret = make_room(value_size);
+  if(ret != SETTINGS_STATUS_OK) {
+    return ret;
+  }
+
+  /* Compacting may have numbered the values again */
+  order = entries[lookup(key, 0)].order;
+  addr = head;
+  append(key, order, 0, value, value_size);
+  index_put(key, order, addr, value_size);
+  maybe_compact();
+  return SETTINGS_STATUS_OK;
+}
+
+/*---------------------------------------------------------------------------*/
+settings_status_t
+settings_delete(settings_key_t key, uint8_t index)
+{
+  settings_status_t ret;
+  int pos;
+  uint8_t order;
+
+  init();
+  if(lookup(key, index) < 0) {
+    return SETTINGS_STATUS_NOT_FOUND;
+  }
+  ret = make_room(0);
+  if(ret != SETTINGS_STATUS_OK) {
+    return ret;
+  }
+
+  pos = lookup(key, index);
+  order = entries[pos].order;
+  index_remove(pos);
+  append(key, order, RECORD_DELETE, NULL, 0);
+  maybe_compact();
+  return SETTINGS_STATUS_OK;
+}
+
+/*---------------------------------------------------------------------------*/
+void
+settings_wipe(void)
+{
+  init();
+  transaction = 0;
+  compacting = 0;
+  /* An empty bank with a new generation */
+  switch_bank(BANK_FIRST(bank ^ 1), new_generation());
+}
+
+/*---------------------------------------------------------------------------*/
+settings_status_t
+settings_transaction_begin(void)
+{
+  init();
+  if(transaction) {
+    return SETTINGS_STATUS_FAILURE;
+  }
+  /* A transaction cannot compact the log, so make room beforehand */
+  if(BANK_END(bank) - head < BANK_SIZE / 2 &&
+     head - BANK_FIRST(bank) > live) {
+    compact();
+  }
+  compacting = 0;
+  transaction = 1;
+  transaction_written = 0;
+  return SETTINGS_STATUS_OK;
+}
+
+/*---------------------------------------------------------------------------*/
+settings_status_t
+settings_transaction_commit(void)
+{
+  if(!transaction) {
+    return SETTINGS_STATUS_FAILURE;
+  }
+  transaction = 0;
+  if(transaction_written) {
+    append_marker(RECORD_COMMIT);
+    maybe_compact();
+  }
+  return SETTINGS_STATUS_OK;
+}
+
+/*---------------------------------------------------------------------------*/
+void
+settings_transaction_abort(void)
+{
+  if(!transaction) {
+    return;
+  }
+  transaction = 0;
+  if(transaction_written) {
+    append_marker(RECORD_ABORT);
+    /* The index has the values of the transaction */
+    replay();
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+void
+settings_get_stats(struct settings_stats *s)
+{
+  init();
+  stats.generation = generation;
+  stats.size = BANK_SIZE;
+  stats.used = head - BANK_START(bank);
+  stats.live = live;
+  stats.values = entries_len;
+  memcpy(s, &stats, sizeof(stats));
+}
+
+#endif /* CONTIKI_CONF_SETTINGS_MANAGER && SETTINGS_CONF_LOG */
@@ -40,7 +40,7 @@
 #include "settings.h"
 #include "dev/eeprom.h"
 
-#if CONTIKI_CONF_SETTINGS_MANAGER
+#if CONTIKI_CONF_SETTINGS_MANAGER && !SETTINGS_CONF_LOG
 
 #if !EEPROM_CONF_SIZE
 #error CONTIKI_CONF_SETTINGS_MANAGER has been set, but EEPROM_CONF_SIZE hasnt!
@@ -472,4 +472,4 @@ settings_debug_dump(void)
 }
 #endif /* DEBUG */
 
-#endif /* CONTIKI_CONF_SETTINGS_MANAGER */
+#endif /* CONTIKI_CONF_SETTINGS_MANAGER && !SETTINGS_CONF_LOG */
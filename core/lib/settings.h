@@ -83,6 +83,22 @@
  *     of the size byte (or size_low byte).
  *   * The key has a value of 0x0000.
  *
+ *  ## Log-structured Store ##
+ *
+ *  With SETTINGS_CONF_LOG, the settings are instead kept in a log in
+ *  one of two banks of the settings area. Setting or deleting a value
+ *  appends a record to the log rather than rewriting EEPROM in place,
+ *  which spreads the wear, and values of any size can be set again.
+ *  An index in RAM of SETTINGS_CONF_INDEX_SIZE values points at the
+ *  latest record of each value, so lookups do not read EEPROM. When
+ *  the log fills up, the current values are copied to the other bank.
+ *  This is done in the background when enough of the log is no longer
+ *  needed. Several changes can be committed together with
+ *  settings_transaction_begin() and settings_transaction_commit().
+ *
+ *  The two formats are not compatible. Stored settings are lost when
+ *  SETTINGS_CONF_LOG is changed.
+ *
  * @{ */
 
 #include <stdint.h>
@@ -130,6 +146,7 @@ typedef uint16_t settings_length_t;
 
 #define SETTINGS_KEY_RDC_INDEX     TCC('R','D') /*!< RDC index, uint8_t */
 #define SETTINGS_KEY_CHANNEL_MASK  TCC('C','M') /*!< Channel mask, uint16_t */
+#define SETTINGS_KEY_PHASE_DRIFT   TCC('P','D') /*!< Phase drift of the neighbors, fixed size */
 
 /*****************************************************************************/
 // MARK: - Constants
@@ -141,6 +158,11 @@ typedef uint16_t settings_length_t;
 /** Returned if no (further) element was found. */
 #define SETTINGS_INVALID_ITER      EEPROM_NULL
 
+#ifndef SETTINGS_CONF_LOG
+/** Selects the log-structured store of settings-log.c */
+#define SETTINGS_CONF_LOG  0
+#endif
+
 #ifndef SETTINGS_CONF_SUPPORT_LARGE_VALUES
 #define SETTINGS_CONF_SUPPORT_LARGE_VALUES  0
 #endif
@@ -180,6 +202,34 @@ extern settings_status_t settings_set(settings_key_t key,
 /** Removes the given key (at the given index) from the settings store. */
 extern settings_status_t settings_delete(settings_key_t key, uint8_t index);
 
+#if SETTINGS_CONF_LOG
+/** Starts a transaction. The values that are set, added and deleted
+ *  until settings_transaction_commit() are stored together, or not
+ *  at all if the node reboots before the commit.
+ */
+extern settings_status_t settings_transaction_begin(void);
+
+/** Stores the changes made since settings_transaction_begin(). */
+extern settings_status_t settings_transaction_commit(void);
+
+/** Discards the changes made since settings_transaction_begin(). */
+extern void settings_transaction_abort(void);
+
+/** How the log-structured store uses its EEPROM. */
+struct settings_stats {
+  uint16_t generation;     /**< Grows with every compaction of the store */
+  uint16_t compactions;    /**< Compactions since boot */
+  uint32_t bytes_written;  /**< Bytes written to EEPROM since boot */
+  settings_length_t size;  /**< Bytes in each of the two banks */
+  settings_length_t used;  /**< Bytes used in the active bank */
+  settings_length_t live;  /**< Bytes used by the current values */
+  uint8_t values;          /**< Number of current values */
+};
+
+/** Fetches the statistics of the log-structured store. */
+extern void settings_get_stats(struct settings_stats *stats);
+#endif /* SETTINGS_CONF_LOG */
+
 /*****************************************************************************/
 // MARK: - Settings traversal functions
 
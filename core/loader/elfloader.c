@@ -131,12 +131,46 @@ struct relevant_section {
   char *address;
 };
 
-char elfloader_unknown[30];	/* Name that caused link error. */
+#define NAME_LEN 30
+
+char elfloader_unknown[NAME_LEN];	/* Name that caused link error. */
 
 struct process * const * elfloader_autostart_processes;
 
 static struct relevant_section bss, data, rodata, text;
 
+/* The symbol and string tables of the file being loaded are read into
+   the cache when they fit, instead of being read from the file for
+   every relocation. */
+#if ELFLOADER_CACHE_SIZE > 0
+static char cache[ELFLOADER_CACHE_SIZE];
+#endif /* ELFLOADER_CACHE_SIZE > 0 */
+static const char *symtab_cache;
+static const char *strtab_cache;
+static unsigned short strtab_cache_size;
+
+/* Relocations are read this many at a time */
+#define RELOCATION_BATCH 8
+
+/* The addends of .rel relocations are read from the section contents
+   this many bytes at a time. Relocations come in order of offset, so
+   one read serves the next few relocations. */
+#define ADDEND_WINDOW 64
+
+#if ELFLOADER_STATS
+struct elfloader_stats elfloader_stats;
+static clock_time_t stats_time;
+#define STATS_ADD(field, n) elfloader_stats.field += (n)
+#define STATS_TIME(field) do {                          \
+    clock_time_t now = clock_time();                    \
+    elfloader_stats.field = now - stats_time;           \
+    stats_time = now;                                   \
+  } while(0)
+#else /* ELFLOADER_STATS */
+#define STATS_ADD(field, n)
+#define STATS_TIME(field)
+#endif /* ELFLOADER_STATS */
+
 static const unsigned char elf_magic_header[] =
   {0x7f, 0x45, 0x4c, 0x46,  /* 0x7f, 'E', 'L', 'F' */
    0x01,                    /* Only 32-bit objects. */
@@ -150,6 +184,8 @@ seek_read(int fd, unsigned int offset, char *buf, int len)
 {
   cfs_seek(fd, offset, CFS_SEEK_SET);
   cfs_read(fd, buf, len);
+  STATS_ADD(reads, 1);
+  STATS_ADD(bytes, len);
 #if DEBUG
   {
     int i;
@@ -172,35 +208,93 @@ seek_write(int fd, unsigned int offset, char *buf, int len)
 }
 */
 /*---------------------------------------------------------------------------*/
+static void
+cache_tables(int fd, unsigned int symtab, unsigned short symtabsize,
+             unsigned int strtab, unsigned short strtabsize)
+{
+#if ELFLOADER_CACHE_SIZE > 0
+  unsigned short used = 0;
+#endif /* ELFLOADER_CACHE_SIZE > 0 */
+
+  symtab_cache = strtab_cache = NULL;
+#if ELFLOADER_CACHE_SIZE > 0
+  if(symtabsize <= sizeof(cache)) {
+    seek_read(fd, symtab, cache, symtabsize);
+    symtab_cache = cache;
+    used = symtabsize;
+  }
+  if(strtabsize > 0 && strtabsize <= sizeof(cache) - used) {
+    seek_read(fd, strtab, cache + used, strtabsize);
+    /* Names are looked up in place, so they must be terminated */
+    if(cache[used + strtabsize - 1] == 0) {
+      strtab_cache = cache + used;
+      strtab_cache_size = strtabsize;
+    }
+  }
+#endif /* ELFLOADER_CACHE_SIZE > 0 */
+#if ELFLOADER_STATS
+  elfloader_stats.cached = symtab_cache != NULL && strtab_cache != NULL;
+#endif /* ELFLOADER_STATS */
+}
+/*---------------------------------------------------------------------------*/
+static void
+read_symbol(int fd, unsigned int symtab, unsigned int index,
+            struct elf32_sym *s)
+{
+  if(symtab_cache != NULL) {
+    memcpy(s, symtab_cache + index * sizeof(*s), sizeof(*s));
+  } else {
+    seek_read(fd, symtab + index * sizeof(*s), (char *)s, sizeof(*s));
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Returns the name of a symbol, from the cache or read into buf */
+static const char *
+symbol_name(int fd, unsigned int strtab, elf32_word offset, char *buf)
+{
+  if(strtab_cache != NULL && offset < strtab_cache_size) {
+    return strtab_cache + offset;
+  }
+  seek_read(fd, strtab + offset, buf, NAME_LEN);
+  buf[NAME_LEN - 1] = 0;
+  return buf;
+}
+/*---------------------------------------------------------------------------*/
+static struct relevant_section *
+find_section(elf32_half shndx)
+{
+  if(shndx == bss.number) {
+    return &bss;
+  } else if(shndx == data.number) {
+    return &data;
+  } else if(shndx == rodata.number) {
+    return &rodata;
+  } else if(shndx == text.number) {
+    return &text;
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
 static void *
 find_local_symbol(int fd, const char *symbol,
 		  unsigned int symtab, unsigned short symtabsize,
 		  unsigned int strtab)
 {
   struct elf32_sym s;
-  unsigned int a;
-  char name[30];
+  unsigned int i;
+  char buf[NAME_LEN];
   struct relevant_section *sect;
-  
-  for(a = symtab; a < symtab + symtabsize; a += sizeof(s)) {
-    seek_read(fd, a, (char *)&s, sizeof(s));
 
-    if(s.st_name != 0) {
-      seek_read(fd, strtab + s.st_name, name, sizeof(name));
-      if(strcmp(name, symbol) == 0) {
-	if(s.st_shndx == bss.number) {
-	  sect = &bss;
-	} else if(s.st_shndx == data.number) {
-	  sect = &data;
-  } else if(s.st_shndx == rodata.number) {
-    sect = &rodata;
-	} else if(s.st_shndx == text.number) {
-	  sect = &text;
-	} else {
-	  return NULL;
-	}
-	return &(sect->address[s.st_value]);
+  for(i = 0; i < symtabsize / sizeof(s); i++) {
+    read_symbol(fd, symtab, i, &s);
+
+    if(s.st_name != 0 &&
+       strcmp(symbol_name(fd, strtab, s.st_name, buf), symbol) == 0) {
+      sect = find_section(s.st_shndx);
+      if(sect == NULL) {
+        return NULL;
       }
+      return &(sect->address[s.st_value]);
     }
   }
   return NULL;
@@ -218,10 +312,17 @@ relocate_section(int fd,
 {
   /* sectionbase added; runtime start address of current section */
   struct elf32_rela rela; /* Now used both for rel and rela data! */
+  char batch[RELOCATION_BATCH * sizeof(struct elf32_rela)];
+  const char *next = batch;
+  int left = 0;
   int rel_size = 0;
   struct elf32_sym s;
   unsigned int a;
-  char name[30];
+  char buf[NAME_LEN];
+  char window[ADDEND_WINDOW];
+  unsigned int window_start = 0;
+  unsigned int window_len = 0;
+  const char *name;
   char *addr;
   struct relevant_section *sect;
 
@@ -233,56 +334,56 @@ relocate_section(int fd,
   }
   
   for(a = section; a < section + size; a += rel_size) {
-    seek_read(fd, a, (char *)&rela, rel_size);
-    seek_read(fd,
-	      symtab + sizeof(struct elf32_sym) * ELF32_R_SYM(rela.r_info),
-	      (char *)&s, sizeof(s));
+    if(left == 0) {
+      left = (section + size - a) / rel_size;
+      if(left > RELOCATION_BATCH) {
+        left = RELOCATION_BATCH;
+      }
+      seek_read(fd, a, batch, left * rel_size);
+      next = batch;
+    }
+    memcpy(&rela, next, rel_size);
+    next += rel_size;
+    left--;
+    STATS_ADD(relocations, 1);
+
+    read_symbol(fd, symtab, ELF32_R_SYM(rela.r_info), &s);
     if(s.st_name != 0) {
-      seek_read(fd, strtab + s.st_name, name, sizeof(name));
+      name = symbol_name(fd, strtab, s.st_name, buf);
       PRINTF("name: %s\n", name);
       addr = (char *)symtab_lookup(name);
-      /* ADDED */
       if(addr == NULL) {
+	/* Not in the core, so it must be defined in the module. The
+	   symbol itself tells where, so there is no need to look it
+	   up by name. */
 	PRINTF("name not found in global: %s\n", name);
-	addr = find_local_symbol(fd, name, symtab, symtabsize, strtab);
-	PRINTF("found address %p\n", addr);
-      }
-      if(addr == NULL) {
-	if(s.st_shndx == bss.number) {
-	  sect = &bss;
-	} else if(s.st_shndx == data.number) {
-	  sect = &data;
-	} else if(s.st_shndx == rodata.number) {
-	  sect = &rodata;
-	} else if(s.st_shndx == text.number) {
-	  sect = &text;
-	} else {
+	sect = find_section(s.st_shndx);
+	if(sect == NULL) {
 	  PRINTF("elfloader unknown name: '%30s'\n", name);
-	  memcpy(elfloader_unknown, name, sizeof(elfloader_unknown));
+	  strncpy(elfloader_unknown, name, sizeof(elfloader_unknown) - 1);
 	  elfloader_unknown[sizeof(elfloader_unknown) - 1] = 0;
 	  return ELFLOADER_SYMBOL_NOT_FOUND;
 	}
-	addr = sect->address;
+	addr = &(sect->address[s.st_value]);
+	PRINTF("found address %p\n", addr);
       }
     } else {
-      if(s.st_shndx == bss.number) {
-	sect = &bss;
-      } else if(s.st_shndx == data.number) {
-	sect = &data;
-      } else if(s.st_shndx == rodata.number) {
-	sect = &rodata;
-      } else if(s.st_shndx == text.number) {
-	sect = &text;
-      } else {
+      sect = find_section(s.st_shndx);
+      if(sect == NULL) {
 	return ELFLOADER_SEGMENT_NOT_FOUND;
       }
-      
       addr = sect->address;
     }
 
     if(!using_relas) {
       /* copy addend to rela structure */
-      seek_read(fd, sectionaddr + rela.r_offset, (char *)&rela.r_addend, 4);
+      if(rela.r_offset < window_start ||
+         rela.r_offset + 4 > window_start + window_len) {
+        window_start = rela.r_offset;
+        window_len = ADDEND_WINDOW;
+        seek_read(fd, sectionaddr + window_start, window, window_len);
+      }
+      memcpy(&rela.r_addend, &window[rela.r_offset - window_start], 4);
     }
 
     elfloader_arch_relocate(fd, sectionaddr, sectionbase, &rela, addr);
@@ -296,17 +397,16 @@ find_program_processes(int fd,
 		       unsigned int strtab)
 {
   struct elf32_sym s;
-  unsigned int a;
-  char name[30];
-  
-  for(a = symtab; a < symtab + size; a += sizeof(s)) {
-    seek_read(fd, a, (char *)&s, sizeof(s));
+  unsigned int i;
+  char buf[NAME_LEN];
 
-    if(s.st_name != 0) {
-      seek_read(fd, strtab + s.st_name, name, sizeof(name));
-      if(strcmp(name, "autostart_processes") == 0) {
-	return &data.address[s.st_value];
-      }
+  for(i = 0; i < size / sizeof(s); i++) {
+    read_symbol(fd, symtab, i, &s);
+
+    if(s.st_name != 0 &&
+       strcmp(symbol_name(fd, strtab, s.st_name, buf),
+              "autostart_processes") == 0) {
+      return &data.address[s.st_value];
     }
   }
   return NULL;
@@ -361,6 +461,10 @@ elfloader_load(int fd)
   int ret;
 
   elfloader_unknown[0] = 0;
+#if ELFLOADER_STATS
+  memset(&elfloader_stats, 0, sizeof(elfloader_stats));
+  stats_time = clock_time();
+#endif /* ELFLOADER_STATS */
 
   /* The ELF header is located at the start of the buffer. */
   seek_read(fd, 0, (char *)&ehdr, sizeof(ehdr));
@@ -438,7 +542,9 @@ elfloader_load(int fd)
       PRINTF("symtab\n");
       symtaboff = shdr.sh_offset;
       symtabsize = shdr.sh_size;
-    } else if(shdr.sh_type == SHT_STRTAB/*strncmp(name, ".strtab", 7) == 0*/) {
+    } else if(shdr.sh_type == SHT_STRTAB/*strncmp(name, ".strtab", 7) == 0*/ &&
+              i != ehdr.e_shstrndx) {
+      /* The section names are in a string table too */
       PRINTF("strtab\n");
       strtaboff = shdr.sh_offset;
       strtabsize = shdr.sh_size;
@@ -503,6 +609,10 @@ elfloader_load(int fd)
   if(textsize == 0) {
     return ELFLOADER_NO_TEXT;
   }
+  STATS_TIME(sections);
+
+  cache_tables(fd, symtaboff, symtabsize, strtaboff, strtabsize);
+  STATS_TIME(tables);
 
   PRINTF("before allocate ram\n");
   bss.address = (char *)elfloader_arch_allocate_ram(bsssize + datasize);
@@ -565,15 +675,19 @@ elfloader_load(int fd)
     }
   }
 
+  STATS_TIME(relocate);
+
   /* Write text and rodata segment into flash and data segment into RAM. */
   elfloader_arch_write_rom(fd, textoff, textsize, text.address);
   elfloader_arch_write_rom(fd, rodataoff, rodatasize, rodata.address);
   
   memset(bss.address, 0, bsssize);
   seek_read(fd, dataoff, data.address, datasize);
+  STATS_TIME(copy);
 
   PRINTF("elfloader: autostart search\n");
   process = (struct process **) find_local_symbol(fd, "autostart_processes", symtaboff, symtabsize, strtaboff);
+  STATS_TIME(autostart);
   if(process != NULL) {
     PRINTF("elfloader: autostart found\n");
     elfloader_autostart_processes = process;
@@ -76,6 +76,9 @@
 #define ELFLOADER_H_
 
 #include "cfs/cfs.h"
+#include "sys/clock.h"
+
+#include <stdint.h>
 
 /**
  * Return value from elfloader_load() indicating that loading worked.
@@ -175,11 +178,51 @@ extern char elfloader_unknown[30];
 #endif
 #endif /* ELFLOADER_TEXTMEMORY_SIZE */
 
-typedef unsigned long  elf32_word;
-typedef   signed long  elf32_sword;
-typedef unsigned short elf32_half;
-typedef unsigned long  elf32_off;
-typedef unsigned long  elf32_addr;
+/**
+ * Bytes of RAM for the symbol and string tables of the module being
+ * loaded. The tables that fit are read once instead of for every
+ * relocation. Zero, the default, disables the cache.
+ */
+#ifndef ELFLOADER_CACHE_SIZE
+#ifdef ELFLOADER_CONF_CACHE_SIZE
+#define ELFLOADER_CACHE_SIZE ELFLOADER_CONF_CACHE_SIZE
+#else
+#define ELFLOADER_CACHE_SIZE 0
+#endif
+#endif /* ELFLOADER_CACHE_SIZE */
+
+#ifdef ELFLOADER_CONF_STATS
+#define ELFLOADER_STATS ELFLOADER_CONF_STATS
+#else
+#define ELFLOADER_STATS 0
+#endif
+
+#if ELFLOADER_STATS
+/**
+ * Where the time of the last elfloader_load() went, in clock ticks,
+ * and how much it read from the file.
+ */
+struct elfloader_stats {
+  clock_time_t sections;   /**< Parsing the section headers */
+  clock_time_t tables;     /**< Reading the symbol and string tables */
+  clock_time_t relocate;   /**< Relocating the sections */
+  clock_time_t copy;       /**< Writing text and data to memory */
+  clock_time_t autostart;  /**< Finding the autostart processes */
+  unsigned long reads;     /**< Number of reads from the file */
+  unsigned long bytes;     /**< Number of bytes read from the file */
+  unsigned short relocations;
+  unsigned char cached;    /**< Non-zero if the symbol and string tables
+                                fit in the cache */
+};
+
+extern struct elfloader_stats elfloader_stats;
+#endif /* ELFLOADER_STATS */
+
+typedef uint32_t elf32_word;
+typedef int32_t  elf32_sword;
+typedef uint16_t elf32_half;
+typedef uint32_t elf32_off;
+typedef uint32_t elf32_addr;
 
 struct elf32_rela {
   elf32_addr      r_offset;       /* Location to be relocated. */
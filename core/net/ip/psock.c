@@ -204,7 +204,12 @@ PT_THREAD(psock_generator_send(CC_REGISTER_ARG struct psock *s,
      uip_appdata buffer. */
     s->sendlen = generate(arg);
     s->sendptr = uip_appdata;
-    
+
+    /* Nothing was generated, so there is nothing to wait for. */
+    if(s->sendlen == 0) {
+      break;
+    }
+
     if(s->sendlen > uip_mss()) {
       uip_send(s->sendptr, uip_mss());
     } else {
@@ -219,6 +219,8 @@ PT_THREAD(psock_generator_send(struct psock *psock,
  *             length of the generated data. The generator function is
  *             called by the protosocket layer when the data first is
  *             sent, and once for every retransmission that is needed.
+ *             If the generator function returns zero, nothing is sent
+ *             and PSOCK_GENERATOR_SEND() returns at once.
  *
  * \hideinitializer
  */
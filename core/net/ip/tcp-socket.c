@@ -60,18 +60,50 @@ static void
 senddata(struct tcp_socket *s)
 {
   int len = MIN(s->output_data_max_seg, uip_mss());
+  int readlen;
 
-  if(s->output_senddata_len > 0) {
+  if(s->output_senddata_len > 0 || s->output_read_len > 0) {
     len = MIN(s->output_senddata_len, len);
     s->output_data_send_nxt = len;
-    uip_send(s->output_data_ptr, len);
+    s->output_read_send_nxt = 0;
+
+    /* The stream follows the data in the output buffer. Since the
+       buffer cannot grow while a stream is queued, a retransmitted
+       segment holds the same data as the original. */
+    if(s->output_read_len > 0 && len == s->output_data_len &&
+       len < MIN(s->output_data_max_seg, uip_mss())) {
+      memcpy(uip_appdata, s->output_data_ptr, len);
+      readlen = MIN(s->output_read_len,
+                    MIN(s->output_data_max_seg, uip_mss()) - len);
+      readlen = s->output_read_callback(s, s->ptr, s->output_read_offset,
+                                        (uint8_t *)uip_appdata + len,
+                                        readlen);
+      if(readlen > 0) {
+        s->output_read_send_nxt = readlen;
+        len += readlen;
+      }
+      if(len > 0) {
+        uip_send(uip_appdata, len);
+      }
+    } else if(len > 0) {
+      uip_send(s->output_data_ptr, len);
+    }
   }
 }
 /*---------------------------------------------------------------------------*/
 static void
+reset_stream(struct tcp_socket *s)
+{
+  s->output_read_callback = NULL;
+  s->output_read_offset = 0;
+  s->output_read_len = 0;
+  s->output_read_send_nxt = 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
 acked(struct tcp_socket *s)
 {
-  if(s->output_senddata_len > 0) {
+  if(s->output_senddata_len > 0 || s->output_read_send_nxt > 0) {
     /* Copy the data in the outputbuf down and update outputbufptr and
        outputbuf_lastsent */
 
@@ -94,6 +126,13 @@ acked(struct tcp_socket *s)
     s->output_senddata_len = s->output_data_len;
     s->output_data_send_nxt = 0;
 
+    s->output_read_offset += s->output_read_send_nxt;
+    s->output_read_len -= s->output_read_send_nxt;
+    s->output_read_send_nxt = 0;
+    if(s->output_read_len == 0) {
+      reset_stream(s);
+    }
+
     call_event(s, TCP_SOCKET_DATA_SENT);
   }
 }
@@ -185,12 +224,18 @@ appcall(void *state)
   }
 
   if(uip_timedout()) {
+    if(s != NULL) {
+      reset_stream(s);
+    }
     call_event(s, TCP_SOCKET_TIMEDOUT);
     relisten(s);
   }
 
   if(uip_aborted()) {
     tcp_markconn(uip_conn, NULL);
+    if(s != NULL) {
+      reset_stream(s);
+    }
     call_event(s, TCP_SOCKET_ABORTED);
     relisten(s);
 
@@ -216,7 +261,8 @@ appcall(void *state)
     senddata(s);
   }
 
-  if(s->output_data_len == 0 && s->flags & TCP_SOCKET_FLAGS_CLOSING) {
+  if(s->output_data_len == 0 && s->output_read_len == 0 &&
+     s->flags & TCP_SOCKET_FLAGS_CLOSING) {
     s->flags &= ~TCP_SOCKET_FLAGS_CLOSING;
     uip_close();
     s->c = NULL;
@@ -229,6 +275,7 @@ appcall(void *state)
   if(uip_closed()) {
     tcp_markconn(uip_conn, NULL);
     s->c = NULL;
+    reset_stream(s);
     call_event(s, TCP_SOCKET_CLOSED);
     relisten(s);
   }
@@ -277,6 +324,7 @@ tcp_socket_register(struct tcp_socket *s, void *ptr,
   s->output_data_len = 0;
   s->output_data_ptr = output_databuf;
   s->output_data_maxlen = output_databuf_len;
+  reset_stream(s);
   s->input_callback = input_callback;
   s->event_callback = event_callback;
   list_add(socketlist, s);
@@ -348,6 +396,11 @@ tcp_socket_send(struct tcp_socket *s,
     return -1;
   }
 
+  if(s->output_read_len > 0) {
+    /* Nothing can be queued behind a stream */
+    return 0;
+  }
+
   len = MIN(datalen, s->output_data_maxlen - s->output_data_len);
 
   memcpy(&s->output_data_ptr[s->output_data_len], data, len);
@@ -363,6 +416,25 @@ tcp_socket_send(struct tcp_socket *s,
 }
 /*---------------------------------------------------------------------------*/
 int
+tcp_socket_send_from(struct tcp_socket *s,
+                     tcp_socket_read_callback_t read_callback,
+                     uint32_t len)
+{
+  if(s == NULL || read_callback == NULL || s->output_read_len > 0) {
+    return -1;
+  }
+
+  s->output_read_callback = read_callback;
+  s->output_read_offset = 0;
+  s->output_read_len = len;
+  s->output_read_send_nxt = 0;
+
+  tcpip_poll_tcp(s->c);
+
+  return len;
+}
+/*---------------------------------------------------------------------------*/
+int
 tcp_socket_send_str(struct tcp_socket *s,
              const char *str)
 {
@@ -398,12 +470,15 @@ tcp_socket_unregister(struct tcp_socket *s)
 int
 tcp_socket_max_sendlen(struct tcp_socket *s)
 {
+  if(s->output_read_len > 0) {
+    return 0;
+  }
   return s->output_data_maxlen - s->output_data_len;
 }
 /*---------------------------------------------------------------------------*/
 int
 tcp_socket_queuelen(struct tcp_socket *s)
 {
-  return s->output_data_len;
+  return s->output_data_len + s->output_read_len;
 }
 /*---------------------------------------------------------------------------*/
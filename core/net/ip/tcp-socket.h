@@ -80,6 +80,27 @@ typedef void (* tcp_socket_event_callback_t)(struct tcp_socket *s,
                                              void *ptr,
                                              tcp_socket_event_t event);
 
+/**
+ * \brief      TCP read callback function
+ * \param s    A pointer to a TCP socket
+ * \param ptr  A user-defined pointer
+ * \param offset The offset in the stream of the first byte to read
+ * \param buf  A pointer to where the data should be written
+ * \param len  The number of bytes to read
+ * \return     The number of bytes read, or -1 on error
+ *
+ *             The TCP read callback function gets called when a
+ *             segment of a stream started with tcp_socket_send_from()
+ *             is sent, and writes the data directly into the outgoing
+ *             packet. The same range may be read more than once if the
+ *             segment has to be retransmitted.
+ */
+typedef int (* tcp_socket_read_callback_t)(struct tcp_socket *s,
+                                           void *ptr,
+                                           uint32_t offset,
+                                           uint8_t *buf,
+                                           int len);
+
 struct tcp_socket {
   struct tcp_socket *next;
 
@@ -100,6 +121,11 @@ struct tcp_socket {
   uint16_t output_senddata_len;
   uint16_t output_data_max_seg;
 
+  tcp_socket_read_callback_t output_read_callback;
+  uint32_t output_read_offset;
+  uint32_t output_read_len;
+  uint16_t output_read_send_nxt;
+
   uint8_t flags;
   uint16_t listen_port;
   struct uip_conn *c;
@@ -229,6 +255,32 @@ int tcp_socket_send(struct tcp_socket *s,
                     const uint8_t *dataptr,
                     int datalen);
 
+/**
+ * \brief      Send a stream of data without copying it to the output buffer
+ * \param s    A pointer to a TCP socket that must have been previously registered with tcp_socket_register()
+ * \param read_callback A pointer to the function that reads the data
+ * \param len  The length of the stream
+ * \retval -1  If an error occurs, or if a stream is already being sent
+ * \return     The length of the stream
+ *
+ *             This function sends len bytes after the data that is
+ *             already in the output buffer. The data is not copied
+ *             to the output buffer, but is read with the read
+ *             callback straight into each outgoing segment, so the
+ *             stream can be larger than the output buffer. The
+ *             callback is called with offsets from 0 to len.
+ *
+ *             While the stream is being sent, tcp_socket_send()
+ *             queues nothing, since the data would otherwise go out
+ *             before the end of the stream. The
+ *             TCP_SOCKET_DATA_SENT event is sent as segments of the
+ *             stream are acknowledged, and tcp_socket_queuelen()
+ *             returns zero when the whole stream has been received.
+ */
+int tcp_socket_send_from(struct tcp_socket *s,
+                         tcp_socket_read_callback_t read_callback,
+                         uint32_t len);
+
 /**
  * \brief      Send a string on a connected TCP socket
  * \param s    A pointer to a TCP socket that must have been previously registered with tcp_socket_register()
@@ -292,6 +344,8 @@ int tcp_socket_max_sendlen(struct tcp_socket *s);
  *             This function queries the TCP socket and returns the
  *             number of bytes that are currently not yet known to
  *             have been successfully received by the receiver.
+ *             This includes the part of a stream started with
+ *             tcp_socket_send_from() that has not been acknowledged.
  *
  */
 int tcp_socket_queuelen(struct tcp_socket *s);
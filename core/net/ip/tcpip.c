@@ -526,6 +526,22 @@ tcpip_input(void)
 }
 /*---------------------------------------------------------------------------*/
 #if NETSTACK_CONF_WITH_IPV6
+#if UIP_CONF_IPV6_QUEUE_PKT && UIP_ND6_SEND_NS
+/* Copy outgoing pkt to the neighbor's queue for transmission once its
+   link-layer address is known. */
+static void
+queue_packet(uip_ds6_nbr_t *nbr)
+{
+  struct uip_packetqueue_packet *p;
+
+  p = uip_packetqueue_alloc(&nbr->packethandle, UIP_DS6_NBR_PACKET_LIFETIME);
+  if(p != NULL) {
+    memcpy(p->queue_buf, UIP_IP_BUF, uip_len);
+    p->queue_buf_len = uip_len;
+  }
+}
+#endif /* UIP_CONF_IPV6_QUEUE_PKT && UIP_ND6_SEND_NS */
+/*---------------------------------------------------------------------------*/
 void
 tcpip_ipv6_output(void)
 {
@@ -670,10 +686,7 @@ tcpip_ipv6_output(void)
       } else {
 #if UIP_CONF_IPV6_QUEUE_PKT
         /* Copy outgoing pkt in the queuing buffer for later transmit. */
-        if(uip_packetqueue_alloc(&nbr->packethandle, UIP_DS6_NBR_PACKET_LIFETIME) != NULL) {
-          memcpy(uip_packetqueue_buf(&nbr->packethandle), UIP_IP_BUF, uip_len);
-          uip_packetqueue_set_buflen(&nbr->packethandle, uip_len);
-        }
+        queue_packet(nbr);
 #endif
         /* RFC4861, 7.2.2:
          * "If the source address of the packet prompting the solicitation is the
@@ -703,10 +716,7 @@ tcpip_ipv6_output(void)
 #if UIP_CONF_IPV6_QUEUE_PKT
         /* Copy outgoing pkt in the queuing buffer for later transmit and set
            the destination nbr to nbr. */
-        if(uip_packetqueue_alloc(&nbr->packethandle, UIP_DS6_NBR_PACKET_LIFETIME) != NULL) {
-          memcpy(uip_packetqueue_buf(&nbr->packethandle), UIP_IP_BUF, uip_len);
-          uip_packetqueue_set_buflen(&nbr->packethandle, uip_len);
-        }
+        queue_packet(nbr);
 #endif /*UIP_CONF_IPV6_QUEUE_PKT*/
         uip_clear_buf();
         return;
@@ -721,23 +731,22 @@ tcpip_ipv6_output(void)
       }
 #endif /* UIP_ND6_SEND_NS */
 
-      tcpip_output(uip_ds6_nbr_get_ll(nbr));
-
-#if UIP_CONF_IPV6_QUEUE_PKT
+#if UIP_CONF_IPV6_QUEUE_PKT && UIP_ND6_SEND_NS
       /*
        * Send the queued packets from here, may not be 100% perfect though.
        * This happens in a few cases, for example when instead of receiving a
        * NA after sendiong a NS, you receive a NS with SLLAO: the entry moves
-       * to STALE, and you must both send a NA and the queued packet.
+       * to STALE, and you must both send a NA and the queued packet. This
+       * packet is queued behind them, so that they all go out in order.
        */
-      if(uip_packetqueue_buflen(&nbr->packethandle) != 0) {
-        uip_len = uip_packetqueue_buflen(&nbr->packethandle);
-        memcpy(UIP_IP_BUF, uip_packetqueue_buf(&nbr->packethandle), uip_len);
-        uip_packetqueue_free(&nbr->packethandle);
-        tcpip_output(uip_ds6_nbr_get_ll(nbr));
+      if(uip_packetqueue_len(&nbr->packethandle) > 0) {
+        queue_packet(nbr);
+        uip_ds6_nbr_send_queued(nbr);
+        return;
       }
-#endif /*UIP_CONF_IPV6_QUEUE_PKT*/
+#endif /* UIP_CONF_IPV6_QUEUE_PKT && UIP_ND6_SEND_NS */
 
+      tcpip_output(uip_ds6_nbr_get_ll(nbr));
       uip_clear_buf();
       return;
     }
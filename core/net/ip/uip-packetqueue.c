@@ -6,8 +6,9 @@
 
 #include "net/ip/uip-packetqueue.h"
 
-#define MAX_NUM_QUEUED_PACKETS 2
-MEMB(packets_memb, struct uip_packetqueue_packet, MAX_NUM_QUEUED_PACKETS);
+MEMB(packets_memb, struct uip_packetqueue_packet, UIP_PACKETQUEUE_NUM);
+
+struct uip_packetqueue_stats uip_packetqueue_stats;
 
 #define DEBUG 0
 #if DEBUG
@@ -17,15 +18,32 @@ MEMB(packets_memb, struct uip_packetqueue_packet, MAX_NUM_QUEUED_PACKETS);
 #define PRINTF(...)
 #endif
 
+/*---------------------------------------------------------------------------*/
+static void
+packet_remove(struct uip_packetqueue_packet *p)
+{
+  struct uip_packetqueue_handle *h = p->handle;
+  struct uip_packetqueue_packet **pp;
+
+  for(pp = &h->packet; *pp != NULL; pp = &(*pp)->next) {
+    if(*pp == p) {
+      *pp = p->next;
+      h->len--;
+      break;
+    }
+  }
+  ctimer_stop(&p->lifetimer);
+  memb_free(&packets_memb, p);
+}
 /*---------------------------------------------------------------------------*/
 static void
 packet_timedout(void *ptr)
 {
-  struct uip_packetqueue_handle *h = ptr;
+  struct uip_packetqueue_packet *p = ptr;
 
-  PRINTF("uip_packetqueue_free timed out %p\n", h);
-  memb_free(&packets_memb, h->packet);
-  h->packet = NULL;
+  PRINTF("uip_packetqueue_free timed out %p\n", p->handle);
+  uip_packetqueue_stats.timedout++;
+  packet_remove(p);
 }
 /*---------------------------------------------------------------------------*/
 void
@@ -33,24 +51,43 @@ uip_packetqueue_new(struct uip_packetqueue_handle *handle)
 {
   PRINTF("uip_packetqueue_new %p\n", handle);
   handle->packet = NULL;
+  handle->len = 0;
 }
 /*---------------------------------------------------------------------------*/
 struct uip_packetqueue_packet *
 uip_packetqueue_alloc(struct uip_packetqueue_handle *handle, clock_time_t lifetime)
 {
+  struct uip_packetqueue_packet *p, **pp;
+
   PRINTF("uip_packetqueue_alloc %p\n", handle);
-  if(handle->packet != NULL) {
-    PRINTF("alloced\n");
-    return NULL;
+  if(handle->len >= UIP_PACKETQUEUE_MAX_PER_HANDLE) {
+    /* The new packet replaces the oldest one */
+    PRINTF("handle full\n");
+    uip_packetqueue_stats.dropped++;
+    packet_remove(handle->packet);
   }
-  handle->packet = memb_alloc(&packets_memb);
-  if(handle->packet != NULL) {
-    ctimer_set(&handle->packet->lifetimer, lifetime,
-               packet_timedout, handle);
-  } else {
+  p = memb_alloc(&packets_memb);
+  if(p == NULL && handle->packet != NULL) {
+    /* Pool exhausted: make room among our own packets */
+    uip_packetqueue_stats.dropped++;
+    packet_remove(handle->packet);
+    p = memb_alloc(&packets_memb);
+  }
+  if(p == NULL) {
     PRINTF("uip_packetqueue_alloc failed\n");
+    uip_packetqueue_stats.dropped++;
+    return NULL;
   }
-  return handle->packet;
+
+  p->next = NULL;
+  p->queue_buf_len = 0;
+  p->handle = handle;
+  for(pp = &handle->packet; *pp != NULL; pp = &(*pp)->next);
+  *pp = p;
+  handle->len++;
+  uip_packetqueue_stats.queued++;
+  ctimer_set(&p->lifetimer, lifetime, packet_timedout, p);
+  return p;
 }
 /*---------------------------------------------------------------------------*/
 void
@@ -58,9 +95,18 @@ uip_packetqueue_free(struct uip_packetqueue_handle *handle)
 {
   PRINTF("uip_packetqueue_free %p\n", handle);
   if(handle->packet != NULL) {
-    ctimer_stop(&handle->packet->lifetimer);
-    memb_free(&packets_memb, handle->packet);
-    handle->packet = NULL;
+    uip_packetqueue_stats.released++;
+    packet_remove(handle->packet);
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+uip_packetqueue_free_all(struct uip_packetqueue_handle *handle)
+{
+  PRINTF("uip_packetqueue_free_all %p\n", handle);
+  while(handle->packet != NULL) {
+    uip_packetqueue_stats.dropped++;
+    packet_remove(handle->packet);
   }
 }
 /*---------------------------------------------------------------------------*/
@@ -84,3 +130,9 @@ uip_packetqueue_set_buflen(struct uip_packetqueue_handle *h, uint16_t len)
   }
 }
 /*---------------------------------------------------------------------------*/
+uint8_t
+uip_packetqueue_len(struct uip_packetqueue_handle *h)
+{
+  return h->len;
+}
+/*---------------------------------------------------------------------------*/
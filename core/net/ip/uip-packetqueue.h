@@ -3,10 +3,30 @@
 
 #include "sys/ctimer.h"
 
+/**
+ * Packets are queued per handle (one handle per neighbor) in FIFO
+ * order, and allocated from a pool shared by all handles.
+ * UIP_PACKETQUEUE_CONF_NUM sets the size of the pool, and
+ * UIP_PACKETQUEUE_CONF_MAX_PER_HANDLE bounds how many of them one
+ * handle may hold. When a handle is full, a new packet replaces the
+ * oldest one (RFC 4861, section 7.2.2).
+ */
+#ifdef UIP_PACKETQUEUE_CONF_NUM
+#define UIP_PACKETQUEUE_NUM UIP_PACKETQUEUE_CONF_NUM
+#else
+#define UIP_PACKETQUEUE_NUM 2
+#endif
+
+#ifdef UIP_PACKETQUEUE_CONF_MAX_PER_HANDLE
+#define UIP_PACKETQUEUE_MAX_PER_HANDLE UIP_PACKETQUEUE_CONF_MAX_PER_HANDLE
+#else
+#define UIP_PACKETQUEUE_MAX_PER_HANDLE UIP_PACKETQUEUE_NUM
+#endif
+
 struct uip_packetqueue_handle;
 
 struct uip_packetqueue_packet {
-  struct uip_ds6_queued_packet *next;
+  struct uip_packetqueue_packet *next;
   uint8_t queue_buf[UIP_BUFSIZE - UIP_LLH_LEN];
   uint16_t queue_buf_len;
   struct ctimer lifetimer;
@@ -15,21 +35,51 @@ struct uip_packetqueue_packet {
 
 struct uip_packetqueue_handle {
   struct uip_packetqueue_packet *packet;
+  uint8_t len;
 };
 
-void uip_packetqueue_new(struct uip_packetqueue_handle *handle);
+/** Counters for all handles together */
+struct uip_packetqueue_stats {
+  /** Packets put in a queue */
+  uint16_t queued;
+  /** Packets taken out of a queue to be sent */
+  uint16_t released;
+  /** Packets replaced by newer ones, not queued for lack of space, or
+      flushed along with their handle */
+  uint16_t dropped;
+  /** Packets whose lifetime ran out while queued */
+  uint16_t timedout;
+};
 
+extern struct uip_packetqueue_stats uip_packetqueue_stats;
 
+void uip_packetqueue_new(struct uip_packetqueue_handle *handle);
+
+/**
+ * Append a packet to the queue of a handle. The caller fills in
+ * queue_buf and queue_buf_len of the returned packet.
+ *
+ * \param handle   The queue
+ * \param lifetime The packet is dropped if still queued after this time
+ * \return The new packet, or NULL if no space could be made for it
+ */
 struct uip_packetqueue_packet *
 uip_packetqueue_alloc(struct uip_packetqueue_handle *handle, clock_time_t lifetime);
 
-
+/** Remove the first (oldest) packet of a handle, after it has been sent. */
 void
 uip_packetqueue_free(struct uip_packetqueue_handle *handle);
 
+/** Drop all packets of a handle. */
+void
+uip_packetqueue_free_all(struct uip_packetqueue_handle *handle);
+
+/** Access to the first (oldest) packet of a handle */
 uint8_t *uip_packetqueue_buf(struct uip_packetqueue_handle *h);
 uint16_t uip_packetqueue_buflen(struct uip_packetqueue_handle *h);
 void uip_packetqueue_set_buflen(struct uip_packetqueue_handle *h, uint16_t len);
 
+/** Number of packets queued on a handle */
+uint8_t uip_packetqueue_len(struct uip_packetqueue_handle *h);
 
 #endif /* UIP_PACKETQUEUE_H */
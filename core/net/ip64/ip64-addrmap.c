@@ -32,7 +32,6 @@
 #include "ip64-addrmap.h"
 
 #include "lib/memb.h"
-#include "lib/list.h"
 
 #include "ip64-conf.h"
 
@@ -47,81 +46,199 @@
 #endif /* IP64_ADDRMAP_CONF_ENTRIES */
 
 MEMB(entrymemb, struct ip64_addrmap_entry, NUM_ENTRIES);
-LIST(entrylist);
 
-#define FIRST_MAPPED_PORT 10000
-#define LAST_MAPPED_PORT  20000
-static uint16_t mapped_port = FIRST_MAPPED_PORT;
+/* All mappings, least recently refreshed first. Since every packet
+   from the IPv6 side refreshes the lifetime of its mapping, expired
+   mappings collect at the head of the list and can be aged out
+   without walking the whole table. */
+static struct ip64_addrmap_entry *entrylist_head, *entrylist_tail;
 
-#define printf(...)
+static struct ip64_addrmap_entry *hash6[IP64_ADDRMAP_HASH_SIZE];
+static struct ip64_addrmap_entry *hash4[IP64_ADDRMAP_HASH_SIZE];
+
+#define FIRST_MAPPED_PORT IP64_ADDRMAP_FIRST_MAPPED_PORT
+#define LAST_MAPPED_PORT  IP64_ADDRMAP_LAST_MAPPED_PORT
+#define NUM_MAPPED_PORTS  (LAST_MAPPED_PORT - FIRST_MAPPED_PORT)
+
+/* One bit per mapped port, set while the port is in use. */
+static uint8_t portmap[(NUM_MAPPED_PORTS + 7) / 8];
 
 /*---------------------------------------------------------------------------*/
 struct ip64_addrmap_entry *
 ip64_addrmap_list(void)
 {
-  return list_head(entrylist);
+  return entrylist_head;
 }
 /*---------------------------------------------------------------------------*/
 void
 ip64_addrmap_init(void)
 {
   memb_init(&entrymemb);
-  list_init(entrylist);
-  mapped_port = FIRST_MAPPED_PORT;
+  entrylist_head = entrylist_tail = NULL;
+  memset(hash6, 0, sizeof(hash6));
+  memset(hash4, 0, sizeof(hash4));
+  memset(portmap, 0, sizeof(portmap));
+}
+/*---------------------------------------------------------------------------*/
+static uint16_t
+hash6_index(const uip_ip6addr_t *ip6addr, uint16_t ip6port,
+            const uip_ip4addr_t *ip4addr, uint16_t ip4port,
+            uint8_t protocol)
+{
+  uint16_t h;
+  int i;
+
+  h = protocol;
+  for(i = 4; i < 8; i++) {
+    h = (h << 5) + h + ip6addr->u16[i];
+  }
+  h = (h << 5) + h + ip4addr->u16[0];
+  h = (h << 5) + h + ip4addr->u16[1];
+  h = (h << 5) + h + ip6port;
+  h = (h << 5) + h + ip4port;
+  return h % IP64_ADDRMAP_HASH_SIZE;
+}
+/*---------------------------------------------------------------------------*/
+static uint16_t
+hash4_index(uint16_t mapped_port, uint8_t protocol)
+{
+  return (uint16_t)(mapped_port ^ protocol) % IP64_ADDRMAP_HASH_SIZE;
 }
 /*---------------------------------------------------------------------------*/
 static void
-check_age(void)
+list_unlink(struct ip64_addrmap_entry *m)
 {
-  struct ip64_addrmap_entry *m;
+  if(m->prev != NULL) {
+    m->prev->next = m->next;
+  } else {
+    entrylist_head = m->next;
+  }
+  if(m->next != NULL) {
+    m->next->prev = m->prev;
+  } else {
+    entrylist_tail = m->prev;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+list_append(struct ip64_addrmap_entry *m)
+{
+  m->next = NULL;
+  m->prev = entrylist_tail;
+  if(entrylist_tail != NULL) {
+    entrylist_tail->next = m;
+  } else {
+    entrylist_head = m;
+  }
+  entrylist_tail = m;
+}
+/*---------------------------------------------------------------------------*/
+static int
+alloc_port(uint16_t *port)
+{
+  uint16_t i, n;
 
-  /* Walk through the list of address mappings, throw away the ones
-     that are too old. */
-  m = list_head(entrylist);
-  while(m != NULL) {
-    if(timer_expired(&m->timer)) {
-      list_remove(entrylist, m);
-      memb_free(&entrymemb, m);
-      m = list_head(entrylist);
+  /* Start at a random position so that mapped ports stay hard to
+     guess, then take the first free port from there. Full bytes are
+     skipped eight ports at a time. */
+  i = random_rand() % NUM_MAPPED_PORTS;
+  for(n = 0; n < NUM_MAPPED_PORTS + 8; n++) {
+    if(portmap[i / 8] == 0xff) {
+      i = (i / 8 + 1) * 8;
+    } else if((portmap[i / 8] & (1 << (i % 8))) == 0) {
+      portmap[i / 8] |= 1 << (i % 8);
+      *port = FIRST_MAPPED_PORT + i;
+      return 1;
     } else {
-      m = list_item_next(m);
+      i++;
+    }
+    if(i >= NUM_MAPPED_PORTS) {
+      i = 0;
     }
   }
+  return 0;
 }
 /*---------------------------------------------------------------------------*/
-static int
-recycle(void)
+static void
+free_port(uint16_t port)
 {
-  /* Find the oldest recyclable mapping and remove it. */
-  struct ip64_addrmap_entry *m, *oldest;
+  uint16_t i;
 
-  /* Walk through the list of address mappings, throw away the ones
-     that are too old. */
+  i = port - FIRST_MAPPED_PORT;
+  portmap[i / 8] &= ~(1 << (i % 8));
+}
+/*---------------------------------------------------------------------------*/
+static void
+remove_entry(struct ip64_addrmap_entry *m)
+{
+  struct ip64_addrmap_entry **p;
 
-  oldest = NULL;
-  for(m = list_head(entrylist);
-      m != NULL;
-      m = list_item_next(m)) {
-    if(m->flags & FLAGS_RECYCLABLE) {
-      if(oldest == NULL) {
-        oldest = m;
-      } else {
-        if(timer_remaining(&m->timer) <
-           timer_remaining(&oldest->timer)) {
-          oldest = m;
-        }
-      }
+  list_unlink(m);
+
+  for(p = &hash6[hash6_index(&m->ip6addr, m->ip6port,
+                             &m->ip4addr, m->ip4port, m->protocol)];
+      *p != NULL; p = &(*p)->hnext6) {
+    if(*p == m) {
+      *p = m->hnext6;
+      break;
+    }
+  }
+  for(p = &hash4[hash4_index(m->mapped_port, m->protocol)];
+      *p != NULL; p = &(*p)->hnext4) {
+    if(*p == m) {
+      *p = m->hnext4;
+      break;
     }
   }
 
-  /* If we found an oldest recyclable entry, remove it and return
-     non-zero. */
-  if(oldest != NULL) {
-    list_remove(entrylist, oldest);
-    memb_free(&entrymemb, oldest);
-    return 1;
+  free_port(m->mapped_port);
+  memb_free(&entrymemb, m);
+}
+/*---------------------------------------------------------------------------*/
+static void
+check_age(void)
+{
+  /* Throw away the mappings that are too old. Only the head of the
+     list is looked at: mappings further back were refreshed later and
+     are picked up when they are looked up or when the table is
+     full. */
+  while(entrylist_head != NULL && timer_expired(&entrylist_head->timer)) {
+    remove_entry(entrylist_head);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+remove_expired(void)
+{
+  struct ip64_addrmap_entry *m, *next;
+  int removed;
+
+  /* Walk through the entire list of address mappings and throw away
+     the ones that are too old. Only used when the table is full. */
+  removed = 0;
+  for(m = entrylist_head; m != NULL; m = next) {
+    next = m->next;
+    if(timer_expired(&m->timer)) {
+      remove_entry(m);
+      removed = 1;
+    }
   }
+  return removed;
+}
+/*---------------------------------------------------------------------------*/
+static int
+recycle(void)
+{
+  struct ip64_addrmap_entry *m;
 
+  /* Find the least recently refreshed recyclable mapping and remove
+     it. */
+  for(m = entrylist_head; m != NULL; m = m->next) {
+    if(m->flags & FLAGS_RECYCLABLE) {
+      remove_entry(m);
+      return 1;
+    }
+  }
   return 0;
 }
 /*---------------------------------------------------------------------------*/
@@ -134,21 +251,18 @@ ip64_addrmap_lookup(const uip_ip6addr_t *ip6addr,
 {
   struct ip64_addrmap_entry *m;
 
-  printf("lookup ip4port %d ip6port %d\n", uip_htons(ip4port),
-	 uip_htons(ip6port));
   check_age();
-  for(m = list_head(entrylist); m != NULL; m = list_item_next(m)) {
-    printf("protocol %d %d, ip4port %d %d, ip6port %d %d, ip4 %d ip6 %d\n",
-	   m->protocol, protocol,
-	   m->ip4port, ip4port,
-	   m->ip6port, ip6port,
-	   uip_ip4addr_cmp(&m->ip4addr, ip4addr),
-	   uip_ip6addr_cmp(&m->ip6addr, ip6addr));
+  for(m = hash6[hash6_index(ip6addr, ip6port, ip4addr, ip4port, protocol)];
+      m != NULL; m = m->hnext6) {
     if(m->protocol == protocol &&
        m->ip4port == ip4port &&
        m->ip6port == ip6port &&
        uip_ip4addr_cmp(&m->ip4addr, ip4addr) &&
        uip_ip6addr_cmp(&m->ip6addr, ip6addr)) {
+      if(timer_expired(&m->timer)) {
+        remove_entry(m);
+        return NULL;
+      }
       m->ip6to4++;
       return m;
     }
@@ -162,12 +276,14 @@ ip64_addrmap_lookup_port(uint16_t mapped_port, uint8_t protocol)
   struct ip64_addrmap_entry *m;
 
   check_age();
-  for(m = list_head(entrylist); m != NULL; m = list_item_next(m)) {
-    printf("mapped port %d %d, protocol %d %d\n",
-	   m->mapped_port, mapped_port,
-	   m->protocol, protocol);
+  for(m = hash4[hash4_index(mapped_port, protocol)];
+      m != NULL; m = m->hnext4) {
     if(m->mapped_port == mapped_port &&
        m->protocol == protocol) {
+      if(timer_expired(&m->timer)) {
+        remove_entry(m);
+        return NULL;
+      }
       m->ip4to6++;
       return m;
     }
@@ -175,13 +291,6 @@ ip64_addrmap_lookup_port(uint16_t mapped_port, uint8_t protocol)
   return NULL;
 }
 /*---------------------------------------------------------------------------*/
-static void
-increase_mapped_port(void)
-{
-  mapped_port = (random_rand() % (LAST_MAPPED_PORT - FIRST_MAPPED_PORT)) +
-    FIRST_MAPPED_PORT;
-}
-/*---------------------------------------------------------------------------*/
 struct ip64_addrmap_entry *
 ip64_addrmap_create(const uip_ip6addr_t *ip6addr,
 		    uint16_t ip6port,
@@ -190,17 +299,23 @@ ip64_addrmap_create(const uip_ip6addr_t *ip6addr,
 		    uint8_t protocol)
 {
   struct ip64_addrmap_entry *m;
+  uint16_t h;
 
   check_age();
   m = memb_alloc(&entrymemb);
   if(m == NULL) {
-    /* We could not allocate an entry, try to recycle one and try to
-       allocate again. */
-    if(recycle()) {
+    /* We could not allocate an entry, try to throw away expired
+       mappings or recycle one and try to allocate again. */
+    if(remove_expired() || recycle()) {
       m = memb_alloc(&entrymemb);
     }
   }
   if(m != NULL) {
+    /* Pick a new, unused local port. */
+    if(!alloc_port(&m->mapped_port)) {
+      memb_free(&entrymemb, m);
+      return NULL;
+    }
     uip_ip4addr_copy(&m->ip4addr, ip4addr);
     m->ip4port = ip4port;
     uip_ip6addr_copy(&m->ip6addr, ip6addr);
@@ -211,25 +326,14 @@ ip64_addrmap_create(const uip_ip6addr_t *ip6addr,
     m->ip4to6 = 0;
     timer_set(&m->timer, 0);
 
-    /* Pick a new, unused local port. First make sure that the
-       mapped_port number does not belong to any active connection. If
-       so, we keep increasing the mapped_port until we're free. */
-    {
-      struct ip64_addrmap_entry *n;
-      n = list_head(entrylist);
-      while(n != NULL) {
-	if(n->mapped_port == mapped_port) {
-	  increase_mapped_port();
-	  n = list_head(entrylist);
-	} else {
-	  n = list_item_next(m);
-	}
-      }
-    }
-    m->mapped_port = mapped_port;
-    increase_mapped_port();
+    h = hash6_index(ip6addr, ip6port, ip4addr, ip4port, protocol);
+    m->hnext6 = hash6[h];
+    hash6[h] = m;
+    h = hash4_index(m->mapped_port, protocol);
+    m->hnext4 = hash4[h];
+    hash4[h] = m;
 
-    list_add(entrylist, m);
+    list_append(m);
     return m;
   }
   return NULL;
@@ -241,6 +345,10 @@ ip64_addrmap_set_lifetime(struct ip64_addrmap_entry *e,
 {
   if(e != NULL) {
     timer_set(&e->timer, time);
+    if(e != entrylist_tail) {
+      list_unlink(e);
+      list_append(e);
+    }
   }
 }
 /*---------------------------------------------------------------------------*/
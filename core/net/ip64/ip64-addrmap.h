@@ -36,8 +36,37 @@
 #include "sys/timer.h"
 #include "net/ip/uip.h"
 
+/* Number of hash buckets in each of the two lookup indexes (6to4 on
+   the full session tuple and 4to6 on the mapped port). */
+#ifdef IP64_ADDRMAP_CONF_HASH_SIZE
+#define IP64_ADDRMAP_HASH_SIZE IP64_ADDRMAP_CONF_HASH_SIZE
+#else /* IP64_ADDRMAP_CONF_HASH_SIZE */
+#define IP64_ADDRMAP_HASH_SIZE 16
+#endif /* IP64_ADDRMAP_CONF_HASH_SIZE */
+
+/* The range of local ports handed out to mappings. Port allocation
+   uses a bitmap with one bit per port in this range. */
+#ifdef IP64_ADDRMAP_CONF_FIRST_MAPPED_PORT
+#define IP64_ADDRMAP_FIRST_MAPPED_PORT IP64_ADDRMAP_CONF_FIRST_MAPPED_PORT
+#else /* IP64_ADDRMAP_CONF_FIRST_MAPPED_PORT */
+#define IP64_ADDRMAP_FIRST_MAPPED_PORT 10000
+#endif /* IP64_ADDRMAP_CONF_FIRST_MAPPED_PORT */
+
+#ifdef IP64_ADDRMAP_CONF_LAST_MAPPED_PORT
+#define IP64_ADDRMAP_LAST_MAPPED_PORT IP64_ADDRMAP_CONF_LAST_MAPPED_PORT
+#else /* IP64_ADDRMAP_CONF_LAST_MAPPED_PORT */
+#define IP64_ADDRMAP_LAST_MAPPED_PORT 20000
+#endif /* IP64_ADDRMAP_CONF_LAST_MAPPED_PORT */
+
 struct ip64_addrmap_entry {
+  /* The list of all mappings is kept in least-recently-refreshed
+     order: the head is the mapping whose lifetime was set longest
+     ago. */
   struct ip64_addrmap_entry *next;
+  struct ip64_addrmap_entry *prev;
+  /* Hash chains for the 6to4 and 4to6 lookup indexes. */
+  struct ip64_addrmap_entry *hnext6;
+  struct ip64_addrmap_entry *hnext4;
   struct timer timer;
   uip_ip6addr_t ip6addr;
   uip_ip4addr_t ip4addr;
@@ -86,7 +115,8 @@ struct ip64_addrmap_entry *ip64_addrmap_create(const uip_ip6addr_t *ip6addr,
 					       uint8_t protocol);
 
 /**
- * Set the lifetime of an address mapping.
+ * Set the lifetime of an address mapping. This also moves the
+ * mapping to the most recently used end of the mapping list.
  */
 void ip64_addrmap_set_lifetime(struct ip64_addrmap_entry *e,
                                clock_time_t lifetime);
@@ -97,7 +127,8 @@ void ip64_addrmap_set_lifetime(struct ip64_addrmap_entry *e,
 void ip64_addrmap_set_recycleble(struct ip64_addrmap_entry *e);
 
 /**
- * Obtain the list of all address mappings.
+ * Obtain the list of all address mappings, least recently refreshed
+ * first.
  */
 struct ip64_addrmap_entry *ip64_addrmap_list(void);
 #endif /* IP64_ADDRMAP_H */
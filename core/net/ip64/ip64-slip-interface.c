@@ -94,10 +94,19 @@ input_callback(void)
        packet back if no route is found */
     uip_ipaddr_copy(&last_sender, &UIP_IP_BUF->srcipaddr);
     
-    uint16_t len = ip64_4to6(&uip_buf[UIP_LLH_LEN], uip_len, 
-			     ip64_packet_buffer);
+    uint16_t len;
+
+    /* Move the IPv4 packet up to make room for the longer IPv6 header
+       and translate it in place. */
+    if(UIP_LLH_LEN + IP64_HDRLEN_DIFF + uip_len <= UIP_BUFSIZE) {
+      memmove(&uip_buf[UIP_LLH_LEN + IP64_HDRLEN_DIFF],
+              &uip_buf[UIP_LLH_LEN], uip_len);
+      len = ip64_4to6(&uip_buf[UIP_LLH_LEN + IP64_HDRLEN_DIFF], uip_len,
+                      &uip_buf[UIP_LLH_LEN]);
+    } else {
+      len = 0;
+    }
     if(len > 0) {
-      memcpy(&uip_buf[UIP_LLH_LEN], ip64_packet_buffer, len);
       uip_len = len;
       /*      PRINTF("send len %d\n", len); */
     } else {
@@ -131,13 +140,13 @@ output(void)
   if(uip_ipaddr_cmp(&last_sender, &UIP_IP_BUF->srcipaddr)) {
     PRINTF("ip64-interface: output, not sending bounced message\n");
   } else {
+    /* Translate in place: the IPv4 packet ends up IP64_HDRLEN_DIFF
+       bytes into the IPv6 packet. */
     len = ip64_6to4(&uip_buf[UIP_LLH_LEN], uip_len,
-		    ip64_packet_buffer);
+		    &uip_buf[UIP_LLH_LEN + IP64_HDRLEN_DIFF]);
     PRINTF("ip64-interface: output len %d\n", len);
     if(len > 0) {
-      memcpy(&uip_buf[UIP_LLH_LEN], ip64_packet_buffer, len);
-      uip_len = len;
-      slip_send();
+      slip_write(&uip_buf[UIP_LLH_LEN + IP64_HDRLEN_DIFF], len);
       return len;
     }
   }
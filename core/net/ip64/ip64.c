@@ -358,6 +358,30 @@ ipv6_transport_checksum(const uint8_t *packet, uint16_t len, uint8_t proto)
   return (sum == 0) ? 0xffff : uip_htons(sum);
 }
 /*---------------------------------------------------------------------------*/
+static uint16_t
+chksum_add(uint16_t sum, uint16_t t)
+{
+  sum += t;
+  if(sum < t) {
+    sum++;		/* carry */
+  }
+  return sum;
+}
+/*---------------------------------------------------------------------------*/
+/* Update a transport layer checksum after its pseudo-header addresses
+   and one port number have changed. old_sum and new_sum are the sums
+   of the fields before and after the change (RFC 1624, eqn. 3). */
+static uint16_t
+chksum_update(uint16_t chksum_field, uint16_t old_sum, uint16_t new_sum)
+{
+  uint16_t sum;
+
+  sum = ~uip_ntohs(chksum_field);
+  sum = chksum_add(sum, ~old_sum);
+  sum = chksum_add(sum, new_sum);
+  return uip_htons(~sum);
+}
+/*---------------------------------------------------------------------------*/
 int
 ip64_6to4(const uint8_t *ipv6packet, const uint16_t ipv6packet_len,
 	  uint8_t *resultpacket)
@@ -370,6 +394,9 @@ ip64_6to4(const uint8_t *ipv6packet, const uint16_t ipv6packet_len,
   struct icmpv6_hdr *icmpv6hdr;
   uint16_t ipv6len, ipv4len;
   struct ip64_addrmap_entry *m;
+  struct ipv6_hdr v6hdr_copy;
+  uint16_t old_port, old_sum, new_sum;
+  uint8_t full_checksum;
 
   v6hdr = (struct ipv6_hdr *)ipv6packet;
   v4hdr = (struct ipv4_hdr *)resultpacket;
@@ -381,11 +408,30 @@ ip64_6to4(const uint8_t *ipv6packet, const uint16_t ipv6packet_len,
     return 0;
   }
 
-  /* We copy the data from the IPv6 packet into the IPv4 packet. We do
-     not modify the data in any way. */
-  memcpy(&resultpacket[IPV4_HDRLEN],
-	 &ipv6packet[IPV6_HDRLEN],
-	 ipv6len - IPV6_HDRLEN);
+#if DEBUG
+  /* The transport layer checksum is updated rather than recomputed,
+     so a bad checksum stays bad and the receiver will drop the
+     packet. We only check it here for debugging. */
+  if((v6hdr->nxthdr == IP_PROTO_TCP || v6hdr->nxthdr == IP_PROTO_UDP) &&
+     ipv6_transport_checksum(ipv6packet, ipv6len, v6hdr->nxthdr) != 0xffff) {
+    PRINTF("ip64_6to4: bad transport layer checksum\n");
+  }
+#endif /* DEBUG */
+
+  if(&resultpacket[IPV4_HDRLEN] == &ipv6packet[IPV6_HDRLEN]) {
+    /* We are translating in place: the data already is where it
+       should be, but the IPv4 header overwrites the end of the IPv6
+       header, so we work from a copy of the IPv6 header. */
+    memcpy(&v6hdr_copy, ipv6packet, IPV6_HDRLEN);
+    v6hdr = &v6hdr_copy;
+  } else {
+    /* We copy the data from the IPv6 packet into the IPv4 packet. We
+       do not modify the data in any way. */
+    memcpy(&resultpacket[IPV4_HDRLEN],
+           &ipv6packet[IPV6_HDRLEN],
+           ipv6len - IPV6_HDRLEN);
+  }
+  full_checksum = 0;
 
   udphdr = (struct udp_hdr *)&resultpacket[IPV4_HDRLEN];
   tcphdr = (struct tcp_hdr *)&resultpacket[IPV4_HDRLEN];
@@ -424,15 +470,6 @@ ip64_6to4(const uint8_t *ipv6packet, const uint16_t ipv6packet_len,
   case IP_PROTO_TCP:
     PRINTF("ip64_6to4: TCP header\n");
     v4hdr->proto = IP_PROTO_TCP;
-
-    /* Compute and check the TCP checksum - since we're going to
-       recompute it ourselves, we must ensure that it was correct in
-       the first place. */
-    if(ipv6_transport_checksum(ipv6packet, ipv6len,
-                               IP_PROTO_TCP) != 0xffff) {
-      PRINTF("Bad TCP checksum, dropping packet\n");
-    }
-
     break;
 
   case IP_PROTO_UDP:
@@ -442,17 +479,13 @@ ip64_6to4(const uint8_t *ipv6packet, const uint16_t ipv6packet_len,
     /* Check if this is a DNS request. If so, we should rewrite it
        with the DNS64 module. */
     if(udphdr->destport == UIP_HTONS(DNS_PORT)) {
-      ip64_dns64_6to4((uint8_t *)v6hdr + IPV6_HDRLEN + sizeof(struct udp_hdr),
+      ip64_dns64_6to4(&ipv6packet[IPV6_HDRLEN + sizeof(struct udp_hdr)],
                       ipv6len - IPV6_HDRLEN - sizeof(struct udp_hdr),
                       (uint8_t *)udphdr + sizeof(struct udp_hdr),
                       BUFSIZE - IPV4_HDRLEN - sizeof(struct udp_hdr));
-    }
-    /* Compute and check the UDP checksum - since we're going to
-       recompute it ourselves, we must ensure that it was correct in
-       the first place. */
-    if(ipv6_transport_checksum(ipv6packet, ipv6len,
-                               IP_PROTO_UDP) != 0xffff) {
-      PRINTF("Bad UDP checksum, dropping packet\n");
+      /* The payload has changed, so the checksum cannot be
+         updated. */
+      full_checksum = 1;
     }
     break;
 
@@ -507,6 +540,9 @@ ip64_6to4(const uint8_t *ipv6packet, const uint16_t ipv6packet_len,
   }
   ip64_addr_copy4(&v4hdr->srcipaddr, &ip64_hostaddr);
 
+  /* Remember the source port, which may be changed below, for the
+     checksum update. */
+  old_port = udphdr->srcport;
 
   /* Next we update the transport layer header. This must be updated
      in two ways: the source port number is changed and the transport
@@ -614,19 +650,30 @@ ip64_6to4(const uint8_t *ipv6packet, const uint16_t ipv6packet_len,
 
 
 
+  /* For TCP and UDP, only the pseudo-header addresses and the source
+     port differ from what the checksum was computed over, so we
+     update the checksum with the difference instead of recomputing
+     it over the whole packet. */
+  old_sum = chksum(0, (uint8_t *)&v6hdr->srcipaddr, 2 * sizeof(uip_ip6addr_t));
+  old_sum = chksum(old_sum, (uint8_t *)&old_port, sizeof(old_port));
+  new_sum = chksum(0, (uint8_t *)&v4hdr->srcipaddr, 2 * sizeof(uip_ip4addr_t));
+  new_sum = chksum(new_sum, (uint8_t *)&udphdr->srcport, sizeof(udphdr->srcport));
+
   /* The checksum is in different places in the different protocol
      headers, so we need to be sure that we update the correct
      field. */
   switch(v4hdr->proto) {
   case IP_PROTO_TCP:
-    tcphdr->tcpchksum = 0;
-    tcphdr->tcpchksum = ~(ipv4_transport_checksum(resultpacket, ipv4len,
-						  IP_PROTO_TCP));
+    tcphdr->tcpchksum = chksum_update(tcphdr->tcpchksum, old_sum, new_sum);
     break;
   case IP_PROTO_UDP:
-    udphdr->udpchksum = 0;
-    udphdr->udpchksum = ~(ipv4_transport_checksum(resultpacket, ipv4len,
-						  IP_PROTO_UDP));
+    if(full_checksum) {
+      udphdr->udpchksum = 0;
+      udphdr->udpchksum = ~(ipv4_transport_checksum(resultpacket, ipv4len,
+                                                    IP_PROTO_UDP));
+    } else {
+      udphdr->udpchksum = chksum_update(udphdr->udpchksum, old_sum, new_sum);
+    }
     if(udphdr->udpchksum == 0) {
       udphdr->udpchksum = 0xffff;
     }
@@ -659,6 +706,9 @@ ip64_4to6(const uint8_t *ipv4packet, const uint16_t ipv4packet_len,
   struct icmpv6_hdr *icmpv6hdr;
   uint16_t ipv4len, ipv6len, ipv6_packet_len;
   struct ip64_addrmap_entry *m;
+  struct ipv4_hdr v4hdr_copy;
+  uint16_t old_port, old_sum, new_sum;
+  uint8_t in_place, full_checksum;
 
   v6hdr = (struct ipv6_hdr *)resultpacket;
   v4hdr = (struct ipv4_hdr *)ipv4packet;
@@ -680,16 +730,30 @@ ip64_4to6(const uint8_t *ipv4packet, const uint16_t ipv4packet_len,
     PRINTF("ip64_4to6: packet too big to fit in buffer, dropping\n");
     return 0;
   }
-  /* We copy the data from the IPv4 packet into the IPv6 packet. */
-  memcpy(&resultpacket[IPV6_HDRLEN],
-	 &ipv4packet[IPV4_HDRLEN],
-	 ipv4len - IPV4_HDRLEN);
-  
+  in_place = &resultpacket[IPV6_HDRLEN] == &ipv4packet[IPV4_HDRLEN];
+  if(in_place) {
+    /* We are translating in place: the data already is where it
+       should be, but the IPv6 header overwrites the IPv4 header, so
+       we work from a copy of the IPv4 header. */
+    memcpy(&v4hdr_copy, ipv4packet, IPV4_HDRLEN);
+    v4hdr = &v4hdr_copy;
+  } else {
+    /* We copy the data from the IPv4 packet into the IPv6 packet. */
+    memcpy(&resultpacket[IPV6_HDRLEN],
+           &ipv4packet[IPV4_HDRLEN],
+           ipv4len - IPV4_HDRLEN);
+  }
+  full_checksum = 0;
+
   udphdr = (struct udp_hdr *)&resultpacket[IPV6_HDRLEN];
   tcphdr = (struct tcp_hdr *)&resultpacket[IPV6_HDRLEN];
   icmpv4hdr = (struct icmpv4_hdr *)&ipv4packet[IPV4_HDRLEN];
   icmpv6hdr = (struct icmpv6_hdr *)&resultpacket[IPV6_HDRLEN];
 
+  /* Remember the destination port, which may be changed below, for
+     the checksum update. */
+  old_port = udphdr->destport;
+
   ipv6len = ipv4len - IPV4_HDRLEN + IPV6_HDRLEN;
   ipv6_packet_len = ipv6len - IPV6_HDRLEN;
 
@@ -732,11 +796,21 @@ ip64_4to6(const uint8_t *ipv4packet, const uint16_t ipv4packet_len,
        with the DNS64 module. */
     if(udphdr->srcport == UIP_HTONS(DNS_PORT)) {
       int len;
-
-      len = ip64_dns64_4to6((uint8_t *)v4hdr + IPV4_HDRLEN + sizeof(struct udp_hdr),
+      const uint8_t *dnsdata;
+
+      dnsdata = &ipv4packet[IPV4_HDRLEN + sizeof(struct udp_hdr)];
+      if(in_place) {
+        /* The DNS64 rewrite grows the answers as it goes, so it
+           cannot work in place. */
+        memcpy(ip64_packet_buffer, dnsdata,
+               ipv4len - IPV4_HDRLEN - sizeof(struct udp_hdr));
+        dnsdata = ip64_packet_buffer;
+      }
+      len = ip64_dns64_4to6(dnsdata,
                             ipv4len - IPV4_HDRLEN - sizeof(struct udp_hdr),
                             (uint8_t *)v6hdr + IPV6_HDRLEN + sizeof(struct udp_hdr),
                             ipv6_packet_len - sizeof(struct udp_hdr));
+      full_checksum = 1;
       ipv6_packet_len = len + sizeof(struct udp_hdr);
       v6hdr->len[0] = ipv6_packet_len >> 8;
       v6hdr->len[1] = ipv6_packet_len & 0xff;
@@ -849,21 +923,31 @@ ip64_4to6(const uint8_t *ipv4packet, const uint16_t ipv4packet_len,
     }
   }
 
+  /* As in ip64_6to4(), TCP and UDP checksums are updated with the
+     difference in the pseudo-header addresses and the destination
+     port. A UDP checksum of zero means that the IPv4 sender did not
+     compute one, but IPv6 requires it, so we compute it in full. */
+  old_sum = chksum(0, (uint8_t *)&v4hdr->srcipaddr, 2 * sizeof(uip_ip4addr_t));
+  old_sum = chksum(old_sum, (uint8_t *)&old_port, sizeof(old_port));
+  new_sum = chksum(0, (uint8_t *)&v6hdr->srcipaddr, 2 * sizeof(uip_ip6addr_t));
+  new_sum = chksum(new_sum, (uint8_t *)&udphdr->destport, sizeof(udphdr->destport));
+
   /* The checksum is in different places in the different protocol
      headers, so we need to be sure that we update the correct
      field. */
   switch(v6hdr->nxthdr) {
   case IP_PROTO_TCP:
-    tcphdr->tcpchksum = 0;
-    tcphdr->tcpchksum = ~(ipv6_transport_checksum(resultpacket,
-						  ipv6len,
-						  IP_PROTO_TCP));
+    tcphdr->tcpchksum = chksum_update(tcphdr->tcpchksum, old_sum, new_sum);
     break;
   case IP_PROTO_UDP:
-    udphdr->udpchksum = 0;
-    udphdr->udpchksum = ~(ipv6_transport_checksum(resultpacket,
-						  ipv6len,
-						  IP_PROTO_UDP));
+    if(full_checksum || udphdr->udpchksum == 0) {
+      udphdr->udpchksum = 0;
+      udphdr->udpchksum = ~(ipv6_transport_checksum(resultpacket,
+                                                    ipv6len,
+                                                    IP_PROTO_UDP));
+    } else {
+      udphdr->udpchksum = chksum_update(udphdr->udpchksum, old_sum, new_sum);
+    }
     if(udphdr->udpchksum == 0) {
       udphdr->udpchksum = 0xffff;
     }
@@ -34,6 +34,15 @@
 
 #include "net/ip/uip.h"
 
+/* The difference between the IPv6 and the IPv4 header lengths.
+
+   ip64_6to4() and ip64_4to6() translate a packet in place, without
+   copying its payload, when the result starts IP64_HDRLEN_DIFF bytes
+   after (6to4) or before (4to6) the original packet. For in place
+   4to6 translation of DNS replies, ip64_packet_buffer is used as
+   scratch space, so the packet must not be in ip64_packet_buffer. */
+#define IP64_HDRLEN_DIFF 20
+
 void ip64_init(void);
 int ip64_6to4(const uint8_t *ipv6packet, const uint16_t ipv6len,
               uint8_t *resultpacket);
@@ -55,6 +55,8 @@
 #define DEBUG DEBUG_NONE
 #include "net/ip/uip-debug.h"
 
+#define UIP_IP_BUF ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+
 #ifdef UIP_CONF_DS6_NEIGHBOR_STATE_CHANGED
 #define NEIGHBOR_STATE_CHANGED(n) UIP_CONF_DS6_NEIGHBOR_STATE_CHANGED(n)
 void NEIGHBOR_STATE_CHANGED(uip_ds6_nbr_t *n);
@@ -128,7 +130,7 @@ uip_ds6_nbr_rm(uip_ds6_nbr_t *nbr)
 {
   if(nbr != NULL) {
 #if UIP_CONF_IPV6_QUEUE_PKT
-    uip_packetqueue_free(&nbr->packethandle);
+    uip_packetqueue_free_all(&nbr->packethandle);
 #endif /* UIP_CONF_IPV6_QUEUE_PKT */
     NEIGHBOR_STATE_CHANGED(nbr);
     return nbr_table_remove(ds6_neighbors, nbr);
@@ -136,6 +138,20 @@ uip_ds6_nbr_rm(uip_ds6_nbr_t *nbr)
   return 0;
 }
 
+#if UIP_CONF_IPV6_QUEUE_PKT
+/*---------------------------------------------------------------------------*/
+void
+uip_ds6_nbr_send_queued(uip_ds6_nbr_t *nbr)
+{
+  while(uip_packetqueue_len(&nbr->packethandle) > 0) {
+    uip_len = uip_packetqueue_buflen(&nbr->packethandle);
+    memcpy(UIP_IP_BUF, uip_packetqueue_buf(&nbr->packethandle), uip_len);
+    uip_packetqueue_free(&nbr->packethandle);
+    tcpip_output(uip_ds6_nbr_get_ll(nbr));
+  }
+  uip_clear_buf();
+}
+#endif /* UIP_CONF_IPV6_QUEUE_PKT */
 /*---------------------------------------------------------------------------*/
 const uip_ipaddr_t *
 uip_ds6_nbr_get_ipaddr(const uip_ds6_nbr_t *nbr)
@@ -98,6 +98,15 @@ void uip_ds6_link_neighbor_callback(int status, int numtx);
 void uip_ds6_neighbor_periodic(void);
 int uip_ds6_nbr_num(void);
 
+#if UIP_CONF_IPV6_QUEUE_PKT
+/**
+ * \brief Send the packets queued for a neighbor while its address was
+ * being resolved, oldest first. Overwrites uip_buf.
+ * \param nbr The neighbor, which must have a link-layer address by now
+ */
+void uip_ds6_nbr_send_queued(uip_ds6_nbr_t *nbr);
+#endif /* UIP_CONF_IPV6_QUEUE_PKT */
+
 #if UIP_ND6_SEND_NS
 /**
  * \brief Refresh the reachable state of a neighbor. This function
@@ -487,6 +487,67 @@ frame802154_parse_fcf(uint8_t *data, frame802154_fcf_t *pfcf)
   memcpy(pfcf, &fcf, sizeof(frame802154_fcf_t));
 }
 /*----------------------------------------------------------------------------*/
+/* Parses a header laid out as framer-802154.c creates it for frames of
+ * the 2003 and 2006 versions: no security, and both addresses with the
+ * PAN ID compressed. Returns the header length, or 0 for any other
+ * layout, which is then left to the full parser. */
+static int
+parse_common(uint8_t *data, int len, frame802154_t *pf)
+{
+  uint8_t *p;
+  int c;
+  int dest_addr_len;
+  int src_addr_len;
+
+  /* Security disabled, PAN ID compression set, not an ACK */
+  if((data[0] & 0x48) != 0x40 ||
+     (data[0] & 7) == FRAME802154_ACKFRAME ||
+     /* Frame version 0 or 1, short or long addresses */
+     (data[1] & 0x20) != 0 ||
+     (data[1] & 0x88) != 0x88) {
+    return 0;
+  }
+
+  dest_addr_len = addr_len((data[1] >> 2) & 3);
+  src_addr_len = addr_len((data[1] >> 6) & 3);
+  c = 2 + ((data[1] & 1) ? 0 : 1) + 2 + dest_addr_len + src_addr_len;
+  if(c > len) {
+    return 0;
+  }
+
+  frame802154_parse_fcf(data, &pf->fcf);
+  p = data + 2;
+  if(pf->fcf.sequence_number_suppression == 0) {
+    pf->seq = p[0];
+    p++;
+  }
+
+  pf->dest_pid = p[0] + (p[1] << 8);
+  pf->src_pid = pf->dest_pid;
+  p += 2;
+
+  if(dest_addr_len == 2) {
+    linkaddr_copy((linkaddr_t *)&(pf->dest_addr), &linkaddr_null);
+  }
+  for(c = 0; c < dest_addr_len; c++) {
+    pf->dest_addr[c] = p[dest_addr_len - 1 - c];
+  }
+  p += dest_addr_len;
+
+  if(src_addr_len == 2) {
+    linkaddr_copy((linkaddr_t *)&(pf->src_addr), &linkaddr_null);
+  }
+  for(c = 0; c < src_addr_len; c++) {
+    pf->src_addr[c] = p[src_addr_len - 1 - c];
+  }
+  p += src_addr_len;
+
+  c = p - data;
+  pf->payload_len = len - c;
+  pf->payload = p;
+  return c;
+}
+/*----------------------------------------------------------------------------*/
 /**
  *   \brief Parses an input frame.  Scans the input frame to find each
  *   section, and stores the information of each section in a
@@ -512,6 +573,11 @@ frame802154_parse(uint8_t *data, int len, frame802154_t *pf)
     return 0;
   }
 
+  c = parse_common(data, len, pf);
+  if(c > 0) {
+    return c;
+  }
+
   p = data;
 
   /* decode the FCF */
@@ -54,6 +54,15 @@
 #define PRINTADDR(addr)
 #endif
 
+/* Number of header templates kept. Frames to a receiver that has a
+   template get a copy of it, with only the sequence number and frame
+   counter filled in. 0 disables the templates. */
+#ifdef FRAMER_802154_CONF_HDR_CACHE_SIZE
+#define HDR_CACHE_SIZE FRAMER_802154_CONF_HDR_CACHE_SIZE
+#else /* FRAMER_802154_CONF_HDR_CACHE_SIZE */
+#define HDR_CACHE_SIZE 4
+#endif /* FRAMER_802154_CONF_HDR_CACHE_SIZE */
+
 /**  \brief The sequence number (0x00 - 0xff) added to the transmitted
  *   data or MAC command frame. The default is a random value within
  *   the range.
@@ -62,25 +71,223 @@ static uint8_t mac_dsn;
 
 static uint8_t initialized = 0;
 
+#if HDR_CACHE_SIZE
+#if LLSEC802154_USES_AUX_HEADER
+#if LLSEC802154_USES_FRAME_COUNTER
+#define FRAME_COUNTER_LEN 4
+#else /* LLSEC802154_USES_FRAME_COUNTER */
+#define FRAME_COUNTER_LEN 0
+#endif /* LLSEC802154_USES_FRAME_COUNTER */
+#if LLSEC802154_USES_EXPLICIT_KEYS
+#define KEY_ID_MAX_LEN 9
+#else /* LLSEC802154_USES_EXPLICIT_KEYS */
+#define KEY_ID_MAX_LEN 0
+#endif /* LLSEC802154_USES_EXPLICIT_KEYS */
+#define AUX_HDR_MAX_LEN (1 + FRAME_COUNTER_LEN + KEY_ID_MAX_LEN)
+#else /* LLSEC802154_USES_AUX_HEADER */
+#define AUX_HDR_MAX_LEN 0
+#endif /* LLSEC802154_USES_AUX_HEADER */
+
+/* FCF, sequence number, one PAN ID and two long addresses */
+#define HDR_MAX_LEN (2 + 1 + 2 + 8 + 8 + AUX_HDR_MAX_LEN)
+
+/* Everything in the header apart from the sequence number and the
+   frame counter */
+struct hdr_key {
+  linkaddr_t receiver;
+  linkaddr_t sender;
+  uint16_t pan_id;
+  uint8_t frame_type;
+  uint8_t pending;
+  uint8_t ack_required;
+  uint8_t broadcast;
+#if LLSEC802154_USES_AUX_HEADER
+  uint8_t security_level;
+#if LLSEC802154_USES_EXPLICIT_KEYS
+  uint8_t key_id_mode;
+  uint8_t key_index;
+  uint16_t key_source;
+#endif /* LLSEC802154_USES_EXPLICIT_KEYS */
+#endif /* LLSEC802154_USES_AUX_HEADER */
+};
+
+struct hdr_template {
+  struct hdr_key key;
+  /* Length of the header, 0 if the template is unused */
+  uint8_t len;
+  /* Where the sequence number and frame counter go, 0 if not present */
+  uint8_t seq_offset;
+  uint8_t frame_counter_offset;
+  uint8_t hdr[HDR_MAX_LEN];
+};
+
+/* Kept roughly in order of use: a template moves one step towards the
+   front each time it is used, and the last one is replaced. */
+static struct hdr_template templates[HDR_CACHE_SIZE];
+#endif /* HDR_CACHE_SIZE */
+
+/*---------------------------------------------------------------------------*/
+static uint8_t
+next_seqno(void)
+{
+  uint8_t seq;
+
+  if(packetbuf_attr(PACKETBUF_ATTR_MAC_SEQNO)) {
+    return packetbuf_attr(PACKETBUF_ATTR_MAC_SEQNO);
+  }
+
+  /* Ensure that the sequence number 0 is not used as it would bypass the above check. */
+  if(mac_dsn == 0) {
+    mac_dsn++;
+  }
+  seq = mac_dsn++;
+  packetbuf_set_attr(PACKETBUF_ATTR_MAC_SEQNO, seq);
+  return seq;
+}
+/*---------------------------------------------------------------------------*/
+#if HDR_CACHE_SIZE
+static void
+get_key(struct hdr_key *key)
+{
+  memset(key, 0, sizeof(struct hdr_key));
+  key->broadcast = packetbuf_holds_broadcast();
+  if(!key->broadcast) {
+    linkaddr_copy(&key->receiver, packetbuf_addr(PACKETBUF_ADDR_RECEIVER));
+    key->ack_required = packetbuf_attr(PACKETBUF_ATTR_MAC_ACK);
+  }
+  linkaddr_copy(&key->sender, packetbuf_addr(PACKETBUF_ADDR_SENDER));
+  key->pan_id = frame802154_get_pan_id();
+  key->frame_type = packetbuf_attr(PACKETBUF_ATTR_FRAME_TYPE);
+  key->pending = packetbuf_attr(PACKETBUF_ATTR_PENDING);
+#if LLSEC802154_USES_AUX_HEADER
+  key->security_level = packetbuf_attr(PACKETBUF_ATTR_SECURITY_LEVEL);
+#if LLSEC802154_USES_EXPLICIT_KEYS
+  key->key_id_mode = packetbuf_attr(PACKETBUF_ATTR_KEY_ID_MODE);
+  key->key_index = packetbuf_attr(PACKETBUF_ATTR_KEY_INDEX);
+  key->key_source = packetbuf_attr(PACKETBUF_ATTR_KEY_SOURCE_BYTES_0_1);
+#endif /* LLSEC802154_USES_EXPLICIT_KEYS */
+#endif /* LLSEC802154_USES_AUX_HEADER */
+}
+/*---------------------------------------------------------------------------*/
+static struct hdr_template *
+lookup_template(const struct hdr_key *key)
+{
+  struct hdr_template tmp;
+  int i;
+
+  for(i = 0; i < HDR_CACHE_SIZE && templates[i].len > 0; i++) {
+    if(memcmp(&templates[i].key, key, sizeof(struct hdr_key)) == 0) {
+      if(i == 0) {
+        return &templates[0];
+      }
+      memcpy(&tmp, &templates[i - 1], sizeof(struct hdr_template));
+      memcpy(&templates[i - 1], &templates[i], sizeof(struct hdr_template));
+      memcpy(&templates[i], &tmp, sizeof(struct hdr_template));
+      return &templates[i - 1];
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static void
+add_template(const struct hdr_key *key, const frame802154_t *params,
+             const uint8_t *hdr, int hdr_len)
+{
+  struct hdr_template *t;
+  int i;
+
+  if(hdr_len > HDR_MAX_LEN) {
+    return;
+  }
+
+  /* Take the first unused template, or the least used one */
+  for(i = 0; i < HDR_CACHE_SIZE - 1 && templates[i].len > 0; i++);
+  t = &templates[i];
+
+  memcpy(&t->key, key, sizeof(struct hdr_key));
+  t->len = hdr_len;
+  memcpy(t->hdr, hdr, hdr_len);
+  t->seq_offset = params->fcf.sequence_number_suppression ? 0 : 2;
+  t->frame_counter_offset = 0;
+#if LLSEC802154_USES_AUX_HEADER && LLSEC802154_USES_FRAME_COUNTER
+  if(params->fcf.security_enabled) {
+    /* The frame counter follows the security control field, and only
+       the key identifier comes after it */
+    t->frame_counter_offset = hdr_len - FRAME_COUNTER_LEN;
+#if LLSEC802154_USES_EXPLICIT_KEYS
+    if(params->aux_hdr.security_control.key_id_mode) {
+      t->frame_counter_offset -=
+        (params->aux_hdr.security_control.key_id_mode - 1) * 4 + 1;
+    }
+#endif /* LLSEC802154_USES_EXPLICIT_KEYS */
+  }
+#endif /* LLSEC802154_USES_AUX_HEADER && LLSEC802154_USES_FRAME_COUNTER */
+}
+/*---------------------------------------------------------------------------*/
+static int
+create_from_template(const struct hdr_template *t, int do_create)
+{
+  uint8_t *hdr;
+  uint8_t seq;
+#if LLSEC802154_USES_AUX_HEADER && LLSEC802154_USES_FRAME_COUNTER
+  frame802154_frame_counter_t frame_counter;
+#endif /* LLSEC802154_USES_AUX_HEADER && LLSEC802154_USES_FRAME_COUNTER */
+
+  if(!do_create) {
+    return t->len;
+  }
+  seq = next_seqno();
+  if(!packetbuf_hdralloc(t->len)) {
+    PRINTF("15.4-OUT: too large header: %u\n", t->len);
+    return FRAMER_FAILED;
+  }
+
+  hdr = packetbuf_hdrptr();
+  memcpy(hdr, t->hdr, t->len);
+  if(t->seq_offset) {
+    hdr[t->seq_offset] = seq;
+  }
+#if LLSEC802154_USES_AUX_HEADER && LLSEC802154_USES_FRAME_COUNTER
+  if(t->frame_counter_offset) {
+    frame_counter.u16[0] = packetbuf_attr(PACKETBUF_ATTR_FRAME_COUNTER_BYTES_0_1);
+    frame_counter.u16[1] = packetbuf_attr(PACKETBUF_ATTR_FRAME_COUNTER_BYTES_2_3);
+    memcpy(hdr + t->frame_counter_offset, frame_counter.u8, 4);
+  }
+#endif /* LLSEC802154_USES_AUX_HEADER && LLSEC802154_USES_FRAME_COUNTER */
+  return t->len;
+}
+#endif /* HDR_CACHE_SIZE */
 /*---------------------------------------------------------------------------*/
 static int
 create_frame(int type, int do_create)
 {
   frame802154_t params;
   int hdr_len;
+#if HDR_CACHE_SIZE
+  struct hdr_key key;
+  struct hdr_template *t;
+#endif /* HDR_CACHE_SIZE */
 
   if(frame802154_get_pan_id() == 0xffff) {
     return -1;
   }
 
-  /* init to zeros */
-  memset(&params, 0, sizeof(params));
-
   if(!initialized) {
     initialized = 1;
     mac_dsn = random_rand() & 0xff;
   }
 
+#if HDR_CACHE_SIZE
+  get_key(&key);
+  t = lookup_template(&key);
+  if(t != NULL) {
+    return create_from_template(t, do_create);
+  }
+#endif /* HDR_CACHE_SIZE */
+
+  /* init to zeros */
+  memset(&params, 0, sizeof(params));
+
   /* Build the FCF. */
   params.fcf.frame_type = packetbuf_attr(PACKETBUF_ATTR_FRAME_TYPE);
   params.fcf.frame_pending = packetbuf_attr(PACKETBUF_ATTR_PENDING);
@@ -121,21 +328,11 @@ create_frame(int type, int do_create)
 #endif /* LLSEC802154_USES_AUX_HEADER */
 
   /* Increment and set the data sequence number. */
-  if(!do_create) {
-    /* Only length calculation - no sequence number is needed and
-       should not be consumed. */
-
-  } else if(packetbuf_attr(PACKETBUF_ATTR_MAC_SEQNO)) {
-    params.seq = packetbuf_attr(PACKETBUF_ATTR_MAC_SEQNO);
-
-  } else {
-    /* Ensure that the sequence number 0 is not used as it would bypass the above check. */
-    if(mac_dsn == 0) {
-      mac_dsn++;
-    }
-    params.seq = mac_dsn++;
-    packetbuf_set_attr(PACKETBUF_ATTR_MAC_SEQNO, params.seq);
+  if(do_create) {
+    params.seq = next_seqno();
   }
+  /* Otherwise only length calculation - no sequence number is needed
+     and should not be consumed. */
 
   /* Complete the addressing fields. */
   /**
@@ -184,6 +381,9 @@ create_frame(int type, int do_create)
     return hdr_len;
   } else if(packetbuf_hdralloc(hdr_len)) {
     frame802154_create(&params, packetbuf_hdrptr());
+#if HDR_CACHE_SIZE
+    add_template(&key, &params, packetbuf_hdrptr(), hdr_len);
+#endif /* HDR_CACHE_SIZE */
 
     PRINTF("15.4-OUT: %2X", params.fcf.frame_type);
     PRINTADDR(params.dest_addr);
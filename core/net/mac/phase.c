@@ -50,15 +50,79 @@
 #define PHASE_DRIFT_CORRECT 0
 #endif
 
+/* Drift is measured over intervals of at least PHASE_DRIFT_MIN_INTERVAL,
+   as the encounter time of a single transmission is too noisy to
+   estimate drift from consecutive packets. Beyond
+   PHASE_DRIFT_MAX_INTERVAL, the accumulated drift is no longer
+   predicted. */
+#ifdef PHASE_CONF_DRIFT_MIN_INTERVAL
+#define PHASE_DRIFT_MIN_INTERVAL PHASE_CONF_DRIFT_MIN_INTERVAL
+#else
+#define PHASE_DRIFT_MIN_INTERVAL (CLOCK_SECOND * 30)
+#endif
+
+#ifdef PHASE_CONF_DRIFT_MAX_INTERVAL
+#define PHASE_DRIFT_MAX_INTERVAL PHASE_CONF_DRIFT_MAX_INTERVAL
+#else
+#define PHASE_DRIFT_MAX_INTERVAL (CLOCK_SECOND * 60 * 10)
+#endif
+
+/* With PHASE_CONF_PERSIST, the drift estimates are periodically saved
+   with the settings manager and restored at boot. The phases
+   themselves are relative to the rtimer of this node and are not
+   valid after a reboot, so they are always relearned. The estimates
+   are kept in a single value of fixed size, so that the settings
+   manager can overwrite it in place. */
+#if PHASE_CONF_PERSIST
+#define PHASE_PERSIST PHASE_CONF_PERSIST
+#else
+#define PHASE_PERSIST 0
+#endif
+
+#if PHASE_PERSIST && !PHASE_DRIFT_CORRECT
+#error "PHASE_CONF_PERSIST requires PHASE_CONF_DRIFT_CORRECT"
+#endif
+
+#ifdef PHASE_CONF_PERSIST_INTERVAL
+#define PHASE_PERSIST_INTERVAL PHASE_CONF_PERSIST_INTERVAL
+#else
+#define PHASE_PERSIST_INTERVAL (CLOCK_SECOND * 60 * 60)
+#endif
+
+#if PHASE_PERSIST
+#include "lib/settings.h"
+#include <string.h>
+#endif
+
+#define PHASE_FLAG_TIME  0x01 /* The time field holds a valid phase */
+#define PHASE_FLAG_DRIFT 0x02 /* The drift field holds an estimate */
+
 struct phase {
   rtimer_clock_t time;
 #if PHASE_DRIFT_CORRECT
-  rtimer_clock_t drift;
+  clock_time_t ctime;      /* clock_time() when time was recorded */
+  rtimer_clock_t ref_time; /* Start of the current drift measurement */
+  clock_time_t ref_ctime;
+  int16_t drift;           /* Phase drift per cycle, in 1/256 rtimer ticks */
 #endif
+  uint8_t flags;
   uint8_t noacks;
   struct timer noacks_timer;
 };
 
+#if PHASE_PERSIST
+struct phase_record {
+  linkaddr_t addr;
+  int16_t drift;
+};
+
+/* The number of drift estimates that fit in the saved value. Unused
+   records have the null address. */
+#define PHASE_PERSIST_RECORDS \
+  MIN(NBR_TABLE_MAX_NEIGHBORS, \
+      SETTINGS_MAX_VALUE_SIZE / sizeof(struct phase_record))
+#endif
+
 struct phase_queueitem {
   struct ctimer timer;
   mac_callback_t mac_callback;
@@ -87,6 +151,147 @@ NBR_TABLE(struct phase, nbr_phase);
 #define PRINTDEBUG(...)
 #endif
 /*---------------------------------------------------------------------------*/
+/* The entry that was looked up last. ContikiMAC looks up the same
+   neighbor in phase_wait() and phase_update() for every packet, and
+   packets tend to come in bursts to the same neighbor, so this avoids
+   most walks through the neighbor table. */
+static struct phase *last_phase;
+
+#if PHASE_DRIFT_CORRECT
+/* The cycle time passed to phase_wait(), needed to estimate drift in
+   phase_update(). */
+static rtimer_clock_t phase_cycle_time;
+#endif
+
+#if PHASE_PERSIST
+static struct ctimer persist_timer;
+static uint8_t persist_dirty;
+#endif
+/*---------------------------------------------------------------------------*/
+static struct phase *
+lookup(const linkaddr_t *neighbor)
+{
+  if(last_phase != NULL &&
+     linkaddr_cmp(neighbor, nbr_table_get_lladdr(nbr_phase, last_phase))) {
+    return last_phase;
+  }
+  last_phase = nbr_table_get_from_lladdr(nbr_phase, neighbor);
+  return last_phase;
+}
+/*---------------------------------------------------------------------------*/
+static void
+remove_phase(struct phase *e)
+{
+  if(e == last_phase) {
+    last_phase = NULL;
+  }
+  nbr_table_remove(nbr_phase, e);
+}
+/*---------------------------------------------------------------------------*/
+static void
+removed_callback(nbr_table_item_t *item)
+{
+  /* Called by the neighbor table when it reuses our entry */
+  if(item == last_phase) {
+    last_phase = NULL;
+  }
+}
+/*---------------------------------------------------------------------------*/
+#if PHASE_DRIFT_CORRECT
+static uint32_t
+cycles_in(clock_time_t t, rtimer_clock_t cycle_time)
+{
+  return ((uint32_t)t * (RTIMER_ARCH_SECOND / cycle_time) +
+          CLOCK_SECOND / 2) / CLOCK_SECOND;
+}
+/*---------------------------------------------------------------------------*/
+/* The drift accumulated since the last update, in rtimer ticks */
+static int32_t
+predicted_drift(const struct phase *e, rtimer_clock_t cycle_time)
+{
+  clock_time_t since;
+
+  since = clock_time() - e->ctime;
+  if(!(e->flags & PHASE_FLAG_DRIFT) || since > PHASE_DRIFT_MAX_INTERVAL) {
+    return 0;
+  }
+  return (int32_t)e->drift * (int32_t)cycles_in(since, cycle_time) / 256;
+}
+/*---------------------------------------------------------------------------*/
+static void
+update_drift(struct phase *e, rtimer_clock_t time, clock_time_t now)
+{
+  rtimer_clock_t cycle_time = phase_cycle_time;
+  clock_time_t since;
+  uint32_t cycles;
+  int32_t offset, expected, sample;
+
+  since = now - e->ref_ctime;
+  if(since < PHASE_DRIFT_MIN_INTERVAL || cycle_time == 0) {
+    return;
+  }
+
+  cycles = cycles_in(since, cycle_time);
+  if(since <= PHASE_DRIFT_MAX_INTERVAL && cycles > 0) {
+    /* The offset of the phase from where it would have been without
+       drift, which we only observe modulo the cycle time. We pick the
+       value closest to what the current estimate predicts. */
+    offset = (rtimer_clock_t)(time - e->ref_time) % cycle_time;
+    if(offset > (int32_t)cycle_time / 2) {
+      offset -= (int32_t)cycle_time;
+    }
+    if(e->flags & PHASE_FLAG_DRIFT) {
+      expected = (int32_t)e->drift * (int32_t)cycles / 256;
+      while(expected - offset > (int32_t)cycle_time / 2) {
+        offset += (int32_t)cycle_time;
+      }
+      while(offset - expected > (int32_t)cycle_time / 2) {
+        offset -= (int32_t)cycle_time;
+      }
+    }
+
+    sample = offset * 256 / (int32_t)cycles;
+    if(sample > INT16_MAX) {
+      sample = INT16_MAX;
+    } else if(sample < INT16_MIN) {
+      sample = INT16_MIN;
+    }
+
+    if(e->flags & PHASE_FLAG_DRIFT) {
+      e->drift = (3 * (int32_t)e->drift + sample) / 4;
+    } else {
+      e->drift = sample;
+      e->flags |= PHASE_FLAG_DRIFT;
+    }
+    PRINTF("phase drift %d/256 per cycle\n", e->drift);
+#if PHASE_PERSIST
+    persist_dirty = 1;
+#endif
+  }
+
+  e->ref_time = time;
+  e->ref_ctime = now;
+}
+#endif /* PHASE_DRIFT_CORRECT */
+/*---------------------------------------------------------------------------*/
+static void
+set_phase(struct phase *e, rtimer_clock_t time)
+{
+#if PHASE_DRIFT_CORRECT
+  clock_time_t now = clock_time();
+
+  if(e->flags & PHASE_FLAG_TIME) {
+    update_drift(e, time, now);
+  } else {
+    e->ref_time = time;
+    e->ref_ctime = now;
+  }
+  e->ctime = now;
+#endif
+  e->time = time;
+  e->flags |= PHASE_FLAG_TIME;
+}
+/*---------------------------------------------------------------------------*/
 void
 phase_update(const linkaddr_t *neighbor, rtimer_clock_t time,
              int mac_status)
@@ -94,18 +299,15 @@ phase_update(const linkaddr_t *neighbor, rtimer_clock_t time,
   struct phase *e;
 
   /* If we have an entry for this neighbor already, we renew it. */
-  e = nbr_table_get_from_lladdr(nbr_phase, neighbor);
+  e = lookup(neighbor);
   if(e != NULL) {
     if(mac_status == MAC_TX_OK) {
-#if PHASE_DRIFT_CORRECT
-      e->drift = time-e->time;
-#endif
-      e->time = time;
+      set_phase(e, time);
     }
     /* If the neighbor didn't reply to us, it may have switched
        phase (rebooted). We try a number of transmissions to it
        before we drop it from the phase list. */
-    if(mac_status == MAC_TX_NOACK) {
+    if(mac_status == MAC_TX_NOACK && (e->flags & PHASE_FLAG_TIME)) {
       PRINTF("phase noacks %d to %d.%d\n", e->noacks, neighbor->u8[0], neighbor->u8[1]);
       e->noacks++;
       if(e->noacks == 1) {
@@ -113,7 +315,16 @@ phase_update(const linkaddr_t *neighbor, rtimer_clock_t time,
       }
       if(e->noacks >= MAX_NOACKS || timer_expired(&e->noacks_timer)) {
         PRINTF("drop %d\n", neighbor->u8[0]);
-        nbr_table_remove(nbr_phase, e);
+#if PHASE_DRIFT_CORRECT
+        /* Forget the phase, but keep the drift estimate: it is a
+           property of the neighbor's clock and survives a reboot. */
+        if(e->flags & PHASE_FLAG_DRIFT) {
+          e->flags &= ~PHASE_FLAG_TIME;
+          e->noacks = 0;
+          return;
+        }
+#endif
+        remove_phase(e);
         return;
       }
     } else if(mac_status == MAC_TX_OK) {
@@ -124,16 +335,24 @@ phase_update(const linkaddr_t *neighbor, rtimer_clock_t time,
     if(mac_status == MAC_TX_OK && e == NULL) {
       e = nbr_table_add_lladdr(nbr_phase, neighbor, NBR_TABLE_REASON_MAC, NULL);
       if(e) {
-        e->time = time;
-#if PHASE_DRIFT_CORRECT
-      e->drift = 0;
-#endif
-      e->noacks = 0;
+        set_phase(e, time);
+        last_phase = e;
       }
     }
   }
 }
 /*---------------------------------------------------------------------------*/
+void
+phase_remove(const linkaddr_t *neighbor)
+{
+  struct phase *e;
+
+  e = lookup(neighbor);
+  if(e != NULL) {
+    remove_phase(e);
+  }
+}
+/*---------------------------------------------------------------------------*/
 static void
 send_packet(void *ptr)
 {
@@ -162,8 +381,8 @@ phase_wait(const linkaddr_t *neighbor, rtimer_clock_t cycle_time,
      phase for this particular neighbor. If so, we can compute the
      time for the next expected phase and setup a ctimer to switch on
      the radio just before the phase. */
-  e = nbr_table_get_from_lladdr(nbr_phase, neighbor);
-  if(e != NULL) {
+  e = lookup(neighbor);
+  if(e != NULL && (e->flags & PHASE_FLAG_TIME)) {
     rtimer_clock_t wait, now, expected, sync;
     clock_time_t ctimewait;
     
@@ -186,14 +405,9 @@ phase_wait(const linkaddr_t *neighbor, rtimer_clock_t cycle_time,
     sync = (e == NULL) ? now : e->time;
 
 #if PHASE_DRIFT_CORRECT
-    {
-      int32_t s;
-      if(e->drift > cycle_time) {
-        s = e->drift % cycle_time / (e->drift / cycle_time);  /* drift per cycle */
-        s = s * (now - sync) / cycle_time;                    /* estimated drift to now */
-        sync += s;                                            /* add it in */
-      }
-    }
+    /* Move the phase by the drift we expect since it was recorded */
+    phase_cycle_time = cycle_time;
+    sync += predicted_drift(e, cycle_time);
 #endif
 
     /* Check if cycle_time is a power of two */
@@ -243,10 +457,73 @@ phase_wait(const linkaddr_t *neighbor, rtimer_clock_t cycle_time,
   return PHASE_UNKNOWN;
 }
 /*---------------------------------------------------------------------------*/
+#if PHASE_PERSIST
+static void
+persist(void *ptr)
+{
+  struct phase *e;
+  struct phase_record r[PHASE_PERSIST_RECORDS];
+  uint8_t i;
+
+  ctimer_reset(&persist_timer);
+  if(!persist_dirty) {
+    /* Spare the EEPROM when nothing has changed */
+    return;
+  }
+  persist_dirty = 0;
+
+  memset(r, 0, sizeof(r));
+  i = 0;
+  for(e = nbr_table_head(nbr_phase);
+      e != NULL && i < PHASE_PERSIST_RECORDS;
+      e = nbr_table_next(nbr_phase, e)) {
+    if(e->flags & PHASE_FLAG_DRIFT) {
+      linkaddr_copy(&r[i].addr, nbr_table_get_lladdr(nbr_phase, e));
+      r[i].drift = e->drift;
+      i++;
+    }
+  }
+  if(settings_set(SETTINGS_KEY_PHASE_DRIFT, (uint8_t *)r,
+                  sizeof(r)) != SETTINGS_STATUS_OK) {
+    PRINTF("phase: could not save drift\n");
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+restore(void)
+{
+  struct phase *e;
+  struct phase_record r[PHASE_PERSIST_RECORDS];
+  settings_length_t size;
+  uint8_t i;
+
+  size = sizeof(r);
+  if(settings_get(SETTINGS_KEY_PHASE_DRIFT, 0, (uint8_t *)r,
+                  &size) != SETTINGS_STATUS_OK || size != sizeof(r)) {
+    return;
+  }
+  for(i = 0; i < PHASE_PERSIST_RECORDS; i++) {
+    if(linkaddr_cmp(&r[i].addr, &linkaddr_null)) {
+      break;
+    }
+    e = nbr_table_add_lladdr(nbr_phase, &r[i].addr, NBR_TABLE_REASON_MAC, NULL);
+    if(e == NULL) {
+      break;
+    }
+    e->drift = r[i].drift;
+    e->flags = PHASE_FLAG_DRIFT;
+  }
+}
+#endif /* PHASE_PERSIST */
+/*---------------------------------------------------------------------------*/
 void
 phase_init(void)
 {
   memb_init(&queued_packets_memb);
-  nbr_table_register(nbr_phase, NULL);
+  nbr_table_register(nbr_phase, removed_callback);
+#if PHASE_PERSIST
+  restore();
+  ctimer_set(&persist_timer, PHASE_PERSIST_INTERVAL, persist, NULL);
+#endif
 }
 /*---------------------------------------------------------------------------*/
@@ -44,6 +44,7 @@
 
 #include <limits.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "contiki.h"
 #include "lib/memb.h"
@@ -77,6 +78,96 @@ MEMB(collect_neighbors_mem, struct collect_neighbor, MAX_COLLECT_NEIGHBORS);
 #define PRINTF(...)
 #endif
 
+/*---------------------------------------------------------------------------*/
+static uint8_t
+hash(const linkaddr_t *addr)
+{
+  uint8_t h;
+  int i;
+
+  h = 0;
+  for(i = 0; i < LINKADDR_SIZE; i++) {
+    h ^= addr->u8[i];
+  }
+  return h & (COLLECT_NEIGHBOR_HASH_SIZE - 1);
+}
+/*---------------------------------------------------------------------------*/
+static void
+hash_add(struct collect_neighbor_list *neighbors_list,
+         struct collect_neighbor *n)
+{
+  uint8_t h;
+
+  h = hash(&n->addr);
+  n->hash_next = neighbors_list->hash[h];
+  neighbors_list->hash[h] = n;
+}
+/*---------------------------------------------------------------------------*/
+static void
+hash_remove(struct collect_neighbor_list *neighbors_list,
+            struct collect_neighbor *n)
+{
+  struct collect_neighbor **p;
+
+  for(p = &neighbors_list->hash[hash(&n->addr)]; *p != NULL;
+      p = &(*p)->hash_next) {
+    if(*p == n) {
+      *p = n->hash_next;
+      return;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * Called whenever the rtmetric or the link estimate of a neighbor
+ * has changed. If the neighbor got better than the best neighbor, it
+ * becomes the best neighbor. If the best neighbor got worse than what
+ * any other neighbor may have, or another neighbor got as good as the
+ * best one, the best neighbor is looked up again the next time it is
+ * asked for. Ties go to the neighbor that comes first in the list,
+ * which only a lookup knows.
+ */
+static void
+update_best(struct collect_neighbor *n)
+{
+  struct collect_neighbor_list *neighbors_list;
+  uint16_t rtmetric;
+
+  neighbors_list = n->neighbor_list;
+  if(!neighbors_list->best_valid) {
+    return;
+  }
+
+  rtmetric = collect_neighbor_rtmetric_link_estimate(n);
+  if(n == neighbors_list->best) {
+    if(rtmetric >= neighbors_list->next_rtmetric || rtmetric >= RTMETRIC_MAX) {
+      neighbors_list->best_valid = 0;
+    } else {
+      neighbors_list->best_rtmetric = rtmetric;
+    }
+  } else if(rtmetric < neighbors_list->best_rtmetric) {
+    neighbors_list->next_rtmetric = neighbors_list->best_rtmetric;
+    neighbors_list->best = n;
+    neighbors_list->best_rtmetric = rtmetric;
+  } else if(rtmetric == neighbors_list->best_rtmetric &&
+            rtmetric < RTMETRIC_MAX) {
+    neighbors_list->best_valid = 0;
+  } else if(rtmetric < neighbors_list->next_rtmetric) {
+    neighbors_list->next_rtmetric = rtmetric;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+neighbor_free(struct collect_neighbor_list *neighbors_list,
+              struct collect_neighbor *n)
+{
+  hash_remove(neighbors_list, n);
+  list_remove(neighbors_list->list, n);
+  if(n == neighbors_list->best) {
+    neighbors_list->best_valid = 0;
+  }
+  memb_free(&collect_neighbors_mem, n);
+}
 /*---------------------------------------------------------------------------*/
 static void
 periodic(void *ptr)
@@ -95,10 +186,10 @@ periodic(void *ptr)
     if(n->le_age == MAX_LE_AGE) {
       collect_link_estimate_new(&n->le);
       n->le_age = 0;
+      update_best(n);
     }
     if(n->age == MAX_AGE) {
-      memb_free(&collect_neighbors_mem, n);
-      list_remove(neighbor_list->list, n);
+      neighbor_free(neighbor_list, n);
       n = list_head(neighbor_list->list);
     }
   }
@@ -121,6 +212,11 @@ collect_neighbor_list_new(struct collect_neighbor_list *neighbors_list)
 {
   LIST_STRUCT_INIT(neighbors_list, list);
   list_init(neighbors_list->list);
+  memset(neighbors_list->hash, 0, sizeof(neighbors_list->hash));
+  neighbors_list->best = NULL;
+  neighbors_list->best_rtmetric = RTMETRIC_MAX;
+  neighbors_list->next_rtmetric = RTMETRIC_MAX;
+  neighbors_list->best_valid = 1;
   ctimer_set(&neighbors_list->periodic, CLOCK_SECOND, periodic, neighbors_list);
 }
 /*---------------------------------------------------------------------------*/
@@ -132,7 +228,7 @@ collect_neighbor_list_find(struct collect_neighbor_list *neighbors_list,
   if(neighbors_list == NULL) {
     return NULL;
   }
-  for(n = list_head(neighbors_list->list); n != NULL; n = list_item_next(n)) {
+  for(n = neighbors_list->hash[hash(addr)]; n != NULL; n = n->hash_next) {
     if(linkaddr_cmp(&n->addr, addr)) {
       return n;
     }
@@ -158,12 +254,10 @@ collect_neighbor_list_add(struct collect_neighbor_list *neighbors_list,
   PRINTF("collect_neighbor_add: adding %d.%d\n", addr->u8[0], addr->u8[1]);
 
   /* Check if the collect_neighbor is already on the list. */
-  for(n = list_head(neighbors_list->list); n != NULL; n = list_item_next(n)) {
-    if(linkaddr_cmp(&n->addr, addr)) {
-      PRINTF("collect_neighbor_add: already on list %d.%d\n",
-             addr->u8[0], addr->u8[1]);
-      break;
-    }
+  n = collect_neighbor_list_find(neighbors_list, addr);
+  if(n != NULL) {
+    PRINTF("collect_neighbor_add: already on list %d.%d\n",
+           addr->u8[0], addr->u8[1]);
   }
 
   /* If the collect_neighbor was not on the list, we try to allocate memory
@@ -173,7 +267,10 @@ collect_neighbor_list_add(struct collect_neighbor_list *neighbors_list,
            addr->u8[0], addr->u8[1]);
     n = memb_alloc(&collect_neighbors_mem);
     if(n != NULL) {
+      n->neighbor_list = neighbors_list;
+      linkaddr_copy(&n->addr, addr);
       list_add(neighbors_list->list, n);
+      hash_add(neighbors_list, n);
     }
   }
 
@@ -209,15 +306,18 @@ collect_neighbor_list_add(struct collect_neighbor_list *neighbors_list,
     if(n != NULL) {
       PRINTF("collect_neighbor_add: not on list, not allocated, recycling %d.%d\n",
              n->addr.u8[0], n->addr.u8[1]);
+      hash_remove(neighbors_list, n);
+      linkaddr_copy(&n->addr, addr);
+      hash_add(neighbors_list, n);
     }
   }
 
   if(n != NULL) {
     n->age = 0;
-    linkaddr_copy(&n->addr, addr);
     n->rtmetric = nrtmetric;
     collect_link_estimate_new(&n->le);
     n->le_age = 0;
+    update_best(n);
     return 1;
   }
   return 0;
@@ -246,8 +346,7 @@ collect_neighbor_list_remove(struct collect_neighbor_list *neighbors_list,
   n = collect_neighbor_list_find(neighbors_list, addr);
 
   if(n != NULL) {
-    list_remove(neighbors_list->list, n);
-    memb_free(&collect_neighbors_mem, n);
+    neighbor_free(neighbors_list, n);
   }
 }
 /*---------------------------------------------------------------------------*/
@@ -255,15 +354,20 @@ struct collect_neighbor *
 collect_neighbor_list_best(struct collect_neighbor_list *neighbors_list)
 {
   struct collect_neighbor *n, *best;
-  uint16_t rtmetric;
+  uint16_t rtmetric, next_rtmetric;
 
   rtmetric = RTMETRIC_MAX;
+  next_rtmetric = RTMETRIC_MAX;
   best = NULL;
 
   if(neighbors_list == NULL) {
     return NULL;
   }
 
+  if(neighbors_list->best_valid) {
+    return neighbors_list->best;
+  }
+
   /*  PRINTF("%d: ", node_id);*/
   PRINTF("collect_neighbor_best: ");
 
@@ -274,12 +378,19 @@ collect_neighbor_list_best(struct collect_neighbor_list *neighbors_list)
            n->rtmetric, collect_neighbor_link_estimate(n),
            collect_neighbor_rtmetric(n));
     if(collect_neighbor_rtmetric_link_estimate(n) < rtmetric) {
+      next_rtmetric = rtmetric;
       rtmetric = collect_neighbor_rtmetric_link_estimate(n);
       best = n;
+    } else if(collect_neighbor_rtmetric_link_estimate(n) < next_rtmetric) {
+      next_rtmetric = collect_neighbor_rtmetric_link_estimate(n);
     }
   }
   PRINTF("\n");
 
+  neighbors_list->best = best;
+  neighbors_list->best_rtmetric = rtmetric;
+  neighbors_list->next_rtmetric = next_rtmetric;
+  neighbors_list->best_valid = 1;
   return best;
 }
 /*---------------------------------------------------------------------------*/
@@ -328,6 +439,11 @@ collect_neighbor_list_purge(struct collect_neighbor_list *neighbors_list)
   while(list_head(neighbors_list->list) != NULL) {
     memb_free(&collect_neighbors_mem, list_pop(neighbors_list->list));
   }
+  memset(neighbors_list->hash, 0, sizeof(neighbors_list->hash));
+  neighbors_list->best = NULL;
+  neighbors_list->best_rtmetric = RTMETRIC_MAX;
+  neighbors_list->next_rtmetric = RTMETRIC_MAX;
+  neighbors_list->best_valid = 1;
 }
 /*---------------------------------------------------------------------------*/
 void
@@ -339,6 +455,7 @@ collect_neighbor_update_rtmetric(struct collect_neighbor *n, uint16_t rtmetric)
            n->addr.u8[0], n->addr.u8[1], rtmetric);
     n->rtmetric = rtmetric;
     n->age = 0;
+    update_best(n);
   }
 }
 /*---------------------------------------------------------------------------*/
@@ -351,6 +468,7 @@ collect_neighbor_tx_fail(struct collect_neighbor *n, uint16_t num_tx)
   collect_link_estimate_update_tx_fail(&n->le, num_tx);
   n->le_age = 0;
   n->age = 0;
+  update_best(n);
 }
 /*---------------------------------------------------------------------------*/
 void
@@ -362,6 +480,7 @@ collect_neighbor_tx(struct collect_neighbor *n, uint16_t num_tx)
   collect_link_estimate_update_tx(&n->le, num_tx);
   n->le_age = 0;
   n->age = 0;
+  update_best(n);
 }
 /*---------------------------------------------------------------------------*/
 void
@@ -372,6 +491,7 @@ collect_neighbor_rx(struct collect_neighbor *n)
   }
   collect_link_estimate_update_rx(&n->le);
   n->age = 0;
+  update_best(n);
 }
 /*---------------------------------------------------------------------------*/
 uint16_t
@@ -57,13 +57,34 @@
 #include "net/rime/collect-link-estimate.h"
 #include "lib/list.h"
 
+#ifdef COLLECT_NEIGHBOR_CONF_HASH_SIZE
+#define COLLECT_NEIGHBOR_HASH_SIZE COLLECT_NEIGHBOR_CONF_HASH_SIZE
+#else /* COLLECT_NEIGHBOR_CONF_HASH_SIZE */
+#define COLLECT_NEIGHBOR_HASH_SIZE 8
+#endif /* COLLECT_NEIGHBOR_CONF_HASH_SIZE */
+
+struct collect_neighbor;
+
 struct collect_neighbor_list {
   LIST_STRUCT(list);
   struct ctimer periodic;
+  /* The neighbors, hashed on their address. Must be a power of two. */
+  struct collect_neighbor *hash[COLLECT_NEIGHBOR_HASH_SIZE];
+  /* The neighbor with the lowest rtmetric + link estimate, kept up
+     to date as the neighbors change, and a lower bound for the
+     rtmetric + link estimate of all other neighbors. The best
+     neighbor is looked up again only if it gets worse than that
+     bound or goes away. */
+  struct collect_neighbor *best;
+  uint16_t best_rtmetric;
+  uint16_t next_rtmetric;
+  uint8_t best_valid;
 };
 
 struct collect_neighbor {
   struct collect_neighbor *next;
+  struct collect_neighbor *hash_next;
+  struct collect_neighbor_list *neighbor_list;
   linkaddr_t addr;
   uint16_t rtmetric;
   uint16_t age;
@@ -256,6 +256,27 @@
 #define RPL_REPAIR_ON_DAO_NACK 0
 #endif /* RPL_CONF_RPL_REPAIR_ON_DAO_NACK */
 
+/*
+ * RPL DAO aggregation (storing mode). Targets received from children are
+ * buffered for RPL_DAO_AGGREGATION_DELAY and forwarded to the preferred
+ * parent in a single DAO carrying up to RPL_DAO_AGGREGATION_MAX_TARGETS
+ * Target options. With a delay of 0, targets are forwarded as soon as a
+ * DAO has been processed. RPL_DAO_AGGREGATION_MAX_TARGETS also bounds the
+ * number of targets accepted from an incoming DAO; a DAO with more targets
+ * is refused with a DAO NACK.
+ * */
+#ifdef RPL_CONF_DAO_AGGREGATION_DELAY
+#define RPL_DAO_AGGREGATION_DELAY RPL_CONF_DAO_AGGREGATION_DELAY
+#else
+#define RPL_DAO_AGGREGATION_DELAY 0
+#endif /* RPL_CONF_DAO_AGGREGATION_DELAY */
+
+#ifdef RPL_CONF_DAO_AGGREGATION_MAX_TARGETS
+#define RPL_DAO_AGGREGATION_MAX_TARGETS RPL_CONF_DAO_AGGREGATION_MAX_TARGETS
+#else
+#define RPL_DAO_AGGREGATION_MAX_TARGETS 4
+#endif /* RPL_CONF_DAO_AGGREGATION_MAX_TARGETS */
+
 /*
  * Setting the DIO_REFRESH_DAO_ROUTES will make the RPL root always
  * increase the DTSN (Destination Advertisement Trigger Sequence Number)
@@ -322,14 +322,78 @@ count_matching_bytes(const void *p1, const void *p2, size_t n)
   return n;
 }
 /*---------------------------------------------------------------------------*/
+#if RPL_NS_SRH_CACHE_SIZE
+/* Source routing headers recently built by the root, one slot per
+ * destination hash. An entry is valid as long as the topology version
+ * it was built from is current. */
+struct srh_cache_entry {
+  rpl_dag_t *dag;
+  uint32_t version;
+  uip_ipaddr_t dest;
+  /* First hop, written as IPv6 destination */
+  uip_ipaddr_t next_hop;
+  /* Number of hops in the header, 0 if no header is needed */
+  uint8_t path_len;
+  uint8_t cmpr;
+  uint8_t padding;
+  uint8_t addr_len;
+  uint8_t addr[RPL_NS_SRH_CACHE_ADDR_LEN];
+};
+static struct srh_cache_entry srh_cache[RPL_NS_SRH_CACHE_SIZE];
+#endif /* RPL_NS_SRH_CACHE_SIZE */
+/*---------------------------------------------------------------------------*/
+/* Make room for a source routing header of ext_len bytes and fill in its
+ * fixed fields. Returns a pointer to the addresses field. */
+static uint8_t *
+open_srh_header(uint8_t ext_len, uint8_t path_len, uint8_t cmpri, uint8_t cmpre,
+                uint8_t padding)
+{
+  /* Move existing ext headers and payload uip_ext_len further */
+  memmove(uip_buf + uip_l2_l3_hdr_len + ext_len,
+      uip_buf + uip_l2_l3_hdr_len, uip_len - UIP_IPH_LEN);
+  memset(uip_buf + uip_l2_l3_hdr_len, 0, ext_len);
+
+  /* Insert source routing header */
+  UIP_RH_BUF->next = UIP_IP_BUF->proto;
+  UIP_IP_BUF->proto = UIP_PROTO_ROUTING;
+
+  /* Initialize IPv6 Routing Header */
+  UIP_RH_BUF->len = (ext_len - 8) / 8;
+  UIP_RH_BUF->routing_type = RPL_RH_TYPE_SRH;
+  UIP_RH_BUF->seg_left = path_len;
+
+  /* Initialize RPL Source Routing Header */
+  UIP_RPL_SRH_BUF->cmpr = (cmpri << 4) + cmpre;
+  UIP_RPL_SRH_BUF->pad = padding << 4;
+
+  return ((uint8_t *)UIP_RH_BUF) + RPL_RH_LEN + RPL_SRH_LEN;
+}
+/*---------------------------------------------------------------------------*/
+static void
+close_srh_header(uint8_t ext_len)
+{
+  uint8_t temp_len;
+
+  /* In-place update of IPv6 length field */
+  temp_len = UIP_IP_BUF->len[1];
+  UIP_IP_BUF->len[1] += ext_len;
+  if(UIP_IP_BUF->len[1] < temp_len) {
+    UIP_IP_BUF->len[0]++;
+  }
+
+  uip_ext_len += ext_len;
+  uip_len += ext_len;
+}
+/*---------------------------------------------------------------------------*/
 static int
 insert_srh_header(void)
 {
   /* Implementation of RFC6554 */
-  uint8_t temp_len;
   uint8_t path_len;
   uint8_t ext_len;
+  uint8_t addr_len;
   uint8_t cmpri, cmpre; /* ComprI and ComprE fields of the RPL Source Routing Header */
+  uint8_t *addr_ptr;
   uint8_t *hop_ptr;
   uint8_t padding;
   rpl_ns_node_t *dest_node;
@@ -337,6 +401,9 @@ insert_srh_header(void)
   rpl_ns_node_t *node;
   rpl_dag_t *dag;
   uip_ipaddr_t node_addr;
+#if RPL_NS_SRH_CACHE_SIZE
+  struct srh_cache_entry *entry;
+#endif /* RPL_NS_SRH_CACHE_SIZE */
 
   PRINTF("RPL: SRH creating source routing header with destination ");
   PRINT6ADDR(&UIP_IP_BUF->destipaddr);
@@ -352,6 +419,28 @@ insert_srh_header(void)
     return 0;
   }
 
+#if RPL_NS_SRH_CACHE_SIZE
+  entry = &srh_cache[rpl_ns_node_hash(&UIP_IP_BUF->destipaddr) % RPL_NS_SRH_CACHE_SIZE];
+  if(entry->dag == dag && entry->version == rpl_ns_topology_version()
+     && uip_ipaddr_cmp(&entry->dest, &UIP_IP_BUF->destipaddr)) {
+    PRINTF("RPL: SRH found in cache, path len %u\n", entry->path_len);
+    if(entry->path_len == 0) {
+      return 1;
+    }
+    ext_len = RPL_RH_LEN + RPL_SRH_LEN + entry->addr_len + entry->padding;
+    if(uip_len + ext_len > UIP_BUFSIZE) {
+      PRINTF("RPL: Packet too long: impossible to add source routing header (%u bytes)\n", ext_len);
+      return 1;
+    }
+    addr_ptr = open_srh_header(ext_len, entry->path_len, entry->cmpr, entry->cmpr,
+                               entry->padding);
+    memcpy(addr_ptr, entry->addr, entry->addr_len);
+    uip_ipaddr_copy(&UIP_IP_BUF->destipaddr, &entry->next_hop);
+    close_srh_header(ext_len);
+    return 1;
+  }
+#endif /* RPL_NS_SRH_CACHE_SIZE */
+
   dest_node = rpl_ns_get_node(dag, &UIP_IP_BUF->destipaddr);
   if(dest_node == NULL) {
     /* The destination is not found, skip SRH insertion */
@@ -378,6 +467,12 @@ insert_srh_header(void)
 
   if(node == root_node) {
     PRINTF("RPL: SRH no need to insert SRH\n");
+#if RPL_NS_SRH_CACHE_SIZE
+    entry->dag = dag;
+    entry->version = rpl_ns_topology_version();
+    uip_ipaddr_copy(&entry->dest, &UIP_IP_BUF->destipaddr);
+    entry->path_len = 0;
+#endif /* RPL_NS_SRH_CACHE_SIZE */
     return 1;
   }
 
@@ -397,9 +492,8 @@ insert_srh_header(void)
   }
 
   /* Extension header length: fixed headers + (n-1) * (16-ComprI) + (16-ComprE)*/
-  ext_len = RPL_RH_LEN + RPL_SRH_LEN
-      + (path_len - 1) * (16 - cmpre)
-      + (16 - cmpri);
+  addr_len = (path_len - 1) * (16 - cmpre) + (16 - cmpri);
+  ext_len = RPL_RH_LEN + RPL_SRH_LEN + addr_len;
 
   padding = ext_len % 8 == 0 ? 0 : (8 - (ext_len % 8));
   ext_len += padding;
@@ -413,28 +507,18 @@ insert_srh_header(void)
     return 1;
   }
 
-  /* Move existing ext headers and payload uip_ext_len further */
-  memmove(uip_buf + uip_l2_l3_hdr_len + ext_len,
-      uip_buf + uip_l2_l3_hdr_len, uip_len - UIP_IPH_LEN);
-  memset(uip_buf + uip_l2_l3_hdr_len, 0, ext_len);
+#if RPL_NS_SRH_CACHE_SIZE
+  /* Key the entry now, the destination address is about to be replaced */
+  entry->dag = NULL;
+  uip_ipaddr_copy(&entry->dest, &UIP_IP_BUF->destipaddr);
+#endif /* RPL_NS_SRH_CACHE_SIZE */
 
-  /* Insert source routing header */
-  UIP_RH_BUF->next = UIP_IP_BUF->proto;
-  UIP_IP_BUF->proto = UIP_PROTO_ROUTING;
-
-  /* Initialize IPv6 Routing Header */
-  UIP_RH_BUF->len = (ext_len - 8) / 8;
-  UIP_RH_BUF->routing_type = RPL_RH_TYPE_SRH;
-  UIP_RH_BUF->seg_left = path_len;
-
-  /* Initialize RPL Source Routing Header */
-  UIP_RPL_SRH_BUF->cmpr = (cmpri << 4) + cmpre;
-  UIP_RPL_SRH_BUF->pad = padding << 4;
+  addr_ptr = open_srh_header(ext_len, path_len, cmpri, cmpre, padding);
 
   /* Initialize addresses field (the actual source route).
    * From last to first. */
   node = dest_node;
-  hop_ptr = ((uint8_t *)UIP_RH_BUF) + ext_len - padding; /* Pointer where to write the next hop compressed address */
+  hop_ptr = addr_ptr + addr_len; /* Pointer where to write the next hop compressed address */
 
   while(node != NULL && node->parent != root_node) {
     rpl_ns_get_node_global_addr(&node_addr, node);
@@ -449,15 +533,20 @@ insert_srh_header(void)
   rpl_ns_get_node_global_addr(&node_addr, node);
   uip_ipaddr_copy(&UIP_IP_BUF->destipaddr, &node_addr);
 
-  /* In-place update of IPv6 length field */
-  temp_len = UIP_IP_BUF->len[1];
-  UIP_IP_BUF->len[1] += ext_len;
-  if(UIP_IP_BUF->len[1] < temp_len) {
-    UIP_IP_BUF->len[0]++;
+#if RPL_NS_SRH_CACHE_SIZE
+  if(addr_len <= RPL_NS_SRH_CACHE_ADDR_LEN) {
+    entry->dag = dag;
+    entry->version = rpl_ns_topology_version();
+    uip_ipaddr_copy(&entry->next_hop, &node_addr);
+    entry->path_len = path_len;
+    entry->cmpr = cmpri;
+    entry->padding = padding;
+    entry->addr_len = addr_len;
+    memcpy(entry->addr, addr_ptr, addr_len);
   }
+#endif /* RPL_NS_SRH_CACHE_SIZE */
 
-  uip_ext_len += ext_len;
-  uip_len += ext_len;
+  close_srh_header(ext_len);
 
   return 1;
 }
@@ -103,38 +103,197 @@ UIP_ICMP6_HANDLER(dao_handler, ICMP6_RPL, RPL_CODE_DAO, dao_input);
 UIP_ICMP6_HANDLER(dao_ack_handler, ICMP6_RPL, RPL_CODE_DAO_ACK, dao_ack_input);
 /*---------------------------------------------------------------------------*/
 
-#if RPL_WITH_DAO_ACK
-static uip_ds6_route_t *
-find_route_entry_by_dao_ack(uint8_t seq)
+#if RPL_WITH_STORING
+/* A DAO target, as parsed from an incoming DAO or queued for forwarding */
+struct dao_target {
+  uip_ipaddr_t prefix;
+  uint8_t prefixlen;
+  uint8_t lifetime;
+};
+
+/* Targets waiting to be forwarded to the preferred parent. They all share
+   the outgoing sequence number dao_fwd_seq, so a single DAO ACK from the
+   parent acknowledges the whole batch. A batch either takes a new
+   sequence number or retransmits targets under the one they were first
+   forwarded with, so that the ACK for it still matches their routes. */
+static struct dao_target dao_fwd_targets[RPL_DAO_AGGREGATION_MAX_TARGETS];
+static uint8_t dao_fwd_num;
+static uint8_t dao_fwd_seq;
+static uint8_t dao_fwd_new_seq;
+static uint8_t dao_fwd_flags;
+static rpl_instance_t *dao_fwd_instance;
+#if RPL_DAO_AGGREGATION_DELAY
+static struct ctimer dao_fwd_timer;
+#endif /* RPL_DAO_AGGREGATION_DELAY */
+/*---------------------------------------------------------------------------*/
+static void
+dao_fwd_output(void)
 {
-  uip_ds6_route_t *re;
-  re = uip_ds6_route_head();
-  while(re != NULL) {
-    if(re->state.dao_seqno_out == seq && RPL_ROUTE_IS_DAO_PENDING(re)) {
-      /* found it! */
-      return re;
+  rpl_instance_t *instance;
+  rpl_parent_t *parent;
+  uip_ipaddr_t *parent_ipaddr;
+  unsigned char *buffer;
+  uint8_t num;
+  int pos;
+  int i;
+
+  num = dao_fwd_num;
+  instance = dao_fwd_instance;
+  dao_fwd_num = 0;
+#if RPL_DAO_AGGREGATION_DELAY
+  ctimer_stop(&dao_fwd_timer);
+#endif /* RPL_DAO_AGGREGATION_DELAY */
+
+  if(num == 0 || instance == NULL || instance->current_dag == NULL) {
+    return;
+  }
+  parent = instance->current_dag->preferred_parent;
+  parent_ipaddr = parent != NULL ? rpl_get_parent_ipaddr(parent) : NULL;
+  if(parent_ipaddr == NULL) {
+    PRINTF("RPL: No parent to forward %u DAO targets to\n", num);
+    return;
+  }
+
+  buffer = UIP_ICMP_PAYLOAD;
+  pos = 0;
+
+  buffer[pos++] = instance->instance_id;
+  buffer[pos++] = dao_fwd_flags;
+  buffer[pos++] = 0; /* reserved */
+  buffer[pos++] = dao_fwd_seq;
+  if(dao_fwd_flags & RPL_DAO_D_FLAG) {
+    memcpy(buffer + pos, &instance->current_dag->dag_id, sizeof(uip_ipaddr_t));
+    pos += sizeof(uip_ipaddr_t);
+  }
+
+  for(i = 0; i < num; i++) {
+    buffer[pos++] = RPL_OPTION_TARGET;
+    buffer[pos++] = 2 + ((dao_fwd_targets[i].prefixlen + 7) / CHAR_BIT);
+    buffer[pos++] = 0; /* reserved */
+    buffer[pos++] = dao_fwd_targets[i].prefixlen;
+    memcpy(buffer + pos, &dao_fwd_targets[i].prefix,
+           (dao_fwd_targets[i].prefixlen + 7) / CHAR_BIT);
+    pos += ((dao_fwd_targets[i].prefixlen + 7) / CHAR_BIT);
+
+    /* A transit information option applies to all the targets preceding
+       it, so one is enough for each run of targets with the same lifetime. */
+    if(i == num - 1 ||
+       dao_fwd_targets[i + 1].lifetime != dao_fwd_targets[i].lifetime) {
+      buffer[pos++] = RPL_OPTION_TRANSIT;
+      buffer[pos++] = 4;
+      buffer[pos++] = 0; /* flags - ignored */
+      buffer[pos++] = 0; /* path control - ignored */
+      buffer[pos++] = 0; /* path seq - ignored */
+      buffer[pos++] = dao_fwd_targets[i].lifetime;
     }
-    re = uip_ds6_route_next(re);
   }
-  return NULL;
-}
-#endif /* RPL_WITH_DAO_ACK */
 
-#if RPL_WITH_STORING
-/* prepare for forwarding of DAO */
-static uint8_t
-prepare_for_dao_fwd(uint8_t sequence, uip_ds6_route_t *rep)
+  PRINTF("RPL: Forwarding DAO with %u targets to parent ", num);
+  PRINT6ADDR(parent_ipaddr);
+  PRINTF(" out seq: %d\n", dao_fwd_seq);
+
+  uip_icmp6_send(parent_ipaddr, ICMP6_RPL, RPL_CODE_DAO, pos);
+}
+/*---------------------------------------------------------------------------*/
+#if RPL_DAO_AGGREGATION_DELAY
+static void
+handle_dao_fwd_timer(void *ptr)
 {
-  /* not pending - or pending but not a retransmission */
-  RPL_LOLLIPOP_INCREMENT(dao_sequence);
+  dao_fwd_output();
+}
+#endif /* RPL_DAO_AGGREGATION_DELAY */
+/*---------------------------------------------------------------------------*/
+/* Queue a target for forwarding to the preferred parent. rep is the route
+   to the target, NULL for multicast targets. */
+static void
+dao_fwd_add(rpl_instance_t *instance, uip_ds6_route_t *rep, uint8_t sequence,
+            uint8_t flags, const struct dao_target *target)
+{
+  int retransmit;
+  int i;
+
+  if(instance->current_dag->preferred_parent == NULL ||
+     rpl_get_parent_ipaddr(instance->current_dag->preferred_parent) == NULL) {
+    return;
+  }
+
+  /* if this is pending and we get the same seq no it is a retrans */
+  retransmit = rep != NULL && RPL_ROUTE_IS_DAO_PENDING(rep) &&
+    rep->state.dao_seqno_in == sequence;
+
+  if(dao_fwd_num > 0 &&
+     (dao_fwd_instance != instance ||
+      (retransmit ? dao_fwd_seq != rep->state.dao_seqno_out :
+       !dao_fwd_new_seq))) {
+    dao_fwd_output();
+  }
+
+  /* Already queued? This happens when a child retransmits its DAO. */
+  for(i = 0; i < dao_fwd_num; i++) {
+    if(dao_fwd_targets[i].prefixlen == target->prefixlen &&
+       uip_ipaddr_cmp(&dao_fwd_targets[i].prefix, &target->prefix)) {
+      break;
+    }
+  }
+
+  if(i == dao_fwd_num) {
+    if(dao_fwd_num == RPL_DAO_AGGREGATION_MAX_TARGETS) {
+      dao_fwd_output();
+      i = 0;
+    }
+    if(dao_fwd_num == 0) {
+      /* Start a new batch */
+      if(retransmit) {
+        /* keep the same seq-no as before for parent also */
+        dao_fwd_seq = rep->state.dao_seqno_out;
+      } else {
+        RPL_LOLLIPOP_INCREMENT(dao_sequence);
+        dao_fwd_seq = dao_sequence;
+      }
+      dao_fwd_new_seq = !retransmit;
+      dao_fwd_flags = 0;
+#if RPL_DAO_SPECIFY_DAG
+      dao_fwd_flags |= RPL_DAO_D_FLAG;
+#endif /* RPL_DAO_SPECIFY_DAG */
+      dao_fwd_instance = instance;
+#if RPL_DAO_AGGREGATION_DELAY
+      ctimer_set(&dao_fwd_timer, RPL_DAO_AGGREGATION_DELAY,
+                 handle_dao_fwd_timer, NULL);
+#endif /* RPL_DAO_AGGREGATION_DELAY */
+    }
+    dao_fwd_num++;
+  }
+
+  memcpy(&dao_fwd_targets[i], target, sizeof(struct dao_target));
+  dao_fwd_flags |= flags & RPL_DAO_K_FLAG;
 
-  /* set DAO pending and sequence numbers */
-  rep->state.dao_seqno_in = sequence;
-  rep->state.dao_seqno_out = dao_sequence;
-  RPL_ROUTE_SET_DAO_PENDING(rep);
-  return dao_sequence;
+  if(rep != NULL) {
+    /* set DAO pending and sequence numbers */
+    rep->state.dao_seqno_in = sequence;
+    rep->state.dao_seqno_out = dao_fwd_seq;
+    RPL_ROUTE_SET_DAO_PENDING(rep);
+  }
 }
 #endif /* RPL_WITH_STORING */
+
+#if RPL_WITH_DAO_ACK && RPL_WITH_STORING
+/* Has the DAO ACK with sequence number seq already been forwarded to the
+   child that registered re, on behalf of a route preceding re? */
+static int
+dao_ack_forwarded(uip_ds6_route_t *re, uint8_t seq)
+{
+  uip_ds6_route_t *r;
+  for(r = uip_ds6_route_head(); r != NULL && r != re; r = uip_ds6_route_next(r)) {
+    if(r->state.dao_seqno_out == seq && !RPL_ROUTE_IS_DAO_PENDING(r) &&
+       r->state.dao_seqno_in == re->state.dao_seqno_in &&
+       uip_ds6_route_nexthop(r) != NULL &&
+       uip_ipaddr_cmp(uip_ds6_route_nexthop(r), uip_ds6_route_nexthop(re))) {
+      return 1;
+    }
+  }
+  return 0;
+}
+#endif /* RPL_WITH_DAO_ACK && RPL_WITH_STORING */
 /*---------------------------------------------------------------------------*/
 static int
 get_global_addr(uip_ipaddr_t *addr)
@@ -621,6 +780,109 @@ dio_output(rpl_instance_t *instance, uip_ipaddr_t *uc_addr)
 #endif /* RPL_LEAF_ONLY */
 }
 /*---------------------------------------------------------------------------*/
+#if RPL_WITH_STORING
+/* Outcome of processing one target of a storing mode DAO */
+#define DAO_TARGET_ACK_NOW   0 /* Nothing prevents acknowledging the DAO now */
+#define DAO_TARGET_ACK_LATER 1 /* The ACK will come from the parent, if any */
+#define DAO_TARGET_FAILED    2 /* No room for the route */
+
+static int
+dao_input_storing_target(rpl_instance_t *instance, uip_ipaddr_t *dao_sender_addr,
+                         int learned_from, uint8_t flags, uint8_t sequence,
+                         struct dao_target *target)
+{
+  rpl_dag_t *dag;
+  uip_ds6_route_t *rep;
+  int ack_now;
+
+  dag = instance->current_dag;
+
+  PRINTF("RPL: DAO lifetime: %u, prefix length: %u prefix: ",
+         (unsigned)target->lifetime, (unsigned)target->prefixlen);
+  PRINT6ADDR(&target->prefix);
+  PRINTF("\n");
+
+#if RPL_WITH_MULTICAST
+  if(uip_is_addr_mcast_global(&target->prefix)) {
+    mcast_group = uip_mcast6_route_add(&target->prefix);
+    if(mcast_group) {
+      mcast_group->dag = dag;
+      mcast_group->lifetime = RPL_LIFETIME(instance, target->lifetime);
+    }
+    if(learned_from == RPL_ROUTE_FROM_UNICAST_DAO) {
+      dao_fwd_add(instance, NULL, sequence, flags, target);
+    }
+    return DAO_TARGET_ACK_LATER;
+  }
+#endif
+
+  rep = uip_ds6_route_lookup(&target->prefix);
+
+  if(target->lifetime == RPL_ZERO_LIFETIME) {
+    PRINTF("RPL: No-Path DAO received\n");
+    /* No-Path DAO received; invoke the route purging routine. */
+    if(rep != NULL &&
+       !RPL_ROUTE_IS_NOPATH_RECEIVED(rep) &&
+       rep->length == target->prefixlen &&
+       uip_ds6_route_nexthop(rep) != NULL &&
+       uip_ipaddr_cmp(uip_ds6_route_nexthop(rep), dao_sender_addr)) {
+      PRINTF("RPL: Setting expiration timer for prefix ");
+      PRINT6ADDR(&target->prefix);
+      PRINTF("\n");
+      RPL_ROUTE_SET_NOPATH_RECEIVED(rep);
+      rep->state.lifetime = RPL_NOPATH_REMOVAL_DELAY;
+
+      /* We forward the incoming No-Path DAO to our parent, if we have
+         one. */
+      dao_fwd_add(instance, rep, sequence, flags, target);
+    }
+    /* independent if we remove or not - ACK the request */
+    return DAO_TARGET_ACK_NOW;
+  }
+
+  PRINTF("RPL: Adding DAO route\n");
+
+  /* Update and add neighbor - if no room - fail. */
+  if(rpl_icmp6_update_nbr_table(dao_sender_addr, NBR_TABLE_REASON_RPL_DAO, instance) == NULL) {
+    PRINTF("RPL: Out of Memory, dropping DAO from ");
+    PRINT6ADDR(dao_sender_addr);
+    PRINTF(", ");
+    PRINTLLADDR((uip_lladdr_t *)packetbuf_addr(PACKETBUF_ADDR_SENDER));
+    PRINTF("\n");
+    return DAO_TARGET_FAILED;
+  }
+
+  rep = rpl_add_route(dag, &target->prefix, target->prefixlen, dao_sender_addr);
+  if(rep == NULL) {
+    RPL_STAT(rpl_stats.mem_overflows++);
+    PRINTF("RPL: Could not add a route after receiving a DAO\n");
+    return DAO_TARGET_FAILED;
+  }
+
+  /* set lifetime and clear NOPATH bit */
+  rep->state.lifetime = RPL_LIFETIME(instance, target->lifetime);
+  RPL_ROUTE_CLEAR_NOPATH_RECEIVED(rep);
+
+  if(learned_from != RPL_ROUTE_FROM_UNICAST_DAO) {
+    return DAO_TARGET_ACK_LATER;
+  }
+
+  /*
+   * check if this route is already installed and we can ack now!
+   * not pending - and same seq-no means that we can ack.
+   * (e.g. the route is installed already so it will not take any
+   * more room that it already takes - so should be ok!)
+   */
+  ack_now = (!RPL_ROUTE_IS_DAO_PENDING(rep) &&
+             rep->state.dao_seqno_in == sequence) ||
+    dag->rank == ROOT_RANK(instance);
+
+  dao_fwd_add(instance, rep, sequence, flags, target);
+
+  return ack_now ? DAO_TARGET_ACK_NOW : DAO_TARGET_ACK_LATER;
+}
+#endif /* RPL_WITH_STORING */
+/*---------------------------------------------------------------------------*/
 static void
 dao_input_storing(void)
 {
@@ -632,27 +894,27 @@ dao_input_storing(void)
   uint16_t sequence;
   uint8_t instance_id;
   uint8_t lifetime;
-  uint8_t prefixlen;
   uint8_t flags;
   uint8_t subopt_type;
   /*
     uint8_t pathcontrol;
     uint8_t pathsequence;
   */
-  uip_ipaddr_t prefix;
-  uip_ds6_route_t *rep;
+  struct dao_target targets[RPL_DAO_AGGREGATION_MAX_TARGETS];
+  uint8_t num_targets;
+  uint8_t first_untransited;
+  uint8_t too_many_targets;
   uint8_t buffer_length;
   int pos;
   int len;
   int i;
   int learned_from;
+  int result;
+  int status;
   rpl_parent_t *parent;
-  uip_ds6_nbr_t *nbr;
   int is_root;
 
-  prefixlen = 0;
   parent = NULL;
-  memset(&prefix, 0, sizeof(prefix));
 
   uip_ipaddr_copy(&dao_sender_addr, &UIP_IP_BUF->srcipaddr);
 
@@ -715,7 +977,11 @@ dao_input_storing(void)
     }
   }
 
-  /* Check if there are any RPL options present. */
+  /* Collect the targets first: forwarding them reuses uip_buf. A transit
+     information option applies to all targets since the previous one. */
+  num_targets = 0;
+  first_untransited = 0;
+  too_many_targets = 0;
   for(i = pos; i < buffer_length; i += len) {
     subopt_type = buffer[i];
     if(subopt_type == RPL_OPTION_PAD1) {
@@ -728,96 +994,40 @@ dao_input_storing(void)
     switch(subopt_type) {
       case RPL_OPTION_TARGET:
         /* Handle the target option. */
-        prefixlen = buffer[i + 3];
-        memset(&prefix, 0, sizeof(prefix));
-        memcpy(&prefix, buffer + i + 4, (prefixlen + 7) / CHAR_BIT);
+        if(buffer[i + 3] > 128) {
+          PRINTF("RPL: Ignoring DAO target with prefix length %u\n", buffer[i + 3]);
+          break;
+        }
+        if(num_targets == RPL_DAO_AGGREGATION_MAX_TARGETS) {
+          too_many_targets = 1;
+          break;
+        }
+        targets[num_targets].prefixlen = buffer[i + 3];
+        targets[num_targets].lifetime = lifetime;
+        memset(&targets[num_targets].prefix, 0, sizeof(uip_ipaddr_t));
+        memcpy(&targets[num_targets].prefix, buffer + i + 4,
+               (targets[num_targets].prefixlen + 7) / CHAR_BIT);
+        num_targets++;
         break;
       case RPL_OPTION_TRANSIT:
         /* The path sequence and control are ignored. */
         /*      pathcontrol = buffer[i + 3];
                 pathsequence = buffer[i + 4];*/
-        lifetime = buffer[i + 5];
+        for(; first_untransited < num_targets; first_untransited++) {
+          targets[first_untransited].lifetime = buffer[i + 5];
+        }
         /* The parent address is also ignored. */
         break;
     }
   }
 
-  PRINTF("RPL: DAO lifetime: %u, prefix length: %u prefix: ",
-         (unsigned)lifetime, (unsigned)prefixlen);
-  PRINT6ADDR(&prefix);
-  PRINTF("\n");
-
-#if RPL_WITH_MULTICAST
-  if(uip_is_addr_mcast_global(&prefix)) {
-    /*
-     * "rep" is used for a unicast route which we don't need now; so set NULL so
-     * that operations on "rep" will be skipped.
-     */
-    rep = NULL;
-    mcast_group = uip_mcast6_route_add(&prefix);
-    if(mcast_group) {
-      mcast_group->dag = dag;
-      mcast_group->lifetime = RPL_LIFETIME(instance, lifetime);
-    }
-    goto fwd_dao;
-  }
-#endif
-
-  rep = uip_ds6_route_lookup(&prefix);
-
-  if(lifetime == RPL_ZERO_LIFETIME) {
-    PRINTF("RPL: No-Path DAO received\n");
-    /* No-Path DAO received; invoke the route purging routine. */
-    if(rep != NULL &&
-       !RPL_ROUTE_IS_NOPATH_RECEIVED(rep) &&
-       rep->length == prefixlen &&
-       uip_ds6_route_nexthop(rep) != NULL &&
-       uip_ipaddr_cmp(uip_ds6_route_nexthop(rep), &dao_sender_addr)) {
-      PRINTF("RPL: Setting expiration timer for prefix ");
-      PRINT6ADDR(&prefix);
-      PRINTF("\n");
-      RPL_ROUTE_SET_NOPATH_RECEIVED(rep);
-      rep->state.lifetime = RPL_NOPATH_REMOVAL_DELAY;
-
-      /* We forward the incoming No-Path DAO to our parent, if we have
-         one. */
-      if(dag->preferred_parent != NULL &&
-         rpl_get_parent_ipaddr(dag->preferred_parent) != NULL) {
-        uint8_t out_seq;
-        out_seq = prepare_for_dao_fwd(sequence, rep);
-
-        PRINTF("RPL: Forwarding No-path DAO to parent - out_seq:%d",
-               out_seq);
-        PRINT6ADDR(rpl_get_parent_ipaddr(dag->preferred_parent));
-        PRINTF("\n");
-
-        buffer = UIP_ICMP_PAYLOAD;
-        buffer[3] = out_seq; /* add an outgoing seq no before fwd */
-        uip_icmp6_send(rpl_get_parent_ipaddr(dag->preferred_parent),
-                       ICMP6_RPL, RPL_CODE_DAO, buffer_length);
-      }
-    }
-    /* independent if we remove or not - ACK the request */
-    if(flags & RPL_DAO_K_FLAG) {
-      /* indicate that we accepted the no-path DAO */
-      uip_clear_buf();
-      dao_ack_output(instance, &dao_sender_addr, sequence,
-                     RPL_DAO_ACK_UNCONDITIONAL_ACCEPT);
-    }
-    return;
-  }
-
-  PRINTF("RPL: Adding DAO route\n");
-
-  /* Update and add neighbor - if no room - fail. */
-  if((nbr = rpl_icmp6_update_nbr_table(&dao_sender_addr, NBR_TABLE_REASON_RPL_DAO, instance)) == NULL) {
-    PRINTF("RPL: Out of Memory, dropping DAO from ");
+  if(too_many_targets) {
+    /* A DAO is accepted as a whole or not at all */
+    PRINTF("RPL: Too many DAO targets, dropping DAO from ");
     PRINT6ADDR(&dao_sender_addr);
-    PRINTF(", ");
-    PRINTLLADDR((uip_lladdr_t *)packetbuf_addr(PACKETBUF_ADDR_SENDER));
     PRINTF("\n");
     if(flags & RPL_DAO_K_FLAG) {
-      /* signal the failure to add the node */
+      uip_clear_buf();
       dao_ack_output(instance, &dao_sender_addr, sequence,
                      is_root ? RPL_DAO_ACK_UNABLE_TO_ADD_ROUTE_AT_ROOT :
                      RPL_DAO_ACK_UNABLE_TO_ACCEPT);
@@ -825,75 +1035,37 @@ dao_input_storing(void)
     return;
   }
 
-  rep = rpl_add_route(dag, &prefix, prefixlen, &dao_sender_addr);
-  if(rep == NULL) {
-    RPL_STAT(rpl_stats.mem_overflows++);
-    PRINTF("RPL: Could not add a route after receiving a DAO\n");
-    if(flags & RPL_DAO_K_FLAG) {
-      /* signal the failure to add the node */
-      dao_ack_output(instance, &dao_sender_addr, sequence,
-                     is_root ? RPL_DAO_ACK_UNABLE_TO_ADD_ROUTE_AT_ROOT :
-                     RPL_DAO_ACK_UNABLE_TO_ACCEPT);
+  status = DAO_TARGET_ACK_NOW;
+  for(i = 0; i < num_targets; i++) {
+    result = dao_input_storing_target(instance, &dao_sender_addr, learned_from,
+                                      flags, sequence, &targets[i]);
+    if(result > status) {
+      status = result;
     }
-    return;
-  }
-
-  /* set lifetime and clear NOPATH bit */
-  rep->state.lifetime = RPL_LIFETIME(instance, lifetime);
-  RPL_ROUTE_CLEAR_NOPATH_RECEIVED(rep);
-
-#if RPL_WITH_MULTICAST
-fwd_dao:
-#endif
-
-  if(learned_from == RPL_ROUTE_FROM_UNICAST_DAO) {
-    int should_ack = 0;
-
-    if(flags & RPL_DAO_K_FLAG) {
-      if(rep != NULL) {
-        /*
-         * check if this route is already installed and we can ack now!
-         * not pending - and same seq-no means that we can ack.
-         * (e.g. the route is installed already so it will not take any
-         * more room that it already takes - so should be ok!)
-         */
-        if((!RPL_ROUTE_IS_DAO_PENDING(rep) &&
-            rep->state.dao_seqno_in == sequence) ||
-           dag->rank == ROOT_RANK(instance)) {
-          should_ack = 1;
-        }
-      }
+    if(status == DAO_TARGET_FAILED) {
+      break;
     }
+  }
 
-    if(dag->preferred_parent != NULL &&
-       rpl_get_parent_ipaddr(dag->preferred_parent) != NULL) {
-      uint8_t out_seq = 0;
-      if(rep != NULL) {
-        /* if this is pending and we get the same seq no it is a retrans */
-        if(RPL_ROUTE_IS_DAO_PENDING(rep) &&
-           rep->state.dao_seqno_in == sequence) {
-          /* keep the same seq-no as before for parent also */
-          out_seq = rep->state.dao_seqno_out;
-        } else {
-          out_seq = prepare_for_dao_fwd(sequence, rep);
-        }
-      }
+  if(dao_fwd_num > 0 && RPL_DAO_AGGREGATION_DELAY == 0) {
+    dao_fwd_output();
+  }
 
-      PRINTF("RPL: Forwarding DAO to parent ");
-      PRINT6ADDR(rpl_get_parent_ipaddr(dag->preferred_parent));
-      PRINTF(" in seq: %d out seq: %d\n", sequence, out_seq);
+  if(num_targets == 0 || !(flags & RPL_DAO_K_FLAG)) {
+    return;
+  }
 
-      buffer = UIP_ICMP_PAYLOAD;
-      buffer[3] = out_seq; /* add an outgoing seq no before fwd */
-      uip_icmp6_send(rpl_get_parent_ipaddr(dag->preferred_parent),
-                     ICMP6_RPL, RPL_CODE_DAO, buffer_length);
-    }
-    if(should_ack) {
-      PRINTF("RPL: Sending DAO ACK\n");
-      uip_clear_buf();
-      dao_ack_output(instance, &dao_sender_addr, sequence,
-                     RPL_DAO_ACK_UNCONDITIONAL_ACCEPT);
-    }
+  if(status == DAO_TARGET_FAILED) {
+    /* signal the failure to add the node */
+    uip_clear_buf();
+    dao_ack_output(instance, &dao_sender_addr, sequence,
+                   is_root ? RPL_DAO_ACK_UNABLE_TO_ADD_ROUTE_AT_ROOT :
+                   RPL_DAO_ACK_UNABLE_TO_ACCEPT);
+  } else if(status == DAO_TARGET_ACK_NOW) {
+    PRINTF("RPL: Sending DAO ACK\n");
+    uip_clear_buf();
+    dao_ack_output(instance, &dao_sender_addr, sequence,
+                   RPL_DAO_ACK_UNCONDITIONAL_ACCEPT);
   }
 #endif /* RPL_WITH_STORING */
 }
@@ -1309,11 +1481,21 @@ dao_ack_input(void)
     }
 #endif
 
-  } else if(RPL_IS_STORING(instance)) {
-    /* this DAO ACK should be forwarded to another recently registered route */
+  }
+#if RPL_WITH_STORING
+  else if(RPL_IS_STORING(instance)) {
+    /* this DAO ACK should be forwarded to the recently registered routes
+       it acknowledges - several of them if we sent an aggregated DAO */
     uip_ds6_route_t *re;
+    uip_ds6_route_t *next;
     uip_ipaddr_t *nexthop;
-    if((re = find_route_entry_by_dao_ack(sequence)) != NULL) {
+    int found = 0;
+    for(re = uip_ds6_route_head(); re != NULL; re = next) {
+      next = uip_ds6_route_next(re);
+      if(re->state.dao_seqno_out != sequence || !RPL_ROUTE_IS_DAO_PENDING(re)) {
+        continue;
+      }
+      found = 1;
       /* pick the recorded seq no from that node and forward DAO ACK - and
          clear the pending flag*/
       RPL_ROUTE_CLEAR_DAO_PENDING(re);
@@ -1321,22 +1503,23 @@ dao_ack_input(void)
       nexthop = uip_ds6_route_nexthop(re);
       if(nexthop == NULL) {
         PRINTF("RPL: No next hop to fwd DAO ACK to\n");
-      } else {
+      } else if(!dao_ack_forwarded(re, sequence)) {
         PRINTF("RPL: Fwd DAO ACK to:");
         PRINT6ADDR(nexthop);
         PRINTF("\n");
-        buffer[2] = re->state.dao_seqno_in;
-        uip_icmp6_send(nexthop, ICMP6_RPL, RPL_CODE_DAO_ACK, 4);
+        dao_ack_output(instance, nexthop, re->state.dao_seqno_in, status);
       }
 
       if(status >= RPL_DAO_ACK_UNABLE_TO_ACCEPT) {
         /* this node did not get in to the routing tables above... - remove */
         uip_ds6_route_rm(re);
       }
-    } else {
+    }
+    if(!found) {
       PRINTF("RPL: No route entry found to forward DAO ACK (seqno %u)\n", sequence);
     }
   }
+#endif /* RPL_WITH_STORING */
 #endif /* RPL_WITH_DAO_ACK */
   uip_clear_buf();
 }
@@ -63,6 +63,55 @@ static int num_nodes;
 LIST(nodelist);
 MEMB(nodememb, rpl_ns_node_t, RPL_NS_LINK_NUM);
 
+/* Hash buckets, chained through rpl_ns_node_t.hnext */
+static rpl_ns_node_t *buckets[RPL_NS_HASH_SIZE];
+
+static uint32_t topology_version;
+
+/*---------------------------------------------------------------------------*/
+static uint16_t
+link_identifier_hash(const unsigned char *id)
+{
+  uint16_t h = 0;
+  int i;
+  for(i = 0; i < 8; i++) {
+    h = (h << 5) + h + id[i];
+  }
+  return h;
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+rpl_ns_node_hash(const uip_ipaddr_t *addr)
+{
+  /* Only the link identifier is hashed: all nodes share the DAG prefix */
+  return link_identifier_hash(((const unsigned char *)addr) + 8);
+}
+/*---------------------------------------------------------------------------*/
+static rpl_ns_node_t **
+bucket_of(const unsigned char *link_identifier)
+{
+  return &buckets[link_identifier_hash(link_identifier) % RPL_NS_HASH_SIZE];
+}
+/*---------------------------------------------------------------------------*/
+static void
+bucket_remove(rpl_ns_node_t *node)
+{
+  rpl_ns_node_t **p;
+  for(p = bucket_of(node->link_identifier); *p != NULL; p = &(*p)->hnext) {
+    if(*p == node) {
+      *p = node->hnext;
+      break;
+    }
+  }
+  node->hnext = NULL;
+}
+/*---------------------------------------------------------------------------*/
+uint32_t
+rpl_ns_topology_version(void)
+{
+  return topology_version;
+}
+
 /*---------------------------------------------------------------------------*/
 int
 rpl_ns_num_nodes(void)
@@ -85,7 +134,11 @@ rpl_ns_node_t *
 rpl_ns_get_node(const rpl_dag_t *dag, const uip_ipaddr_t *addr)
 {
   rpl_ns_node_t *l;
-  for(l = list_head(nodelist); l != NULL; l = list_item_next(l)) {
+  if(addr == NULL) {
+    return NULL;
+  }
+  l = buckets[rpl_ns_node_hash(addr) % RPL_NS_HASH_SIZE];
+  for(; l != NULL; l = l->hnext) {
     /* Compare prefix and node identifier */
     if(node_matches_address(dag, l, addr)) {
       return l;
@@ -114,6 +167,8 @@ rpl_ns_expire_parent(rpl_dag_t *dag, const uip_ipaddr_t *child, const uip_ipaddr
   /* Check if parent matches */
   if(l != NULL && node_matches_address(dag, l->parent, parent)) {
     l->lifetime = RPL_NOPATH_REMOVAL_DELAY;
+    /* The link is about to go away, stop source routing through it */
+    topology_version++;
   }
 }
 /*---------------------------------------------------------------------------*/
@@ -142,18 +197,25 @@ rpl_ns_update_node(rpl_dag_t *dag, const uip_ipaddr_t *child, const uip_ipaddr_t
       return NULL;
     }
     child_node->parent = NULL;
+    child_node->dag = NULL;
+    memcpy(child_node->link_identifier, ((const unsigned char *)child) + 8, 8);
+    child_node->hnext = *bucket_of(child_node->link_identifier);
+    *bucket_of(child_node->link_identifier) = child_node;
     list_add(nodelist, child_node);
     num_nodes++;
+    topology_version++;
   }
 
   /* Initialize node */
-  child_node->dag = dag;
+  if(child_node->dag != dag) {
+    child_node->dag = dag;
+    topology_version++;
+  }
   child_node->lifetime = lifetime;
-  memcpy(child_node->link_identifier, ((const unsigned char *)child) + 8, 8);
+  old_parent_node = child_node->parent;
 
   /* Is the node reachable before the update? */
   if(rpl_ns_is_node_reachable(dag, child)) {
-    old_parent_node = child_node->parent;
     /* Update node */
     child_node->parent = parent_node;
     /* Has the node become unreachable? May happen if we create a loop. */
@@ -167,6 +229,10 @@ rpl_ns_update_node(rpl_dag_t *dag, const uip_ipaddr_t *child, const uip_ipaddr_t
     child_node->parent = parent_node;
   }
 
+  if(child_node->parent != old_parent_node) {
+    topology_version++;
+  }
+
   return child_node;
 }
 /*---------------------------------------------------------------------------*/
@@ -176,6 +242,8 @@ rpl_ns_init(void)
   num_nodes = 0;
   memb_init(&nodememb);
   list_init(nodelist);
+  memset(buckets, 0, sizeof(buckets));
+  topology_version++;
 }
 /*---------------------------------------------------------------------------*/
 rpl_ns_node_t *
@@ -203,6 +271,7 @@ void
 rpl_ns_periodic(void)
 {
   rpl_ns_node_t *l;
+  rpl_ns_node_t *next;
   /* First pass, decrement lifetime for all nodes with non-infinite lifetime */
   for(l = list_head(nodelist); l != NULL; l = list_item_next(l)) {
     /* Don't touch infinite lifetime nodes */
@@ -211,7 +280,8 @@ rpl_ns_periodic(void)
     }
   }
   /* Second pass, for all expire nodes, deallocate them iff no child points to them */
-  for(l = list_head(nodelist); l != NULL; l = list_item_next(l)) {
+  for(l = list_head(nodelist); l != NULL; l = next) {
+    next = list_item_next(l);
     if(l->lifetime == 0) {
       rpl_ns_node_t *l2;
       for(l2 = list_head(nodelist); l2 != NULL; l2 = list_item_next(l2)) {
@@ -219,10 +289,14 @@ rpl_ns_periodic(void)
           break;
         }
       }
-      /* No child found, deallocate node */
-      list_remove(nodelist, l);
-      memb_free(&nodememb, l);
-      num_nodes--;
+      if(l2 == NULL) {
+        /* No child found, deallocate node */
+        bucket_remove(l);
+        list_remove(nodelist, l);
+        memb_free(&nodememb, l);
+        num_nodes--;
+        topology_version++;
+      }
     }
   }
 }
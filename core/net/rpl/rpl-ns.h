@@ -49,8 +49,33 @@
 #define RPL_NS_LINK_NUM 32
 #endif /* RPL_NS_CONF_LINK_NUM */
 
+/* Number of buckets of the node hash table, indexed by link identifier */
+#ifdef RPL_NS_CONF_HASH_SIZE
+#define RPL_NS_HASH_SIZE RPL_NS_CONF_HASH_SIZE
+#else /* RPL_NS_CONF_HASH_SIZE */
+#define RPL_NS_HASH_SIZE 16
+#endif /* RPL_NS_CONF_HASH_SIZE */
+
+/* Number of source routing headers cached at the root (0 to disable).
+ * The cache is RAM on every non-storing node, so only enable it for
+ * roots that build source routing headers. */
+#ifdef RPL_NS_CONF_SRH_CACHE_SIZE
+#define RPL_NS_SRH_CACHE_SIZE RPL_NS_CONF_SRH_CACHE_SIZE
+#else /* RPL_NS_CONF_SRH_CACHE_SIZE */
+#define RPL_NS_SRH_CACHE_SIZE 0
+#endif /* RPL_NS_CONF_SRH_CACHE_SIZE */
+
+/* Maximum size of the compressed address field of a cached header */
+#ifdef RPL_NS_CONF_SRH_CACHE_ADDR_LEN
+#define RPL_NS_SRH_CACHE_ADDR_LEN RPL_NS_CONF_SRH_CACHE_ADDR_LEN
+#else /* RPL_NS_CONF_SRH_CACHE_ADDR_LEN */
+#define RPL_NS_SRH_CACHE_ADDR_LEN 64
+#endif /* RPL_NS_CONF_SRH_CACHE_ADDR_LEN */
+
 typedef struct rpl_ns_node {
   struct rpl_ns_node *next;
+  /* Next node in the same hash bucket */
+  struct rpl_ns_node *hnext;
   uint32_t lifetime;
   rpl_dag_t *dag;
   /* Store only IPv6 link identifiers as all nodes in the DAG share the same prefix */
@@ -68,5 +93,10 @@ rpl_ns_node_t *rpl_ns_get_node(const rpl_dag_t *dag, const uip_ipaddr_t *addr);
 int rpl_ns_is_node_reachable(const rpl_dag_t *dag, const uip_ipaddr_t *addr);
 void rpl_ns_get_node_global_addr(uip_ipaddr_t *addr, rpl_ns_node_t *node);
 void rpl_ns_periodic(void);
+/* Incremented every time a node is added, removed or changes parent.
+ * Anything derived from the topology (e.g. source routes) is stale
+ * once this changes. */
+uint32_t rpl_ns_topology_version(void);
+uint16_t rpl_ns_node_hash(const uip_ipaddr_t *addr);
 
 #endif /* RPL_NS_H */
@@ -129,6 +129,23 @@
 
 #define CC_ACCESS_NOW(type, variable) (*(volatile type *)&(variable))
 
+/** \def CC_MEMORY_BARRIER()
+ * This macro keeps the memory accesses before it from being moved
+ * past the ones after it, except that a store before it may still be
+ * moved past a load after it. That is enough for a single writer and
+ * a single reader to share a buffer.
+ * A single CPU sees its own accesses in order, so the default only
+ * stops the compiler. Platforms where several CPUs share memory
+ * define CC_CONF_MEMORY_BARRIER() to a hardware barrier.
+ */
+#ifdef CC_CONF_MEMORY_BARRIER
+#define CC_MEMORY_BARRIER() CC_CONF_MEMORY_BARRIER()
+#elif defined(__GNUC__)
+#define CC_MEMORY_BARRIER() __asm__ __volatile__("" : : : "memory")
+#else
+#define CC_MEMORY_BARRIER()
+#endif
+
 #ifndef NULL
 #define NULL 0
 #endif /* NULL */
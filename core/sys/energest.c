@@ -38,8 +38,11 @@
  */
 
 #include "sys/energest.h"
+#include "sys/process.h"
 #include "contiki-conf.h"
 
+#include <string.h>
+
 #if ENERGEST_CONF_ON
 
 int energest_total_count;
@@ -119,3 +122,93 @@ void energest_init(void) {}
 unsigned long energest_type_time(int type) { return 0; }
 void energest_flush(void) {}
 #endif /* ENERGEST_CONF_ON */
+/*---------------------------------------------------------------------------*/
+#if ENERGEST_ACCOUNTING
+
+volatile unsigned long energest_accounting_charged;
+
+static struct energest_account rtimers[ENERGEST_ACCOUNTING_RTIMERS];
+
+/*---------------------------------------------------------------------------*/
+unsigned long
+energest_accounting_end(energest_frame_t *frame)
+{
+  unsigned long elapsed, nested;
+
+  elapsed = (rtimer_clock_t)(ENERGEST_ACCOUNTING_NOW() - frame->start);
+  nested = energest_accounting_charged - frame->charged;
+  elapsed = elapsed > nested ? elapsed - nested : 0;
+  energest_accounting_charged += elapsed;
+  return elapsed;
+}
+/*---------------------------------------------------------------------------*/
+void
+energest_accounting_rtimer(rtimer_callback_t callback, unsigned long time)
+{
+  struct energest_account *a;
+
+  for(a = rtimers; a < &rtimers[ENERGEST_ACCOUNTING_RTIMERS]; a++) {
+    if(a->callback == callback || a->callback == NULL) {
+      a->callback = callback;
+      a->time += time;
+      a->count++;
+      return;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Inserts an account into the top list if it is among the n largest */
+static int
+insert(struct energest_account *top, int len, int n,
+       const struct energest_account *a)
+{
+  int i;
+
+  if(a->count == 0) {
+    return len;
+  }
+  for(i = len; i > 0 && top[i - 1].time < a->time; i--);
+  if(i == n) {
+    return len;
+  }
+  if(len == n) {
+    len--;
+  }
+  memmove(&top[i + 1], &top[i], (len - i) * sizeof(*top));
+  top[i] = *a;
+  return len + 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+energest_accounting_top(struct energest_account *top, int n)
+{
+  struct energest_account a;
+  struct process *p;
+  int i, len;
+
+  len = 0;
+  a.callback = NULL;
+  for(p = PROCESS_LIST(); p != NULL; p = p->next) {
+    a.process = p;
+    a.time = p->energest_time;
+    a.count = p->energest_count;
+    len = insert(top, len, n, &a);
+  }
+  for(i = 0; i < ENERGEST_ACCOUNTING_RTIMERS; i++) {
+    len = insert(top, len, n, &rtimers[i]);
+  }
+  return len;
+}
+/*---------------------------------------------------------------------------*/
+void
+energest_accounting_reset(void)
+{
+  struct process *p;
+
+  for(p = PROCESS_LIST(); p != NULL; p = p->next) {
+    p->energest_time = p->energest_count = 0;
+  }
+  memset(rtimers, 0, sizeof(rtimers));
+}
+/*---------------------------------------------------------------------------*/
+#endif /* ENERGEST_ACCOUNTING */
@@ -152,4 +152,77 @@ extern energest_t energest_leveldevice_current_leveltime[ENERGEST_CONF_LEVELDEVI
 #define ENERGEST_SWITCH(type_off, type_on) do { } while(0)
 #endif /* ENERGEST_CONF_ON */
 
+/*
+ * Accounting of the CPU time that each process and each rtimer
+ * callback uses. The time of a call excludes the time of the calls
+ * and interrupts that are nested in it, so the times add up to the
+ * time spent in all of them.
+ */
+#ifdef ENERGEST_CONF_ACCOUNTING
+#define ENERGEST_ACCOUNTING ENERGEST_CONF_ACCOUNTING
+#else
+#define ENERGEST_ACCOUNTING 0
+#endif
+
+#if ENERGEST_ACCOUNTING
+
+/* The clock that the time is measured with. Calls must take less
+   than a wrap-around of rtimer_clock_t. */
+#ifdef ENERGEST_CONF_ACCOUNTING_NOW
+#define ENERGEST_ACCOUNTING_NOW() ENERGEST_CONF_ACCOUNTING_NOW()
+#define ENERGEST_ACCOUNTING_SECOND ENERGEST_CONF_ACCOUNTING_SECOND
+#else
+#define ENERGEST_ACCOUNTING_NOW() RTIMER_NOW()
+#define ENERGEST_ACCOUNTING_SECOND RTIMER_SECOND
+#endif
+
+/* The number of rtimer callbacks that are accounted for */
+#ifdef ENERGEST_CONF_ACCOUNTING_RTIMERS
+#define ENERGEST_ACCOUNTING_RTIMERS ENERGEST_CONF_ACCOUNTING_RTIMERS
+#else
+#define ENERGEST_ACCOUNTING_RTIMERS 8
+#endif
+
+struct process;
+
+/* The time used by a process or an rtimer callback */
+struct energest_account {
+  const struct process *process; /* NULL for an rtimer callback */
+  rtimer_callback_t callback;
+  unsigned long time;            /* In ENERGEST_ACCOUNTING_SECOND units */
+  unsigned long count;           /* Number of calls */
+};
+
+typedef struct {
+  rtimer_clock_t start;
+  unsigned long charged;
+} energest_frame_t;
+
+extern volatile unsigned long energest_accounting_charged;
+
+#define ENERGEST_ACCOUNTING_BEGIN(frame) do {                       \
+    (frame).charged = energest_accounting_charged;                  \
+    (frame).start = ENERGEST_ACCOUNTING_NOW();                      \
+  } while(0)
+
+/* Returns the time since ENERGEST_ACCOUNTING_BEGIN(), less that of
+   the nested calls */
+unsigned long energest_accounting_end(energest_frame_t *frame);
+
+/* Charges the time of an rtimer callback */
+void energest_accounting_rtimer(rtimer_callback_t callback,
+                                unsigned long time);
+
+/**
+ * Fills in the processes and rtimer callbacks that have used the most
+ * CPU time, most first, and returns how many there are, at most n.
+ * Only running processes are included.
+ */
+int energest_accounting_top(struct energest_account *top, int n);
+
+/** Starts the accounting over */
+void energest_accounting_reset(void);
+
+#endif /* ENERGEST_ACCOUNTING */
+
 #endif /* ENERGEST_H_ */
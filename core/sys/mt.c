@@ -46,6 +46,9 @@
 #include "sys/mt.h"
 #include "sys/cc.h"
 
+#include <stddef.h>
+#include <string.h>
+
 static struct mt_thread *current;
 
 /*--------------------------------------------------------------------------*/
@@ -107,3 +110,59 @@ mt_stop(struct mt_thread *thread)
   mtarch_stop(&thread->thread);
 }
 /*--------------------------------------------------------------------------*/
+/* The process of every mt_process, which runs the thread on each event */
+static PT_THREAD(mt_process_thread(struct pt *process_pt,
+                                   process_event_t ev,
+                                   process_data_t data))
+{
+  struct mt_process *p;
+
+  p = (struct mt_process *)PROCESS_CURRENT();
+
+  PROCESS_BEGIN();
+
+  mt_start(&p->thread, p->function, p->data);
+
+  while(ev != PROCESS_EVENT_EXIT) {
+    p->ev = ev;
+    p->evdata = data;
+    mt_exec(&p->thread);
+    if(p->thread.state == MT_STATE_EXITED) {
+      break;
+    }
+    PROCESS_YIELD();
+  }
+
+  mt_stop(&p->thread);
+
+  PROCESS_END();
+}
+/*--------------------------------------------------------------------------*/
+void
+mt_process_start(struct mt_process *p, const char *name,
+                 void (* function)(void *), void *data)
+{
+  memset(&p->process, 0, sizeof(p->process));
+  p->process.thread = mt_process_thread;
+#if !PROCESS_CONF_NO_PROCESS_NAMES
+  p->process.name = name;
+#endif /* !PROCESS_CONF_NO_PROCESS_NAMES */
+  p->function = function;
+  p->data = data;
+  process_start(&p->process, NULL);
+}
+/*--------------------------------------------------------------------------*/
+process_event_t
+mt_process_wait(process_data_t *data)
+{
+  struct mt_process *p;
+
+  p = (struct mt_process *)((char *)current -
+                            offsetof(struct mt_process, thread));
+  mt_yield();
+  if(data != NULL) {
+    *data = p->evdata;
+  }
+  return p->ev;
+}
+/*--------------------------------------------------------------------------*/
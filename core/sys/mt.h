@@ -258,6 +258,45 @@ void mt_exit(void);
  */
 void mt_stop(struct mt_thread *thread);
 
+/**
+ * A thread that runs in a process of its own.
+ *
+ * The thread is run each time an event is posted to the process, so
+ * it can block until an event arrives with mt_process_wait(). Timers,
+ * connections and other things that are set up by the thread belong
+ * to its process, so their events wake up the thread.
+ */
+struct mt_process {
+  struct process process;
+  struct mt_thread thread;
+  void (* function)(void *);
+  void *data;
+  process_event_t ev;
+  process_data_t evdata;
+};
+
+/**
+ * Start a thread in a process of its own.
+ * The process exits when the function returns or the thread calls
+ * mt_exit(), and when the process is exited, the thread is stopped.
+ * \param p Pointer to an mt_process struct that must have been
+ * previously allocated by the caller.
+ * \param name The name of the process.
+ * \param function A pointer to the entry function of the thread.
+ * \param data A pointer that will be passed to the entry function.
+ */
+void mt_process_start(struct mt_process *p, const char *name,
+                      void (* function)(void *), void *data);
+
+/**
+ * Wait for an event to be posted to the process of the thread.
+ * This function is called from a thread that was started with
+ * mt_process_start().
+ * \param data If not NULL, set to the data of the event.
+ * \return The event.
+ */
+process_event_t mt_process_wait(process_data_t *data);
+
 /** @} */
 /** @} */
 #endif /* MT_H_ */
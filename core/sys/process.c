@@ -47,6 +47,7 @@
 
 #include "sys/process.h"
 #include "sys/arg.h"
+#include "sys/energest.h"
 
 /*
  * Pointer to the currently running process structure.
@@ -175,6 +176,9 @@ static void
 call_process(struct process *p, process_event_t ev, process_data_t data)
 {
   int ret;
+#if ENERGEST_ACCOUNTING
+  energest_frame_t frame;
+#endif /* ENERGEST_ACCOUNTING */
 
 #if DEBUG
   if(p->state == PROCESS_STATE_CALLED) {
@@ -187,7 +191,14 @@ call_process(struct process *p, process_event_t ev, process_data_t data)
     PRINTF("process: calling process '%s' with event %d\n", PROCESS_NAME_STRING(p), ev);
     process_current = p;
     p->state = PROCESS_STATE_CALLED;
+#if ENERGEST_ACCOUNTING
+    ENERGEST_ACCOUNTING_BEGIN(frame);
+#endif /* ENERGEST_ACCOUNTING */
     ret = p->thread(&p->pt, ev, data);
+#if ENERGEST_ACCOUNTING
+    p->energest_time += energest_accounting_end(&frame);
+    p->energest_count++;
+#endif /* ENERGEST_ACCOUNTING */
     if(ret == PT_EXITED ||
        ret == PT_ENDED ||
        ev == PROCESS_EVENT_EXIT) {
@@ -375,6 +386,10 @@ process_poll(struct process *p)
        p->state == PROCESS_STATE_CALLED) {
       p->needspoll = 1;
       poll_requested = 1;
+#ifdef PROCESS_CONF_POLL_NOTIFY
+      /* Lets a platform that sleeps in its main loop wake up */
+      PROCESS_CONF_POLL_NOTIFY();
+#endif
     }
   }
 }
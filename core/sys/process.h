@@ -323,6 +323,9 @@ struct process {
   PT_THREAD((* thread)(struct pt *, process_event_t, process_data_t));
   struct pt pt;
   unsigned char state, needspoll;
+#if ENERGEST_CONF_ACCOUNTING
+  unsigned long energest_time, energest_count;
+#endif /* ENERGEST_CONF_ACCOUNTING */
 };
 
 /**
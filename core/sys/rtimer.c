@@ -54,8 +54,87 @@
 #define PRINTF(...)
 #endif
 
-static struct rtimer *next_rtimer;
+/* Pending tasks, sorted by time. Times are compared with
+   RTIMER_CLOCK_LT(), so tasks must be set less than half the range of
+   rtimer_clock_t into the future. */
+static struct rtimer *queue;
 
+/* Set while the queue is changed outside of rtimer_run_next(). An
+   rtimer interrupt that comes in meanwhile is armed again when the
+   queue is unlocked. */
+static volatile uint8_t locked;
+static volatile uint8_t run_deferred;
+
+/* Set while rtimer_run_next() runs tasks. It schedules the next task
+   when it is done, so tasks that set timers need not. */
+static uint8_t running;
+
+/* The arch timer may never fire for a compare time that has passed,
+   so it is armed at least this many ticks ahead */
+#define SCHEDULE_AHEAD (RTIMER_GUARD_TIME > 0 ? RTIMER_GUARD_TIME : 1)
+
+/*---------------------------------------------------------------------------*/
+static int
+remove_task(struct rtimer *rtimer)
+{
+  struct rtimer **p;
+
+  for(p = &queue; *p != NULL; p = &(*p)->next) {
+    if(*p == rtimer) {
+      *p = rtimer->next;
+      return 1;
+    }
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+insert_task(struct rtimer *rtimer)
+{
+  struct rtimer **p;
+
+  /* Tasks set for the same time run in the order they were set */
+  for(p = &queue; *p != NULL && !RTIMER_CLOCK_LT(rtimer->time, (*p)->time);
+      p = &(*p)->next);
+  rtimer->next = *p;
+  *p = rtimer;
+}
+/*---------------------------------------------------------------------------*/
+static void
+schedule_head(void)
+{
+  rtimer_clock_t time;
+
+  do {
+    time = RTIMER_NOW() + SCHEDULE_AHEAD;
+    if(!RTIMER_CLOCK_LT(queue->time, time)) {
+      time = queue->time;
+    }
+    rtimer_arch_schedule(time);
+  } while(!RTIMER_CLOCK_LT(RTIMER_NOW(), time));
+}
+/*---------------------------------------------------------------------------*/
+static void
+unlock(void)
+{
+  /* An interrupt that came in while the queue was locked is not run
+     from here, where interrupts are enabled, but is armed again. The
+     flag is checked once more after unlocking, in case the interrupt
+     came in just before. */
+  for(;;) {
+    if(run_deferred) {
+      run_deferred = 0;
+      if(queue != NULL && !running) {
+        schedule_head();
+      }
+    }
+    locked = 0;
+    if(!run_deferred) {
+      return;
+    }
+    locked = 1;
+  }
+}
 /*---------------------------------------------------------------------------*/
 void
 rtimer_init(void)
@@ -68,40 +147,95 @@ rtimer_set(struct rtimer *rtimer, rtimer_clock_t time,
 	   rtimer_clock_t duration,
 	   rtimer_callback_t func, void *ptr)
 {
-  int first = 0;
+  struct rtimer *head;
 
   PRINTF("rtimer_set time %d\n", time);
 
-  if(next_rtimer == NULL) {
-    first = 1;
-  }
+  locked = 1;
+
+  head = queue;
+  /* A task that is already pending is moved to its new time */
+  remove_task(rtimer);
 
   rtimer->func = func;
   rtimer->ptr = ptr;
-
   rtimer->time = time;
-  next_rtimer = rtimer;
+  insert_task(rtimer);
 
-  if(first == 1) {
-    rtimer_arch_schedule(time);
+  if((queue != head || queue == rtimer) && !running) {
+    schedule_head();
   }
+
+  unlock();
   return RTIMER_OK;
 }
 /*---------------------------------------------------------------------------*/
+int
+rtimer_cancel(struct rtimer *rtimer)
+{
+  int removed;
+
+  locked = 1;
+
+  if(queue == rtimer) {
+    queue = rtimer->next;
+    removed = 1;
+    /* With no tasks left, the interrupt that was set for this one
+       finds nothing to run */
+    if(queue != NULL && !running) {
+      schedule_head();
+    }
+  } else {
+    removed = remove_task(rtimer);
+  }
+
+  unlock();
+  return removed;
+}
+/*---------------------------------------------------------------------------*/
 void
 rtimer_run_next(void)
 {
   struct rtimer *t;
-  if(next_rtimer == NULL) {
+  rtimer_clock_t now;
+#if ENERGEST_ACCOUNTING
+  rtimer_callback_t func;
+  energest_frame_t frame;
+#endif /* ENERGEST_ACCOUNTING */
+
+  if(locked) {
+    run_deferred = 1;
     return;
   }
-  t = next_rtimer;
-  next_rtimer = NULL;
-  t->func(t, t->ptr);
-  if(next_rtimer != NULL) {
-    rtimer_arch_schedule(next_rtimer->time);
+
+  running = 1;
+  while(queue != NULL) {
+    now = RTIMER_NOW();
+    if(RTIMER_CLOCK_LT(now, queue->time)) {
+      /* The arch timer may have fired early. A task that became due
+         while the timer was armed runs right away. */
+      schedule_head();
+      if(RTIMER_CLOCK_LT(RTIMER_NOW(), queue->time)) {
+        break;
+      }
+      continue;
+    }
+    t = queue;
+    queue = t->next;
+#ifdef RTIMER_CONF_LATENESS_HOOK
+    RTIMER_CONF_LATENESS_HOOK(t, RTIMER_CLOCK_DIFF(now, t->time));
+#endif /* RTIMER_CONF_LATENESS_HOOK */
+#if ENERGEST_ACCOUNTING
+    /* The callback may set the rtimer again, with another function */
+    func = t->func;
+    ENERGEST_ACCOUNTING_BEGIN(frame);
+    func(t, t->ptr);
+    energest_accounting_rtimer(func, energest_accounting_end(&frame));
+#else /* ENERGEST_ACCOUNTING */
+    t->func(t, t->ptr);
+#endif /* ENERGEST_ACCOUNTING */
   }
-  return;
+  running = 0;
 }
 /*---------------------------------------------------------------------------*/
 
@@ -84,6 +84,7 @@ typedef void (* rtimer_callback_t)(struct rtimer *t, void *ptr);
  *             support module for the real-time module.
  */
 struct rtimer {
+  struct rtimer *next;
   rtimer_clock_t time;
   rtimer_callback_t func;
   void *ptr;
@@ -103,22 +104,38 @@ enum {
  * \param duration Unused argument.
  * \param func A function to be called when the task is executed.
  * \param ptr An opaque pointer that will be supplied as an argument to the callback function.
- * \return     Non-zero (true) if the task could be scheduled, zero
- *             (false) if the task could not be scheduled.
+ * \return     RTIMER_OK
  *
  *             This function schedules a real-time task at a specified
- *             time in the future.
+ *             time in the future. Any number of tasks can be pending
+ *             at once. Setting a task that is already pending moves
+ *             it to the new time.
+ *
+ *             Tasks may be set and cancelled both from other tasks
+ *             and from the main context, but not from other
+ *             interrupts.
  *
  */
 int rtimer_set(struct rtimer *task, rtimer_clock_t time,
 	       rtimer_clock_t duration, rtimer_callback_t func, void *ptr);
 
 /**
- * \brief      Execute the next real-time task and schedule the next task, if any
+ * \brief      Cancel a pending real-time task.
+ * \param task The task
+ * \return     Non-zero if the task was pending
+ */
+int rtimer_cancel(struct rtimer *task);
+
+/**
+ * \brief      Execute the real-time tasks that are due and schedule the next task, if any
  *
  *             This function is called by the architecture dependent
  *             code to execute and schedule the next real-time task.
  *
+ *             If RTIMER_CONF_LATENESS_HOOK(task, lateness) is
+ *             defined, it is called before each task with how many
+ *             ticks late the task runs.
+ *
  */
 void rtimer_run_next(void);
 
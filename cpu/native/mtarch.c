@@ -32,10 +32,24 @@
  *
  */
 
+
+/*
+ * On Linux, the stacks of the threads come from a pool. Each stack is
+ * mapped with an inaccessible guard page below it, so that a thread
+ * that overflows its stack is stopped with a message rather than
+ * corrupting memory. A stopped thread's stack goes back to the pool
+ * for the next thread. Only the pages a thread touches take memory,
+ * so the stacks can be larger than the threads normally need.
+ *
+ * On x86-64, AArch64 and ARM, threads are switched by saving the
+ * callee-saved registers on the stack and changing the stack
+ * pointer. Other CPUs use ucontext, as does MTARCH_CONF_UCONTEXT.
+ */
+
 #include "sys/mt.h"
 
 #ifndef MTARCH_STACKSIZE
-#define MTARCH_STACKSIZE 4096
+#define MTARCH_STACKSIZE 16384
 #endif /* MTARCH_STACKSIZE */
 
 #if defined(_WIN32) || defined(__CYGWIN__)
@@ -52,20 +66,281 @@ static void *main_fiber;
 #define _XOPEN_SOURCE
 #endif
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include <ucontext.h>
 
+#if MTARCH_CONF_UCONTEXT
+#define FAST_SWITCH 0
+#elif defined(__linux) && \
+  (defined(__x86_64__) || defined(__aarch64__) || defined(__arm__))
+#define FAST_SWITCH 1
+#else
+#define FAST_SWITCH 0
+#endif
+
 struct mtarch_t {
-  char stack[MTARCH_STACKSIZE];
+  struct mtarch_t *next;  /* The next free stack in the pool */
+  struct mtarch_t *all;   /* The next stack, free or not */
+  char *guard;            /* The guard page */
+  char *stack;            /* The lowest address of the stack */
+  size_t size;
+#if FAST_SWITCH
+  void *sp;
+#else /* FAST_SWITCH */
   ucontext_t context;
+  void (* function)(void *);
+  void *data;
+#endif /* FAST_SWITCH */
 };
 
+static struct mtarch_t *free_stacks, *all_stacks;
+static size_t page_size;
+#if defined(__linux)
+static struct sigaction previous_overflow_action;
+#endif /* __linux */
+
+#if FAST_SWITCH
+static void *main_sp;
+static struct mtarch_t *running;
+
+/* Saves the callee-saved registers on the current stack and its
+   stack pointer in *from, then switches to the stack at to and
+   restores the registers saved there. */
+void mtarch_native_switch(void **from, void *to);
+/* Where a new thread starts: calls the function in the first saved
+   register with the argument in the second. */
+void mtarch_native_entry(void);
+void mtarch_native_run(void (* function)(void *), void *data);
+
+#if defined(__x86_64__)
+#define FRAME_WORDS 8
+#define FRAME_FUNCTION 4
+#define FRAME_DATA 3
+#define FRAME_RETURN 7
+__asm__ (
+  ".text\n"
+  ".globl mtarch_native_switch\n"
+  ".type mtarch_native_switch, @function\n"
+  ".p2align 4\n"
+  "mtarch_native_switch:\n\t"
+  "pushq %rbp\n\t"
+  "pushq %rbx\n\t"
+  "pushq %r12\n\t"
+  "pushq %r13\n\t"
+  "pushq %r14\n\t"
+  "pushq %r15\n\t"
+  "subq $8, %rsp\n\t"
+  "stmxcsr (%rsp)\n\t"
+  "fnstcw 4(%rsp)\n\t"
+  "movq %rsp, (%rdi)\n\t"
+  "movq %rsi, %rsp\n\t"
+  "ldmxcsr (%rsp)\n\t"
+  "fldcw 4(%rsp)\n\t"
+  "addq $8, %rsp\n\t"
+  "popq %r15\n\t"
+  "popq %r14\n\t"
+  "popq %r13\n\t"
+  "popq %r12\n\t"
+  "popq %rbx\n\t"
+  "popq %rbp\n\t"
+  "ret\n"
+  ".size mtarch_native_switch, .-mtarch_native_switch\n"
+  ".globl mtarch_native_entry\n"
+  ".type mtarch_native_entry, @function\n"
+  ".p2align 4\n"
+  "mtarch_native_entry:\n\t"
+  "movq %r12, %rdi\n\t"
+  "movq %r13, %rsi\n\t"
+  "call mtarch_native_run@PLT\n\t"
+  "ud2\n"
+  ".size mtarch_native_entry, .-mtarch_native_entry\n"
+);
+/* The MXCSR and x87 control word defaults */
+#define FRAME_CONTROL 0x037f00001f80UL
+#elif defined(__aarch64__)
+#define FRAME_WORDS 20
+#define FRAME_FUNCTION 0
+#define FRAME_DATA 1
+#define FRAME_RETURN 11
+__asm__ (
+  ".text\n"
+  ".globl mtarch_native_switch\n"
+  ".type mtarch_native_switch, %function\n"
+  ".p2align 4\n"
+  "mtarch_native_switch:\n\t"
+  "sub sp, sp, #160\n\t"
+  "stp x19, x20, [sp, #0]\n\t"
+  "stp x21, x22, [sp, #16]\n\t"
+  "stp x23, x24, [sp, #32]\n\t"
+  "stp x25, x26, [sp, #48]\n\t"
+  "stp x27, x28, [sp, #64]\n\t"
+  "stp x29, x30, [sp, #80]\n\t"
+  "stp d8, d9, [sp, #96]\n\t"
+  "stp d10, d11, [sp, #112]\n\t"
+  "stp d12, d13, [sp, #128]\n\t"
+  "stp d14, d15, [sp, #144]\n\t"
+  "mov x2, sp\n\t"
+  "str x2, [x0]\n\t"
+  "mov sp, x1\n\t"
+  "ldp x19, x20, [sp, #0]\n\t"
+  "ldp x21, x22, [sp, #16]\n\t"
+  "ldp x23, x24, [sp, #32]\n\t"
+  "ldp x25, x26, [sp, #48]\n\t"
+  "ldp x27, x28, [sp, #64]\n\t"
+  "ldp x29, x30, [sp, #80]\n\t"
+  "ldp d8, d9, [sp, #96]\n\t"
+  "ldp d10, d11, [sp, #112]\n\t"
+  "ldp d12, d13, [sp, #128]\n\t"
+  "ldp d14, d15, [sp, #144]\n\t"
+  "add sp, sp, #160\n\t"
+  "ret\n"
+  ".size mtarch_native_switch, .-mtarch_native_switch\n"
+  ".globl mtarch_native_entry\n"
+  ".type mtarch_native_entry, %function\n"
+  ".p2align 4\n"
+  "mtarch_native_entry:\n\t"
+  "mov x0, x19\n\t"
+  "mov x1, x20\n\t"
+  "bl mtarch_native_run\n\t"
+  "brk #0\n"
+  ".size mtarch_native_entry, .-mtarch_native_entry\n"
+);
+#else /* __arm__ */
+#ifdef __ARM_PCS_VFP
+#define FRAME_WORDS 26
+#define VFP_PUSH "vpush {d8-d15}\n\t"
+#define VFP_POP "vpop {d8-d15}\n\t"
+#else /* __ARM_PCS_VFP */
+#define FRAME_WORDS 10
+#define VFP_PUSH
+#define VFP_POP
+#endif /* __ARM_PCS_VFP */
+/* r3 is saved only to keep the stack 8-byte aligned. The functions
+   are ARM code, and the assembler is put back in Thumb mode after
+   them if the compiler uses it. */
+#ifdef __thumb__
+#define ASM_MODE ".thumb\n"
+#else /* __thumb__ */
+#define ASM_MODE
+#endif /* __thumb__ */
+#define FRAME_FUNCTION (FRAME_WORDS - 9)
+#define FRAME_DATA (FRAME_WORDS - 8)
+#define FRAME_RETURN (FRAME_WORDS - 1)
+__asm__ (
+  ".text\n"
+  ".arm\n"
+  ".globl mtarch_native_switch\n"
+  ".type mtarch_native_switch, %function\n"
+  ".p2align 2\n"
+  "mtarch_native_switch:\n\t"
+  "push {r3-r11, lr}\n\t"
+  VFP_PUSH
+  "str sp, [r0]\n\t"
+  "mov sp, r1\n\t"
+  VFP_POP
+  "pop {r3-r11, pc}\n"
+  ".size mtarch_native_switch, .-mtarch_native_switch\n"
+  ".globl mtarch_native_entry\n"
+  ".type mtarch_native_entry, %function\n"
+  ".p2align 2\n"
+  "mtarch_native_entry:\n\t"
+  "mov r0, r4\n\t"
+  "mov r1, r5\n\t"
+  "bl mtarch_native_run\n"
+  ".size mtarch_native_entry, .-mtarch_native_entry\n"
+  ASM_MODE
+);
+#endif /* __x86_64__ */
+#else /* FAST_SWITCH */
 static ucontext_t main_context;
-static ucontext_t *running_context;
+static struct mtarch_t *running;
+#endif /* FAST_SWITCH */
 
 #endif /* _WIN32 || __CYGWIN__ || __linux */
 
+#if defined(__linux)
+/*--------------------------------------------------------------------------*/
+static void
+overflow(int signo, siginfo_t *info, void *context)
+{
+  static const char message[] = "mt: stack overflow in a thread\n";
+  struct mtarch_t *t;
+  ssize_t n;
+
+  for(t = all_stacks; t != NULL; t = t->all) {
+    if((char *)info->si_addr >= t->guard && (char *)info->si_addr < t->stack) {
+      n = write(STDERR_FILENO, message, sizeof(message) - 1);
+      (void)n;
+      break;
+    }
+  }
+  /* Chain to the handler that was there before. It is called from
+     here, since it may not run on a stack of its own. Without one, the
+     access faults again when this returns, and the process ends as it
+     would have without this handler. */
+  if(previous_overflow_action.sa_flags & SA_SIGINFO) {
+    previous_overflow_action.sa_sigaction(signo, info, context);
+  } else if(previous_overflow_action.sa_handler != SIG_DFL &&
+            previous_overflow_action.sa_handler != SIG_IGN) {
+    previous_overflow_action.sa_handler(signo);
+  } else {
+    sigaction(SIGSEGV, &previous_overflow_action, NULL);
+  }
+}
+/*--------------------------------------------------------------------------*/
+static struct mtarch_t *
+alloc_stack(void)
+{
+  struct mtarch_t *t;
+  char *map;
+
+  if(free_stacks != NULL) {
+    t = free_stacks;
+    free_stacks = t->next;
+    return t;
+  }
+
+  t = malloc(sizeof(struct mtarch_t));
+  if(t == NULL) {
+    return NULL;
+  }
+  t->size = (MTARCH_STACKSIZE + page_size - 1) & ~(page_size - 1);
+  map = mmap(NULL, page_size + t->size, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if(map == MAP_FAILED) {
+    free(t);
+    return NULL;
+  }
+  mprotect(map, page_size, PROT_NONE);
+  t->guard = map;
+  t->stack = map + page_size;
+  t->all = all_stacks;
+  all_stacks = t;
+  return t;
+}
+#endif /* __linux */
+#if FAST_SWITCH
+/*--------------------------------------------------------------------------*/
+void
+mtarch_native_run(void (* function)(void *), void *data)
+{
+  function(data);
+  mt_exit();
+}
+#elif defined(__linux)
+/*--------------------------------------------------------------------------*/
+static void
+run(void)
+{
+  running->function(running->data);
+  mt_exit();
+}
+#endif /* FAST_SWITCH */
 /*--------------------------------------------------------------------------*/
 void
 mtarch_init(void)
@@ -74,7 +349,28 @@ mtarch_init(void)
 
   main_fiber = ConvertThreadToFiber(NULL);
 
-#endif /* _WIN32 || __CYGWIN__ */
+#elif defined(__linux)
+
+  static char signal_stack[32768];
+  struct sigaction action;
+  stack_t ss;
+
+  page_size = sysconf(_SC_PAGESIZE);
+
+  /* The overflow is handled on a stack of its own, since the thread's
+     stack is full */
+  ss.ss_sp = signal_stack;
+  ss.ss_size = sizeof(signal_stack);
+  ss.ss_flags = 0;
+  sigaltstack(&ss, NULL);
+
+  memset(&action, 0, sizeof(action));
+  action.sa_sigaction = overflow;
+  action.sa_flags = SA_SIGINFO | SA_ONSTACK;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGSEGV, &action, &previous_overflow_action);
+
+#endif /* _WIN32 || __CYGWIN__ || __linux */
 }
 /*--------------------------------------------------------------------------*/
 void
@@ -98,24 +394,46 @@ mtarch_start(struct mtarch_thread *thread,
 
 #elif defined(__linux)
 
-  thread->mt_thread = malloc(sizeof(struct mtarch_t));
-
-  getcontext(&((struct mtarch_t *)thread->mt_thread)->context);
-
-  ((struct mtarch_t *)thread->mt_thread)->context.uc_link = NULL;
-  ((struct mtarch_t *)thread->mt_thread)->context.uc_stack.ss_sp = 
-			((struct mtarch_t *)thread->mt_thread)->stack;
-  ((struct mtarch_t *)thread->mt_thread)->context.uc_stack.ss_size = 
-			sizeof(((struct mtarch_t *)thread->mt_thread)->stack);
+  struct mtarch_t *t;
+
+  t = alloc_stack();
+  thread->mt_thread = t;
+  if(t == NULL) {
+    fprintf(stderr, "mt: could not allocate a stack, the thread will not run\n");
+    return;
+  }
+
+#if FAST_SWITCH
+  {
+    /* A frame as mtarch_native_switch() leaves it, which returns to
+       mtarch_native_entry() */
+    unsigned long *frame;
+
+    frame = (unsigned long *)(t->stack + t->size) - FRAME_WORDS;
+    memset(frame, 0, FRAME_WORDS * sizeof(unsigned long));
+#ifdef FRAME_CONTROL
+    frame[0] = FRAME_CONTROL;
+#endif /* FRAME_CONTROL */
+    frame[FRAME_FUNCTION] = (unsigned long)function;
+    frame[FRAME_DATA] = (unsigned long)data;
+    frame[FRAME_RETURN] = (unsigned long)mtarch_native_entry;
+    t->sp = frame;
+  }
+#else /* FAST_SWITCH */
+  getcontext(&t->context);
+
+  t->context.uc_link = NULL;
+  t->context.uc_stack.ss_sp = t->stack;
+  t->context.uc_stack.ss_size = t->size;
 
   /* Some notes:
-     - If a CPU needs stronger alignment for the stack than malloc()
+     - If a CPU needs stronger alignment for the stack than mmap()
        guarantees (like i.e. IA64) then makecontext() is supposed to
        add that alignment internally.
      - According to POSIX the arguments to function() are of type int
        and there are in fact 64-bit implementations which support only
-       32 bits per argument meaning that a pointer argument has to be
-       splitted into two arguments.
+       32 bits per argument, so function() and data are passed in
+       struct mtarch_t instead.
      - Most implementations interpret context.uc_stack.ss_sp on entry
        as the lowest stack address even if the CPU stack actually grows
        downwards. Although this means that ss_sp does NOT represent the
@@ -123,8 +441,10 @@ mtarch_start(struct mtarch_thread *thread,
        the only way to stay independent from the CPU architecture. But
        Solaris prior to release 10 interprets ss_sp as highest stack
        address thus requiring special handling. */
-  makecontext(&((struct mtarch_t *)thread->mt_thread)->context,
-	      (void (*)(void))function, 1, data);
+  t->function = function;
+  t->data = data;
+  makecontext(&t->context, run, 0);
+#endif /* FAST_SWITCH */
 
 #endif /* _WIN32 || __CYGWIN__ || __linux */
 }
@@ -136,9 +456,13 @@ mtarch_yield(void)
 
   SwitchToFiber(main_fiber);
 
+#elif FAST_SWITCH
+
+  mtarch_native_switch(&running->sp, main_sp);
+
 #elif defined(__linux)
 
-  swapcontext(running_context, &main_context);
+  swapcontext(&running->context, &main_context);
 
 #endif /* _WIN32 || __CYGWIN__ || __linux */
 }
@@ -150,11 +474,21 @@ mtarch_exec(struct mtarch_thread *thread)
 
   SwitchToFiber(thread->mt_thread);
 
+#elif FAST_SWITCH
+
+  if(thread->mt_thread != NULL) {
+    running = thread->mt_thread;
+    mtarch_native_switch(&main_sp, running->sp);
+    running = NULL;
+  }
+
 #elif defined(__linux)
 
-  running_context = &((struct mtarch_t *)thread->mt_thread)->context;
-  swapcontext(&main_context, running_context);
-  running_context = NULL;
+  if(thread->mt_thread != NULL) {
+    running = thread->mt_thread;
+    swapcontext(&main_context, &running->context);
+    running = NULL;
+  }
 
 #endif /* _WIN32 || __CYGWIN__ || __linux */
 }
@@ -168,7 +502,14 @@ mtarch_stop(struct mtarch_thread *thread)
 
 #elif defined(linux) || defined(__linux)
 
-  free(thread->mt_thread);
+  struct mtarch_t *t;
+
+  t = thread->mt_thread;
+  if(t != NULL) {
+    t->next = free_stacks;
+    free_stacks = t;
+    thread->mt_thread = NULL;
+  }
 
 #endif /* _WIN32 || __CYGWIN__ || __linux */
 }
@@ -0,0 +1,573 @@
+/*
+ * Copyright (c) 2016, Thingsquare, http://www.thingsquare.com/.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file
+ *         Measures the throughput of the native border router between
+ *         its tun interface and the slip-radio. The benchmark plays the
+ *         slip-radio on a TCP connection, which the border router is
+ *         started with, and a host on the other side of the tun
+ *         interface. It floods UDP packets to a node through tun, and
+ *         802.15.4 frames with UDP packets from the node to the host,
+ *         and counts how many make it to the other side. Each border
+ *         router binary is run on 1 to N cores.
+ *
+ *         Needs root, for the tun interface.
+ */
+
+/* For memmem() and the CPU affinity macros */
+#define _GNU_SOURCE
+
+#include "contiki.h"
+
+#include <arpa/inet.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifndef BORDER_ROUTER_BENCHMARK_SECONDS
+#define BORDER_ROUTER_BENCHMARK_SECONDS 3
+#endif
+#ifndef BORDER_ROUTER_BENCHMARK_PAYLOAD_LEN
+#define BORDER_ROUTER_BENCHMARK_PAYLOAD_LEN 32
+#endif
+
+#define DEFAULT_BORDER_ROUTER "../ipv6/native-border-router/border-router.native"
+
+/* Not fd00::/64, which the host may use already */
+#define PREFIX "fdbe::1/64"
+
+#define NODE_PORT 5683
+#define HOST_PORT 5684
+
+#define SLIP_END     0300
+#define SLIP_ESC     0333
+#define SLIP_ESC_END 0334
+#define SLIP_ESC_ESC 0335
+
+/* Frames from the node, with every 802.15.4 sequence number */
+#define UPLINK_FRAMES 256
+
+#define UDP_LEN (8 + BORDER_ROUTER_BENCHMARK_PAYLOAD_LEN)
+
+static const uint8_t router_mac[8] = { 0x00, 0x12, 0x4b, 0, 0, 0, 0, 0x01 };
+static const uint8_t node_mac[8] = { 0x00, 0x12, 0x4b, 0, 0, 0, 0, 0x02 };
+static const uint8_t magic[4] = { 'B', 'R', 'B', '!' };
+
+static uint8_t host_ip[16];
+static uint8_t node_ip[16];
+static uint8_t router_ll[16];
+static uint8_t node_ll[16];
+
+/* The TCP connection of the slip-radio, written by two threads */
+static int radio_fd;
+static pthread_mutex_t radio_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static volatile int mac_requested;
+/* Stops the thread of a measurement, and the threads of a run */
+static volatile int stopping;
+static volatile int done;
+static volatile unsigned long downlink_frames;
+static volatile unsigned long uplink_received;
+
+/* All uplink frames, SLIP encoded back-to-back */
+static uint8_t uplink[UPLINK_FRAMES * 2 * 128];
+static int uplink_len;
+
+extern int contiki_argc;
+extern char **contiki_argv;
+
+PROCESS(border_router_benchmark_process, "border router benchmark");
+AUTOSTART_PROCESSES(&border_router_benchmark_process);
+/*---------------------------------------------------------------------------*/
+static void
+set_ip(uint8_t *ip, uint8_t first, uint8_t second, const uint8_t *mac)
+{
+  memset(ip, 0, 16);
+  ip[0] = first;
+  ip[1] = second;
+  if(mac != NULL) {
+    memcpy(&ip[8], mac, 8);
+    ip[8] ^= 0x02;
+  } else {
+    ip[15] = 1;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static uint32_t
+sum(uint32_t acc, const uint8_t *data, int len)
+{
+  int i;
+
+  for(i = 0; i + 1 < len; i += 2) {
+    acc += (data[i] << 8) + data[i + 1];
+  }
+  if(len & 1) {
+    acc += data[len - 1] << 8;
+  }
+  return acc;
+}
+/*---------------------------------------------------------------------------*/
+static void
+set_checksum(uint8_t *sum_field, const uint8_t *src, const uint8_t *dst,
+             uint8_t proto, const uint8_t *upper, int len)
+{
+  uint32_t acc;
+
+  acc = sum(0, src, 16);
+  acc = sum(acc, dst, 16);
+  acc = sum(acc + len + proto, upper, len);
+  while(acc >> 16) {
+    acc = (acc & 0xffff) + (acc >> 16);
+  }
+  acc = ~acc & 0xffff;
+  if(acc == 0) {
+    acc = 0xffff;
+  }
+  sum_field[0] = acc >> 8;
+  sum_field[1] = acc & 0xff;
+}
+/*---------------------------------------------------------------------------*/
+/* An 802.15.4 frame from the node to the border router, with an IPHC
+   header that carries the addresses inline */
+static int
+make_frame(uint8_t *f, uint8_t seq, uint8_t proto, const uint8_t *src,
+           const uint8_t *dst, const uint8_t *upper, int len)
+{
+  int i;
+
+  f[0] = 0x41;                  /* Data, PAN ID compression */
+  f[1] = 0xcc;                  /* Long addresses */
+  f[2] = seq;
+  f[3] = 0xcd;                  /* PAN ID 0xabcd */
+  f[4] = 0xab;
+  for(i = 0; i < 8; i++) {
+    f[5 + i] = router_mac[7 - i];
+    f[13 + i] = node_mac[7 - i];
+  }
+  f[21] = 0x7a;                 /* IPHC, inline next header, hop limit 64 */
+  f[22] = 0x00;                 /* Inline addresses */
+  f[23] = proto;
+  memcpy(&f[24], src, 16);
+  memcpy(&f[40], dst, 16);
+  memcpy(&f[56], upper, len);
+  return 56 + len;
+}
+/*---------------------------------------------------------------------------*/
+static int
+slip_encode(uint8_t *out, const uint8_t *frame, int len)
+{
+  int i, n;
+
+  n = 0;
+  for(i = 0; i < len; i++) {
+    if(frame[i] == SLIP_END) {
+      out[n++] = SLIP_ESC;
+      out[n++] = SLIP_ESC_END;
+    } else if(frame[i] == SLIP_ESC) {
+      out[n++] = SLIP_ESC;
+      out[n++] = SLIP_ESC_ESC;
+    } else {
+      out[n++] = frame[i];
+    }
+  }
+  out[n++] = SLIP_END;
+  return n;
+}
+/*---------------------------------------------------------------------------*/
+static void
+radio_write(const uint8_t *data, int len)
+{
+  int n;
+
+  pthread_mutex_lock(&radio_lock);
+  while(len > 0 && (n = write(radio_fd, data, len)) > 0) {
+    data += n;
+    len -= n;
+  }
+  pthread_mutex_unlock(&radio_lock);
+}
+/*---------------------------------------------------------------------------*/
+static void
+radio_send(const uint8_t *frame, int len)
+{
+  uint8_t buf[2 * 128 + 1];
+
+  radio_write(buf, slip_encode(buf, frame, len));
+}
+/*---------------------------------------------------------------------------*/
+/* Answers the border router as a slip-radio that sends every frame */
+static void
+radio_input(const uint8_t *frame, int len)
+{
+  uint8_t reply[10];
+
+  if(len >= 2 && frame[0] == '?' && frame[1] == 'M') {
+    reply[0] = '!';
+    reply[1] = 'M';
+    memcpy(&reply[2], router_mac, 8);
+    radio_send(reply, 10);
+    mac_requested = 1;
+  } else if(len >= 3 && frame[0] == '!' && frame[1] == 'S') {
+    if(memmem(frame, len, magic, sizeof(magic)) != NULL) {
+      downlink_frames++;
+    }
+    reply[0] = '!';
+    reply[1] = 'R';
+    reply[2] = frame[2];
+    reply[3] = 0;               /* MAC_TX_OK */
+    reply[4] = 1;
+    radio_send(reply, 5);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void *
+radio(void *arg)
+{
+  static uint8_t buf[4096];
+  static uint8_t frame[2048];
+  int n, i, len, esc;
+
+  len = esc = 0;
+  while((n = read(radio_fd, buf, sizeof(buf))) > 0) {
+    for(i = 0; i < n; i++) {
+      if(buf[i] == SLIP_END) {
+        if(len > 0 && len <= sizeof(frame)) {
+          radio_input(frame, len);
+        }
+        len = esc = 0;
+      } else if(buf[i] == SLIP_ESC) {
+        esc = 1;
+      } else {
+        if(len < sizeof(frame)) {
+          frame[len] = !esc ? buf[i] :
+            buf[i] == SLIP_ESC_END ? SLIP_END : SLIP_ESC;
+        }
+        len++;
+        esc = 0;
+      }
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static void
+set_node_addr(struct sockaddr_in6 *addr, uint16_t port)
+{
+  memset(addr, 0, sizeof(*addr));
+  addr->sin6_family = AF_INET6;
+  addr->sin6_port = htons(port);
+  memcpy(&addr->sin6_addr, node_ip, 16);
+}
+/*---------------------------------------------------------------------------*/
+/* The host side: UDP packets to the node, through tun. Sends one
+   packet if arg is not NULL. */
+static void *
+downlink(void *arg)
+{
+  struct sockaddr_in6 addr;
+  uint8_t payload[BORDER_ROUTER_BENCHMARK_PAYLOAD_LEN];
+  int s;
+
+  s = socket(AF_INET6, SOCK_DGRAM, 0);
+  set_node_addr(&addr, NODE_PORT);
+  memset(payload, 0, sizeof(payload));
+  memcpy(payload, magic, sizeof(magic));
+  do {
+    sendto(s, payload, sizeof(payload), 0,
+           (struct sockaddr *)&addr, sizeof(addr));
+  } while(!stopping && arg == NULL);
+  close(s);
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+/* The node side: UDP packets to the host, over SLIP */
+static void *
+uplink_sender(void *arg)
+{
+  while(!stopping) {
+    radio_write(uplink, uplink_len);
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static void *
+uplink_receiver(void *arg)
+{
+  struct timeval tv;
+  uint8_t buf[256];
+  int s;
+
+  s = *(int *)arg;
+  tv.tv_sec = 0;
+  tv.tv_usec = 100000;
+  setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  while(!done) {
+    if(recv(s, buf, sizeof(buf), 0) == UDP_LEN - 8) {
+      uplink_received++;
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static void
+make_uplink(void)
+{
+  uint8_t upper[UDP_LEN];
+  uint8_t frame[128];
+  int i, len;
+
+  uplink_len = 0;
+  for(i = 0; i < UPLINK_FRAMES; i++) {
+    memset(upper, 0, sizeof(upper));
+    upper[0] = NODE_PORT >> 8;
+    upper[1] = NODE_PORT & 0xff;
+    upper[2] = HOST_PORT >> 8;
+    upper[3] = HOST_PORT & 0xff;
+    upper[4] = UDP_LEN >> 8;
+    upper[5] = UDP_LEN & 0xff;
+    memcpy(&upper[8], magic, sizeof(magic));
+    upper[8 + sizeof(magic)] = i;
+    set_checksum(&upper[6], node_ip, host_ip, 17, upper, UDP_LEN);
+    len = make_frame(frame, i, 17, node_ip, host_ip, upper, UDP_LEN);
+    uplink_len += slip_encode(&uplink[uplink_len], frame, len);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* A DAO from the node, so that the border router routes to it */
+static void
+send_dao(void)
+{
+  static uint8_t seq;
+  uint8_t icmp[4 + 4 + 20 + 6];
+  uint8_t frame[128];
+
+  memset(icmp, 0, sizeof(icmp));
+  icmp[0] = 155;                /* RPL */
+  icmp[1] = 0x02;               /* DAO */
+  icmp[4] = 0x1e;               /* RPL_DEFAULT_INSTANCE */
+  icmp[7] = ++seq;
+  icmp[8] = 0x05;               /* Target */
+  icmp[9] = 18;
+  icmp[11] = 128;
+  memcpy(&icmp[12], node_ip, 16);
+  icmp[28] = 0x06;              /* Transit information */
+  icmp[29] = 4;
+  icmp[33] = 0xff;              /* Lifetime */
+  set_checksum(&icmp[2], node_ll, router_ll, 58, icmp, sizeof(icmp));
+  radio_send(frame, make_frame(frame, seq, 58, node_ll, router_ll,
+                               icmp, sizeof(icmp)));
+}
+/*---------------------------------------------------------------------------*/
+static unsigned long
+cpu_time(pid_t pid)
+{
+  char name[32];
+  unsigned long utime, stime;
+  FILE *f;
+
+  /* In clock ticks, fields 14 and 15 */
+  snprintf(name, sizeof(name), "/proc/%d/stat", (int)pid);
+  f = fopen(name, "r");
+  if(f == NULL) {
+    return 0;
+  }
+  utime = stime = 0;
+  if(fscanf(f, "%*d %*s %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+            &utime, &stime) != 2) {
+    utime = stime = 0;
+  }
+  fclose(f);
+  return utime + stime;
+}
+/*---------------------------------------------------------------------------*/
+/* Runs a phase and prints packets/s and the CPU time of the border
+   router per packet */
+static void
+measure(pid_t pid, const char *name, void *(*thread)(void *),
+        volatile unsigned long *count)
+{
+  pthread_t id;
+  unsigned long start, packets, ticks;
+
+  stopping = 0;
+  pthread_create(&id, NULL, thread, NULL);
+  sleep(1);
+  start = *count;
+  ticks = cpu_time(pid);
+  sleep(BORDER_ROUTER_BENCHMARK_SECONDS);
+  packets = *count - start;
+  ticks = cpu_time(pid) - ticks;
+  stopping = 1;
+  pthread_join(id, NULL);
+
+  printf("  %s %7lu packets/s", name, packets / BORDER_ROUTER_BENCHMARK_SECONDS);
+  if(packets > 0) {
+    printf(", %5lu us CPU/packet",
+           ticks * 1000000UL / sysconf(_SC_CLK_TCK) / packets);
+  }
+  printf("\n");
+}
+/*---------------------------------------------------------------------------*/
+static void
+run(const char *border_router, int cores)
+{
+  struct sockaddr_in addr;
+  struct sockaddr_in6 addr6;
+  socklen_t addrlen;
+  char port[8];
+  cpu_set_t cpus, allowed;
+  pthread_t radio_thread, receiver_thread;
+  pid_t pid;
+  int listen_fd, host_fd, fd, i, n;
+
+  listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if(bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+     listen(listen_fd, 1) < 0) {
+    err(1, "listen");
+  }
+  addrlen = sizeof(addr);
+  getsockname(listen_fd, (struct sockaddr *)&addr, &addrlen);
+  snprintf(port, sizeof(port), "%u", ntohs(addr.sin_port));
+
+  host_fd = socket(AF_INET6, SOCK_DGRAM, 0);
+  memset(&addr6, 0, sizeof(addr6));
+  addr6.sin6_family = AF_INET6;
+  addr6.sin6_port = htons(HOST_PORT);
+  if(bind(host_fd, (struct sockaddr *)&addr6, sizeof(addr6)) < 0) {
+    err(1, "bind");
+  }
+
+  pid = fork();
+  if(pid == 0) {
+    /* The first cores the benchmark may use */
+    sched_getaffinity(0, sizeof(allowed), &allowed);
+    CPU_ZERO(&cpus);
+    for(i = 0, n = 0; n < cores; i++) {
+      if(CPU_ISSET(i, &allowed)) {
+        CPU_SET(i, &cpus);
+        n++;
+      }
+    }
+    sched_setaffinity(0, sizeof(cpus), &cpus);
+    fd = open("/dev/null", O_RDWR);
+    dup2(fd, STDIN_FILENO);
+    dup2(fd, STDOUT_FILENO);
+    dup2(fd, STDERR_FILENO);
+    execl(border_router, border_router, "-a", "127.0.0.1", "-p", port,
+          PREFIX, (char *)NULL);
+    _exit(1);
+  }
+
+  radio_fd = accept(listen_fd, NULL, NULL);
+  close(listen_fd);
+  mac_requested = 0;
+  downlink_frames = 0;
+  done = 0;
+  pthread_create(&radio_thread, NULL, radio, NULL);
+  pthread_create(&receiver_thread, NULL, uplink_receiver, &host_fd);
+
+  /* Wait for the border router to come up, then for a route to the
+     node */
+  for(i = 0; i < 100 && !mac_requested; i++) {
+    usleep(100000);
+  }
+  sleep(2);
+  for(i = 0; i < 50 && downlink_frames == 0; i++) {
+    send_dao();
+    downlink(&i);
+    usleep(200000);
+  }
+
+  printf("%s, %d core%s:\n", border_router, cores, cores > 1 ? "s" : "");
+  if(downlink_frames == 0) {
+    printf("  no route to the node through the border router\n");
+  } else {
+    measure(pid, "tun to SLIP", downlink, &downlink_frames);
+    measure(pid, "SLIP to tun", uplink_sender, &uplink_received);
+  }
+
+  done = 1;
+  pthread_join(receiver_thread, NULL);
+
+  kill(pid, SIGTERM);
+  waitpid(pid, NULL, 0);
+  shutdown(radio_fd, SHUT_RDWR);
+  pthread_join(radio_thread, NULL);
+  close(radio_fd);
+  close(host_fd);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(border_router_benchmark_process, ev, data)
+{
+  cpu_set_t allowed;
+  int cores, i, n;
+
+  PROCESS_BEGIN();
+
+  set_ip(host_ip, 0xfd, 0xbe, NULL);
+  set_ip(node_ip, 0xfd, 0xbe, node_mac);
+  set_ip(router_ll, 0xfe, 0x80, router_mac);
+  set_ip(node_ll, 0xfe, 0x80, node_mac);
+  make_uplink();
+  signal(SIGPIPE, SIG_IGN);
+
+  sched_getaffinity(0, sizeof(allowed), &allowed);
+  cores = CPU_COUNT(&allowed);
+  printf("%u byte payloads, %d core%s\n", BORDER_ROUTER_BENCHMARK_PAYLOAD_LEN,
+         cores, cores > 1 ? "s" : "");
+
+  for(i = 1; i < contiki_argc || i == 1; i++) {
+    for(n = 1; n <= cores; n++) {
+      run(i < contiki_argc ? contiki_argv[i] : DEFAULT_BORDER_ROUTER, n);
+    }
+  }
+
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
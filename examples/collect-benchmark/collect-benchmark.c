@@ -0,0 +1,294 @@
+/*
+ * Copyright (c) 2016, Thingsquare, http://www.thingsquare.com/.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file
+ *         Measures the time the Rime collect neighbor table takes per
+ *         packet for a node with many neighbors. For each packet, a
+ *         routing advertisement is received from a random neighbor
+ *         and a data packet is sent to the parent and acknowledged,
+ *         with the same neighbor table calls that collect.c makes for
+ *         them. Then checks that the best neighbor is the one a linear
+ *         scan of the table finds, over random updates that often make
+ *         neighbors tie.
+ */
+
+#include "contiki.h"
+#include "net/rime/collect.h"
+#include "net/rime/collect-neighbor.h"
+#include "lib/random.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#ifndef COLLECT_BENCHMARK_PACKETS
+#define COLLECT_BENCHMARK_PACKETS 1000000UL
+#endif
+
+#define RTMETRIC_MAX COLLECT_MAX_DEPTH
+
+#ifndef COLLECT_BENCHMARK_CHECK_UPDATES
+#define COLLECT_BENCHMARK_CHECK_UPDATES 100000UL
+#endif
+
+#define COLLECT_BENCHMARK_REXMITS 4
+
+/* As in collect.c */
+#define SIGNIFICANT_RTMETRIC_PARENT_CHANGE (COLLECT_LINK_ESTIMATE_UNIT +  \
+                                            COLLECT_LINK_ESTIMATE_UNIT / 2)
+
+static struct collect_neighbor_list neighbor_list;
+static linkaddr_t parent;
+static uint16_t rtmetric;
+static unsigned long parent_changes;
+
+PROCESS(collect_benchmark_process, "collect benchmark");
+AUTOSTART_PROCESSES(&collect_benchmark_process);
+/*---------------------------------------------------------------------------*/
+static unsigned long
+usec(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+}
+/*---------------------------------------------------------------------------*/
+static void
+neighbor_addr(linkaddr_t *addr, uint16_t i)
+{
+  linkaddr_copy(addr, &linkaddr_null);
+  addr->u8[0] = (i + 2) & 0xff;
+  addr->u8[1] = (i + 2) >> 8;
+}
+/*---------------------------------------------------------------------------*/
+static uint16_t
+random_rtmetric(void)
+{
+  return COLLECT_LINK_ESTIMATE_UNIT * (1 + random_rand() % 8) +
+    random_rand() % COLLECT_LINK_ESTIMATE_UNIT;
+}
+/*---------------------------------------------------------------------------*/
+/* collect.c:rtmetric_compute() */
+static void
+rtmetric_compute(void)
+{
+  struct collect_neighbor *n;
+
+  n = collect_neighbor_list_find(&neighbor_list, &parent);
+  if(n == NULL) {
+    rtmetric = RTMETRIC_MAX;
+  } else {
+    rtmetric = collect_neighbor_rtmetric_link_estimate(n);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* collect.c:update_parent() */
+static void
+update_parent(void)
+{
+  struct collect_neighbor *current;
+  struct collect_neighbor *best;
+
+  current = collect_neighbor_list_find(&neighbor_list, &parent);
+  best = collect_neighbor_list_best(&neighbor_list);
+  if(best != NULL) {
+    if(current == NULL ||
+       collect_neighbor_rtmetric_link_estimate(best) +
+       SIGNIFICANT_RTMETRIC_PARENT_CHANGE <
+       collect_neighbor_rtmetric_link_estimate(current)) {
+      linkaddr_copy(&parent, &best->addr);
+      parent_changes++;
+    }
+  }
+  rtmetric_compute();
+}
+/*---------------------------------------------------------------------------*/
+static void
+run(uint16_t neighbors)
+{
+  struct collect_neighbor *n;
+  linkaddr_t from;
+  unsigned long i;
+  unsigned long start, elapsed;
+  unsigned long sum;
+  uint16_t s;
+
+  random_init(1);
+  collect_neighbor_list_purge(&neighbor_list);
+  collect_neighbor_list_new(&neighbor_list);
+  linkaddr_copy(&parent, &linkaddr_null);
+  parent_changes = 0;
+
+  for(s = 0; s < neighbors; s++) {
+    neighbor_addr(&from, s);
+    collect_neighbor_list_add(&neighbor_list, &from, random_rtmetric());
+  }
+  update_parent();
+
+  sum = 0;
+  start = usec();
+  for(i = 0; i < COLLECT_BENCHMARK_PACKETS; i++) {
+    /* A routing advertisement from a neighbor (collect.c:received_announcement()) */
+    neighbor_addr(&from, random_rand() % neighbors);
+    n = collect_neighbor_list_find(&neighbor_list, &from);
+    if(n != NULL) {
+      collect_neighbor_update_rtmetric(n, random_rtmetric());
+      update_parent();
+    }
+
+    /* A data packet to the parent, acknowledged after a few
+       transmissions (collect.c:send_queued_packet() and
+       handle_ack()), or now and then not at all
+       (collect.c:retransmit_not_sent_callback()) */
+    n = collect_neighbor_list_find(&neighbor_list, &parent);
+    if(n != NULL) {
+      n = collect_neighbor_list_find(&neighbor_list, &parent);
+      if(random_rand() % 16 == 0) {
+        collect_neighbor_tx_fail(n, COLLECT_BENCHMARK_REXMITS);
+      } else {
+        collect_neighbor_tx(n, 1 + random_rand() % 3);
+        collect_neighbor_update_rtmetric(n, collect_neighbor_rtmetric(n));
+      }
+      update_parent();
+    }
+    sum += rtmetric;
+  }
+  elapsed = usec() - start;
+
+  printf("%4u neighbors: %lu ns per packet, %lu parent changes (%lu)\n",
+         neighbors, elapsed * 1000 / COLLECT_BENCHMARK_PACKETS,
+         parent_changes, sum);
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * The best neighbor as collect_neighbor_list_best() used to find it:
+ * the first one in the list with the lowest rtmetric + link estimate.
+ */
+static struct collect_neighbor *
+linear_best(void)
+{
+  struct collect_neighbor *n, *best;
+  uint16_t best_rtmetric;
+
+  best_rtmetric = RTMETRIC_MAX;
+  best = NULL;
+  for(n = list_head(collect_neighbor_list(&neighbor_list)); n != NULL;
+      n = list_item_next(n)) {
+    if(collect_neighbor_rtmetric_link_estimate(n) < best_rtmetric) {
+      best_rtmetric = collect_neighbor_rtmetric_link_estimate(n);
+      best = n;
+    }
+  }
+  return best;
+}
+/*---------------------------------------------------------------------------*/
+/* Few distinct values, so that neighbors often tie */
+static uint16_t
+coarse_rtmetric(void)
+{
+  if(random_rand() % 16 == 0) {
+    return RTMETRIC_MAX;
+  }
+  return COLLECT_LINK_ESTIMATE_UNIT * (random_rand() % 4);
+}
+/*---------------------------------------------------------------------------*/
+static int
+check(uint16_t neighbors)
+{
+  struct collect_neighbor *n;
+  linkaddr_t addr;
+  unsigned long i;
+  unsigned long mismatches;
+
+  random_init(2);
+  collect_neighbor_list_purge(&neighbor_list);
+  collect_neighbor_list_new(&neighbor_list);
+
+  mismatches = 0;
+  for(i = 0; i < COLLECT_BENCHMARK_CHECK_UPDATES; i++) {
+    neighbor_addr(&addr, random_rand() % neighbors);
+    n = collect_neighbor_list_find(&neighbor_list, &addr);
+    switch(random_rand() % 8) {
+    case 0:
+      collect_neighbor_list_remove(&neighbor_list, &addr);
+      break;
+    case 1:
+      collect_neighbor_list_add(&neighbor_list, &addr, coarse_rtmetric());
+      break;
+    case 2:
+    case 3:
+      collect_neighbor_update_rtmetric(n, coarse_rtmetric());
+      break;
+    case 4:
+    case 5:
+      collect_neighbor_tx(n, 1 + random_rand() % 2);
+      break;
+    case 6:
+      collect_neighbor_tx_fail(n, 1);
+      break;
+    default:
+      collect_neighbor_rx(n);
+      break;
+    }
+
+    if(collect_neighbor_list_best(&neighbor_list) != linear_best()) {
+      mismatches++;
+    }
+  }
+
+  printf("%4u neighbors: %lu of %lu best neighbors differ from a linear scan\n",
+         neighbors, mismatches, COLLECT_BENCHMARK_CHECK_UPDATES);
+  return mismatches == 0;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(collect_benchmark_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  collect_neighbor_init();
+  collect_neighbor_list_new(&neighbor_list);
+
+  run(8);
+  run(32);
+  run(128);
+
+  if(!check(4) || !check(16) || !check(64)) {
+    exit(1);
+  }
+
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
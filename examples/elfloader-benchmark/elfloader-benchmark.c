@@ -0,0 +1,436 @@
+/*
+ * Copyright (c) 2016, Thingsquare, http://www.thingsquare.com/.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file
+ *         Measures how long the ELF loader takes to load a module of
+ *         about 10 kB. The benchmark writes a relocatable ELF32 object
+ *         to a file: a text section with calls to the core and to its
+ *         own functions, data with pointers, and an autostart_processes
+ *         symbol, as a compiled Contiki program has. It then loads the
+ *         file repeatedly with elfloader_load().
+ */
+
+#include "contiki.h"
+#include "cfs/cfs.h"
+#include "loader/elfloader.h"
+#include "loader/elfloader-arch.h"
+#include "loader/symbols.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#ifndef ELFLOADER_BENCHMARK_LOADS
+#define ELFLOADER_BENCHMARK_LOADS 200
+#endif
+
+#define FILENAME "benchmark.ce"
+
+#define TEXT_SIZE        8192
+#define RODATA_SIZE      1024
+#define DATA_SIZE        512
+#define BSS_SIZE         256
+
+#define LOCAL_FUNCTIONS  64
+#define LOCAL_VARIABLES  32
+#define TEXT_RELOCATIONS 800
+#define DATA_RELOCATIONS 64
+
+/* Sections of the generated file, in this order */
+enum {
+  SHN_UNDEF_, SECT_TEXT, SECT_REL_TEXT, SECT_RODATA, SECT_DATA,
+  SECT_REL_DATA, SECT_BSS, SECT_SYMTAB, SECT_STRTAB, SECT_SHSTRTAB,
+  SECTIONS
+};
+
+#define STB_LOCAL   0
+#define STB_GLOBAL  1
+#define STT_NOTYPE  0
+#define STT_OBJECT  1
+#define STT_FUNC    2
+#define STT_SECTION 3
+#define R_386_32    1
+
+/* Core functions that the module calls */
+static const char *core_names[] = {
+  "etimer_expired", "etimer_set", "memcpy", "memset", "printf",
+  "process_exit", "process_post", "process_start", "strcmp", "strlen",
+};
+#define CORE_SYMBOLS (sizeof(core_names) / sizeof(core_names[0]))
+
+/* The symbols of the core that elfloader_load() looks up, sorted by
+   name as symtab_lookup() expects */
+const int symbols_nelts = CORE_SYMBOLS + 1;
+const struct symbols symbols[CORE_SYMBOLS + 1] = {
+  { "etimer_expired", (void *)etimer_expired },
+  { "etimer_set", (void *)etimer_set },
+  { "memcpy", (void *)memcpy },
+  { "memset", (void *)memset },
+  { "printf", (void *)printf },
+  { "process_exit", (void *)process_exit },
+  { "process_post", (void *)process_post },
+  { "process_start", (void *)process_start },
+  { "strcmp", (void *)strcmp },
+  { "strlen", (void *)strlen },
+  { 0, 0 }
+};
+
+static uint8_t file[32768];
+static uint8_t relocated[sizeof(file)];
+static unsigned file_len;
+
+static char datamemory[ELFLOADER_DATAMEMORY_SIZE];
+static char textmemory[ELFLOADER_TEXTMEMORY_SIZE];
+
+static unsigned long relocations;
+
+PROCESS(elfloader_benchmark_process, "ELF loader benchmark");
+AUTOSTART_PROCESSES(&elfloader_benchmark_process);
+/*---------------------------------------------------------------------------*/
+void *
+elfloader_arch_allocate_ram(int size)
+{
+  return datamemory;
+}
+/*---------------------------------------------------------------------------*/
+void *
+elfloader_arch_allocate_rom(int size)
+{
+  return textmemory;
+}
+/*---------------------------------------------------------------------------*/
+void
+elfloader_arch_write_rom(int fd, unsigned short textoff, unsigned int size,
+                         char *mem)
+{
+  cfs_seek(fd, textoff, CFS_SEEK_SET);
+  cfs_read(fd, mem, size);
+}
+/*---------------------------------------------------------------------------*/
+void
+elfloader_arch_relocate(int fd, unsigned int sectionoffset, char *sectionaddr,
+                        struct elf32_rela *rela, char *addr)
+{
+  uint32_t value;
+
+  /* R_386_32. elfloader-x86 writes the result back to the file, but
+     that would change the module between loads, so it goes into a
+     copy of the file here. */
+  value = (uint32_t)(uintptr_t)addr + rela->r_addend;
+  memcpy(&relocated[sectionoffset + rela->r_offset], &value, sizeof(value));
+  relocations++;
+}
+/*---------------------------------------------------------------------------*/
+static void
+put16(unsigned offset, uint16_t v)
+{
+  file[offset] = v & 0xff;
+  file[offset + 1] = v >> 8;
+}
+/*---------------------------------------------------------------------------*/
+static void
+put32(unsigned offset, uint32_t v)
+{
+  put16(offset, v & 0xffff);
+  put16(offset + 2, v >> 16);
+}
+/*---------------------------------------------------------------------------*/
+static unsigned
+add_string(unsigned table, unsigned *len, const char *s)
+{
+  unsigned offset;
+
+  offset = *len;
+  strcpy((char *)&file[table + offset], s);
+  *len += strlen(s) + 1;
+  return offset;
+}
+/*---------------------------------------------------------------------------*/
+static unsigned
+add_symbol(unsigned symtab, unsigned *nsyms, unsigned name, uint32_t value,
+           int bind, int type, int shndx)
+{
+  unsigned s;
+
+  s = symtab + *nsyms * 16;
+  put32(s, name);
+  put32(s + 4, value);
+  put32(s + 8, 4);
+  file[s + 12] = (bind << 4) | type;
+  file[s + 13] = 0;
+  put16(s + 14, shndx);
+  return (*nsyms)++;
+}
+/*---------------------------------------------------------------------------*/
+static void
+add_section(unsigned shdr, int n, unsigned name, int type, unsigned offset,
+            unsigned size, int link, int entsize)
+{
+  unsigned h;
+
+  h = shdr + n * 40;
+  put32(h, name);
+  put32(h + 4, type);
+  put32(h + 16, offset);
+  put32(h + 20, size);
+  put32(h + 24, link);
+  put32(h + 36, entsize);
+}
+/*---------------------------------------------------------------------------*/
+/* Writes a relocatable ELF32 object to the file buffer */
+static void
+make_module(void)
+{
+  unsigned text, reltext, rodata, data, reldata, symtab, strtab, shstrtab;
+  unsigned shdr;
+  unsigned nsyms, strtab_len, shstrtab_len;
+  unsigned sym_section[SECTIONS];
+  unsigned sym_core[CORE_SYMBOLS];
+  unsigned sym_function[LOCAL_FUNCTIONS];
+  unsigned sym_variable[LOCAL_VARIABLES];
+  unsigned sym_autostart;
+  unsigned names[SECTIONS];
+  unsigned i, r, sym;
+  char name[32];
+
+  memset(file, 0, sizeof(file));
+  srand(1);
+
+  text = 52;
+  reltext = text + TEXT_SIZE;
+  rodata = reltext + TEXT_RELOCATIONS * 8;
+  data = rodata + RODATA_SIZE;
+  reldata = data + DATA_SIZE;
+  symtab = reldata + DATA_RELOCATIONS * 8;
+
+  /* Leave room for the symbol table before the string tables */
+  nsyms = 4 + CORE_SYMBOLS + LOCAL_FUNCTIONS + LOCAL_VARIABLES + 2;
+  strtab = symtab + nsyms * 16;
+  nsyms = 0;
+  strtab_len = 0;
+
+  /* Code and data, with the addends of the relocations in place */
+  for(i = text; i < text + TEXT_SIZE; i++) {
+    file[i] = rand();
+  }
+  for(i = data; i < data + DATA_SIZE; i++) {
+    file[i] = rand();
+  }
+
+  add_string(strtab, &strtab_len, "");
+  add_symbol(symtab, &nsyms, 0, 0, STB_LOCAL, STT_NOTYPE, 0);
+  sym_section[SECT_TEXT] =
+    add_symbol(symtab, &nsyms, 0, 0, STB_LOCAL, STT_SECTION, SECT_TEXT);
+  sym_section[SECT_RODATA] =
+    add_symbol(symtab, &nsyms, 0, 0, STB_LOCAL, STT_SECTION, SECT_RODATA);
+  sym_section[SECT_DATA] =
+    add_symbol(symtab, &nsyms, 0, 0, STB_LOCAL, STT_SECTION, SECT_DATA);
+  for(i = 0; i < LOCAL_FUNCTIONS; i++) {
+    snprintf(name, sizeof(name), "benchmark_function_%u", i);
+    sym_function[i] = add_symbol(symtab, &nsyms,
+                                 add_string(strtab, &strtab_len, name),
+                                 i * (TEXT_SIZE / LOCAL_FUNCTIONS),
+                                 STB_LOCAL, STT_FUNC, SECT_TEXT);
+  }
+  for(i = 0; i < LOCAL_VARIABLES; i++) {
+    snprintf(name, sizeof(name), "benchmark_variable_%u", i);
+    sym_variable[i] = add_symbol(symtab, &nsyms,
+                                 add_string(strtab, &strtab_len, name),
+                                 i * 4, STB_LOCAL, STT_OBJECT,
+                                 i & 1 ? SECT_BSS : SECT_DATA);
+  }
+  sym_autostart = add_symbol(symtab, &nsyms,
+                             add_string(strtab, &strtab_len,
+                                        "autostart_processes"),
+                             DATA_SIZE - 8, STB_GLOBAL, STT_OBJECT, SECT_DATA);
+  for(i = 0; i < CORE_SYMBOLS; i++) {
+    sym_core[i] = add_symbol(symtab, &nsyms,
+                             add_string(strtab, &strtab_len, core_names[i]),
+                             0, STB_GLOBAL, STT_NOTYPE, 0);
+  }
+
+  /* Calls to the core and to the module itself, and references to
+     variables and constants, as compiled code has */
+  for(i = 0; i < TEXT_RELOCATIONS; i++) {
+    r = rand() % 10;
+    if(r < 4) {
+      sym = sym_core[rand() % CORE_SYMBOLS];
+    } else if(r < 7) {
+      sym = sym_function[rand() % LOCAL_FUNCTIONS];
+    } else if(r < 9) {
+      sym = sym_variable[rand() % LOCAL_VARIABLES];
+    } else {
+      sym = sym_section[SECT_RODATA];
+    }
+    put32(reltext + i * 8, i * (TEXT_SIZE / TEXT_RELOCATIONS));
+    put32(reltext + i * 8 + 4, (sym << 8) | R_386_32);
+  }
+  for(i = 0; i < DATA_RELOCATIONS; i++) {
+    sym = i & 1 ? sym_function[rand() % LOCAL_FUNCTIONS] :
+      sym_section[SECT_TEXT];
+    put32(reldata + i * 8, i * 4);
+    put32(reldata + i * 8 + 4, (sym << 8) | R_386_32);
+  }
+
+  shstrtab = strtab + strtab_len;
+  shstrtab_len = 0;
+  names[SHN_UNDEF_] = add_string(shstrtab, &shstrtab_len, "");
+  names[SECT_TEXT] = add_string(shstrtab, &shstrtab_len, ".text");
+  names[SECT_REL_TEXT] = add_string(shstrtab, &shstrtab_len, ".rel.text");
+  names[SECT_RODATA] = add_string(shstrtab, &shstrtab_len, ".rodata");
+  names[SECT_DATA] = add_string(shstrtab, &shstrtab_len, ".data");
+  names[SECT_REL_DATA] = add_string(shstrtab, &shstrtab_len, ".rel.data");
+  names[SECT_BSS] = add_string(shstrtab, &shstrtab_len, ".bss");
+  names[SECT_SYMTAB] = add_string(shstrtab, &shstrtab_len, ".symtab");
+  names[SECT_STRTAB] = add_string(shstrtab, &shstrtab_len, ".strtab");
+  names[SECT_SHSTRTAB] = add_string(shstrtab, &shstrtab_len, ".shstrtab");
+
+  shdr = (shstrtab + shstrtab_len + 3) & ~3;
+  add_section(shdr, SECT_TEXT, names[SECT_TEXT], 1, text, TEXT_SIZE, 0, 0);
+  add_section(shdr, SECT_REL_TEXT, names[SECT_REL_TEXT], 9, reltext,
+              TEXT_RELOCATIONS * 8, SECT_SYMTAB, 8);
+  add_section(shdr, SECT_RODATA, names[SECT_RODATA], 1, rodata,
+              RODATA_SIZE, 0, 0);
+  add_section(shdr, SECT_DATA, names[SECT_DATA], 1, data, DATA_SIZE, 0, 0);
+  add_section(shdr, SECT_REL_DATA, names[SECT_REL_DATA], 9, reldata,
+              DATA_RELOCATIONS * 8, SECT_SYMTAB, 8);
+  add_section(shdr, SECT_BSS, names[SECT_BSS], 8, 0, BSS_SIZE, 0, 0);
+  add_section(shdr, SECT_SYMTAB, names[SECT_SYMTAB], 2, symtab, nsyms * 16,
+              SECT_STRTAB, 16);
+  add_section(shdr, SECT_STRTAB, names[SECT_STRTAB], 3, strtab,
+              strtab_len, 0, 0);
+  add_section(shdr, SECT_SHSTRTAB, names[SECT_SHSTRTAB], 3, shstrtab,
+              shstrtab_len, 0, 0);
+
+  /* The ELF header */
+  memcpy(file, "\177ELF\001\001\001", 7);
+  put16(16, 1);                 /* ET_REL */
+  put16(18, 3);                 /* EM_386 */
+  put32(20, 1);
+  put32(32, shdr);
+  put16(40, 52);
+  put16(46, 40);
+  put16(48, SECTIONS);
+  put16(50, SECT_SHSTRTAB);
+
+  file_len = shdr + SECTIONS * 40;
+  printf("Module: %u bytes text, %u relocations, %u symbols, "
+         "%u bytes symbol and string tables\n",
+         TEXT_SIZE + RODATA_SIZE, TEXT_RELOCATIONS + DATA_RELOCATIONS,
+         nsyms, nsyms * 16 + strtab_len);
+  (void)sym_autostart;
+}
+/*---------------------------------------------------------------------------*/
+static unsigned long
+now_us(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec * 1000000UL + tv.tv_usec;
+}
+/*---------------------------------------------------------------------------*/
+#if ELFLOADER_STATS
+/* Microseconds per load from the total clock ticks of all loads */
+static unsigned long
+per_load(clock_time_t ticks)
+{
+  return (unsigned long)ticks * 1000000UL /
+    CLOCK_SECOND / ELFLOADER_BENCHMARK_LOADS;
+}
+#endif /* ELFLOADER_STATS */
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(elfloader_benchmark_process, ev, data)
+{
+  int fd;
+  int i;
+  int ret;
+  unsigned long start, elapsed;
+#if ELFLOADER_STATS
+  static struct elfloader_stats total;
+#endif /* ELFLOADER_STATS */
+
+  PROCESS_BEGIN();
+
+  make_module();
+
+  fd = cfs_open(FILENAME, CFS_WRITE);
+  if(fd < 0 || cfs_write(fd, file, file_len) != file_len) {
+    printf("Could not write %s\n", FILENAME);
+    exit(1);
+  }
+  cfs_close(fd);
+
+  ret = ELFLOADER_OK;
+  elapsed = 0;
+  for(i = 0; i < ELFLOADER_BENCHMARK_LOADS; i++) {
+    fd = cfs_open(FILENAME, CFS_READ);
+    start = now_us();
+    ret = elfloader_load(fd);
+    elapsed += now_us() - start;
+    cfs_close(fd);
+#if ELFLOADER_STATS
+    total.sections += elfloader_stats.sections;
+    total.tables += elfloader_stats.tables;
+    total.relocate += elfloader_stats.relocate;
+    total.copy += elfloader_stats.copy;
+    total.autostart += elfloader_stats.autostart;
+#endif /* ELFLOADER_STATS */
+  }
+  cfs_remove(FILENAME);
+
+  /* A module without a process has no start point */
+  if(ret != ELFLOADER_OK && ret != ELFLOADER_NO_STARTPOINT) {
+    printf("elfloader_load() failed: %d %s\n", ret, elfloader_unknown);
+    exit(1);
+  }
+  printf("Cache size %u: %lu us per load, %lu relocations\n",
+         ELFLOADER_CACHE_SIZE, elapsed / ELFLOADER_BENCHMARK_LOADS,
+         relocations / ELFLOADER_BENCHMARK_LOADS);
+#if ELFLOADER_STATS
+  printf("  %lu reads of %lu bytes from the file, tables %s\n",
+         elfloader_stats.reads, elfloader_stats.bytes,
+         elfloader_stats.cached ? "cached" : "not cached");
+  printf("  sections %lu, tables %lu, relocate %lu, copy %lu, "
+         "autostart %lu us\n",
+         per_load(total.sections), per_load(total.tables),
+         per_load(total.relocate), per_load(total.copy),
+         per_load(total.autostart));
+#endif /* ELFLOADER_STATS */
+
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,214 @@
+/*
+ * Copyright (c) 2016, Thingsquare, http://www.thingsquare.com/.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file
+ *         Checks how the CPU time is attributed to processes and rtimer
+ *         callbacks by the energest accounting, and measures what the
+ *         accounting adds to each process call. Three processes do
+ *         work in the ratio 1:2:4, called synchronously from a driver
+ *         process, while an rtimer callback interrupts them every 5 ms.
+ */
+
+#include "contiki.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#ifndef ENERGEST_BENCHMARK_ROUNDS
+#define ENERGEST_BENCHMARK_ROUNDS 1000
+#endif
+#ifndef ENERGEST_BENCHMARK_WORK
+#define ENERGEST_BENCHMARK_WORK 20000
+#endif
+#ifndef ENERGEST_BENCHMARK_CALLS
+#define ENERGEST_BENCHMARK_CALLS 2000000UL
+#endif
+
+/* Calls per round of the overhead test, so that each round of the
+   driver is much shorter than a wrap-around of the clock */
+#define CALLS_PER_ROUND 10000
+
+PROCESS(energest_benchmark_process, "energest benchmark");
+PROCESS(worker_a_process, "worker a");
+PROCESS(worker_b_process, "worker b");
+PROCESS(worker_c_process, "worker c");
+PROCESS(empty_process, "empty");
+AUTOSTART_PROCESSES(&energest_benchmark_process);
+
+static struct rtimer rt;
+static volatile unsigned long sink;
+/*---------------------------------------------------------------------------*/
+static unsigned long
+usec(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec * 1000000UL + tv.tv_usec;
+}
+/*---------------------------------------------------------------------------*/
+unsigned short
+energest_benchmark_now(void)
+{
+  return (unsigned short)usec();
+}
+/*---------------------------------------------------------------------------*/
+static void
+work(int units)
+{
+  unsigned long i;
+
+  for(i = 0; i < units * (unsigned long)ENERGEST_BENCHMARK_WORK; i++) {
+    sink += i;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+periodic(struct rtimer *t, void *ptr)
+{
+  work(1);
+  rtimer_set(t, RTIMER_NOW() + RTIMER_SECOND / 200, 0, periodic, NULL);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(worker_a_process, ev, data)
+{
+  PROCESS_BEGIN();
+  while(1) {
+    PROCESS_WAIT_EVENT();
+    work(1);
+  }
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(worker_b_process, ev, data)
+{
+  PROCESS_BEGIN();
+  while(1) {
+    PROCESS_WAIT_EVENT();
+    work(2);
+  }
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(worker_c_process, ev, data)
+{
+  PROCESS_BEGIN();
+  while(1) {
+    PROCESS_WAIT_EVENT();
+    work(4);
+  }
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(empty_process, ev, data)
+{
+  PROCESS_BEGIN();
+  while(1) {
+    PROCESS_WAIT_EVENT();
+  }
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+#if ENERGEST_ACCOUNTING
+static void
+print_top(unsigned long elapsed)
+{
+  struct energest_account top[8];
+  unsigned long total;
+  int i, n;
+
+  n = energest_accounting_top(top, 8);
+  total = 0;
+  for(i = 0; i < n; i++) {
+    total += top[i].time;
+  }
+  printf("%10s %8s %6s %s\n", "us", "calls", "share", "name");
+  for(i = 0; i < n; i++) {
+    printf("%10lu %8lu %5lu%% %s\n", top[i].time, top[i].count,
+           top[i].time * 100 / (total ? total : 1),
+           top[i].process != NULL ? PROCESS_NAME_STRING(top[i].process) :
+           top[i].callback == periodic ? "rtimer periodic" : "rtimer");
+  }
+  printf("%lu us accounted for of %lu us\n", total, elapsed);
+}
+#endif /* ENERGEST_ACCOUNTING */
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(energest_benchmark_process, ev, data)
+{
+  static unsigned long start;
+  static int round;
+  unsigned long i;
+
+  PROCESS_BEGIN();
+
+  process_start(&worker_a_process, NULL);
+  process_start(&worker_b_process, NULL);
+  process_start(&worker_c_process, NULL);
+  process_start(&empty_process, NULL);
+
+#if ENERGEST_ACCOUNTING
+  energest_accounting_reset();
+#endif /* ENERGEST_ACCOUNTING */
+  rtimer_set(&rt, RTIMER_NOW() + RTIMER_SECOND / 200, 0, periodic, NULL);
+
+  start = usec();
+  for(round = 0; round < ENERGEST_BENCHMARK_ROUNDS; round++) {
+    process_post_synch(&worker_a_process, PROCESS_EVENT_CONTINUE, NULL);
+    process_post_synch(&worker_b_process, PROCESS_EVENT_CONTINUE, NULL);
+    process_post_synch(&worker_c_process, PROCESS_EVENT_CONTINUE, NULL);
+    process_poll(&energest_benchmark_process);
+    PROCESS_YIELD_UNTIL(ev == PROCESS_EVENT_POLL);
+  }
+#if ENERGEST_ACCOUNTING
+  print_top(usec() - start);
+#else /* ENERGEST_ACCOUNTING */
+  printf("Accounting off\n");
+#endif /* ENERGEST_ACCOUNTING */
+
+  start = usec();
+  for(round = 0; round < ENERGEST_BENCHMARK_CALLS / CALLS_PER_ROUND; round++) {
+    for(i = 0; i < CALLS_PER_ROUND; i++) {
+      process_post_synch(&empty_process, PROCESS_EVENT_CONTINUE, NULL);
+    }
+    process_poll(&energest_benchmark_process);
+    PROCESS_YIELD_UNTIL(ev == PROCESS_EVENT_POLL);
+  }
+  printf("%lu ns per call of an empty process\n",
+         (usec() - start) * 1000 / ENERGEST_BENCHMARK_CALLS);
+
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
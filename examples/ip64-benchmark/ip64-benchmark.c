@@ -0,0 +1,260 @@
+/*
+ * Copyright (c) 2016, Thingsquare, http://www.thingsquare.com/.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file
+ *         Measures how many packets per second ip64 translates with a
+ *         given number of active address mappings. Each run opens one
+ *         UDP session per IPv6 host, then translates outgoing packets
+ *         with ip64_6to4() and replies with ip64_4to6() for randomly
+ *         chosen sessions. Packets are translated in place, as the
+ *         ip64 interfaces do.
+ */
+
+#include "contiki.h"
+#include "contiki-net.h"
+#include "ip64.h"
+#include "ip64-addrmap.h"
+#include "lib/random.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef IP64_BENCHMARK_PACKETS
+#define IP64_BENCHMARK_PACKETS 200000UL
+#endif
+#ifndef IP64_BENCHMARK_PAYLOAD_LEN
+#define IP64_BENCHMARK_PAYLOAD_LEN 256
+#endif
+
+#define MAX_SESSIONS 10000
+
+#define IPV6_HDRLEN 40
+#define IPV4_HDRLEN 20
+#define UDP_HDRLEN  8
+
+#define IPV6_PACKET_LEN (IPV6_HDRLEN + UDP_HDRLEN + IP64_BENCHMARK_PAYLOAD_LEN)
+#define IPV4_PACKET_LEN (IPV4_HDRLEN + UDP_HDRLEN + IP64_BENCHMARK_PAYLOAD_LEN)
+
+#define SESSION_PORT 5683
+
+/* The packets of each session, as they arrive from either side */
+static uint8_t ipv6packets[MAX_SESSIONS][IPV6_PACKET_LEN];
+static uint8_t ipv4packets[MAX_SESSIONS][IPV4_PACKET_LEN];
+
+/* Packets are translated in place, as the ip64 interfaces do */
+static uint8_t buf[IP64_HDRLEN_DIFF + UIP_BUFSIZE];
+
+static uip_ip4addr_t hostaddr;
+static uip_ip4addr_t server;
+
+PROCESS(ip64_benchmark_process, "ip64 benchmark");
+AUTOSTART_PROCESSES(&ip64_benchmark_process);
+/*---------------------------------------------------------------------------*/
+static uint32_t
+sum(uint32_t acc, const uint8_t *data, uint16_t len)
+{
+  uint16_t i;
+
+  for(i = 0; i + 1 < len; i += 2) {
+    acc += (data[i] << 8) + data[i + 1];
+  }
+  if(len & 1) {
+    acc += data[len - 1] << 8;
+  }
+  return acc;
+}
+/*---------------------------------------------------------------------------*/
+static void
+set_udp_checksum(uint8_t *udp, uint32_t acc)
+{
+  acc = sum(acc + UIP_PROTO_UDP + UDP_HDRLEN + IP64_BENCHMARK_PAYLOAD_LEN,
+            udp, UDP_HDRLEN + IP64_BENCHMARK_PAYLOAD_LEN);
+  while(acc >> 16) {
+    acc = (acc & 0xffff) + (acc >> 16);
+  }
+  acc = ~acc & 0xffff;
+  if(acc == 0) {
+    acc = 0xffff;
+  }
+  udp[6] = acc >> 8;
+  udp[7] = acc & 0xff;
+}
+/*---------------------------------------------------------------------------*/
+static void
+make_ipv6_packet(uint16_t session)
+{
+  uint8_t *p;
+  uint8_t *udp;
+  uint16_t i;
+
+  p = ipv6packets[session];
+  memset(p, 0, IPV6_PACKET_LEN);
+  p[0] = 0x60;
+  p[4] = (UDP_HDRLEN + IP64_BENCHMARK_PAYLOAD_LEN) >> 8;
+  p[5] = (UDP_HDRLEN + IP64_BENCHMARK_PAYLOAD_LEN) & 0xff;
+  p[6] = UIP_PROTO_UDP;
+  p[7] = 64;
+  /* Source fd00::<session>, destination ::ffff:<server> */
+  p[8] = 0xfd;
+  p[22] = session >> 8;
+  p[23] = session & 0xff;
+  p[34] = 0xff;
+  p[35] = 0xff;
+  memcpy(&p[36], &server, sizeof(server));
+
+  udp = &p[IPV6_HDRLEN];
+  udp[0] = SESSION_PORT >> 8;
+  udp[1] = SESSION_PORT & 0xff;
+  udp[2] = SESSION_PORT >> 8;
+  udp[3] = SESSION_PORT & 0xff;
+  udp[4] = (UDP_HDRLEN + IP64_BENCHMARK_PAYLOAD_LEN) >> 8;
+  udp[5] = (UDP_HDRLEN + IP64_BENCHMARK_PAYLOAD_LEN) & 0xff;
+  for(i = 0; i < IP64_BENCHMARK_PAYLOAD_LEN; i++) {
+    udp[UDP_HDRLEN + i] = session + i;
+  }
+  set_udp_checksum(udp, sum(0, &p[8], 2 * sizeof(uip_ip6addr_t)));
+}
+/*---------------------------------------------------------------------------*/
+static void
+make_ipv4_packet(uint16_t session, uint16_t mapped_port)
+{
+  uint8_t *p;
+  uint8_t *udp;
+  uint16_t i;
+
+  p = ipv4packets[session];
+  memset(p, 0, IPV4_PACKET_LEN);
+  p[0] = 0x45;
+  p[2] = IPV4_PACKET_LEN >> 8;
+  p[3] = IPV4_PACKET_LEN & 0xff;
+  p[8] = 64;
+  p[9] = UIP_PROTO_UDP;
+  memcpy(&p[12], &server, sizeof(server));
+  memcpy(&p[16], &hostaddr, sizeof(hostaddr));
+
+  udp = &p[IPV4_HDRLEN];
+  udp[0] = SESSION_PORT >> 8;
+  udp[1] = SESSION_PORT & 0xff;
+  udp[2] = mapped_port >> 8;
+  udp[3] = mapped_port & 0xff;
+  udp[4] = (UDP_HDRLEN + IP64_BENCHMARK_PAYLOAD_LEN) >> 8;
+  udp[5] = (UDP_HDRLEN + IP64_BENCHMARK_PAYLOAD_LEN) & 0xff;
+  for(i = 0; i < IP64_BENCHMARK_PAYLOAD_LEN; i++) {
+    udp[UDP_HDRLEN + i] = session - i;
+  }
+  set_udp_checksum(udp, sum(0, &p[12], 2 * sizeof(uip_ip4addr_t)));
+}
+/*---------------------------------------------------------------------------*/
+static unsigned long
+rate(clock_time_t elapsed)
+{
+  if(elapsed == 0) {
+    elapsed = 1;
+  }
+  return (IP64_BENCHMARK_PACKETS * CLOCK_SECOND) / elapsed;
+}
+/*---------------------------------------------------------------------------*/
+static void
+run(uint16_t sessions)
+{
+  unsigned long i;
+  unsigned long out, in;
+  uint16_t s;
+  clock_time_t start;
+  clock_time_t out_time, in_time;
+
+  random_init(1);
+  ip64_addrmap_init();
+
+  for(s = 0; s < sessions; s++) {
+    make_ipv6_packet(s);
+    memcpy(buf, ipv6packets[s], IPV6_PACKET_LEN);
+    if(ip64_6to4(buf, IPV6_PACKET_LEN, &buf[IP64_HDRLEN_DIFF]) == 0) {
+      printf("Could not open session %u\n", s);
+      return;
+    }
+    make_ipv4_packet(s, (buf[IP64_HDRLEN_DIFF + IPV4_HDRLEN] << 8) +
+                     buf[IP64_HDRLEN_DIFF + IPV4_HDRLEN + 1]);
+  }
+
+  out = 0;
+  start = clock_time();
+  for(i = 0; i < IP64_BENCHMARK_PACKETS; i++) {
+    s = random_rand() % sessions;
+    memcpy(buf, ipv6packets[s], IPV6_PACKET_LEN);
+    if(ip64_6to4(buf, IPV6_PACKET_LEN, &buf[IP64_HDRLEN_DIFF]) != 0) {
+      out++;
+    }
+  }
+  out_time = clock_time() - start;
+
+  in = 0;
+  start = clock_time();
+  for(i = 0; i < IP64_BENCHMARK_PACKETS; i++) {
+    s = random_rand() % sessions;
+    memcpy(&buf[IP64_HDRLEN_DIFF], ipv4packets[s], IPV4_PACKET_LEN);
+    if(ip64_4to6(&buf[IP64_HDRLEN_DIFF], IPV4_PACKET_LEN, buf) != 0 &&
+       buf[39] == (s & 0xff)) {
+      in++;
+    }
+  }
+  in_time = clock_time() - start;
+
+  printf("%5u sessions: 6to4 %lu/%lu, %lu packets/s; 4to6 %lu/%lu, %lu packets/s\n",
+         sessions, out, IP64_BENCHMARK_PACKETS, rate(out_time),
+         in, IP64_BENCHMARK_PACKETS, rate(in_time));
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(ip64_benchmark_process, ev, data)
+{
+  uip_ip4addr_t netmask;
+
+  PROCESS_BEGIN();
+
+  printf("%u byte payloads\n", IP64_BENCHMARK_PAYLOAD_LEN);
+
+  uip_ipaddr(&hostaddr, 10, 0, 0, 2);
+  uip_ipaddr(&netmask, 255, 255, 255, 0);
+  uip_ipaddr(&server, 192, 0, 2, 1);
+  ip64_set_ipv4_address(&hostaddr, &netmask);
+
+  run(10);
+  run(1000);
+  run(10000);
+
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
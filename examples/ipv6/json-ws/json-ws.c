@@ -262,33 +262,11 @@ struct jsontree_callback json_leds_callback =
 
 #endif /* PLATFORM_HAS_LEDS */
 /*---------------------------------------------------------------------------*/
-static struct httpd_ws_state *json_putchar_context;
-static int
-json_putchar(int c)
-{
-  if(json_putchar_context != NULL &&
-     json_putchar_context->outbuf_pos < HTTPD_OUTBUF_SIZE) {
-    json_putchar_context->outbuf[json_putchar_context->outbuf_pos++] = c;
-    return c;
-  }
-  return 0;
-}
-static int putchar_size = 0;
-static int
-json_putchar_count(int c)
-{
-  putchar_size++;
-  return c;
-}
-/*---------------------------------------------------------------------------*/
 static
 PT_THREAD(send_values(struct httpd_ws_state *s))
 {
-  json_putchar_context = s;
-
   PSOCK_BEGIN(&s->sout);
 
-  s->json.putchar = json_putchar;
   s->outbuf_pos = 0;
 
   if(s->json.values[0] == NULL) {
@@ -313,15 +291,11 @@ PT_THREAD(send_values(struct httpd_ws_state *s))
     s->outbuf_pos = 15;
 
   } else {
-    /* Get value */
-    while(jsontree_print_next(&s->json) && s->json.path <= s->json.depth) {
-      if(s->outbuf_pos >= UIP_TCP_MSS) {
-        SEND_STRING(&s->sout, s->outbuf, UIP_TCP_MSS);
-        s->outbuf_pos -= UIP_TCP_MSS;
-        if(s->outbuf_pos > 0) {
-          memcpy(s->outbuf, &s->outbuf[UIP_TCP_MSS], s->outbuf_pos);
-        }
-      }
+    /* Get value, one segment at a time */
+    while((s->outbuf_pos =
+           jsontree_print_buf(&s->json, jsontree_print_offset(&s->json),
+                              s->outbuf, UIP_TCP_MSS)) == UIP_TCP_MSS) {
+      SEND_STRING(&s->sout, s->outbuf, UIP_TCP_MSS);
     }
   }
 
@@ -392,11 +366,7 @@ calculate_json_size(const char *path, struct jsontree_value *v)
   }
 
   json.path = json.depth;
-  json.putchar = json_putchar_count;
-  putchar_size = 0;
-  while(jsontree_print_next(&json) && json.path <= json.depth);
-
-  return putchar_size;
+  return jsontree_size(&json);
 }
 /*---------------------------------------------------------------------------*/
 httpd_ws_script_t
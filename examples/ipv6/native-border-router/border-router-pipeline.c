@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2016, Thingsquare, http://www.thingsquare.com/.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file
+ *         Queues and threads for the pipelined border router datapath
+ */
+
+#include "border-router-pipeline.h"
+
+#if BORDER_ROUTER_PIPELINE
+
+#include <err.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#define MASK (BORDER_ROUTER_PIPELINE_QUEUE - 1)
+#define POSITION(ptr) CC_ACCESS_NOW(uint16_t, ptr)
+
+#if BORDER_ROUTER_PIPELINE_QUEUE & MASK
+#error BORDER_ROUTER_CONF_PIPELINE_QUEUE must be a power of two
+#endif
+/*---------------------------------------------------------------------------*/
+void
+pipeline_init(struct pipeline_queue *q)
+{
+  q->put_ptr = q->get_ptr = 0;
+  q->waiting = 0;
+  q->dropped = 0;
+  q->fd = eventfd(0, EFD_CLOEXEC);
+  if(q->fd < 0) {
+    err(1, "pipeline_init");
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Wakes up the other side if it sleeps. The full barrier orders the
+   position update before the read of the flag, and pairs with the one
+   in pipeline_wait_put() and pipeline_wait_get(). */
+static void
+wake(struct pipeline_queue *q)
+{
+  static const uint64_t one = 1;
+
+  __sync_synchronize();
+  if(CC_ACCESS_NOW(int, q->waiting)) {
+    if(write(q->fd, &one, sizeof(one)) < 0) {
+      err(1, "pipeline: wake");
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+block(struct pipeline_queue *q)
+{
+  uint64_t n;
+
+  if(read(q->fd, &n, sizeof(n)) < 0) {
+    err(1, "pipeline: block");
+  }
+}
+/*---------------------------------------------------------------------------*/
+struct pipeline_packet *
+pipeline_put_slot(struct pipeline_queue *q)
+{
+  if((uint16_t)(q->put_ptr - POSITION(q->get_ptr)) >= BORDER_ROUTER_PIPELINE_QUEUE) {
+    return NULL;
+  }
+  /* Not written before the consumer is done with it */
+  CC_MEMORY_BARRIER();
+  return &q->packets[q->put_ptr & MASK];
+}
+/*---------------------------------------------------------------------------*/
+void
+pipeline_put(struct pipeline_queue *q)
+{
+  CC_MEMORY_BARRIER();
+  POSITION(q->put_ptr) = q->put_ptr + 1;
+  wake(q);
+}
+/*---------------------------------------------------------------------------*/
+struct pipeline_packet *
+pipeline_get_slot(struct pipeline_queue *q)
+{
+  if(POSITION(q->put_ptr) == q->get_ptr) {
+    return NULL;
+  }
+  CC_MEMORY_BARRIER();
+  return &q->packets[q->get_ptr & MASK];
+}
+/*---------------------------------------------------------------------------*/
+void
+pipeline_get(struct pipeline_queue *q)
+{
+  CC_MEMORY_BARRIER();
+  POSITION(q->get_ptr) = q->get_ptr + 1;
+  wake(q);
+}
+/*---------------------------------------------------------------------------*/
+/* Only one side of a queue can be blocked at a time: the producer when
+   it is full, or the consumer when it is empty. */
+struct pipeline_packet *
+pipeline_wait_put(struct pipeline_queue *q)
+{
+  struct pipeline_packet *p;
+
+  while((p = pipeline_put_slot(q)) == NULL) {
+    CC_ACCESS_NOW(int, q->waiting) = 1;
+    __sync_synchronize();
+    if((p = pipeline_put_slot(q)) == NULL) {
+      block(q);
+    }
+    CC_ACCESS_NOW(int, q->waiting) = 0;
+  }
+  return p;
+}
+/*---------------------------------------------------------------------------*/
+struct pipeline_packet *
+pipeline_wait_get(struct pipeline_queue *q)
+{
+  struct pipeline_packet *p;
+
+  while((p = pipeline_get_slot(q)) == NULL) {
+    CC_ACCESS_NOW(int, q->waiting) = 1;
+    __sync_synchronize();
+    if((p = pipeline_get_slot(q)) == NULL) {
+      block(q);
+    }
+    CC_ACCESS_NOW(int, q->waiting) = 0;
+  }
+  return p;
+}
+/*---------------------------------------------------------------------------*/
+void
+pipeline_start(void *(*thread)(void *), void *arg)
+{
+  pthread_t id;
+  sigset_t all, old;
+
+  /* Signals are for the protocol thread, which cleans up on exit */
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, &old);
+  if(pthread_create(&id, NULL, thread, arg) != 0) {
+    err(1, "pipeline_start");
+  }
+  pthread_detach(id);
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
+/*---------------------------------------------------------------------------*/
+#endif /* BORDER_ROUTER_PIPELINE */
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2016, Thingsquare, http://www.thingsquare.com/.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file
+ *         Queues and threads for the pipelined border router datapath
+ *
+ *         With BORDER_ROUTER_CONF_PIPELINE, SLIP framing and tun I/O
+ *         run in threads of their own. They exchange whole packets
+ *         with the protocol thread, which runs uIP, RPL and 6LoWPAN as
+ *         before, through single-producer single-consumer queues.
+ */
+
+#ifndef BORDER_ROUTER_PIPELINE_H_
+#define BORDER_ROUTER_PIPELINE_H_
+
+#include "contiki.h"
+
+#ifdef BORDER_ROUTER_CONF_PIPELINE
+#define BORDER_ROUTER_PIPELINE BORDER_ROUTER_CONF_PIPELINE
+#else
+#define BORDER_ROUTER_PIPELINE 0
+#endif
+
+/* Number of packets in each queue, a power of two */
+#ifdef BORDER_ROUTER_CONF_PIPELINE_QUEUE
+#define BORDER_ROUTER_PIPELINE_QUEUE BORDER_ROUTER_CONF_PIPELINE_QUEUE
+#else
+#define BORDER_ROUTER_PIPELINE_QUEUE 64
+#endif
+
+/* Large enough for an IPv6 packet from tun and for a SLIP frame */
+#define BORDER_ROUTER_PIPELINE_PACKET_SIZE 2048
+
+struct pipeline_packet {
+  uint16_t len;
+  uint8_t data[BORDER_ROUTER_PIPELINE_PACKET_SIZE];
+};
+
+struct pipeline_queue {
+  struct pipeline_packet packets[BORDER_ROUTER_PIPELINE_QUEUE];
+  uint16_t put_ptr;
+  uint16_t get_ptr;
+  /* Set by a thread that sleeps in pipeline_wait_put() or
+     pipeline_wait_get(), which is woken up through the eventfd */
+  int waiting;
+  int fd;
+  /* Packets dropped because the queue was full */
+  unsigned long dropped;
+};
+
+void pipeline_init(struct pipeline_queue *q);
+
+/* Non-blocking, for the protocol thread. put_slot() and get_slot()
+   return NULL when the queue is full or empty. */
+struct pipeline_packet *pipeline_put_slot(struct pipeline_queue *q);
+void pipeline_put(struct pipeline_queue *q);
+struct pipeline_packet *pipeline_get_slot(struct pipeline_queue *q);
+void pipeline_get(struct pipeline_queue *q);
+
+/* Blocking, for the worker threads */
+struct pipeline_packet *pipeline_wait_put(struct pipeline_queue *q);
+struct pipeline_packet *pipeline_wait_get(struct pipeline_queue *q);
+
+void pipeline_start(void *(*thread)(void *), void *arg);
+
+#endif /* BORDER_ROUTER_PIPELINE_H_ */
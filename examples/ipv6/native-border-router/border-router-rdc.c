@@ -42,6 +42,9 @@
 #include "net/netstack.h"
 #include "packetutils.h"
 #include "border-router.h"
+#include "lib/list.h"
+#include "lib/memb.h"
+#include "sys/ctimer.h"
 #include <string.h>
 
 #define DEBUG 0
@@ -52,58 +55,213 @@
 #define PRINTF(...)
 #endif
 
-#define MAX_CALLBACKS 16
-static int callback_pos;
+/*
+ * Number of frames that may be outstanding at the slip-radio, i.e.
+ * sent over SLIP but not yet reported back with !R. The slip-radio
+ * transmits one frame at a time and its SLIP driver buffers at most
+ * one more, so larger windows only make sense with radios that queue
+ * frames themselves. Must not exceed the 16 session ids slip-radio
+ * keeps track of.
+ */
+#ifdef BORDER_ROUTER_RDC_CONF_WINDOW
+#define WINDOW BORDER_ROUTER_RDC_CONF_WINDOW
+#else
+#define WINDOW 2
+#endif
+
+/* Number of frames waiting for a free slot in the window */
+#ifdef BORDER_ROUTER_RDC_CONF_QUEUE
+#define QUEUE BORDER_ROUTER_RDC_CONF_QUEUE
+#else
+#define QUEUE 4
+#endif
+
+/* Time to wait for the !R report of a frame before giving up on it */
+#ifdef BORDER_ROUTER_RDC_CONF_TIMEOUT
+#define TIMEOUT BORDER_ROUTER_RDC_CONF_TIMEOUT
+#else
+#define TIMEOUT (CLOCK_SECOND * 2)
+#endif
 
-/* a structure for calling back when packet data is coming back
-   from radio... */
-struct tx_callback {
+#if WINDOW < 1 || WINDOW > 16
+#error BORDER_ROUTER_RDC_CONF_WINDOW must be between 1 and 16
+#endif
+
+/* A frame on its way to the radio and the callback for its report */
+struct tx_session {
+  struct tx_session *next;
   mac_callback_t cback;
   void *ptr;
   struct packetbuf_attr attrs[PACKETBUF_NUM_ATTRS];
   struct packetbuf_addr addrs[PACKETBUF_NUM_ADDRS];
+  clock_time_t queued;
+  clock_time_t sent;
+  uint16_t len;
+  uint8_t sid;
+  /* 3 bytes per packet attribute is required for serialization */
+  uint8_t buf[PACKETBUF_NUM_ATTRS * 3 + PACKETBUF_SIZE + 3];
 };
 
-static struct tx_callback callbacks[MAX_CALLBACKS];
+MEMB(sessions_memb, struct tx_session, WINDOW + QUEUE);
+/* Serialized frames not yet written to SLIP, oldest first */
+LIST(queued_list);
+/* Frames written to SLIP and waiting for !R, oldest first */
+LIST(inflight_list);
+
+static uint8_t next_sid;
+static struct ctimer timeout_timer;
+
+/* for statistics */
+static struct {
+  unsigned long sent;
+  unsigned long reported;
+  unsigned long timeouts;
+  unsigned long rejected;
+  unsigned long unknown;
+  clock_time_t queue_time;
+  clock_time_t rtt;
+  clock_time_t rtt_max;
+} stats;
+
+static void check_timeouts(void *ptr);
 /*---------------------------------------------------------------------------*/
-void packet_sent(uint8_t sessionid, uint8_t status, uint8_t tx)
+static struct tx_session *
+find_inflight(uint8_t sid)
 {
-  if(sessionid < MAX_CALLBACKS) {
-    struct tx_callback *callback;
-    callback = &callbacks[sessionid];
-    packetbuf_clear();
-    packetbuf_attr_copyfrom(callback->attrs, callback->addrs);
-    mac_call_sent_callback(callback->cback, callback->ptr, status, tx);
-  } else {
-    PRINTF("*** ERROR: too high session id %d\n", sessionid);
+  struct tx_session *s;
+
+  for(s = list_head(inflight_list); s != NULL; s = list_item_next(s)) {
+    if(s->sid == sid) {
+      return s;
+    }
   }
+  return NULL;
 }
 /*---------------------------------------------------------------------------*/
-static int
-setup_callback(mac_callback_t sent, void *ptr)
+static void
+set_timeout(void)
 {
-  struct tx_callback *callback;
-  int tmp = callback_pos;
-  callback = &callbacks[callback_pos];
-  callback->cback = sent;
-  callback->ptr = ptr;
-  packetbuf_attr_copyto(callback->attrs, callback->addrs);
-
-  callback_pos++;
-  if(callback_pos >= MAX_CALLBACKS) {
-    callback_pos = 0;
+  struct tx_session *s;
+  clock_time_t elapsed;
+
+  s = list_head(inflight_list);
+  if(s == NULL) {
+    ctimer_stop(&timeout_timer);
+    return;
   }
+  elapsed = clock_time() - s->sent;
+  ctimer_set(&timeout_timer, elapsed < TIMEOUT ? TIMEOUT - elapsed : 0,
+             check_timeouts, NULL);
+}
+/*---------------------------------------------------------------------------*/
+/* Move queued frames into the window and write them to SLIP. All
+   frames written here end up in the same serial write. */
+static void
+transmit_queued(void)
+{
+  struct tx_session *s;
+  int started;
 
-  return tmp;
+  started = list_head(inflight_list) == NULL;
+  while(list_length(inflight_list) < WINDOW &&
+        (s = list_pop(queued_list)) != NULL) {
+    /* sequence or session number for this packet */
+    while(find_inflight(next_sid) != NULL) {
+      next_sid++;
+    }
+    s->sid = next_sid++;
+    s->buf[2] = s->sid;
+    s->sent = clock_time();
+    stats.queue_time += s->sent - s->queued;
+    stats.sent++;
+    list_add(inflight_list, s);
+    write_to_slip(s->buf, s->len);
+  }
+  if(started) {
+    set_timeout();
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+session_done(struct tx_session *s, uint8_t status, uint8_t tx)
+{
+  mac_callback_t cback;
+  void *ptr;
+  clock_time_t rtt;
+
+  list_remove(inflight_list, s);
+  rtt = clock_time() - s->sent;
+  stats.rtt += rtt;
+  if(rtt > stats.rtt_max) {
+    stats.rtt_max = rtt;
+  }
+
+  cback = s->cback;
+  ptr = s->ptr;
+  packetbuf_clear();
+  packetbuf_attr_copyfrom(s->attrs, s->addrs);
+  memb_free(&sessions_memb, s);
+
+  /* Refill the window before the callback, which may send more */
+  transmit_queued();
+  set_timeout();
+
+  mac_call_sent_callback(cback, ptr, status, tx);
+}
+/*---------------------------------------------------------------------------*/
+static void
+check_timeouts(void *ptr)
+{
+  struct tx_session *s;
+
+  while((s = list_head(inflight_list)) != NULL &&
+        clock_time() - s->sent >= TIMEOUT) {
+    PRINTF("br-rdc: no report for session %d\n", s->sid);
+    stats.timeouts++;
+    session_done(s, MAC_TX_ERR, 1);
+  }
+  set_timeout();
+}
+/*---------------------------------------------------------------------------*/
+void packet_sent(uint8_t sessionid, uint8_t status, uint8_t tx)
+{
+  struct tx_session *s;
+
+  s = find_inflight(sessionid);
+  if(s == NULL) {
+    /* Timed out already, or not ours */
+    PRINTF("*** ERROR: unknown session id %d\n", sessionid);
+    stats.unknown++;
+    return;
+  }
+  stats.reported++;
+  session_done(s, status, tx);
+}
+/*---------------------------------------------------------------------------*/
+void
+border_router_rdc_print_stat(void)
+{
+  printf("frames sent to radio: %lu, reported: %lu, timed out: %lu\n",
+         stats.sent, stats.reported, stats.timeouts);
+  printf("frames rejected with full window: %lu, unknown reports: %lu\n",
+         stats.rejected, stats.unknown);
+  if(stats.sent > 0) {
+    printf("avg queue time: %lu ms\n",
+           (unsigned long)(stats.queue_time * 1000 / CLOCK_SECOND / stats.sent));
+  }
+  if(stats.reported + stats.timeouts > 0) {
+    printf("avg radio round trip: %lu ms, max: %lu ms\n",
+           (unsigned long)(stats.rtt * 1000 / CLOCK_SECOND /
+                           (stats.reported + stats.timeouts)),
+           (unsigned long)(stats.rtt_max * 1000 / CLOCK_SECOND));
+  }
 }
 /*---------------------------------------------------------------------------*/
 static void
 send_packet(mac_callback_t sent, void *ptr)
 {
+  struct tx_session *s;
   int size;
-  /* 3 bytes per packet attribute is required for serialization */
-  uint8_t buf[PACKETBUF_NUM_ATTRS * 3 + PACKETBUF_SIZE + 3];
-  uint8_t sid;
 
   packetbuf_set_addr(PACKETBUF_ADDR_SENDER, &linkaddr_node_addr);
 
@@ -114,29 +272,45 @@ send_packet(mac_callback_t sent, void *ptr)
     /* Failed to allocate space for headers */
     PRINTF("br-rdc: send failed, too large header\n");
     mac_call_sent_callback(sent, ptr, MAC_TX_ERR_FATAL, 1);
+    return;
+  }
 
-  } else {
-    /* here we send the data over SLIP to the radio-chip */
-    size = 0;
+  s = memb_alloc(&sessions_memb);
+  if(s == NULL) {
+    /* Window and queue are full: let the MAC back off and retry */
+    PRINTF("br-rdc: window full\n");
+    stats.rejected++;
+    mac_call_sent_callback(sent, ptr, MAC_TX_COLLISION, 0);
+    return;
+  }
+
+  /* here we send the data over SLIP to the radio-chip */
+  size = 0;
 #if SERIALIZE_ATTRIBUTES
-    size = packetutils_serialize_atts(&buf[3], sizeof(buf) - 3);
+  size = packetutils_serialize_atts(&s->buf[3], sizeof(s->buf) - 3);
 #endif
-    if(size < 0 || size + packetbuf_totlen() + 3 > sizeof(buf)) {
-      PRINTF("br-rdc: send failed, too large header\n");
-      mac_call_sent_callback(sent, ptr, MAC_TX_ERR_FATAL, 1);
-    } else {
-      sid = setup_callback(sent, ptr);
+  if(size < 0 || size + packetbuf_totlen() + 3 > sizeof(s->buf)) {
+    PRINTF("br-rdc: send failed, too large header\n");
+    memb_free(&sessions_memb, s);
+    mac_call_sent_callback(sent, ptr, MAC_TX_ERR_FATAL, 1);
+    return;
+  }
 
-      buf[0] = '!';
-      buf[1] = 'S';
-      buf[2] = sid; /* sequence or session number for this packet */
+  s->cback = sent;
+  s->ptr = ptr;
+  packetbuf_attr_copyto(s->attrs, s->addrs);
 
-      /* Copy packet data */
-      memcpy(&buf[3 + size], packetbuf_hdrptr(), packetbuf_totlen());
+  s->buf[0] = '!';
+  s->buf[1] = 'S';
+  /* buf[2] is set to the session id when the frame enters the window */
 
-      write_to_slip(buf, packetbuf_totlen() + size + 3);
-    }
-  }
+  /* Copy packet data */
+  memcpy(&s->buf[3 + size], packetbuf_hdrptr(), packetbuf_totlen());
+  s->len = packetbuf_totlen() + size + 3;
+  s->queued = clock_time();
+
+  list_add(queued_list, s);
+  transmit_queued();
 }
 /*---------------------------------------------------------------------------*/
 static void
@@ -179,7 +353,10 @@ channel_check_interval(void)
 static void
 init(void)
 {
-  callback_pos = 0;
+  memb_init(&sessions_memb);
+  list_init(queued_list);
+  list_init(inflight_list);
+  next_sid = 0;
 }
 /*---------------------------------------------------------------------------*/
 const struct rdc_driver border_router_rdc_driver = {
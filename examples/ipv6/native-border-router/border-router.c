@@ -260,6 +260,7 @@ border_router_print_stat()
 {
   printf("bytes received over SLIP: %ld\n", slip_received);
   printf("bytes sent over SLIP: %ld\n", slip_sent);
+  border_router_rdc_print_stat();
 }
 
 /*---------------------------------------------------------------------------*/
@@ -42,7 +42,18 @@
 #undef UIP_CONF_RECEIVE_WINDOW
 #define UIP_CONF_RECEIVE_WINDOW  60
 
-#define SLIP_DEV_CONF_SEND_DELAY (CLOCK_SECOND / 32)
+/* The RDC window bounds the number of frames buffered in the
+   slip-radio, so frames can be written back-to-back. */
+#define SLIP_DEV_CONF_SEND_DELAY 0
+#ifndef BORDER_ROUTER_RDC_CONF_WINDOW
+#define BORDER_ROUTER_RDC_CONF_WINDOW 2
+#endif
+
+/* Experimental: run SLIP framing and tun I/O in threads of their own,
+   next to the protocol thread. Linux only. */
+#ifndef BORDER_ROUTER_CONF_PIPELINE
+#define BORDER_ROUTER_CONF_PIPELINE 0
+#endif
 
 #undef WEBSERVER_CONF_CFS_CONNS
 #define WEBSERVER_CONF_CFS_CONNS 2
@@ -50,11 +50,13 @@
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <err.h>
+#include <poll.h>
 
 #include "net/netstack.h"
 #include "net/packetbuf.h"
 #include "cmd.h"
 #include "border-router-cmds.h"
+#include "border-router-pipeline.h"
 
 extern int slip_config_verbose;
 extern int slip_config_flowcontrol;
@@ -72,7 +74,9 @@ extern speed_t slip_config_b_rate;
 
 int devopen(const char *dev, int flags);
 
+#if !BORDER_ROUTER_PIPELINE
 static FILE *inslip;
+#endif /* !BORDER_ROUTER_PIPELINE */
 
 /* for statistics */
 long slip_sent = 0;
@@ -88,6 +92,22 @@ int slipfd = 0;
 #define SLIP_ESC_END 0334
 #define SLIP_ESC_ESC 0335
 
+#if BORDER_ROUTER_PIPELINE
+/* Frames decoded by the reader thread, and frames for the writer thread
+   to encode and write */
+static struct pipeline_queue slip_in;
+static struct pipeline_queue slip_out;
+
+PROCESS(slip_pipeline_process, "SLIP pipeline");
+
+/* The reader thread does not echo bytes as they arrive, so printable
+   strings are echoed whole at any verbosity */
+#define ECHO_STRINGS (slip_config_verbose >= 1)
+#else /* BORDER_ROUTER_PIPELINE */
+/* strings already echoed as they arrive for verbose>1 */
+#define ECHO_STRINGS (slip_config_verbose == 1)
+#endif /* BORDER_ROUTER_PIPELINE */
+
 /*---------------------------------------------------------------------------*/
 static void *
 get_in_addr(struct sockaddr *sa)
@@ -169,6 +189,46 @@ slip_packet_input(unsigned char *data, int len)
   NETSTACK_RDC.input();
 }
 /*---------------------------------------------------------------------------*/
+/* Handles a frame from the slip-radio: a command, debug output or an
+   802.15.4 packet */
+static void
+slip_frame_input(unsigned char *inbuf, int inbufptr)
+{
+  int i;
+
+  if(inbuf[0] == '!') {
+    command_context = CMD_CONTEXT_RADIO;
+    cmd_input(inbuf, inbufptr);
+  } else if(inbuf[0] == '?') {
+#define DEBUG_LINE_MARKER '\r'
+  } else if(inbuf[0] == DEBUG_LINE_MARKER) {
+    fwrite(inbuf + 1, inbufptr - 1, 1, stdout);
+  } else if(is_sensible_string(inbuf, inbufptr)) {
+    if(ECHO_STRINGS) {
+      fwrite(inbuf, inbufptr, 1, stdout);
+    }
+  } else {
+    if(slip_config_verbose > 2) {
+      printf("Packet from SLIP of length %d - write TUN\n", inbufptr);
+      if(slip_config_verbose > 4) {
+#if WIRESHARK_IMPORT_FORMAT
+        printf("0000");
+        for(i = 0; i < inbufptr; i++) printf(" %02x", inbuf[i]);
+#else
+        printf("         ");
+        for(i = 0; i < inbufptr; i++) {
+          printf("%02x", inbuf[i]);
+          if((i & 3) == 3) printf(" ");
+          if((i & 15) == 15) printf("\n         ");
+        }
+#endif
+        printf("\n");
+      }
+    }
+    slip_packet_input(inbuf, inbufptr);
+  }
+}
+/*---------------------------------------------------------------------------*/
 /*
  * Read from serial, when we have a packet call slip_packet_input. No output
  * buffering, input buffered by stdio.
@@ -178,7 +238,7 @@ serial_input(FILE *inslip)
 {
   static unsigned char inbuf[2048];
   static int inbufptr = 0;
-  int ret,i;
+  int ret;
   unsigned char c;
 
 #ifdef linux
@@ -207,37 +267,7 @@ serial_input(FILE *inslip)
   switch(c) {
   case SLIP_END:
     if(inbufptr > 0) {
-      if(inbuf[0] == '!') {
-	command_context = CMD_CONTEXT_RADIO;
-	cmd_input(inbuf, inbufptr);
-      } else if(inbuf[0] == '?') {
-#define DEBUG_LINE_MARKER '\r'
-      } else if(inbuf[0] == DEBUG_LINE_MARKER) {
-	fwrite(inbuf + 1, inbufptr - 1, 1, stdout);
-      } else if(is_sensible_string(inbuf, inbufptr)) {
-        if(slip_config_verbose == 1) {   /* strings already echoed below for verbose>1 */
-          fwrite(inbuf, inbufptr, 1, stdout);
-        }
-      } else {
-        if(slip_config_verbose > 2) {
-          printf("Packet from SLIP of length %d - write TUN\n", inbufptr);
-          if(slip_config_verbose > 4) {
-#if WIRESHARK_IMPORT_FORMAT
-            printf("0000");
-	    for(i = 0; i < inbufptr; i++) printf(" %02x", inbuf[i]);
-#else
-            printf("         ");
-            for(i = 0; i < inbufptr; i++) {
-              printf("%02x", inbuf[i]);
-              if((i & 3) == 3) printf(" ");
-              if((i & 15) == 15) printf("\n         ");
-            }
-#endif
-            printf("\n");
-          }
-        }
-	slip_packet_input(inbuf, inbufptr);
-      }
+      slip_frame_input(inbuf, inbufptr);
       inbufptr = 0;
     }
     break;
@@ -280,13 +310,25 @@ serial_input(FILE *inslip)
   goto read_more;
 }
 
-unsigned char slip_buf[2048];
+#ifdef SLIP_DEV_CONF_BUFFER_SIZE
+#define SLIP_BUFFER_SIZE SLIP_DEV_CONF_BUFFER_SIZE
+#else
+#define SLIP_BUFFER_SIZE 2048
+#endif
+
+unsigned char slip_buf[SLIP_BUFFER_SIZE];
 int slip_end, slip_begin, slip_packet_end, slip_packet_count;
-static struct timer send_delay_timer;
+/* A ctimer, so that the main loop wakes up when the delay expires */
+static struct ctimer send_delay_timer;
 /* delay between slip packets */
 static clock_time_t send_delay = SEND_DELAY;
 /*---------------------------------------------------------------------------*/
 static void
+send_delay_expired(void *ptr)
+{
+}
+/*---------------------------------------------------------------------------*/
+static void
 slip_send(int fd, unsigned char c)
 {
   if(slip_end >= sizeof(slip_buf)) {
@@ -319,7 +361,10 @@ slip_flushbuf(int fd)
     return;
   }
 
-  n = write(fd, slip_buf + slip_begin, slip_packet_end - slip_begin);
+  /* Without a delay between packets, everything queued goes out in
+     one write. Only complete packets are ever queued. */
+  n = write(fd, slip_buf + slip_begin,
+            (send_delay > 0 ? slip_packet_end : slip_end) - slip_begin);
 
   if(n == -1 && errno != EAGAIN) {
     err(1, "slip_flushbuf write failed");
@@ -327,27 +372,29 @@ slip_flushbuf(int fd)
     PROGRESS("Q");		/* Outqueue is full! */
   } else {
     slip_begin += n;
-    if(slip_begin == slip_packet_end) {
-      slip_packet_count--;
-      if(slip_end > slip_packet_end) {
-        memcpy(slip_buf, slip_buf + slip_packet_end,
-               slip_end - slip_packet_end);
+    if(slip_begin == slip_end) {
+      slip_begin = slip_end = slip_packet_end = slip_packet_count = 0;
+    } else if(slip_begin >= slip_packet_end) {
+      /* At least the first packet is done; drop what has been written */
+      for(n = 0; n < slip_begin; n++) {
+        if(slip_buf[n] == SLIP_END) {
+          slip_packet_count--;
+        }
       }
-      slip_end -= slip_packet_end;
+      memmove(slip_buf, slip_buf + slip_begin, slip_end - slip_begin);
+      slip_end -= slip_begin;
       slip_begin = slip_packet_end = 0;
-      if(slip_end > 0) {
-        /* Find end of next slip packet */
-        for(n = 1; n < slip_end; n++) {
-          if(slip_buf[n] == SLIP_END) {
-            slip_packet_end = n + 1;
-            break;
-          }
-        }
-        /* a delay between slip packets to avoid losing data */
-        if(send_delay > 0) {
-          timer_set(&send_delay_timer, send_delay);
+      /* Find end of next slip packet */
+      for(n = 0; n < slip_end; n++) {
+        if(slip_buf[n] == SLIP_END) {
+          slip_packet_end = n + 1;
+          break;
         }
       }
+      /* a delay between slip packets to avoid losing data */
+      if(send_delay > 0) {
+        ctimer_set(&send_delay_timer, send_delay, send_delay_expired, NULL);
+      }
     }
   }
 }
@@ -380,6 +427,24 @@ write_to_serial(int outfd, const uint8_t *inbuf, int len)
     }
   }
 
+#if BORDER_ROUTER_PIPELINE
+  {
+    struct pipeline_packet *out;
+
+    /* Encoded and written by the writer thread. The window of the RDC
+       keeps the queue short, so a full queue means a stuck radio. */
+    out = pipeline_put_slot(&slip_out);
+    if(out == NULL || len > sizeof(out->data)) {
+      slip_out.dropped++;
+      return;
+    }
+    memcpy(out->data, inbuf, len);
+    out->len = len;
+    pipeline_put(&slip_out);
+    return;
+  }
+#endif /* BORDER_ROUTER_PIPELINE */
+
   /* It would be ``nice'' to send a SLIP_END here but it's not
    * really necessary.
    */
@@ -459,11 +524,12 @@ stty_telos(int fd)
   if(tcflush(fd, TCIOFLUSH) == -1) err(1, "tcflush");
 }
 /*---------------------------------------------------------------------------*/
+#if !BORDER_ROUTER_PIPELINE
 static int
 set_fd(fd_set *rset, fd_set *wset)
 {
   /* Anything to flush? */
-  if(!slip_empty() && (send_delay == 0 || timer_expired(&send_delay_timer))) {
+  if(!slip_empty() && (send_delay == 0 || ctimer_expired(&send_delay_timer))) {
     FD_SET(slipfd, wset);
   }
 
@@ -484,6 +550,159 @@ handle_fd(fd_set *rset, fd_set *wset)
 }
 /*---------------------------------------------------------------------------*/
 static const struct select_callback slip_callback = { set_fd, handle_fd };
+#else /* !BORDER_ROUTER_PIPELINE */
+/*---------------------------------------------------------------------------*/
+/* Waits until the nonblocking SLIP fd is ready */
+static void
+slip_poll(short events)
+{
+  struct pollfd pfd;
+
+  pfd.fd = slipfd;
+  pfd.events = events;
+  if(poll(&pfd, 1, -1) < 0 && errno != EINTR) {
+    err(1, "slip_poll");
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void *
+slip_reader(void *arg)
+{
+  static unsigned char buf[2048];
+  struct pipeline_packet *p;
+  int len, esc, n, i;
+  unsigned char c;
+
+  p = NULL;
+  len = esc = 0;
+  while(1) {
+    n = read(slipfd, buf, sizeof(buf));
+    if(n < 0 && (errno == EAGAIN || errno == EINTR)) {
+      slip_poll(POLLIN);
+      continue;
+    } else if(n <= 0) {
+      err(1, "serial_input: read");
+    }
+    slip_received += n;
+
+    for(i = 0; i < n; i++) {
+      c = buf[i];
+      if(c == SLIP_END) {
+        if(p != NULL && len > 0 && len <= sizeof(p->data)) {
+          p->len = len;
+          pipeline_put(&slip_in);
+          process_poll(&slip_pipeline_process);
+          p = NULL;
+        } else if(len > 0) {
+          fprintf(stderr, "*** dropping large %d byte packet\n", len);
+        }
+        len = esc = 0;
+      } else if(c == SLIP_ESC) {
+        esc = 1;
+      } else {
+        if(esc) {
+          c = c == SLIP_ESC_END ? SLIP_END : c == SLIP_ESC_ESC ? SLIP_ESC : c;
+          esc = 0;
+        }
+        if(p == NULL) {
+          /* Waits while the protocol thread catches up */
+          p = pipeline_wait_put(&slip_in);
+        }
+        if(len < sizeof(p->data)) {
+          p->data[len] = c;
+        }
+        len++;
+      }
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static void
+slip_write(const unsigned char *buf, int len)
+{
+  int n;
+
+  while(len > 0) {
+    n = write(slipfd, buf, len);
+    if(n < 0 && (errno == EAGAIN || errno == EINTR)) {
+      slip_poll(POLLOUT);
+    } else if(n < 0) {
+      err(1, "slip_flushbuf write failed");
+    } else {
+      buf += n;
+      len -= n;
+      slip_sent += n;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Encodes queued frames and writes them out, all that are queued in one
+   write unless there is a delay between packets */
+static void *
+slip_writer(void *arg)
+{
+  static unsigned char buf[2 * BORDER_ROUTER_PIPELINE_PACKET_SIZE + 1];
+  struct pipeline_packet *p;
+  int len, i;
+
+  buf[0] = SLIP_END;
+  slip_write(buf, 1);
+
+  while(1) {
+    p = pipeline_wait_get(&slip_out);
+    len = 0;
+    do {
+      for(i = 0; i < p->len; i++) {
+        if(p->data[i] == SLIP_END) {
+          buf[len++] = SLIP_ESC;
+          buf[len++] = SLIP_ESC_END;
+        } else if(p->data[i] == SLIP_ESC) {
+          buf[len++] = SLIP_ESC;
+          buf[len++] = SLIP_ESC_ESC;
+        } else {
+          buf[len++] = p->data[i];
+        }
+      }
+      buf[len++] = SLIP_END;
+      pipeline_get(&slip_out);
+    } while(send_delay == 0 &&
+            (p = pipeline_get_slot(&slip_out)) != NULL &&
+            len + 2 * p->len + 1 <= sizeof(buf));
+
+    slip_write(buf, len);
+    if(send_delay > 0) {
+      usleep(send_delay * 1000000UL / CLOCK_SECOND);
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+/* Hands the frames from the reader thread to the protocol, a queue at a
+   time so that other processes get to run in between */
+PROCESS_THREAD(slip_pipeline_process, ev, data)
+{
+  struct pipeline_packet *p;
+  int n;
+
+  PROCESS_BEGIN();
+
+  while(1) {
+    PROCESS_YIELD_UNTIL(ev == PROCESS_EVENT_POLL);
+
+    for(n = 0; n < BORDER_ROUTER_PIPELINE_QUEUE &&
+          (p = pipeline_get_slot(&slip_in)) != NULL; n++) {
+      slip_frame_input(p->data, p->len);
+      pipeline_get(&slip_in);
+    }
+    if(n == BORDER_ROUTER_PIPELINE_QUEUE) {
+      process_poll(&slip_pipeline_process);
+    }
+  }
+
+  PROCESS_END();
+}
+#endif /* !BORDER_ROUTER_PIPELINE */
 /*---------------------------------------------------------------------------*/
 void
 slip_init(void)
@@ -526,7 +745,9 @@ slip_init(void)
     }
   }
 
+#if !BORDER_ROUTER_PIPELINE
   select_set_callback(slipfd, &slip_callback);
+#endif /* !BORDER_ROUTER_PIPELINE */
 
   if(slip_config_host != NULL) {
     fprintf(stderr, "********SLIP opened to ``%s:%s''\n", slip_config_host,
@@ -536,11 +757,18 @@ slip_init(void)
     stty_telos(slipfd);
   }
 
-  timer_set(&send_delay_timer, 0);
+#if BORDER_ROUTER_PIPELINE
+  pipeline_init(&slip_in);
+  pipeline_init(&slip_out);
+  process_start(&slip_pipeline_process, NULL);
+  pipeline_start(slip_reader, NULL);
+  pipeline_start(slip_writer, NULL);
+#else /* BORDER_ROUTER_PIPELINE */
   slip_send(slipfd, SLIP_END);
   inslip = fdopen(slipfd, "r");
   if(inslip == NULL) {
     err(1, "main: fdopen");
   }
+#endif /* BORDER_ROUTER_PIPELINE */
 }
 /*---------------------------------------------------------------------------*/
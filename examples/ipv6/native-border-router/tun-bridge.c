@@ -64,6 +64,7 @@
 #include "net/packetbuf.h"
 #include "cmd.h"
 #include "border-router.h"
+#include "border-router-pipeline.h"
 
 extern const char *slip_config_ipaddr;
 extern char slip_config_tundev[32];
@@ -72,12 +73,14 @@ extern uint16_t slip_config_basedelay;
 #ifndef __CYGWIN__
 static int tunfd;
 
+#if !BORDER_ROUTER_PIPELINE
 static int set_fd(fd_set *rset, fd_set *wset);
 static void handle_fd(fd_set *rset, fd_set *wset);
 static const struct select_callback tun_select_callback = {
   set_fd,
   handle_fd
 };
+#endif /* !BORDER_ROUTER_PIPELINE */
 #endif /* __CYGWIN__ */
 
 int ssystem(const char *fmt, ...)
@@ -195,9 +198,21 @@ tun_init()
 
 #else
 
-static uint16_t delaymsec=0;
-static uint32_t delaystartsec,delaystartmsec;
+/* Optional delay between outgoing packets. Running it on a ctimer
+   wakes up the main loop when it expires. */
+static struct ctimer delay_timer;
 
+#if BORDER_ROUTER_PIPELINE
+/* Packets read from tun by the reader thread, and packets for the
+   writer thread to write to tun */
+static struct pipeline_queue tun_in;
+static struct pipeline_queue tun_out;
+
+PROCESS(tun_pipeline_process, "tun pipeline");
+
+static void *tun_reader(void *arg);
+static void *tun_writer(void *arg);
+#endif /* BORDER_ROUTER_PIPELINE */
 /*---------------------------------------------------------------------------*/
 void
 tun_init()
@@ -209,7 +224,15 @@ tun_init()
   tunfd = tun_alloc(slip_config_tundev);
   if(tunfd == -1) err(1, "main: open");
 
+#if BORDER_ROUTER_PIPELINE
+  pipeline_init(&tun_in);
+  pipeline_init(&tun_out);
+  process_start(&tun_pipeline_process, NULL);
+  pipeline_start(tun_reader, NULL);
+  pipeline_start(tun_writer, NULL);
+#else /* BORDER_ROUTER_PIPELINE */
   select_set_callback(tunfd, &tun_select_callback);
+#endif /* BORDER_ROUTER_PIPELINE */
 
   fprintf(stderr, "opened %s device ``/dev/%s''\n",
           "tun", slip_config_tundev);
@@ -251,9 +274,26 @@ init(void)
 static int
 output(void)
 {
+#if BORDER_ROUTER_PIPELINE
+  struct pipeline_packet *p;
+#endif /* BORDER_ROUTER_PIPELINE */
+
   PRINTF("SUT: %u\n", uip_len);
   if(uip_len > 0) {
+#if BORDER_ROUTER_PIPELINE
+    /* Dropped like on a full interface queue if the writer lags */
+    p = pipeline_put_slot(&tun_out);
+    if(p == NULL) {
+      tun_out.dropped++;
+      return 0;
+    }
+    memcpy(p->data, &uip_buf[UIP_LLH_LEN], uip_len);
+    p->len = uip_len;
+    pipeline_put(&tun_out);
+    return 0;
+#else /* BORDER_ROUTER_PIPELINE */
     return tun_output(&uip_buf[UIP_LLH_LEN], uip_len);
+#endif /* BORDER_ROUTER_PIPELINE */
   }
   return 0;
 }
@@ -266,10 +306,22 @@ const struct uip_fallback_interface rpl_interface = {
 /*---------------------------------------------------------------------------*/
 /* tun and slip select callback                                              */
 /*---------------------------------------------------------------------------*/
+static void
+delay_expired(void *ptr)
+{
+#if BORDER_ROUTER_PIPELINE
+  process_poll(&tun_pipeline_process);
+#endif /* BORDER_ROUTER_PIPELINE */
+}
+/*---------------------------------------------------------------------------*/
+#if !BORDER_ROUTER_PIPELINE
 static int
 set_fd(fd_set *rset, fd_set *wset)
 {
-  FD_SET(tunfd, rset);
+  /* Base delay times number of 6lowpan fragments to be sent */
+  if(ctimer_expired(&delay_timer)) {
+    FD_SET(tunfd, rset);
+  }
   return 1;
 }
 
@@ -278,37 +330,89 @@ set_fd(fd_set *rset, fd_set *wset)
 static void
 handle_fd(fd_set *rset, fd_set *wset)
 {
-  /* Optional delay between outgoing packets */
-  /* Base delay times number of 6lowpan fragments to be sent */
-  /* delaymsec = 10; */
-  if(delaymsec) {
-    struct timeval tv;
-    int dmsec;
-    gettimeofday(&tv, NULL);
-    dmsec=(tv.tv_sec-delaystartsec)*1000+tv.tv_usec/1000-delaystartmsec;
-    if(dmsec<0) delaymsec=0;
-    if(dmsec>delaymsec) delaymsec=0;
+  int size;
+
+  if(FD_ISSET(tunfd, rset)) {
+    size = tun_input(&uip_buf[UIP_LLH_LEN], sizeof(uip_buf));
+    /* printf("TUN data incoming read:%d\n", size); */
+    uip_len = size;
+    tcpip_input();
+
+    if(slip_config_basedelay) {
+      ctimer_set(&delay_timer, slip_config_basedelay * CLOCK_SECOND / 1000,
+                 delay_expired, NULL);
+    }
   }
+}
+#else /* !BORDER_ROUTER_PIPELINE */
+/*---------------------------------------------------------------------------*/
+static void *
+tun_reader(void *arg)
+{
+  struct pipeline_packet *p;
+  int size;
 
-  if(delaymsec==0) {
-    int size;
+  while(1) {
+    p = pipeline_wait_put(&tun_in);
+    size = tun_input(p->data, sizeof(p->data));
+    if(size > 0) {
+      p->len = size;
+      pipeline_put(&tun_in);
+      process_poll(&tun_pipeline_process);
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static void *
+tun_writer(void *arg)
+{
+  struct pipeline_packet *p;
 
-    if(FD_ISSET(tunfd, rset)) {
-      size = tun_input(&uip_buf[UIP_LLH_LEN], sizeof(uip_buf));
-      /* printf("TUN data incoming read:%d\n", size); */
-      uip_len = size;
-      tcpip_input();
+  while(1) {
+    p = pipeline_wait_get(&tun_out);
+    tun_output(p->data, p->len);
+    pipeline_get(&tun_out);
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+/* Hands the packets from the reader thread to uIP, a queue at a time
+   so that other processes get to run in between */
+PROCESS_THREAD(tun_pipeline_process, ev, data)
+{
+  struct pipeline_packet *p;
+  int n;
+
+  PROCESS_BEGIN();
+
+  while(1) {
+    PROCESS_YIELD_UNTIL(ev == PROCESS_EVENT_POLL);
+
+    for(n = 0; n < BORDER_ROUTER_PIPELINE_QUEUE &&
+          ctimer_expired(&delay_timer) &&
+          (p = pipeline_get_slot(&tun_in)) != NULL; n++) {
+      /* Packets larger than uIP can take are dropped */
+      uip_len = p->len <= sizeof(uip_buf) - UIP_LLH_LEN ? p->len : 0;
+      memcpy(&uip_buf[UIP_LLH_LEN], p->data, uip_len);
+      pipeline_get(&tun_in);
+      if(uip_len > 0) {
+        tcpip_input();
+      }
 
       if(slip_config_basedelay) {
-        struct timeval tv;
-      	gettimeofday(&tv, NULL) ;
-      	delaymsec=slip_config_basedelay;
-      	delaystartsec =tv.tv_sec;
-      	delaystartmsec=tv.tv_usec/1000;
+        ctimer_set(&delay_timer, slip_config_basedelay * CLOCK_SECOND / 1000,
+                   delay_expired, NULL);
       }
     }
+    if(n == BORDER_ROUTER_PIPELINE_QUEUE) {
+      process_poll(&tun_pipeline_process);
+    }
   }
+
+  PROCESS_END();
 }
+#endif /* !BORDER_ROUTER_PIPELINE */
 #endif /*  __CYGWIN_ */
 
 /*---------------------------------------------------------------------------*/
@@ -0,0 +1,225 @@
+/*
+ * Copyright (c) 2016, Inria.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Measures how fast a non-storing root turns packets into source
+ *         routed packets. A synthetic DODAG is loaded in the root's link
+ *         table and packets to random destinations are run through
+ *         rpl_update_header() and rpl_srh_get_next_hop(), as tcpip_ipv6_output()
+ *         would. Build with SRH_CACHE_SIZE=0 to compare against the uncached
+ *         path; the printed digest must be the same for both builds.
+ */
+
+#include "contiki.h"
+#include "contiki-net.h"
+#include "net/rpl/rpl.h"
+#include "net/rpl/rpl-ns.h"
+#include "lib/random.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define UIP_IP_BUF ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+
+#ifndef SRH_BENCHMARK_NODES
+#define SRH_BENCHMARK_NODES 300
+#endif
+#ifndef SRH_BENCHMARK_MAX_DEPTH
+#define SRH_BENCHMARK_MAX_DEPTH 8
+#endif
+#ifndef SRH_BENCHMARK_PACKETS
+#define SRH_BENCHMARK_PACKETS 200000UL
+#endif
+/* Number of destinations in the "hot" traffic pattern */
+#define HOT_DESTINATIONS 8
+/* Packets between two parent switches in the churn pattern */
+#define CHURN_INTERVAL 1000
+
+#define PAYLOAD_LEN 32
+
+static uip_ipaddr_t prefix;
+static rpl_dag_t *dag;
+static uint16_t parent_of[SRH_BENCHMARK_NODES + 1];
+static uint8_t depth_of[SRH_BENCHMARK_NODES + 1];
+
+PROCESS(srh_benchmark_process, "SRH benchmark");
+AUTOSTART_PROCESSES(&srh_benchmark_process);
+/*---------------------------------------------------------------------------*/
+/* Node 0 is the root */
+static void
+node_addr(uip_ipaddr_t *addr, uint16_t id)
+{
+  uip_ipaddr_copy(addr, &prefix);
+  addr->u8[8] = 0x02;
+  addr->u8[9] = 0x12;
+  addr->u8[10] = 0x74;
+  addr->u8[11] = id >> 8;
+  addr->u8[13] = id >> 8;
+  addr->u8[14] = id >> 8;
+  addr->u8[15] = id & 0xff;
+}
+/*---------------------------------------------------------------------------*/
+static void
+set_parent(uint16_t id, uint16_t parent)
+{
+  uip_ipaddr_t child_addr;
+  uip_ipaddr_t parent_addr;
+
+  node_addr(&child_addr, id);
+  node_addr(&parent_addr, parent);
+  parent_of[id] = parent;
+  depth_of[id] = depth_of[parent] + 1;
+  rpl_ns_update_node(dag, &child_addr, &parent_addr, 0xffffffff);
+}
+/*---------------------------------------------------------------------------*/
+static uint16_t
+random_parent(uint16_t id)
+{
+  uint16_t parent;
+  do {
+    parent = random_rand() % id;
+  } while(depth_of[parent] >= SRH_BENCHMARK_MAX_DEPTH);
+  return parent;
+}
+/*---------------------------------------------------------------------------*/
+static void
+build_topology(void)
+{
+  uint16_t id;
+
+  depth_of[0] = 0;
+  for(id = 1; id <= SRH_BENCHMARK_NODES; id++) {
+    set_parent(id, random_parent(id));
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Move a node whose subtree is empty, so depths stay bounded */
+static void
+churn(void)
+{
+  uint16_t id;
+  uint16_t i;
+
+  id = 1 + random_rand() % SRH_BENCHMARK_NODES;
+  for(i = 1; i <= SRH_BENCHMARK_NODES; i++) {
+    if(parent_of[i] == id) {
+      return;
+    }
+  }
+  set_parent(id, random_parent(id));
+}
+/*---------------------------------------------------------------------------*/
+static void
+make_packet(uint16_t dest)
+{
+  memset(uip_buf, 0, UIP_LLH_LEN + UIP_IPUDPH_LEN + PAYLOAD_LEN);
+  UIP_IP_BUF->vtc = 0x60;
+  UIP_IP_BUF->len[1] = UIP_UDPH_LEN + PAYLOAD_LEN;
+  UIP_IP_BUF->proto = UIP_PROTO_UDP;
+  UIP_IP_BUF->ttl = 64;
+  node_addr(&UIP_IP_BUF->srcipaddr, 0);
+  node_addr(&UIP_IP_BUF->destipaddr, dest);
+  uip_len = UIP_IPUDPH_LEN + PAYLOAD_LEN;
+  uip_ext_len = 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+run(const char *name, uint16_t destinations, int with_churn)
+{
+  unsigned long i;
+  unsigned long sent;
+  unsigned long digest;
+  uint16_t dest;
+  uip_ipaddr_t nexthop;
+  clock_time_t start;
+  clock_time_t elapsed;
+  int j;
+
+  random_init(1);
+  build_topology();
+
+  sent = 0;
+  digest = 0;
+  start = clock_time();
+  for(i = 0; i < SRH_BENCHMARK_PACKETS; i++) {
+    if(with_churn && i % CHURN_INTERVAL == CHURN_INTERVAL - 1) {
+      churn();
+    }
+    dest = 1 + random_rand() % destinations;
+    make_packet(dest);
+    if(rpl_update_header() && rpl_srh_get_next_hop(&nexthop)) {
+      sent++;
+      for(j = 0; j < uip_len; j++) {
+        digest = digest * 31 + uip_buf[UIP_LLH_LEN + j];
+      }
+    }
+  }
+  elapsed = clock_time() - start;
+  if(elapsed == 0) {
+    elapsed = 1;
+  }
+
+  printf("%-8s %lu packets, %lu routed, %lu ms, %lu packets/s, digest %08lx\n",
+         name, SRH_BENCHMARK_PACKETS, sent, (unsigned long)elapsed,
+         (SRH_BENCHMARK_PACKETS * CLOCK_SECOND) / elapsed, digest & 0xffffffffUL);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(srh_benchmark_process, ev, data)
+{
+  uip_ipaddr_t root_addr;
+
+  PROCESS_BEGIN();
+
+  uip_ip6addr(&prefix, 0xfd00, 0, 0, 0, 0, 0, 0, 0);
+  node_addr(&root_addr, 0);
+  uip_ds6_addr_add(&root_addr, 0, ADDR_MANUAL);
+  dag = rpl_set_root(RPL_DEFAULT_INSTANCE, &root_addr);
+  if(dag == NULL) {
+    printf("Failed to create a DAG\n");
+    PROCESS_EXIT();
+  }
+  rpl_set_prefix(dag, &prefix, 64);
+
+  printf("%u nodes, max depth %u, SRH cache size %u\n",
+         SRH_BENCHMARK_NODES, SRH_BENCHMARK_MAX_DEPTH, RPL_NS_SRH_CACHE_SIZE);
+
+  run("uniform", SRH_BENCHMARK_NODES, 0);
+  run("hot", HOT_DESTINATIONS, 0);
+  run("churn", HOT_DESTINATIONS, 1);
+
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
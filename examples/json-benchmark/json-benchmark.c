@@ -0,0 +1,402 @@
+/*
+ * Copyright (c) 2016, Thingsquare, http://www.thingsquare.com/.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file
+ *         Compares jsonparse, which needs the whole document in one
+ *         buffer, with jsonstream, which is fed the document in
+ *         fragments the size of TCP segments. Both parsers must see
+ *         the same tokens and values, which is checked with a hash.
+ *         The RAM each parser needs is its state plus the buffer it
+ *         parses from.
+ *
+ *         Then compares jsontree output through putchar with output
+ *         into buffers of the size of CoAP blocks and TCP segments,
+ *         which must give the same bytes, and fetching each block with
+ *         a new context with continuing from the last one.
+ */
+
+#include "contiki.h"
+#include "jsonparse.h"
+#include "jsonstream.h"
+#include "jsontree.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef JSON_BENCHMARK_DOCUMENT_SIZE
+#define JSON_BENCHMARK_DOCUMENT_SIZE 65536
+#endif
+#ifndef JSON_BENCHMARK_ROUNDS
+#define JSON_BENCHMARK_ROUNDS 1000
+#endif
+
+/* Largest value in the document, for the jsonparse_copy_value() buffer */
+#define MAX_VALUE_LEN 64
+
+/* Devices in the tree that is serialized */
+#define TREE_DEVICES 250
+
+static char document[JSON_BENCHMARK_DOCUMENT_SIZE + 1];
+static int document_len;
+static char value[MAX_VALUE_LEN + 1];
+
+static uint32_t hash;
+static unsigned long tokens;
+
+static char output[JSON_BENCHMARK_DOCUMENT_SIZE];
+static uint32_t output_len;
+static char block[1024];
+
+PROCESS(json_benchmark_process, "JSON benchmark");
+AUTOSTART_PROCESSES(&json_benchmark_process);
+/*---------------------------------------------------------------------------*/
+static void
+hash_bytes(const char *data, int len)
+{
+  int i;
+
+  for(i = 0; i < len; i++) {
+    hash = (hash ^ (uint8_t)data[i]) * 16777619UL;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+hash_type(int type)
+{
+  char c = type;
+
+  hash_bytes(&c, 1);
+  tokens++;
+}
+/*---------------------------------------------------------------------------*/
+static void
+append(const char *str)
+{
+  int len = strlen(str);
+
+  memcpy(&document[document_len], str, len);
+  document_len += len;
+}
+/*---------------------------------------------------------------------------*/
+/* A configuration document with devices, as a gateway might download it */
+static void
+make_document(void)
+{
+  static const char *tail = "\n]}";
+  char entry[256];
+  int i;
+
+  document_len = 0;
+  append("{\"version\": 3, \"devices\": [\n");
+  for(i = 0; ; i++) {
+    snprintf(entry, sizeof(entry),
+             "%s{\"id\": %d, \"name\": \"sensor \\\"%d\\\"\\n\", "
+             "\"enabled\": %s, \"threshold\": -%d.%d, "
+             "\"tags\": [\"room-%d\", \"floor-%d\"], \"calibration\": null, "
+             "\"limits\": {\"min\": %d, \"max\": %d}}",
+             i == 0 ? "" : ",\n", i, i, i % 3 ? "true" : "false",
+             i % 100, i % 10, i % 40, i % 5, -i, i * 2);
+    if(document_len + strlen(entry) + strlen(tail) >
+       JSON_BENCHMARK_DOCUMENT_SIZE) {
+      break;
+    }
+    append(entry);
+  }
+  append(tail);
+  document[document_len] = 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+run_jsonparse(void)
+{
+  struct jsonparse_state state;
+  int type;
+
+  jsonparse_setup(&state, document, document_len);
+  while((type = jsonparse_next(&state)) != 0) {
+    if(type == ',') {
+      continue;
+    }
+    if(jsonparse_copy_value(&state, value, sizeof(value)) != 0) {
+      hash_bytes(value, strlen(value));
+    }
+    hash_type(type);
+  }
+  return state.error;
+}
+/*---------------------------------------------------------------------------*/
+static void
+token(struct jsonstream_state *state, int type, const char *value, int len)
+{
+  hash_bytes(value, len);
+  if(jsonstream_value_done(state)) {
+    hash_type(type);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+run_jsonstream(int fragment_size)
+{
+  struct jsonstream_state state;
+  int pos;
+  int len;
+
+  jsonstream_init(&state, token, NULL);
+  for(pos = 0; pos < document_len; pos += len) {
+    len = document_len - pos < fragment_size ?
+      document_len - pos : fragment_size;
+    if(jsonstream_feed(&state, &document[pos], len) != JSON_ERROR_OK) {
+      break;
+    }
+  }
+  return jsonstream_end(&state);
+}
+/*---------------------------------------------------------------------------*/
+static int
+id_get(struct jsontree_context *js_ctx)
+{
+  /* The device is the element of the array at depth 1 */
+  jsontree_write_int(js_ctx, js_ctx->index[1]);
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+tags_get(struct jsontree_context *js_ctx)
+{
+  char tag[16];
+
+  /* Output in two steps, the second one resumed from callback_state */
+  if(js_ctx->callback_state++ == 0) {
+    jsontree_write_atom(js_ctx, "[");
+    snprintf(tag, sizeof(tag), "room-%d", js_ctx->index[1] % 40);
+    jsontree_write_string(js_ctx, tag);
+    return 1;
+  }
+  jsontree_write_atom(js_ctx, ",");
+  snprintf(tag, sizeof(tag), "floor-%d", js_ctx->index[1] % 5);
+  jsontree_write_string(js_ctx, tag);
+  jsontree_write_atom(js_ctx, "]");
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static struct jsontree_uint version = { JSON_TYPE_UINT, 3 };
+static struct jsontree_string name = JSONTREE_STRING("sensor \"A\"");
+static struct jsontree_int threshold = { JSON_TYPE_INT, -12 };
+static struct jsontree_uint min = { JSON_TYPE_UINT, 0 };
+static struct jsontree_uint max = { JSON_TYPE_UINT, 65535 };
+static struct jsontree_callback id = JSONTREE_CALLBACK(id_get, NULL);
+static struct jsontree_callback tags = JSONTREE_CALLBACK(tags_get, NULL);
+
+JSONTREE_OBJECT(limits,
+                JSONTREE_PAIR("min", &min),
+                JSONTREE_PAIR("max", &max));
+JSONTREE_OBJECT(device,
+                JSONTREE_PAIR("id", &id),
+                JSONTREE_PAIR("name", &name),
+                JSONTREE_PAIR("threshold", &threshold),
+                JSONTREE_PAIR("tags", &tags),
+                JSONTREE_PAIR("limits", &limits));
+JSONTREE_ARRAY(devices, TREE_DEVICES);
+JSONTREE_OBJECT(config,
+                JSONTREE_PAIR("version", &version),
+                JSONTREE_PAIR("devices", &devices));
+/*---------------------------------------------------------------------------*/
+static int
+output_putchar(int c)
+{
+  output[output_len++] = c;
+  return c;
+}
+/*---------------------------------------------------------------------------*/
+static void
+run_putchar(void)
+{
+  struct jsontree_context js_ctx;
+
+  output_len = 0;
+  jsontree_setup(&js_ctx, (struct jsontree_value *)&config, output_putchar);
+  while(jsontree_print_next(&js_ctx));
+}
+/*---------------------------------------------------------------------------*/
+/* Continue each block where the last one ended, 1 if the output differs */
+static int
+run_print_buf(int block_size, int check)
+{
+  struct jsontree_context js_ctx;
+  int len;
+
+  jsontree_setup(&js_ctx, (struct jsontree_value *)&config, NULL);
+  do {
+    len = jsontree_print_buf(&js_ctx, jsontree_print_offset(&js_ctx),
+                             block, block_size);
+    if(check &&
+       memcmp(block, &output[jsontree_print_offset(&js_ctx) - len], len)) {
+      return 1;
+    }
+  } while(len == block_size);
+  return jsontree_print_offset(&js_ctx) != output_len;
+}
+/*---------------------------------------------------------------------------*/
+/* Start each block with a new context, as a stateless CoAP resource does */
+static int
+run_print_block(int block_size, uint32_t offset)
+{
+  struct jsontree_context js_ctx;
+  int len;
+
+  jsontree_setup(&js_ctx, (struct jsontree_value *)&config, NULL);
+  len = jsontree_print_buf(&js_ctx, offset, block, block_size);
+  if(len < 0 || memcmp(block, &output[offset], len) ||
+     (len < block_size && offset + len != output_len)) {
+    return 1;
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static unsigned long
+throughput(unsigned long len, clock_time_t elapsed)
+{
+  if(elapsed == 0) {
+    elapsed = 1;
+  }
+  return len * JSON_BENCHMARK_ROUNDS / 1024 * CLOCK_SECOND / elapsed;
+}
+/*---------------------------------------------------------------------------*/
+static void
+report(const char *name, clock_time_t elapsed, int error,
+       unsigned long ram)
+{
+  printf("%-22s %6lu kbytes/s, %6lu bytes of RAM, %lu tokens, hash %08lx%s\n",
+         name, throughput(document_len, elapsed),
+         ram, tokens / JSON_BENCHMARK_ROUNDS, (unsigned long)hash,
+         error == JSON_ERROR_OK ? "" : ", error");
+}
+/*---------------------------------------------------------------------------*/
+static void
+report_output(const char *name, clock_time_t elapsed, int differs)
+{
+  printf("%-22s %6lu kbytes/s%s\n",
+         name, throughput(output_len, elapsed),
+         differs ? ", output differs" : "");
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(json_benchmark_process, ev, data)
+{
+  static const int fragment_sizes[] = { 64, 512, 1220 };
+  static const int block_sizes[] = { 16, 64, 1024 };
+  char name[32];
+  clock_time_t start;
+  uint32_t offset;
+  uint32_t size;
+  int error;
+  int i;
+  int f;
+
+  PROCESS_BEGIN();
+
+  make_document();
+  printf("%d byte document, %d rounds\n", document_len,
+         JSON_BENCHMARK_ROUNDS);
+
+  hash = 2166136261UL;
+  tokens = 0;
+  error = JSON_ERROR_OK;
+  start = clock_time();
+  for(i = 0; i < JSON_BENCHMARK_ROUNDS; i++) {
+    error |= run_jsonparse();
+  }
+  /* The whole document is buffered, plus the largest value */
+  report("jsonparse", clock_time() - start, error,
+         document_len + sizeof(struct jsonparse_state) + sizeof(value));
+
+  for(f = 0; f < sizeof(fragment_sizes) / sizeof(fragment_sizes[0]); f++) {
+    hash = 2166136261UL;
+    tokens = 0;
+    error = JSON_ERROR_OK;
+    start = clock_time();
+    for(i = 0; i < JSON_BENCHMARK_ROUNDS; i++) {
+      error |= run_jsonstream(fragment_sizes[f]);
+    }
+    /* Only the fragment being received is buffered */
+    snprintf(name, sizeof(name), "jsonstream, %d bytes", fragment_sizes[f]);
+    report(name, clock_time() - start, error,
+           fragment_sizes[f] + sizeof(struct jsonstream_state));
+  }
+
+  for(i = 0; i < TREE_DEVICES; i++) {
+    devices.values[i] = (struct jsontree_value *)&device;
+  }
+  {
+    struct jsontree_context js_ctx;
+
+    jsontree_setup(&js_ctx, (struct jsontree_value *)&config, NULL);
+    size = jsontree_size(&js_ctx);
+  }
+  start = clock_time();
+  for(i = 0; i < JSON_BENCHMARK_ROUNDS; i++) {
+    run_putchar();
+  }
+  printf("\n%lu byte tree, size computed as %lu\n",
+         (unsigned long)output_len, (unsigned long)size);
+  report_output("jsontree, putchar", clock_time() - start,
+                size != output_len);
+
+  for(f = 0; f < sizeof(block_sizes) / sizeof(block_sizes[0]); f++) {
+    error = run_print_buf(block_sizes[f], 1);
+    start = clock_time();
+    for(i = 0; i < JSON_BENCHMARK_ROUNDS; i++) {
+      error |= run_print_buf(block_sizes[f], 0);
+    }
+    snprintf(name, sizeof(name), "jsontree, %d bytes", block_sizes[f]);
+    report_output(name, clock_time() - start, error);
+  }
+
+  /* Every block is rendered from the start of the tree */
+  for(f = 0; f < sizeof(block_sizes) / sizeof(block_sizes[0]); f++) {
+    error = 0;
+    start = clock_time();
+    for(i = 0; i < JSON_BENCHMARK_ROUNDS / 10; i++) {
+      for(offset = 0; offset < output_len; offset += block_sizes[f]) {
+        error |= run_print_block(block_sizes[f], offset);
+      }
+    }
+    snprintf(name, sizeof(name), "new context, %d bytes", block_sizes[f]);
+    report_output(name, (clock_time() - start) * 10, error);
+  }
+
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,267 @@
+/*
+ * Copyright (c) 2016, Thingsquare, http://www.thingsquare.com/.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file
+ *         Reads an object with 50 instances block by block, as TLV and
+ *         as JSON, the way a LWM2M server reads it with CoAP block2.
+ *         Blocks that follow each other continue where the last block
+ *         ended. When two reads are interleaved, every block starts
+ *         over from the first instance. The blocks must add up to the
+ *         same output for all block sizes.
+ */
+
+#include "contiki.h"
+#include "lwm2m-object.h"
+#include "lwm2m-engine.h"
+#include "oma-tlv.h"
+#include "er-coap.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef LWM2M_BENCHMARK_ROUNDS
+#define LWM2M_BENCHMARK_ROUNDS 1000
+#endif
+
+#define INSTANCES 50
+#define OUTPUT_SIZE 8192
+
+static int32_t values[INSTANCES];
+static int32_t minimums[INSTANCES];
+static int on[INSTANCES];
+
+static uint8_t block[REST_MAX_CHUNK_SIZE];
+static uint8_t output[OUTPUT_SIZE];
+static uint8_t reference[OUTPUT_SIZE];
+static int reference_len;
+
+PROCESS(lwm2m_benchmark_process, "LWM2M benchmark");
+AUTOSTART_PROCESSES(&lwm2m_benchmark_process);
+/*---------------------------------------------------------------------------*/
+static int
+name_read(lwm2m_context_t *ctx, uint8_t *outbuf, size_t outsize)
+{
+  char name[16];
+
+  snprintf(name, sizeof(name), "sensor-%u", ctx->object_instance_id);
+  return ctx->writer->write_string(ctx, outbuf, outsize, name, strlen(name));
+}
+/*---------------------------------------------------------------------------*/
+LWM2M_RESOURCES(sensor_resources,
+                LWM2M_RESOURCE_INTEGER_VAR_ARR(5700, INSTANCES, values),
+                LWM2M_RESOURCE_STRING(5701, "Cel"),
+                LWM2M_RESOURCE_FLOATFIX_VAR_ARR(5601, INSTANCES, minimums),
+                LWM2M_RESOURCE_FLOATFIX(5603, -50 * LWM2M_FLOAT32_FRAC),
+                LWM2M_RESOURCE_BOOLEAN_VAR_ARR(5850, INSTANCES, on),
+                LWM2M_RESOURCE_CALLBACK(5750, { name_read, NULL, NULL }),
+                );
+LWM2M_INSTANCES(sensor_instances,
+                LWM2M_INSTANCE(0, sensor_resources), LWM2M_INSTANCE(1, sensor_resources), LWM2M_INSTANCE(2, sensor_resources), LWM2M_INSTANCE(3, sensor_resources), LWM2M_INSTANCE(4, sensor_resources),
+                LWM2M_INSTANCE(5, sensor_resources), LWM2M_INSTANCE(6, sensor_resources), LWM2M_INSTANCE(7, sensor_resources), LWM2M_INSTANCE(8, sensor_resources), LWM2M_INSTANCE(9, sensor_resources),
+                LWM2M_INSTANCE(10, sensor_resources), LWM2M_INSTANCE(11, sensor_resources), LWM2M_INSTANCE(12, sensor_resources), LWM2M_INSTANCE(13, sensor_resources), LWM2M_INSTANCE(14, sensor_resources),
+                LWM2M_INSTANCE(15, sensor_resources), LWM2M_INSTANCE(16, sensor_resources), LWM2M_INSTANCE(17, sensor_resources), LWM2M_INSTANCE(18, sensor_resources), LWM2M_INSTANCE(19, sensor_resources),
+                LWM2M_INSTANCE(20, sensor_resources), LWM2M_INSTANCE(21, sensor_resources), LWM2M_INSTANCE(22, sensor_resources), LWM2M_INSTANCE(23, sensor_resources), LWM2M_INSTANCE(24, sensor_resources),
+                LWM2M_INSTANCE(25, sensor_resources), LWM2M_INSTANCE(26, sensor_resources), LWM2M_INSTANCE(27, sensor_resources), LWM2M_INSTANCE(28, sensor_resources), LWM2M_INSTANCE(29, sensor_resources),
+                LWM2M_INSTANCE(30, sensor_resources), LWM2M_INSTANCE(31, sensor_resources), LWM2M_INSTANCE(32, sensor_resources), LWM2M_INSTANCE(33, sensor_resources), LWM2M_INSTANCE(34, sensor_resources),
+                LWM2M_INSTANCE(35, sensor_resources), LWM2M_INSTANCE(36, sensor_resources), LWM2M_INSTANCE(37, sensor_resources), LWM2M_INSTANCE(38, sensor_resources), LWM2M_INSTANCE(39, sensor_resources),
+                LWM2M_INSTANCE(40, sensor_resources), LWM2M_INSTANCE(41, sensor_resources), LWM2M_INSTANCE(42, sensor_resources), LWM2M_INSTANCE(43, sensor_resources), LWM2M_INSTANCE(44, sensor_resources),
+                LWM2M_INSTANCE(45, sensor_resources), LWM2M_INSTANCE(46, sensor_resources), LWM2M_INSTANCE(47, sensor_resources), LWM2M_INSTANCE(48, sensor_resources), LWM2M_INSTANCE(49, sensor_resources));
+LWM2M_OBJECT(sensor, 3303, sensor_instances);
+/*---------------------------------------------------------------------------*/
+struct transfer {
+  coap_packet_t request;
+  int32_t offset;
+  int len;
+  int blocks;
+};
+/*---------------------------------------------------------------------------*/
+static void
+transfer_init(struct transfer *t, char *path, unsigned int accept)
+{
+  coap_init_message(&t->request, COAP_TYPE_CON, COAP_GET, 0);
+  coap_set_header_uri_path(&t->request, path);
+  coap_set_header_accept(&t->request, accept);
+  t->offset = 0;
+  t->len = 0;
+  t->blocks = 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Get the next block, 0 when the transfer is done or failed */
+static int
+transfer_next(struct transfer *t, int block_size, uint8_t *out)
+{
+  coap_packet_t response;
+  int32_t offset;
+
+  if(t->offset < 0) {
+    return 0;
+  }
+  coap_init_message(&response, COAP_TYPE_ACK, CONTENT_2_05, 0);
+  offset = t->offset;
+  lwm2m_engine_handler(&sensor, &t->request, &response, block, block_size,
+                       &offset);
+  if(response.code != CONTENT_2_05 || t->len + response.payload_len >
+     OUTPUT_SIZE) {
+    t->offset = -1;
+    t->len = -1;
+    return 0;
+  }
+  if(out != NULL) {
+    memcpy(&out[t->len], response.payload, response.payload_len);
+  }
+  t->len += response.payload_len;
+  t->blocks++;
+  /* The engine leaves the offset alone when one block holds everything */
+  t->offset = offset == t->offset ? -1 : offset;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Count the instances and resources, to check that the TLV is complete */
+static int
+check_tlv(const uint8_t *data, int len)
+{
+  oma_tlv_t instance;
+  oma_tlv_t resource;
+  int pos, ipos, l, resources;
+
+  resources = 0;
+  for(pos = 0; pos < len; pos += l) {
+    l = oma_tlv_read(&instance, &data[pos], len - pos);
+    if(l == 0 || instance.type != OMA_TLV_TYPE_OBJECT_INSTANCE) {
+      return 0;
+    }
+    for(ipos = 0; ipos < instance.length; ipos += oma_tlv_get_size(&resource)) {
+      if(oma_tlv_read(&resource, &instance.value[ipos],
+                      instance.length - ipos) == 0) {
+        return 0;
+      }
+      resources++;
+    }
+  }
+  return resources;
+}
+/*---------------------------------------------------------------------------*/
+static unsigned long
+rate(clock_time_t elapsed, int rounds)
+{
+  if(elapsed == 0) {
+    elapsed = 1;
+  }
+  return (unsigned long)rounds * CLOCK_SECOND / elapsed;
+}
+/*---------------------------------------------------------------------------*/
+static void
+run(const char *name, unsigned int accept, int block_size)
+{
+  struct transfer t1, t2;
+  clock_time_t start, resumed, interleaved;
+  int differs;
+  int i;
+
+  transfer_init(&t1, "3303", accept);
+  while(transfer_next(&t1, block_size, output));
+  differs = t1.len != reference_len || memcmp(output, reference, t1.len);
+
+  start = clock_time();
+  for(i = 0; i < LWM2M_BENCHMARK_ROUNDS; i++) {
+    transfer_init(&t1, "3303", accept);
+    while(transfer_next(&t1, block_size, NULL));
+  }
+  resumed = clock_time() - start;
+
+  /* Two servers read the object at the same time */
+  start = clock_time();
+  for(i = 0; i < LWM2M_BENCHMARK_ROUNDS / 10; i++) {
+    transfer_init(&t1, "3303", accept);
+    transfer_init(&t2, "3303", accept);
+    while(transfer_next(&t1, block_size, NULL) |
+          transfer_next(&t2, block_size, NULL));
+  }
+  interleaved = clock_time() - start;
+
+  printf("%-5s %4d byte blocks: %4d blocks, %6lu reads/s, "
+         "interleaved %5lu reads/s%s\n",
+         name, block_size, t1.blocks,
+         rate(resumed, LWM2M_BENCHMARK_ROUNDS),
+         rate(interleaved, 2 * (LWM2M_BENCHMARK_ROUNDS / 10)),
+         differs ? ", output differs" : "");
+}
+/*---------------------------------------------------------------------------*/
+static void
+run_format(const char *name, unsigned int accept)
+{
+  static const int block_sizes[] = { 16, 64, 256, 1024 };
+  struct transfer t;
+  int i;
+
+  /* The largest blocks give the reference output */
+  transfer_init(&t, "3303", accept);
+  while(transfer_next(&t, REST_MAX_CHUNK_SIZE, reference));
+  reference_len = t.len;
+  if(accept == LWM2M_TLV) {
+    printf("%s: %d bytes, %d resources\n", name, reference_len,
+           check_tlv(reference, reference_len));
+  } else {
+    printf("%s: %d bytes, %.*s...%.*s\n", name, reference_len,
+           32, (char *)reference, 16,
+           (char *)&reference[reference_len - 16]);
+  }
+
+  for(i = 0; i < sizeof(block_sizes) / sizeof(block_sizes[0]); i++) {
+    run(name, accept, block_sizes[i]);
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(lwm2m_benchmark_process, ev, data)
+{
+  int i;
+
+  PROCESS_BEGIN();
+
+  for(i = 0; i < INSTANCES; i++) {
+    values[i] = i * 100 - 2000;
+    minimums[i] = (i - 20) * LWM2M_FLOAT32_FRAC / 4;
+    on[i] = i & 1;
+  }
+
+  printf("%d instances of %u resources, %d rounds\n", INSTANCES,
+         sensor_instances[0].count, LWM2M_BENCHMARK_ROUNDS);
+  run_format("TLV", LWM2M_TLV);
+  run_format("JSON", LWM2M_JSON);
+
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,257 @@
+/*
+ * Copyright (c) 2016, Thingsquare, http://www.thingsquare.com/.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file
+ *         Measures how much CPU the native main loop uses when idle, and
+ *         how long it takes from an event to its handler: an etimer
+ *         expiring, process_poll() from another thread, and an fd
+ *         becoming readable.
+ */
+
+#include "contiki.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#ifndef MAINLOOP_BENCHMARK_IDLE_TIME
+#define MAINLOOP_BENCHMARK_IDLE_TIME 10
+#endif
+#ifndef MAINLOOP_BENCHMARK_EVENTS
+#define MAINLOOP_BENCHMARK_EVENTS 200
+#endif
+
+/* Events are made at random intervals of up to this many ms */
+#define MAX_INTERVAL 20
+
+static int pipefd[2];
+
+/* When the current event was made, and how long handlers took to
+   see the events, in microseconds */
+static volatile uint64_t event_time;
+static uint64_t total;
+static uint64_t max;
+static unsigned events;
+
+/* The threads wait for each event to be handled before they make the
+   next one, as polls that come too close would be merged into one */
+static volatile int pending;
+static volatile int done;
+
+PROCESS(mainloop_benchmark_process, "Main loop benchmark");
+PROCESS(poll_process, "Poll receiver");
+AUTOSTART_PROCESSES(&mainloop_benchmark_process);
+/*---------------------------------------------------------------------------*/
+/* On the same clock as clock_time() */
+static uint64_t
+now_us(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+/*---------------------------------------------------------------------------*/
+static void
+handled(void)
+{
+  uint64_t latency;
+
+  latency = now_us() - event_time;
+  total += latency;
+  if(latency > max) {
+    max = latency;
+  }
+  events++;
+  pending = 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+wait_handled(void)
+{
+  int i;
+
+  /* Give up after a second, which leaves the event counted as lost */
+  for(i = 0; pending && i < 10000; i++) {
+    usleep(100);
+  }
+  pending = 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+report(const char *name)
+{
+  printf("%-8s %u/%u events, latency %lu us average, %lu us max\n",
+         name, events, MAINLOOP_BENCHMARK_EVENTS, (unsigned long)(total / (events ? events : 1)),
+         (unsigned long)max);
+  total = max = 0;
+  events = 0;
+}
+/*---------------------------------------------------------------------------*/
+static void *
+poll_thread(void *ptr)
+{
+  int i;
+
+  for(i = 0; i < MAINLOOP_BENCHMARK_EVENTS; i++) {
+    usleep(1000 + (random() % MAX_INTERVAL) * 1000);
+    pending = 1;
+    event_time = now_us();
+    process_poll(&poll_process);
+    wait_handled();
+  }
+  done = 1;
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static void *
+fd_thread(void *ptr)
+{
+  int i;
+  char c = 0;
+
+  for(i = 0; i < MAINLOOP_BENCHMARK_EVENTS; i++) {
+    usleep(1000 + (random() % MAX_INTERVAL) * 1000);
+    pending = 1;
+    event_time = now_us();
+    if(write(pipefd[1], &c, 1) != 1) {
+      perror("write");
+    }
+    wait_handled();
+  }
+  done = 1;
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static int
+set_fd(fd_set *rset, fd_set *wset)
+{
+  FD_SET(pipefd[0], rset);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+handle_fd(fd_set *rset, fd_set *wset)
+{
+  char c;
+
+  if(FD_ISSET(pipefd[0], rset) && read(pipefd[0], &c, 1) == 1) {
+    handled();
+  }
+}
+/*---------------------------------------------------------------------------*/
+static const struct select_callback pipe_callback = { set_fd, handle_fd };
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(poll_process, ev, data)
+{
+  PROCESS_POLLHANDLER(handled());
+
+  PROCESS_BEGIN();
+  PROCESS_WAIT_UNTIL(ev == PROCESS_EVENT_EXIT);
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(mainloop_benchmark_process, ev, data)
+{
+  static struct etimer et;
+  static struct rusage start, end;
+  static uint64_t start_us;
+  static pthread_t thread;
+  static int i;
+  clock_time_t interval;
+
+  PROCESS_BEGIN();
+
+  /* Idle, apart from a periodic timer as any node has */
+  printf("Idle for %u seconds\n", MAINLOOP_BENCHMARK_IDLE_TIME);
+  getrusage(RUSAGE_SELF, &start);
+  start_us = now_us();
+  for(i = 0; i < MAINLOOP_BENCHMARK_IDLE_TIME; i++) {
+    etimer_set(&et, CLOCK_SECOND);
+    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  }
+  getrusage(RUSAGE_SELF, &end);
+  printf("idle     %lu us CPU per second, %lu wake-ups per second\n",
+         (unsigned long)(((end.ru_utime.tv_sec - start.ru_utime.tv_sec +
+                           end.ru_stime.tv_sec - start.ru_stime.tv_sec) * 1000000 +
+                          end.ru_utime.tv_usec - start.ru_utime.tv_usec +
+                          end.ru_stime.tv_usec - start.ru_stime.tv_usec) /
+                         ((now_us() - start_us) / 1000000)),
+         (unsigned long)((end.ru_nvcsw - start.ru_nvcsw) /
+                         ((now_us() - start_us) / 1000000)));
+
+  /* etimer: from when it should have expired to when it is seen */
+  for(i = 0; i < MAINLOOP_BENCHMARK_EVENTS; i++) {
+    interval = 1 + random() % MAX_INTERVAL;
+    etimer_set(&et, interval * CLOCK_SECOND / 1000);
+    event_time = (uint64_t)etimer_expiration_time(&et) * 1000000 / CLOCK_SECOND;
+    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+    handled();
+  }
+  report("etimer");
+
+  /* process_poll() from another thread */
+  process_start(&poll_process, NULL);
+  pthread_create(&thread, NULL, poll_thread, NULL);
+  while(!done) {
+    etimer_set(&et, CLOCK_SECOND / 10);
+    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  }
+  pthread_join(thread, NULL);
+  done = 0;
+  report("poll");
+
+  /* A pipe becoming readable */
+  if(pipe(pipefd) < 0) {
+    perror("pipe");
+    exit(1);
+  }
+  select_set_callback(pipefd[0], &pipe_callback);
+  pthread_create(&thread, NULL, fd_thread, NULL);
+  while(!done) {
+    etimer_set(&et, CLOCK_SECOND / 10);
+    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  }
+  pthread_join(thread, NULL);
+  done = 0;
+  report("fd");
+
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
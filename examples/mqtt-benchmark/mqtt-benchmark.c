@@ -0,0 +1,344 @@
+/*
+ * Copyright (c) 2016, Texas Instruments Incorporated - http://www.ti.com/
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/*---------------------------------------------------------------------------*/
+/**
+ * \file
+ *    Measures the MQTT engine against a stub broker in the same node, over
+ *    a loopback link with a fixed delay. QoS 0 runs count the TCP frames
+ *    each message takes with and without batching, and publish large
+ *    payloads from memory and from a file. QoS 1 and QoS 2 runs measure how
+ *    many messages per second get acknowledged with different in-flight
+ *    windows, and publish payloads too large for the outbox. A last run has the broker drop the connection half way, and
+ *    checks that every message is still delivered in order.
+ */
+/*---------------------------------------------------------------------------*/
+#include "contiki.h"
+#include "contiki-net.h"
+#include "cfs/cfs.h"
+#include "mqtt.h"
+#include "loopback-net.h"
+#include "stub-broker.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+/*---------------------------------------------------------------------------*/
+#ifndef MQTT_BENCHMARK_MESSAGES
+#define MQTT_BENCHMARK_MESSAGES 200UL
+#endif
+/* One-way delay of the loopback link */
+#ifndef MQTT_BENCHMARK_LINK_DELAY
+#define MQTT_BENCHMARK_LINK_DELAY (CLOCK_SECOND / 200)
+#endif
+#ifndef MQTT_BENCHMARK_PAYLOAD_LEN
+#define MQTT_BENCHMARK_PAYLOAD_LEN 32
+#endif
+/* Large payloads go straight from memory or a file into the TCP segments */
+#ifndef MQTT_BENCHMARK_LARGE_MESSAGES
+#define MQTT_BENCHMARK_LARGE_MESSAGES 20UL
+#endif
+#ifndef MQTT_BENCHMARK_LARGE_PAYLOAD_LEN
+#define MQTT_BENCHMARK_LARGE_PAYLOAD_LEN 2048
+#endif
+
+#define BROKER_PORT       1883
+#define TOPIC             "bench/data"
+#define MAX_SEGMENT_SIZE  512
+#define KEEP_ALIVE        60
+#define JOURNAL_FILE      "mqtt-outbox"
+#define PAYLOAD_FILE      "mqtt-payload"
+/*---------------------------------------------------------------------------*/
+static struct mqtt_connection conn;
+static char broker_addr[40];
+static uint8_t payload[MQTT_BENCHMARK_LARGE_PAYLOAD_LEN];
+static char label[64];
+
+static uint32_t messages;
+static uint16_t payload_len;
+static int payload_fd;
+static uint32_t published;
+static uint32_t acked;
+static mqtt_qos_level_t qos;
+static clock_time_t start;
+static struct etimer et;
+/*---------------------------------------------------------------------------*/
+PROCESS(mqtt_benchmark_process, "MQTT benchmark");
+AUTOSTART_PROCESSES(&mqtt_benchmark_process);
+/*---------------------------------------------------------------------------*/
+static void
+mqtt_event(struct mqtt_connection *m, mqtt_event_t event, void *data)
+{
+  if(event == MQTT_EVENT_PUBACK || event == MQTT_EVENT_PUBCOMP) {
+    acked++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Every payload byte holds its offset, except for the first four, which hold
+ * the sequence number the broker uses to check the order.
+ */
+static void
+fill_payload(uint32_t seqno)
+{
+  uint16_t i;
+
+  payload[0] = seqno >> 24;
+  payload[1] = seqno >> 16;
+  payload[2] = seqno >> 8;
+  payload[3] = seqno;
+  for(i = 4; i < sizeof(payload); i++) {
+    payload[i] = i;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+publish(void)
+{
+  mqtt_status_t status;
+
+  /* QoS 0 payloads are sent from where they are, so wait until done */
+  while(published < messages && mqtt_ready(&conn)) {
+    if(payload_fd >= 0) {
+      cfs_seek(payload_fd, published * payload_len, CFS_SEEK_SET);
+      status = mqtt_publish_file(&conn, NULL, TOPIC, payload_fd, payload_len,
+                                 MQTT_RETAIN_OFF);
+    } else {
+      fill_payload(published);
+      status = mqtt_publish(&conn, NULL, TOPIC, payload, payload_len,
+                            qos, MQTT_RETAIN_OFF);
+    }
+    if(status != MQTT_STATUS_OK) {
+      return;
+    }
+    published++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+done(void)
+{
+  if(qos == MQTT_QOS_LEVEL_0) {
+    return stub_broker_stats.received + stub_broker_stats.out_of_order >=
+           messages;
+  }
+  return acked >= messages;
+}
+/*---------------------------------------------------------------------------*/
+static void
+start_run(mqtt_qos_level_t q, uint32_t n, uint16_t len)
+{
+  qos = q;
+  messages = n;
+  payload_len = len;
+  payload_fd = -1;
+  published = 0;
+  acked = 0;
+  stub_broker_reset();
+  memset(&loopback_net_stats, 0, sizeof(loopback_net_stats));
+  start = clock_time();
+}
+/*---------------------------------------------------------------------------*/
+static void
+print_run(void)
+{
+  clock_time_t elapsed;
+
+  elapsed = clock_time() - start;
+  if(elapsed == 0) {
+    elapsed = 1;
+  }
+  printf("%s: %lu messages/s, %lu.%02lu frames and %lu bytes per message\n"
+         "  (received %lu, duplicates %lu, out of order %lu, corrupt %lu, "
+         "drops %lu)\n",
+         label,
+         (unsigned long)(messages * CLOCK_SECOND / elapsed),
+         (unsigned long)(loopback_net_stats.frames / messages),
+         (unsigned long)(loopback_net_stats.frames * 100 / messages % 100),
+         (unsigned long)(loopback_net_stats.bytes / messages),
+         (unsigned long)stub_broker_stats.received,
+         (unsigned long)stub_broker_stats.duplicates,
+         (unsigned long)stub_broker_stats.out_of_order,
+         (unsigned long)stub_broker_stats.corrupt,
+         (unsigned long)stub_broker_stats.drops);
+}
+/*---------------------------------------------------------------------------*/
+/* Writes one large payload per message to a file */
+static int
+write_payload_file(void)
+{
+  int fd;
+  uint32_t i;
+
+  cfs_remove(PAYLOAD_FILE);
+  fd = cfs_open(PAYLOAD_FILE, CFS_WRITE);
+  if(fd < 0) {
+    return -1;
+  }
+  for(i = 0; i < MQTT_BENCHMARK_LARGE_MESSAGES; i++) {
+    fill_payload(i);
+    if(cfs_write(fd, payload, MQTT_BENCHMARK_LARGE_PAYLOAD_LEN) !=
+       MQTT_BENCHMARK_LARGE_PAYLOAD_LEN) {
+      cfs_close(fd);
+      return -1;
+    }
+  }
+  cfs_close(fd);
+  return cfs_open(PAYLOAD_FILE, CFS_READ);
+}
+/*---------------------------------------------------------------------------*/
+#define RUN()                                                                  \
+  do {                                                                         \
+    while(!done()) {                                                           \
+      publish();                                                               \
+      etimer_set(&et, 1);                                                      \
+      PROCESS_WAIT_EVENT();                                                    \
+    }                                                                          \
+    print_run();                                                               \
+  } while(0)
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(mqtt_benchmark_process, ev, data)
+{
+  static const uint8_t windows[] = { 1, 2, 4, 8 };
+  static const clock_time_t batch_delays[] = {
+    0, CLOCK_SECOND / 100, CLOCK_SECOND / 20
+  };
+  static uint8_t i;
+  static uint8_t q;
+  static int fd;
+  uip_ipaddr_t addr;
+
+  PROCESS_BEGIN();
+
+  printf("%lu messages of %u bytes per run, link delay %lu ms\n",
+         (unsigned long)MQTT_BENCHMARK_MESSAGES, MQTT_BENCHMARK_PAYLOAD_LEN,
+         (unsigned long)(MQTT_BENCHMARK_LINK_DELAY * 1000 / CLOCK_SECOND));
+
+  loopback_net_init(MQTT_BENCHMARK_LINK_DELAY);
+  loopback_net_get_addr(&addr);
+  stub_broker_init(BROKER_PORT);
+
+  snprintf(broker_addr, sizeof(broker_addr),
+           "%x:%x:%x:%x:%x:%x:%x:%x",
+           uip_ntohs(addr.u16[0]), uip_ntohs(addr.u16[1]),
+           uip_ntohs(addr.u16[2]), uip_ntohs(addr.u16[3]),
+           uip_ntohs(addr.u16[4]), uip_ntohs(addr.u16[5]),
+           uip_ntohs(addr.u16[6]), uip_ntohs(addr.u16[7]));
+
+  /* Start from an empty outbox */
+  cfs_remove(JOURNAL_FILE);
+
+  mqtt_register(&conn, &mqtt_benchmark_process, "mqtt-benchmark",
+                mqtt_event, MAX_SEGMENT_SIZE);
+  mqtt_connect(&conn, broker_addr, BROKER_PORT, KEEP_ALIVE);
+  PROCESS_WAIT_EVENT_UNTIL(mqtt_connected(&conn));
+
+  /* Small QoS 0 messages, coalesced into fewer segments by batching */
+  for(i = 0; i < sizeof(batch_delays) / sizeof(batch_delays[0]); i++) {
+    mqtt_set_batch_delay(&conn, batch_delays[i]);
+    start_run(MQTT_QOS_LEVEL_0, MQTT_BENCHMARK_MESSAGES,
+              MQTT_BENCHMARK_PAYLOAD_LEN);
+    snprintf(label, sizeof(label), "QoS 0, batch delay %lu ms",
+             (unsigned long)(batch_delays[i] * 1000 / CLOCK_SECOND));
+    RUN();
+  }
+  mqtt_set_batch_delay(&conn, 0);
+
+  /* Large QoS 0 messages, from memory and from a file */
+  start_run(MQTT_QOS_LEVEL_0, MQTT_BENCHMARK_LARGE_MESSAGES,
+            MQTT_BENCHMARK_LARGE_PAYLOAD_LEN);
+  snprintf(label, sizeof(label), "QoS 0, %u bytes from memory",
+           MQTT_BENCHMARK_LARGE_PAYLOAD_LEN);
+  RUN();
+
+  fd = write_payload_file();
+  if(fd < 0) {
+    printf("Could not write %s\n", PAYLOAD_FILE);
+  } else {
+    start_run(MQTT_QOS_LEVEL_0, MQTT_BENCHMARK_LARGE_MESSAGES,
+              MQTT_BENCHMARK_LARGE_PAYLOAD_LEN);
+    payload_fd = fd;
+    snprintf(label, sizeof(label), "QoS 0, %u bytes from a file",
+             MQTT_BENCHMARK_LARGE_PAYLOAD_LEN);
+    RUN();
+    cfs_close(fd);
+    cfs_remove(PAYLOAD_FILE);
+  }
+
+  /* QoS 1 and 2 messages too large for the outbox, sent one at a time */
+  for(q = MQTT_QOS_LEVEL_1; q <= MQTT_QOS_LEVEL_2; q++) {
+    start_run(q, MQTT_BENCHMARK_LARGE_MESSAGES,
+              MQTT_BENCHMARK_LARGE_PAYLOAD_LEN);
+    snprintf(label, sizeof(label), "QoS %u, %u bytes from memory", q,
+             MQTT_BENCHMARK_LARGE_PAYLOAD_LEN);
+    RUN();
+  }
+
+  for(q = MQTT_QOS_LEVEL_1; q <= MQTT_QOS_LEVEL_2; q++) {
+    for(i = 0; i < sizeof(windows); i++) {
+      mqtt_set_max_in_flight(&conn, windows[i]);
+      start_run(q, MQTT_BENCHMARK_MESSAGES, MQTT_BENCHMARK_PAYLOAD_LEN);
+      snprintf(label, sizeof(label), "QoS %u, window %u", q, windows[i]);
+      RUN();
+    }
+  }
+
+  /* The window and a batch delay together */
+  mqtt_set_batch_delay(&conn, CLOCK_SECOND / 100);
+  start_run(MQTT_QOS_LEVEL_1, MQTT_BENCHMARK_MESSAGES,
+            MQTT_BENCHMARK_PAYLOAD_LEN);
+  snprintf(label, sizeof(label), "QoS 1, window 8, batch delay 10 ms");
+  RUN();
+  mqtt_set_batch_delay(&conn, 0);
+
+#if MQTT_OUTBOX_CFS
+  /* Journal every change of the outbox to a file */
+  mqtt_set_outbox_file(&conn, JOURNAL_FILE);
+  for(q = MQTT_QOS_LEVEL_1; q <= MQTT_QOS_LEVEL_2; q++) {
+    start_run(q, MQTT_BENCHMARK_MESSAGES, MQTT_BENCHMARK_PAYLOAD_LEN);
+    snprintf(label, sizeof(label), "QoS %u, window 8, journaled", q);
+    RUN();
+  }
+#endif /* MQTT_OUTBOX_CFS */
+
+#if MQTT_OUTBOX_SIZE
+  /* Lose the connection half way, the outbox is resent after reconnecting */
+  for(q = MQTT_QOS_LEVEL_1; q <= MQTT_QOS_LEVEL_2; q++) {
+    start_run(q, MQTT_BENCHMARK_MESSAGES, MQTT_BENCHMARK_PAYLOAD_LEN);
+    stub_broker_drop_after(MQTT_BENCHMARK_MESSAGES / 2);
+    snprintf(label, sizeof(label), "QoS %u, window 8, reconnect", q);
+    RUN();
+  }
+#endif /* MQTT_OUTBOX_SIZE */
+
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
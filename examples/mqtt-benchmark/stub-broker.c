@@ -0,0 +1,273 @@
+/*
+ * Copyright (c) 2016, Texas Instruments Incorporated - http://www.ti.com/
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/*---------------------------------------------------------------------------*/
+#include "contiki.h"
+#include "contiki-net.h"
+#include "tcp-socket.h"
+#include "mqtt.h"
+#include "stub-broker.h"
+
+#include <string.h>
+/*---------------------------------------------------------------------------*/
+#define MSG_TYPE_CONNECT     0x10
+#define MSG_TYPE_PUBLISH     0x30
+#define MSG_TYPE_PUBREL      0x60
+#define MSG_TYPE_SUBSCRIBE   0x80
+#define MSG_TYPE_PINGREQ     0xC0
+#define MSG_TYPE_DISCONNECT  0xE0
+
+#define DUP_FLAG             0x08
+
+/* Enough of a message to find the topic, MID and sequence number */
+#define BODY_SIZE            (2 + MQTT_MAX_TOPIC_LENGTH + 2 + 4)
+
+#define INPUT_BUFFER_SIZE    1280
+#define OUTPUT_BUFFER_SIZE   1280
+/*---------------------------------------------------------------------------*/
+struct stub_broker_stats stub_broker_stats;
+
+static struct tcp_socket socket;
+static uint8_t inbuf[INPUT_BUFFER_SIZE];
+static uint8_t outbuf[OUTPUT_BUFFER_SIZE];
+
+/* The message being read */
+static uint8_t fhdr;
+static uint32_t remaining_length;
+static uint32_t multiplier;
+static uint8_t has_remaining_length;
+static uint32_t body_pos;
+static uint8_t body[BODY_SIZE];
+static uint8_t payload_corrupt;
+
+/* Replies to the messages of one segment are sent together */
+static uint8_t replies[OUTPUT_BUFFER_SIZE];
+static uint16_t replies_len;
+
+static uint32_t next_seqno;
+static uint32_t drop_after;
+/*---------------------------------------------------------------------------*/
+static void
+reply(const uint8_t *msg, uint16_t len)
+{
+  if(replies_len + len <= sizeof(replies)) {
+    memcpy(&replies[replies_len], msg, len);
+    replies_len += len;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+reply_mid(uint8_t type, uint16_t mid)
+{
+  uint8_t msg[4];
+
+  msg[0] = type;
+  msg[1] = 2;
+  msg[2] = mid >> 8;
+  msg[3] = mid & 0xff;
+  reply(msg, sizeof(msg));
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+qos(void)
+{
+  return (fhdr >> 1) & 0x03;
+}
+/*---------------------------------------------------------------------------*/
+/* Offset of the payload in the body of a PUBLISH message */
+static uint32_t
+payload_start(void)
+{
+  return 2 + ((body[0] << 8) | body[1]) + (qos() > 0 ? 2 : 0);
+}
+/*---------------------------------------------------------------------------*/
+static void
+handle_publish(void)
+{
+  uint16_t mid;
+  uint32_t seqno;
+  uint8_t *p;
+
+  if(payload_start() + 4 > BODY_SIZE ||
+     payload_start() + 4 > remaining_length) {
+    return;
+  }
+  p = &body[payload_start()];
+  mid = qos() > 0 ? (p[-2] << 8) | p[-1] : 0;
+  seqno = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+    (p[2] << 8) | p[3];
+
+  if(payload_corrupt) {
+    stub_broker_stats.corrupt++;
+  }
+
+  if(seqno == next_seqno) {
+    stub_broker_stats.received++;
+    next_seqno++;
+  } else if(seqno < next_seqno) {
+    stub_broker_stats.duplicates++;
+  } else {
+    stub_broker_stats.out_of_order++;
+    next_seqno = seqno + 1;
+  }
+
+  if(drop_after > 0 && stub_broker_stats.received == drop_after) {
+    drop_after = 0;
+    stub_broker_stats.drops++;
+    tcp_socket_close(&socket);
+    return;
+  }
+
+  switch(qos()) {
+  case 1:
+    reply_mid(0x40, mid);
+    break;
+  case 2:
+    reply_mid(0x50, mid);
+    break;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+handle_message(void)
+{
+  uint8_t msg[5];
+
+  switch(fhdr & 0xF0) {
+  case MSG_TYPE_CONNECT:
+    msg[0] = 0x20;
+    msg[1] = 2;
+    msg[2] = 0;
+    msg[3] = 0;
+    reply(msg, 4);
+    break;
+  case MSG_TYPE_PUBLISH:
+    handle_publish();
+    break;
+  case MSG_TYPE_PUBREL:
+    stub_broker_stats.released++;
+    reply_mid(0x70, (body[0] << 8) | body[1]);
+    break;
+  case MSG_TYPE_SUBSCRIBE:
+    msg[0] = 0x90;
+    msg[1] = 3;
+    msg[2] = body[0];
+    msg[3] = body[1];
+    msg[4] = 0;
+    reply(msg, 5);
+    break;
+  case MSG_TYPE_PINGREQ:
+    msg[0] = 0xD0;
+    msg[1] = 0;
+    reply(msg, 2);
+    break;
+  case MSG_TYPE_DISCONNECT:
+    tcp_socket_close(&socket);
+    break;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+reset_message(void)
+{
+  fhdr = 0;
+  remaining_length = 0;
+  multiplier = 1;
+  has_remaining_length = 0;
+  body_pos = 0;
+  payload_corrupt = 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+input(struct tcp_socket *s, void *ptr, const uint8_t *data, int len)
+{
+  int pos;
+
+  for(pos = 0; pos < len; pos++) {
+    if(fhdr == 0) {
+      fhdr = data[pos];
+    } else if(!has_remaining_length) {
+      remaining_length += (data[pos] & 0x7F) * multiplier;
+      multiplier *= 128;
+      has_remaining_length = (data[pos] & 0x80) == 0;
+    } else {
+      if(body_pos < BODY_SIZE) {
+        body[body_pos] = data[pos];
+      }
+      /* Check the payload after the sequence number */
+      if((fhdr & 0xF0) == MSG_TYPE_PUBLISH && body_pos >= 2 &&
+         body_pos >= payload_start() + 4 &&
+         data[pos] != ((body_pos - payload_start()) & 0xff)) {
+        payload_corrupt = 1;
+      }
+      body_pos++;
+    }
+
+    if(has_remaining_length && body_pos == remaining_length) {
+      handle_message();
+      reset_message();
+    }
+  }
+
+  if(replies_len > 0) {
+    tcp_socket_send(&socket, replies, replies_len);
+    replies_len = 0;
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+event(struct tcp_socket *s, void *ptr, tcp_socket_event_t ev)
+{
+  if(ev == TCP_SOCKET_CONNECTED) {
+    reset_message();
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+stub_broker_init(uint16_t port)
+{
+  tcp_socket_register(&socket, NULL, inbuf, sizeof(inbuf),
+                      outbuf, sizeof(outbuf), input, event);
+  tcp_socket_listen(&socket, port);
+}
+/*---------------------------------------------------------------------------*/
+void
+stub_broker_reset(void)
+{
+  memset(&stub_broker_stats, 0, sizeof(stub_broker_stats));
+  next_seqno = 0;
+}
+/*---------------------------------------------------------------------------*/
+void
+stub_broker_drop_after(uint32_t count)
+{
+  drop_after = count;
+}
+/*---------------------------------------------------------------------------*/
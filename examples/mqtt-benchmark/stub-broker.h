@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2016, Texas Instruments Incorporated - http://www.ti.com/
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/*---------------------------------------------------------------------------*/
+/**
+ * \file
+ *    A minimal MQTT broker for the MQTT benchmark. It accepts one client,
+ *    acknowledges everything it is sent, and checks that the sequence
+ *    numbers carried by PUBLISH payloads arrive in order. The rest of each
+ *    payload must hold its own offset, modulo 256, in every byte. It does
+ *    not forward messages to subscribers.
+ */
+/*---------------------------------------------------------------------------*/
+#ifndef STUB_BROKER_H_
+#define STUB_BROKER_H_
+/*---------------------------------------------------------------------------*/
+#include "contiki.h"
+/*---------------------------------------------------------------------------*/
+struct stub_broker_stats {
+  /* PUBLISH messages with the next sequence number */
+  uint32_t received;
+  /* PUBLISH messages with an earlier sequence number */
+  uint32_t duplicates;
+  /* PUBLISH messages with a later sequence number than the next one */
+  uint32_t out_of_order;
+  /* PUBREL messages */
+  uint32_t released;
+  /* Number of times the broker has closed the connection */
+  uint32_t drops;
+  /* PUBLISH messages whose payload did not follow the expected pattern */
+  uint32_t corrupt;
+};
+
+extern struct stub_broker_stats stub_broker_stats;
+
+/**
+ * \brief Starts listening for a client
+ * \param port The TCP port to listen on
+ */
+void stub_broker_init(uint16_t port);
+
+/**
+ * \brief Resets the statistics and the expected sequence number
+ */
+void stub_broker_reset(void);
+
+/**
+ * \brief Closes the connection once, after a number of PUBLISH messages
+ * \param count The number of PUBLISH messages to accept before closing,
+ *        or 0 to never close the connection
+ */
+void stub_broker_drop_after(uint32_t count);
+/*---------------------------------------------------------------------------*/
+#endif /* STUB_BROKER_H_ */
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,237 @@
+/*
+ * Copyright (c) 2016, Thingsquare, http://www.thingsquare.com/.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file
+ *         Measures the multi-threading library: the time of switching
+ *         to a thread and back, of starting and stopping a thread, and
+ *         of passing an event through a ring of threads that block on
+ *         events in processes of their own, as a server with many
+ *         client sessions would.
+ */
+
+#include "contiki.h"
+#include "sys/mt.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef MT_BENCHMARK_SWITCHES
+#define MT_BENCHMARK_SWITCHES 2000000UL
+#endif
+#ifndef MT_BENCHMARK_STARTS
+#define MT_BENCHMARK_STARTS 200000UL
+#endif
+#ifndef MT_BENCHMARK_SESSIONS
+#define MT_BENCHMARK_SESSIONS 500
+#endif
+#ifndef MT_BENCHMARK_HOPS
+#define MT_BENCHMARK_HOPS 1000000UL
+#endif
+/* Makes a thread overflow its stack, to show the guard page */
+#ifndef MT_BENCHMARK_OVERFLOW
+#define MT_BENCHMARK_OVERFLOW 0
+#endif
+
+static struct mt_thread thread;
+static struct mt_process sessions[MT_BENCHMARK_SESSIONS];
+static struct process protothreads[MT_BENCHMARK_SESSIONS];
+static unsigned long hops;
+static process_event_t token_event;
+
+PROCESS(mt_benchmark_process, "mt benchmark");
+AUTOSTART_PROCESSES(&mt_benchmark_process);
+/*---------------------------------------------------------------------------*/
+static unsigned long
+usec(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+}
+/*---------------------------------------------------------------------------*/
+static unsigned long
+resident_kb(void)
+{
+  unsigned long size, resident;
+  FILE *f;
+
+  resident = 0;
+  f = fopen("/proc/self/statm", "r");
+  if(f != NULL) {
+    if(fscanf(f, "%lu %lu", &size, &resident) != 2) {
+      resident = 0;
+    }
+    fclose(f);
+  }
+  return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+/*---------------------------------------------------------------------------*/
+static void
+yielder(void *data)
+{
+  while(1) {
+    mt_yield();
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+nothing(void *data)
+{
+  mt_exit();
+}
+/*---------------------------------------------------------------------------*/
+#if MT_BENCHMARK_OVERFLOW
+static int
+recurse(int depth)
+{
+  volatile char frame[256];
+
+  frame[0] = depth;
+  if(depth == 1000000) {
+    return 0;
+  }
+  return recurse(depth + 1) + frame[0];
+}
+#endif /* MT_BENCHMARK_OVERFLOW */
+/*---------------------------------------------------------------------------*/
+static void
+session(void *data)
+{
+  struct mt_process *next;
+  process_event_t ev;
+
+  next = data;
+#if MT_BENCHMARK_OVERFLOW
+  recurse(0);
+#endif /* MT_BENCHMARK_OVERFLOW */
+  while(1) {
+    /* Block until the token comes, as a session blocks on input */
+    ev = mt_process_wait(NULL);
+    if(ev != token_event) {
+      continue;
+    }
+    if(++hops == MT_BENCHMARK_HOPS) {
+      process_post(&mt_benchmark_process, token_event, NULL);
+    } else {
+      process_post(&next->process, token_event, NULL);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* The same ring as the sessions, but with protothreads */
+static
+PT_THREAD(protothread(struct pt *process_pt, process_event_t ev,
+                      process_data_t data))
+{
+  int s;
+
+  PROCESS_BEGIN();
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == token_event);
+    s = PROCESS_CURRENT() - protothreads;
+    if(++hops == MT_BENCHMARK_HOPS) {
+      process_post(&mt_benchmark_process, token_event, NULL);
+    } else {
+      process_post(&protothreads[(s + 1) % MT_BENCHMARK_SESSIONS],
+                   token_event, NULL);
+    }
+  }
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(mt_benchmark_process, ev, data)
+{
+  static unsigned long start, before;
+  unsigned long i;
+  int s;
+
+  PROCESS_BEGIN();
+
+  mt_init();
+  token_event = process_alloc_event();
+
+  mt_start(&thread, yielder, NULL);
+  start = usec();
+  for(i = 0; i < MT_BENCHMARK_SWITCHES; i++) {
+    mt_exec(&thread);
+  }
+  printf("switch   %lu ns to a thread and back\n",
+         (usec() - start) * 1000 / MT_BENCHMARK_SWITCHES);
+  mt_stop(&thread);
+
+  start = usec();
+  for(i = 0; i < MT_BENCHMARK_STARTS; i++) {
+    mt_start(&thread, nothing, NULL);
+    mt_exec(&thread);
+    mt_stop(&thread);
+  }
+  printf("start    %lu ns to start, run and stop a thread\n",
+         (usec() - start) * 1000 / MT_BENCHMARK_STARTS);
+
+  before = resident_kb();
+  for(s = 0; s < MT_BENCHMARK_SESSIONS; s++) {
+    mt_process_start(&sessions[s], "session", session,
+                     &sessions[(s + 1) % MT_BENCHMARK_SESSIONS]);
+  }
+  printf("sessions %d threads waiting for events, %lu kB more memory\n",
+         MT_BENCHMARK_SESSIONS, resident_kb() - before);
+
+  start = usec();
+  process_post(&sessions[0].process, token_event, NULL);
+  PROCESS_WAIT_EVENT_UNTIL(ev == token_event);
+  printf("events   %lu ns per event passed to the next thread\n",
+         (usec() - start) * 1000 / MT_BENCHMARK_HOPS);
+
+  for(s = 0; s < MT_BENCHMARK_SESSIONS; s++) {
+    process_exit(&sessions[s].process);
+  }
+
+  for(s = 0; s < MT_BENCHMARK_SESSIONS; s++) {
+    protothreads[s].thread = protothread;
+    process_start(&protothreads[s], NULL);
+  }
+  hops = 0;
+  start = usec();
+  process_post(&protothreads[0], token_event, NULL);
+  PROCESS_WAIT_EVENT_UNTIL(ev == token_event);
+  printf("events   %lu ns per event passed to the next protothread\n",
+         (usec() - start) * 1000 / MT_BENCHMARK_HOPS);
+
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
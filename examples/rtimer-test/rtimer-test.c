@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2016, Thingsquare, http://www.thingsquare.com/.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file
+ *         Checks the rtimer task queue on the native platform, where
+ *         the SIGALRM handler plays the rtimer interrupt. Tasks are
+ *         set from inside callbacks, for times that have already
+ *         passed, and from the main context while a periodic task
+ *         keeps interrupting it, so that the interrupt often finds
+ *         the queue locked.
+ */
+
+#include "contiki.h"
+#include "sys/rtimer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Ticks between the runs of the periodic task */
+#define PERIOD 2
+/* Ticks that the main context sets and cancels tasks for */
+#define DURATION 3000
+/* How late a task may run, in ticks, with the delays of signals on a
+   busy host */
+#define MAX_LATENESS 10
+
+PROCESS(rtimer_test_process, "rtimer test");
+AUTOSTART_PROCESSES(&rtimer_test_process);
+
+static struct rtimer first, past, later, same[2], periodic, idle;
+static volatile char order[8];
+static volatile int ran;
+static volatile rtimer_clock_t later_time;
+static volatile unsigned long periodic_runs;
+static volatile rtimer_clock_t last_run;
+static volatile int max_gap;
+static int failures;
+/*---------------------------------------------------------------------------*/
+static void
+record(struct rtimer *t, void *ptr)
+{
+  if(ran < sizeof(order) - 1) {
+    order[ran++] = *(char *)ptr;
+  }
+  if(t == &later) {
+    later_time = RTIMER_NOW();
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+chain(struct rtimer *t, void *ptr)
+{
+  record(t, ptr);
+  /* Set from inside a callback: one task that is already due, one
+     for later and two for the same time, which run in the order
+     they were set */
+  rtimer_set(&later, RTIMER_TIME(t) + 10, 0, record, "d");
+  rtimer_set(&past, RTIMER_TIME(t) - 5, 0, record, "b");
+  rtimer_set(&same[0], RTIMER_TIME(t) + 5, 0, record, "c");
+  rtimer_set(&same[1], RTIMER_TIME(t) + 5, 0, record, "C");
+}
+/*---------------------------------------------------------------------------*/
+static void
+tick(struct rtimer *t, void *ptr)
+{
+  rtimer_clock_t now;
+  int gap;
+
+  now = RTIMER_NOW();
+  gap = RTIMER_CLOCK_DIFF(now, last_run);
+  if(periodic_runs > 0 && gap > max_gap) {
+    max_gap = gap;
+  }
+  last_run = now;
+  periodic_runs++;
+  rtimer_set(t, RTIMER_TIME(t) + PERIOD, 0, tick, NULL);
+}
+/*---------------------------------------------------------------------------*/
+static void
+check(int ok, const char *what)
+{
+  printf("%s %s\n", ok ? "ok  " : "FAIL", what);
+  if(!ok) {
+    failures++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+wait_ticks(rtimer_clock_t ticks)
+{
+  rtimer_clock_t start;
+
+  start = RTIMER_NOW();
+  while(RTIMER_CLOCK_DIFF(RTIMER_NOW(), start) < ticks);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(rtimer_test_process, ev, data)
+{
+  rtimer_clock_t start;
+  unsigned long sets;
+
+  PROCESS_BEGIN();
+
+  rtimer_set(&first, RTIMER_NOW() + 5, 0, chain, "a");
+  wait_ticks(30);
+  order[ran] = '\0';
+  printf("order %s\n", order);
+  check(strcmp((char *)order, "abcCd") == 0,
+        "tasks set from a callback run in time order");
+  check(RTIMER_CLOCK_DIFF(later_time, RTIMER_TIME(&later)) >= 0 &&
+        RTIMER_CLOCK_DIFF(later_time, RTIMER_TIME(&later)) <= MAX_LATENESS,
+        "a task set from a callback runs on time");
+
+  ran = 0;
+  rtimer_set(&past, RTIMER_NOW() - 10, 0, record, "p");
+  wait_ticks(MAX_LATENESS + 1);
+  check(ran == 1, "a task set in the past from the main context runs");
+
+  /* The periodic task interrupts the main context, which keeps the
+     queue locked most of the time by setting and cancelling a task */
+  rtimer_set(&periodic, RTIMER_NOW() + PERIOD, 0, tick, NULL);
+  start = RTIMER_NOW();
+  sets = 0;
+  while(RTIMER_CLOCK_DIFF(RTIMER_NOW(), start) < DURATION) {
+    rtimer_set(&idle, RTIMER_NOW() + 1000, 0, record, "i");
+    rtimer_cancel(&idle);
+    sets++;
+  }
+  rtimer_cancel(&periodic);
+  printf("locked %lu tasks set and cancelled, %lu periodic runs, "
+         "longest gap %d ticks\n", sets, periodic_runs, max_gap);
+  check(periodic_runs >= DURATION / PERIOD * 9 / 10,
+        "the periodic task runs while the queue is locked");
+  check(max_gap <= PERIOD + MAX_LATENESS,
+        "the periodic task never stalls");
+
+  printf("%s\n", failures == 0 ? "passed" : "failed");
+  exit(failures == 0 ? 0 : 1);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
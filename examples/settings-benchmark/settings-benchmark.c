@@ -0,0 +1,387 @@
+/*
+ * Copyright (c) 2016, Thingsquare, http://www.thingsquare.com/.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file
+ *         Measures how the settings manager reads and wears its EEPROM.
+ *         The benchmark stores the parameters of a node, starts again
+ *         and loads them as a node does at boot, then updates, resizes
+ *         and deletes values at random. The EEPROM is kept in RAM and
+ *         counts the accesses, and how many times each byte is written.
+ */
+
+#include "contiki.h"
+#include "lib/settings.h"
+#include "lib/random.h"
+#include "dev/eeprom.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#define PARAMETERS       40
+#define MAX_VALUE_SIZE   16
+#define HOT_PARAMETERS   4
+
+#define GETS             1000
+#define UPDATES          2000
+#define RESIZES          200
+#define DELETES          200
+#define TRANSACTIONS     200
+
+/* The parameters left when the store is wiped during a compaction */
+#define WIPE_PARAMETERS  8
+
+#define IMAGE_VARIABLE   "SETTINGS_BENCHMARK_IMAGE"
+
+static uint8_t eeprom[EEPROM_SIZE];
+static uint16_t wear[EEPROM_SIZE];
+static unsigned long reads, read_bytes;
+static unsigned long writes, written_bytes;
+
+/* What the settings should contain */
+static uint8_t values[PARAMETERS][MAX_VALUE_SIZE];
+static settings_length_t sizes[PARAMETERS];
+static uint8_t stored[PARAMETERS];
+
+PROCESS(settings_benchmark_process, "Settings benchmark");
+AUTOSTART_PROCESSES(&settings_benchmark_process);
+/*---------------------------------------------------------------------------*/
+void
+eeprom_init(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+void
+eeprom_read(eeprom_addr_t addr, unsigned char *buf, int size)
+{
+  memcpy(buf, &eeprom[addr], size);
+  reads++;
+  read_bytes += size;
+}
+/*---------------------------------------------------------------------------*/
+void
+eeprom_write(eeprom_addr_t addr, unsigned char *buf, int size)
+{
+  int i;
+
+  memcpy(&eeprom[addr], buf, size);
+  for(i = 0; i < size; i++) {
+    wear[addr + i]++;
+  }
+  writes++;
+  written_bytes += size;
+}
+/*---------------------------------------------------------------------------*/
+static void
+reset_counters(void)
+{
+  reads = read_bytes = writes = written_bytes = 0;
+  memset(wear, 0, sizeof(wear));
+}
+/*---------------------------------------------------------------------------*/
+static unsigned
+max_wear(void)
+{
+  unsigned i, max;
+
+  max = 0;
+  for(i = 0; i < EEPROM_SIZE; i++) {
+    if(wear[i] > max) {
+      max = wear[i];
+    }
+  }
+  return max;
+}
+/*---------------------------------------------------------------------------*/
+static unsigned long
+now_us(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec * 1000000UL + tv.tv_usec;
+}
+/*---------------------------------------------------------------------------*/
+static settings_key_t
+key(int i)
+{
+  return TCC('a' + i % 26, 'a' + i / 26);
+}
+/*---------------------------------------------------------------------------*/
+static void
+new_value(int i, settings_length_t size)
+{
+  settings_length_t j;
+
+  sizes[i] = size;
+  for(j = 0; j < size; j++) {
+    values[i][j] = random_rand();
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+set(int i)
+{
+  if(settings_set(key(i), values[i], sizes[i]) != SETTINGS_STATUS_OK) {
+    return 0;
+  }
+  stored[i] = 1;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Returns the number of parameters that do not read back as stored */
+static int
+verify(void)
+{
+  uint8_t buf[MAX_VALUE_SIZE];
+  settings_length_t size;
+  int i, wrong;
+
+  wrong = 0;
+  for(i = 0; i < PARAMETERS; i++) {
+    size = sizeof(buf);
+    if(settings_get(key(i), 0, buf, &size) != SETTINGS_STATUS_OK) {
+      wrong += stored[i];
+    } else if(!stored[i] || size != sizes[i] ||
+              memcmp(buf, values[i], size) != 0) {
+      wrong++;
+    }
+  }
+  return wrong;
+}
+/*---------------------------------------------------------------------------*/
+static void
+store(void)
+{
+  FILE *f;
+  char name[] = "/tmp/settings-benchmarkXXXXXX";
+  int i, fd;
+
+  memset(eeprom, 0xff, sizeof(eeprom));
+  settings_wipe();
+  for(i = 0; i < PARAMETERS; i++) {
+    new_value(i, 1 + (i * 7) % MAX_VALUE_SIZE);
+    if(!set(i)) {
+      printf("Could not store parameter %d\n", i);
+      exit(1);
+    }
+  }
+
+  /* Start again from the stored EEPROM, as a node that reboots */
+  fd = mkstemp(name);
+  f = fdopen(fd, "w");
+  if(f == NULL ||
+     fwrite(eeprom, sizeof(eeprom), 1, f) != 1 ||
+     fwrite(values, sizeof(values), 1, f) != 1 ||
+     fwrite(sizes, sizeof(sizes), 1, f) != 1) {
+    perror(name);
+    exit(1);
+  }
+  fclose(f);
+  setenv(IMAGE_VARIABLE, name, 1);
+  fflush(stdout);
+  execl("/proc/self/exe", "settings-benchmark", NULL);
+  perror("execl");
+  exit(1);
+}
+/*---------------------------------------------------------------------------*/
+static void
+load(const char *name)
+{
+  FILE *f;
+
+  f = fopen(name, "r");
+  if(f == NULL ||
+     fread(eeprom, sizeof(eeprom), 1, f) != 1 ||
+     fread(values, sizeof(values), 1, f) != 1 ||
+     fread(sizes, sizeof(sizes), 1, f) != 1) {
+    perror(name);
+    exit(1);
+  }
+  fclose(f);
+  unlink(name);
+  memset(stored, 1, sizeof(stored));
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(settings_benchmark_process, ev, data)
+{
+  static const char *image;
+  uint8_t buf[MAX_VALUE_SIZE];
+  settings_length_t size;
+  unsigned long start, elapsed;
+  int i, j, failed;
+#if SETTINGS_CONF_LOG
+  struct settings_stats stats;
+  static uint16_t compactions;
+#endif /* SETTINGS_CONF_LOG */
+
+  PROCESS_BEGIN();
+
+  random_init(1);
+  image = getenv(IMAGE_VARIABLE);
+  if(image == NULL) {
+    store();
+  }
+  load(image);
+
+  printf("%s store, %u parameters of 1-%u bytes\n",
+         SETTINGS_CONF_LOG ? "Log-structured" : "Chained",
+         PARAMETERS, MAX_VALUE_SIZE);
+
+  /* Loading the parameters at boot */
+  reset_counters();
+  for(i = 0; i < PARAMETERS; i++) {
+    size = sizeof(buf);
+    settings_get(key(i), 0, buf, &size);
+  }
+  printf("boot     %lu reads of %lu bytes\n", reads, read_bytes);
+
+  reset_counters();
+  start = now_us();
+  for(j = 0; j < GETS; j++) {
+    for(i = 0; i < PARAMETERS; i++) {
+      size = sizeof(buf);
+      settings_get(key(i), 0, buf, &size);
+    }
+  }
+  elapsed = now_us() - start;
+  printf("get      %lu reads of %lu bytes per get, %lu ns per get\n",
+         reads / (GETS * PARAMETERS), read_bytes / (GETS * PARAMETERS),
+         elapsed * 1000 / (GETS * PARAMETERS));
+
+  /* Values that change, such as counters and calibration. A few of
+     them change much more often than the others. */
+  reset_counters();
+  failed = 0;
+  for(j = 0; j < UPDATES; j++) {
+    if(random_rand() % 4) {
+      i = random_rand() % HOT_PARAMETERS;
+    } else {
+      i = random_rand() % PARAMETERS;
+    }
+    new_value(i, sizes[i]);
+    failed += !set(i);
+  }
+  printf("update   %d/%d failed, %lu bytes written, "
+         "most written byte %u times\n",
+         failed, UPDATES, written_bytes, max_wear());
+
+  reset_counters();
+  failed = 0;
+  for(j = 0; j < RESIZES; j++) {
+    i = random_rand() % PARAMETERS;
+    new_value(i, 1 + random_rand() % MAX_VALUE_SIZE);
+    if(!set(i)) {
+      failed++;
+      stored[i] = 0;
+    }
+  }
+  printf("resize   %d/%d failed, %lu bytes written\n",
+         failed, RESIZES, written_bytes);
+
+  reset_counters();
+  failed = 0;
+  for(j = 0; j < DELETES; j++) {
+    i = random_rand() % PARAMETERS;
+    if(stored[i] && settings_delete(key(i), 0) != SETTINGS_STATUS_OK) {
+      failed++;
+    } else {
+      stored[i] = 0;
+    }
+    new_value(i, sizes[i]);
+    set(i);
+  }
+  printf("delete   %d/%d failed, %lu bytes written\n",
+         failed, DELETES, written_bytes);
+
+#if SETTINGS_CONF_LOG
+  /* Parameters that must change together */
+  reset_counters();
+  failed = 0;
+  for(j = 0; j < TRANSACTIONS; j++) {
+    settings_transaction_begin();
+    for(i = j % 4; i < PARAMETERS; i += PARAMETERS / 4) {
+      new_value(i, sizes[i]);
+      failed += !set(i);
+    }
+    settings_transaction_commit();
+  }
+  /* And a transaction that is abandoned */
+  settings_transaction_begin();
+  settings_set(key(0), (uint8_t *)"abandoned", 9);
+  settings_transaction_abort();
+  printf("commit   %d/%d failed, %lu bytes written\n",
+         failed, TRANSACTIONS, written_bytes);
+
+  settings_get_stats(&stats);
+  printf("stats    %u compactions, %u of %u bytes used, %u live\n",
+         stats.compactions, stats.used, stats.size, stats.live);
+#endif /* SETTINGS_CONF_LOG */
+
+  printf("verify   %d parameters wrong\n", verify());
+
+#if SETTINGS_CONF_LOG
+  /* Start a background compaction of a few values, and wipe the store
+     before it has copied them all */
+  for(i = WIPE_PARAMETERS; i < PARAMETERS; i++) {
+    if(stored[i]) {
+      settings_delete(key(i), 0);
+      stored[i] = 0;
+    }
+  }
+  settings_get_stats(&stats);
+  while(stats.size - stats.used > stats.size / 4) {
+    new_value(0, sizes[0]);
+    set(0);
+    settings_get_stats(&stats);
+  }
+  compactions = stats.compactions;
+  PROCESS_PAUSE();
+  settings_get_stats(&stats);
+  if(stats.compactions != compactions) {
+    printf("The compaction was not interrupted\n");
+  }
+  settings_wipe();
+  memset(stored, 0, sizeof(stored));
+  settings_get_stats(&stats);
+  printf("wipe     %u values left, %d parameters wrong\n",
+         stats.values, verify());
+#endif /* SETTINGS_CONF_LOG */
+
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
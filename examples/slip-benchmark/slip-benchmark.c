@@ -0,0 +1,352 @@
+/*
+ * Copyright (c) 2016, Thingsquare, http://www.thingsquare.com/.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file
+ *         Measures the SLIP input path and the ring buffers that UART
+ *         drivers use. SLIP packets are fed to the driver one byte at
+ *         a time, as from a UART interrupt, or in spans, as from DMA,
+ *         and decoded by the SLIP process. The ring buffers move bytes
+ *         one at a time and in blocks, and a writer thread checks the
+ *         ringbuf16 library with a concurrent reader.
+ */
+
+#include "contiki.h"
+#include "contiki-net.h"
+#include "dev/slip.h"
+#include "lib/ringbuf.h"
+#include "lib/ringbuf16.h"
+#include "lib/random.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef SLIP_BENCHMARK_PACKETS
+#define SLIP_BENCHMARK_PACKETS 100000UL
+#endif
+#ifndef SLIP_BENCHMARK_PACKET_LEN
+#define SLIP_BENCHMARK_PACKET_LEN 400
+#endif
+/* Bytes per slip_input() call, or 1 for slip_input_byte() */
+#ifndef SLIP_BENCHMARK_SPAN
+#define SLIP_BENCHMARK_SPAN 64
+#endif
+#ifndef SLIP_BENCHMARK_RING_BYTES
+#define SLIP_BENCHMARK_RING_BYTES (64UL * 1024 * 1024)
+#endif
+
+#define SLIP_END     0300
+#define SLIP_ESC     0333
+#define SLIP_ESC_END 0334
+#define SLIP_ESC_ESC 0335
+
+#define DIFFERENT_PACKETS 64
+#define BLOCK 64
+
+static uint8_t packets[DIFFERENT_PACKETS][SLIP_BENCHMARK_PACKET_LEN];
+static uint8_t encoded[DIFFERENT_PACKETS][2 * SLIP_BENCHMARK_PACKET_LEN + 2];
+static uint16_t encoded_len[DIFFERENT_PACKETS];
+
+static const uint8_t *expected;
+static unsigned long received, wrong;
+
+static uint8_t ring_data[32768];
+
+PROCESS(slip_benchmark_process, "slip benchmark");
+AUTOSTART_PROCESSES(&slip_benchmark_process);
+/*---------------------------------------------------------------------------*/
+static unsigned long
+usec(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+}
+/*---------------------------------------------------------------------------*/
+void
+slip_arch_writeb(unsigned char c)
+{
+}
+/*---------------------------------------------------------------------------*/
+void
+slip_benchmark_input(void)
+{
+  if(uip_len == SLIP_BENCHMARK_PACKET_LEN &&
+     memcmp(uip_buf, expected, SLIP_BENCHMARK_PACKET_LEN) == 0) {
+    received++;
+  } else {
+    wrong++;
+  }
+  uip_clear_buf();
+}
+/*---------------------------------------------------------------------------*/
+static void
+make_packets(void)
+{
+  uint8_t *p;
+  uint8_t c;
+  int i, j;
+
+  for(i = 0; i < DIFFERENT_PACKETS; i++) {
+    p = encoded[i];
+    *p++ = SLIP_END;
+    for(j = 0; j < SLIP_BENCHMARK_PACKET_LEN; j++) {
+      c = random_rand();
+      packets[i][j] = c;
+      if(c == SLIP_END) {
+        *p++ = SLIP_ESC;
+        c = SLIP_ESC_END;
+      } else if(c == SLIP_ESC) {
+        *p++ = SLIP_ESC;
+        c = SLIP_ESC_ESC;
+      }
+      *p++ = c;
+    }
+    *p++ = SLIP_END;
+    encoded_len[i] = p - encoded[i];
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+input(const uint8_t *data, uint16_t len)
+{
+#if SLIP_BENCHMARK_SPAN == 1
+  uint16_t i;
+
+  for(i = 0; i < len; i++) {
+    slip_input_byte(data[i]);
+  }
+#else /* SLIP_BENCHMARK_SPAN == 1 */
+  uint16_t n;
+
+  for(; len > 0; data += n, len -= n) {
+    n = len < SLIP_BENCHMARK_SPAN ? len : SLIP_BENCHMARK_SPAN;
+    slip_input(data, n);
+  }
+#endif /* SLIP_BENCHMARK_SPAN == 1 */
+}
+/*---------------------------------------------------------------------------*/
+static void
+run_slip(void)
+{
+  unsigned long i, start, input_time, decode_time;
+  int p;
+
+  received = wrong = 0;
+  input_time = decode_time = 0;
+  for(i = 0; i < SLIP_BENCHMARK_PACKETS; i++) {
+    p = i % DIFFERENT_PACKETS;
+    expected = packets[p];
+
+    start = usec();
+    input(encoded[p], encoded_len[p]);
+    input_time += usec() - start;
+
+    start = usec();
+    while(process_run() > 0);
+    decode_time += usec() - start;
+  }
+
+  if(SLIP_BENCHMARK_SPAN == 1) {
+    printf("slip_input_byte()\n");
+  } else {
+    printf("slip_input() with %d byte spans\n", SLIP_BENCHMARK_SPAN);
+  }
+  printf("input    %lu ns per packet\n",
+         input_time * 1000 / SLIP_BENCHMARK_PACKETS);
+  printf("decode   %lu ns per packet\n",
+         decode_time * 1000 / SLIP_BENCHMARK_PACKETS);
+  printf("verify   %lu/%lu packets right, %lu wrong\n",
+         received, SLIP_BENCHMARK_PACKETS, wrong);
+}
+/*---------------------------------------------------------------------------*/
+static void
+print_rate(const char *name, unsigned long elapsed, unsigned long errors)
+{
+  if(elapsed == 0) {
+    elapsed = 1;
+  }
+  printf("%-28s %5lu MB/s, %lu errors\n", name,
+         SLIP_BENCHMARK_RING_BYTES / elapsed, errors);
+}
+/*---------------------------------------------------------------------------*/
+static void
+run_ringbuf(void)
+{
+  static struct ringbuf r;
+  unsigned long moved, start, errors;
+  uint8_t in, out;
+  int c;
+
+  ringbuf_init(&r, ring_data, 128);
+  in = out = 0;
+  errors = 0;
+  start = usec();
+  for(moved = 0; moved < SLIP_BENCHMARK_RING_BYTES;) {
+    while(ringbuf_put(&r, in)) {
+      in++;
+    }
+    while((c = ringbuf_get(&r)) != -1) {
+      errors += c != out++;
+      moved++;
+    }
+  }
+  print_rate("ringbuf, 128 bytes", usec() - start, errors);
+}
+/*---------------------------------------------------------------------------*/
+static void
+run_ringbuf16(void)
+{
+  static struct ringbuf16 r;
+  static uint8_t block[BLOCK];
+  unsigned long moved, start, errors;
+  uint16_t i, n;
+  uint8_t in, out;
+  int c;
+
+  ringbuf16_init(&r, ring_data, 1024);
+  in = out = 0;
+  errors = 0;
+  start = usec();
+  for(moved = 0; moved < SLIP_BENCHMARK_RING_BYTES;) {
+    while(ringbuf16_put(&r, in)) {
+      in++;
+    }
+    while((c = ringbuf16_get(&r)) != -1) {
+      errors += c != out++;
+      moved++;
+    }
+  }
+  print_rate("ringbuf16, 1024 bytes", usec() - start, errors);
+
+  in = out = 0;
+  errors = 0;
+  start = usec();
+  for(moved = 0; moved < SLIP_BENCHMARK_RING_BYTES;) {
+    do {
+      for(i = 0; i < BLOCK; i++) {
+        block[i] = in + i;
+      }
+      n = ringbuf16_put_n(&r, block, BLOCK);
+      in += n;
+    } while(n == BLOCK);
+    while((n = ringbuf16_get_n(&r, block, BLOCK)) > 0) {
+      for(i = 0; i < n; i++) {
+        errors += block[i] != out++;
+      }
+      moved += n;
+    }
+  }
+  print_rate("ringbuf16, 64 byte blocks", usec() - start, errors);
+}
+/*---------------------------------------------------------------------------*/
+static struct ringbuf16 shared;
+
+static void *
+writer(void *arg)
+{
+  unsigned long written;
+  uint8_t *ptr;
+  uint16_t i, n;
+  uint8_t in;
+
+  in = 0;
+  for(written = 0; written < SLIP_BENCHMARK_RING_BYTES; written += n) {
+    /* Write as a DMA-fed driver would, into the free space */
+    n = ringbuf16_peek_put(&shared, &ptr);
+    if(n == 0) {
+      sched_yield();
+    }
+    if(n > SLIP_BENCHMARK_RING_BYTES - written) {
+      n = SLIP_BENCHMARK_RING_BYTES - written;
+    }
+    for(i = 0; i < n; i++) {
+      ptr[i] = in++;
+    }
+    ringbuf16_commit_put(&shared, n);
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static void
+run_threads(void)
+{
+  static uint8_t block[BLOCK];
+  unsigned long moved, start, errors;
+  pthread_t thread;
+  uint16_t i, n;
+  uint8_t out;
+
+  ringbuf16_init(&shared, ring_data, 1024);
+  out = 0;
+  errors = 0;
+  start = usec();
+  pthread_create(&thread, NULL, writer, NULL);
+  for(moved = 0; moved < SLIP_BENCHMARK_RING_BYTES; moved += n) {
+    n = ringbuf16_get_n(&shared, block, random_rand() % BLOCK + 1);
+    if(n == 0) {
+      sched_yield();
+    }
+    for(i = 0; i < n; i++) {
+      errors += block[i] != out++;
+    }
+  }
+  pthread_join(thread, NULL);
+  print_rate("ringbuf16, two threads", usec() - start, errors);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(slip_benchmark_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  random_init(1);
+  make_packets();
+  process_start(&slip_process, NULL);
+
+  printf("%lu packets of %u bytes\n", SLIP_BENCHMARK_PACKETS,
+         SLIP_BENCHMARK_PACKET_LEN);
+  run_slip();
+
+  run_ringbuf();
+  run_ringbuf16();
+  run_threads();
+
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
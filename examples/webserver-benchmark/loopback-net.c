@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2016, Texas Instruments Incorporated - http://www.ti.com/
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/*---------------------------------------------------------------------------*/
+#include "contiki.h"
+#include "contiki-net.h"
+#include "loopback-net.h"
+
+#include <string.h>
+/*---------------------------------------------------------------------------*/
+#define QUEUE_LENGTH 32
+
+#define UIP_IP_BUF ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+
+struct packet {
+  clock_time_t due;
+  uint16_t len;
+  uint8_t data[UIP_BUFSIZE];
+};
+
+struct loopback_net_stats loopback_net_stats;
+
+static struct packet queue[QUEUE_LENGTH];
+static uint8_t queue_head;
+static uint8_t queue_count;
+static clock_time_t link_delay;
+static struct etimer et;
+
+PROCESS(loopback_net_process, "Loopback link");
+/*---------------------------------------------------------------------------*/
+static uint8_t
+output(const uip_lladdr_t *lladdr)
+{
+  struct packet *p;
+
+  if(UIP_IP_BUF->proto != UIP_PROTO_TCP || queue_count == QUEUE_LENGTH) {
+    return 0;
+  }
+
+  p = &queue[(queue_head + queue_count) % QUEUE_LENGTH];
+  p->due = clock_time() + link_delay;
+  p->len = uip_len;
+  memcpy(p->data, uip_buf, uip_len);
+  queue_count++;
+
+  loopback_net_stats.frames++;
+  loopback_net_stats.bytes += uip_len;
+
+  process_poll(&loopback_net_process);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(loopback_net_process, ev, data)
+{
+  struct packet *p;
+
+  PROCESS_BEGIN();
+
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL ||
+                             ev == PROCESS_EVENT_TIMER);
+
+    while(queue_count > 0 && queue[queue_head].due <= clock_time()) {
+      p = &queue[queue_head];
+      memcpy(uip_buf, p->data, p->len);
+      uip_len = p->len;
+      queue_head = (queue_head + 1) % QUEUE_LENGTH;
+      queue_count--;
+      tcpip_input();
+    }
+
+    if(queue_count > 0) {
+      etimer_set(&et, queue[queue_head].due - clock_time());
+    }
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+void
+loopback_net_init(clock_time_t delay)
+{
+  link_delay = delay;
+  tcpip_set_outputfunc(output);
+  process_start(&loopback_net_process, NULL);
+}
+/*---------------------------------------------------------------------------*/
+void
+loopback_net_get_addr(uip_ipaddr_t *addr)
+{
+  uip_ipaddr_copy(addr, &uip_ds6_get_link_local(-1)->ipaddr);
+  if(uip_ds6_nbr_lookup(addr) == NULL) {
+    uip_ds6_nbr_add(addr, &uip_lladdr, 0, NBR_REACHABLE,
+                    NBR_TABLE_REASON_UNDEFINED, NULL);
+  }
+}
+/*---------------------------------------------------------------------------*/
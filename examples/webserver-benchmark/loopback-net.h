@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2016, Texas Instruments Incorporated - http://www.ti.com/
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/*---------------------------------------------------------------------------*/
+/**
+ * \file
+ *    A loopback link for the web server benchmark. TCP segments sent by
+ *    uIP are delivered back to uIP after a fixed delay, so that clients
+ *    and a server in the same node can talk over a link with a known round
+ *    trip time. Other packets, such as neighbor discovery, are dropped.
+ */
+/*---------------------------------------------------------------------------*/
+#ifndef LOOPBACK_NET_H_
+#define LOOPBACK_NET_H_
+/*---------------------------------------------------------------------------*/
+#include "contiki.h"
+#include "contiki-net.h"
+/*---------------------------------------------------------------------------*/
+struct loopback_net_stats {
+  /* TCP segments sent over the link, in both directions */
+  uint32_t frames;
+  /* Bytes of those segments, including the IPv6 and TCP headers */
+  uint32_t bytes;
+};
+
+extern struct loopback_net_stats loopback_net_stats;
+
+/**
+ * \brief Takes over the output of uIP and starts delivering packets back
+ * \param delay One-way delay of the link
+ */
+void loopback_net_init(clock_time_t delay);
+
+/**
+ * \brief Makes the link-local address of this node reachable over the link
+ * \param addr Set to the address
+ */
+void loopback_net_get_addr(uip_ipaddr_t *addr);
+/*---------------------------------------------------------------------------*/
+#endif /* LOOPBACK_NET_H_ */
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,318 @@
+/*
+ * Copyright (c) 2016, Texas Instruments Incorporated - http://www.ti.com/
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/*---------------------------------------------------------------------------*/
+/**
+ * \file
+ *    Measures how many requests per second the web server answers when
+ *    several clients in the same node fetch a file at once, over a
+ *    loopback link with a fixed delay. By default the file comes from the
+ *    built-in file system, and the time httpd_fs_open() takes to find a
+ *    file is also measured. Built with HTTPD-CFS=1, the file is written
+ *    to CFS and served by httpd-cfs.c.
+ */
+/*---------------------------------------------------------------------------*/
+#include "contiki.h"
+#include "contiki-net.h"
+#include "tcp-socket.h"
+#include "webserver.h"
+#include "httpd.h"
+#include "loopback-net.h"
+#if WEBSERVER_BENCHMARK_CFS
+#include "cfs/cfs.h"
+#else /* WEBSERVER_BENCHMARK_CFS */
+#include "httpd-fs.h"
+#endif /* WEBSERVER_BENCHMARK_CFS */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+/*---------------------------------------------------------------------------*/
+#ifndef WEBSERVER_BENCHMARK_REQUESTS
+#define WEBSERVER_BENCHMARK_REQUESTS 500UL
+#endif
+/* One-way delay of the loopback link */
+#ifndef WEBSERVER_BENCHMARK_LINK_DELAY
+#define WEBSERVER_BENCHMARK_LINK_DELAY (CLOCK_SECOND / 200)
+#endif
+#ifndef WEBSERVER_BENCHMARK_LOOKUPS
+#define WEBSERVER_BENCHMARK_LOOKUPS 2000000UL
+#endif
+/* Length of the file served from CFS */
+#ifndef WEBSERVER_BENCHMARK_FILE_LEN
+#define WEBSERVER_BENCHMARK_FILE_LEN 4096
+#endif
+
+#define MAX_CLIENTS 8
+#define HTTP_PORT   80
+
+#if WEBSERVER_BENCHMARK_CFS
+#define FILE_NAME   "bench.bin"
+#define REQUEST     "GET /" FILE_NAME " HTTP/1.0\r\n\r\n"
+#else /* WEBSERVER_BENCHMARK_CFS */
+#define REQUEST     "GET /style.css HTTP/1.0\r\n\r\n"
+#endif /* WEBSERVER_BENCHMARK_CFS */
+/*---------------------------------------------------------------------------*/
+struct client {
+  struct tcp_socket socket;
+  uint8_t inbuf[128];
+  uint8_t outbuf[64];
+  uint32_t received;
+  uint8_t busy;
+};
+
+static struct client clients[MAX_CLIENTS];
+static uint8_t active_clients;
+static uip_ipaddr_t addr;
+
+static uint32_t requested;
+static uint32_t completed;
+static uint32_t errors;
+/* Bytes in every response, taken from the first one of a run */
+static uint32_t response_len;
+static clock_time_t start;
+
+#if !WEBSERVER_BENCHMARK_CFS
+/* The files of the built-in file system, and a name that is not there */
+static const char *names[] = {
+  "/index.html", "/style.css", "/404.html", "/header.html", "/footer.html",
+  "/files.shtml", "/processes.shtml", "/status.shtml", "/tcp.shtml",
+  "/upload.html", "/missing.html"
+};
+#endif /* !WEBSERVER_BENCHMARK_CFS */
+
+PROCESS(webserver_process, "Web server");
+PROCESS(webserver_benchmark_process, "Web server benchmark");
+AUTOSTART_PROCESSES(&webserver_process, &webserver_benchmark_process);
+/*---------------------------------------------------------------------------*/
+void
+webserver_log(char *msg)
+{
+}
+/*---------------------------------------------------------------------------*/
+void
+webserver_log_file(uip_ipaddr_t *requester, char *file)
+{
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(webserver_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  httpd_init();
+
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == tcpip_event);
+    httpd_appcall(data);
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+static int
+input(struct tcp_socket *s, void *ptr, const uint8_t *data, int len)
+{
+  struct client *c = ptr;
+
+  c->received += len;
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+event(struct tcp_socket *s, void *ptr, tcp_socket_event_t ev)
+{
+  struct client *c = ptr;
+
+  if(ev == TCP_SOCKET_CONNECTED) {
+    tcp_socket_send_str(s, REQUEST);
+    return;
+  }
+  if(ev == TCP_SOCKET_DATA_SENT || !c->busy) {
+    return;
+  }
+
+  /* The server closes the connection after the response */
+  if(ev != TCP_SOCKET_CLOSED) {
+    errors++;
+  } else if(response_len == 0) {
+    response_len = c->received;
+  } else if(c->received != response_len) {
+    errors++;
+  }
+  completed++;
+  c->busy = 0;
+  process_poll(&webserver_benchmark_process);
+}
+/*---------------------------------------------------------------------------*/
+static void
+start_requests(void)
+{
+  uint8_t i;
+
+  for(i = 0; i < active_clients; i++) {
+    if(!clients[i].busy && requested < WEBSERVER_BENCHMARK_REQUESTS) {
+      requested++;
+      clients[i].received = 0;
+      clients[i].busy = 1;
+      tcp_socket_connect(&clients[i].socket, &addr, HTTP_PORT);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+start_run(uint8_t n)
+{
+  active_clients = n;
+  requested = 0;
+  completed = 0;
+  errors = 0;
+  response_len = 0;
+  memset(&loopback_net_stats, 0, sizeof(loopback_net_stats));
+  start = clock_time();
+  start_requests();
+}
+/*---------------------------------------------------------------------------*/
+static void
+print_run(void)
+{
+  clock_time_t elapsed;
+
+  elapsed = clock_time() - start;
+  if(elapsed == 0) {
+    elapsed = 1;
+  }
+  printf("%u clients: %lu requests/s, %lu bytes and %lu frames per request",
+         active_clients,
+         (unsigned long)(completed * CLOCK_SECOND / elapsed),
+         (unsigned long)response_len,
+         (unsigned long)(loopback_net_stats.frames / completed));
+  if(errors > 0) {
+    printf(", %lu errors", (unsigned long)errors);
+  }
+  printf("\n");
+}
+/*---------------------------------------------------------------------------*/
+#if WEBSERVER_BENCHMARK_CFS
+static int
+write_file(void)
+{
+  static uint8_t buf[256];
+  int fd;
+  int i;
+
+  for(i = 0; i < sizeof(buf); i++) {
+    buf[i] = i;
+  }
+  cfs_remove(FILE_NAME);
+  fd = cfs_open(FILE_NAME, CFS_WRITE);
+  if(fd < 0) {
+    return -1;
+  }
+  for(i = 0; i < WEBSERVER_BENCHMARK_FILE_LEN; i += sizeof(buf)) {
+    if(cfs_write(fd, buf, sizeof(buf)) != sizeof(buf)) {
+      cfs_close(fd);
+      return -1;
+    }
+  }
+  cfs_close(fd);
+  return 0;
+}
+#else /* WEBSERVER_BENCHMARK_CFS */
+static void
+measure_lookups(void)
+{
+  struct httpd_fs_file file;
+  unsigned long i;
+  unsigned long found;
+  clock_time_t elapsed;
+
+  found = 0;
+  elapsed = clock_time();
+  for(i = 0; i < WEBSERVER_BENCHMARK_LOOKUPS; i++) {
+    found += httpd_fs_open(names[i % (sizeof(names) / sizeof(names[0]))],
+                           &file);
+  }
+  elapsed = clock_time() - elapsed;
+  if(elapsed == 0) {
+    elapsed = 1;
+  }
+  printf("httpd_fs_open: %lu lookups/s, %lu/%lu found\n",
+         WEBSERVER_BENCHMARK_LOOKUPS * CLOCK_SECOND / elapsed,
+         found, WEBSERVER_BENCHMARK_LOOKUPS);
+}
+#endif /* WEBSERVER_BENCHMARK_CFS */
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(webserver_benchmark_process, ev, data)
+{
+  static const uint8_t concurrency[] = { 1, 2, 4, 8 };
+  static uint8_t i;
+
+  PROCESS_BEGIN();
+
+#if WEBSERVER_BENCHMARK_CFS
+  if(write_file() < 0) {
+    printf("Could not write %s\n", FILE_NAME);
+    exit(1);
+  }
+  printf("Serving %u bytes from CFS\n", WEBSERVER_BENCHMARK_FILE_LEN);
+#else /* WEBSERVER_BENCHMARK_CFS */
+  measure_lookups();
+#endif /* WEBSERVER_BENCHMARK_CFS */
+
+  printf("%lu requests per run, link delay %lu ms\n",
+         (unsigned long)WEBSERVER_BENCHMARK_REQUESTS,
+         (unsigned long)(WEBSERVER_BENCHMARK_LINK_DELAY * 1000 / CLOCK_SECOND));
+
+  loopback_net_init(WEBSERVER_BENCHMARK_LINK_DELAY);
+  loopback_net_get_addr(&addr);
+
+  for(i = 0; i < MAX_CLIENTS; i++) {
+    tcp_socket_register(&clients[i].socket, &clients[i],
+                        clients[i].inbuf, sizeof(clients[i].inbuf),
+                        clients[i].outbuf, sizeof(clients[i].outbuf),
+                        input, event);
+  }
+
+  for(i = 0; i < sizeof(concurrency); i++) {
+    start_run(concurrency[i]);
+    while(completed < WEBSERVER_BENCHMARK_REQUESTS) {
+      PROCESS_WAIT_EVENT();
+      start_requests();
+    }
+    print_run();
+  }
+
+#if WEBSERVER_BENCHMARK_CFS
+  cfs_remove(FILE_NAME);
+#endif /* WEBSERVER_BENCHMARK_CFS */
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -178,6 +178,9 @@ doInterfaceActionsBeforeTick(void)
 static void
 doInterfaceActionsAfterTick(void)
 {
+  if(simCFSChanged) {
+    simInterfaceChanged = 1;
+  }
 }
 /*---------------------------------------------------------------------------*/
 SIM_INTERFACE(cfs_interface,
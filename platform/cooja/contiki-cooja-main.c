@@ -357,6 +357,105 @@ process_run_thread_loop(void *data)
     }
 }
 /*---------------------------------------------------------------------------*/
+static void
+tick(void)
+{
+  simProcessRunValue = 0;
+
+  /* Let all simulation interfaces act first */
+  doActionsBeforeTick();
+
+  /* Poll etimer process */
+  if(etimer_pending()) {
+    etimer_request_poll();
+  }
+
+  /* Let rtimers run.
+   * Sets simProcessRunValue */
+  cooja_mt_exec(&rtimer_thread);
+
+  if(simProcessRunValue == 0) {
+    /* Rtimers done: Let Contiki handle a few events.
+     * Sets simProcessRunValue */
+    cooja_mt_exec(&process_run_thread);
+  }
+
+  /* Let all simulation interfaces act before returning to java */
+  doActionsAfterTick();
+
+  /* Do we have any pending timers */
+  simEtimerPending = etimer_pending();
+
+  /* Save nearest expiration time */
+  simEtimerNextExpirationTime = etimer_next_expiration_time();
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * Returns the simulation time (us) at which COOJA would tick the mote
+ * next, as ContikiClock.java schedules it, or 0 if it would not.
+ */
+static rtimer_clock_t
+next_tick(rtimer_clock_t now, rtimer_clock_t mote_time)
+{
+  rtimer_clock_t next;
+  int64_t expiration;
+
+  next = 0;
+  if(simProcessRunValue != 0) {
+    next = now + 1000;
+  } else if(simEtimerPending) {
+    /* COOJA reads the expiration time as a 32-bit millisecond value */
+    expiration = (int64_t)(int32_t)simEtimerNextExpirationTime * 1000;
+    if(expiration <= (int64_t)mote_time) {
+      next = now + 1000;
+    } else {
+      next = now + (expiration - mote_time);
+    }
+  }
+  if(simRtimerPending &&
+     (next == 0 || simRtimerNextExpirationTime < next)) {
+    next = simRtimerNextExpirationTime;
+  }
+  return next;
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * Lets the mote run on its own until simFastForwardUntil, for as long
+ * as nothing it does needs to be seen by COOJA. This saves COOJA the
+ * JNI call and the copying of the mote memory for each tick that only
+ * advances timers and processes.
+ *
+ * The mote is ticked at the same simulation times as COOJA would
+ * have done, so the simulation runs the same as without
+ * fast-forward. simRtimerCurrentTicks is left at the time of the last
+ * tick, which is the time at which COOJA lets the interfaces act.
+ */
+static void
+fast_forward(void)
+{
+  rtimer_clock_t now;
+  rtimer_clock_t next;
+  rtimer_clock_t mote_time;
+
+  now = simRtimerCurrentTicks;
+  /* COOJA keeps the mote clock drift in whole milliseconds */
+  mote_time = (rtimer_clock_t)simCurrentTime * 1000 + now % 1000;
+
+  while(!simInterfaceChanged) {
+    next = next_tick(now, mote_time);
+    if(next <= now || next >= simFastForwardUntil) {
+      break;
+    }
+
+    mote_time += next - now;
+    now = next;
+    simRtimerCurrentTicks = now;
+    simCurrentTime = mote_time / 1000;
+
+    tick();
+  }
+}
+/*---------------------------------------------------------------------------*/
 /**
  * \brief      Initialize a mote by starting processes etc.
  * \param env  JNI Environment interface pointer
@@ -446,41 +545,22 @@ Java_org_contikios_cooja_corecomm_CLASSNAME_setMemory(JNIEnv *env, jobject obj,
  *             messages to the Java part are also handled (those which may need
  *             special attention).
  *
+ *             If simFastForwardUntil is set, the mote may be ticked several
+ *             times, see fast_forward().
+ *
  *             This is a JNI function and should only be called via the
  *             responsible Java part (MoteType.java).
  */
 JNIEXPORT void JNICALL
 Java_org_contikios_cooja_corecomm_CLASSNAME_tick(JNIEnv *env, jobject obj)
 {
-  simProcessRunValue = 0;
+  simInterfaceChanged = 0;
 
-  /* Let all simulation interfaces act first */
-  doActionsBeforeTick();
+  tick();
 
-  /* Poll etimer process */
-  if(etimer_pending()) {
-    etimer_request_poll();
+  if(simFastForwardUntil != 0) {
+    fast_forward();
   }
-
-  /* Let rtimers run.
-   * Sets simProcessRunValue */
-  cooja_mt_exec(&rtimer_thread);
-
-  if(simProcessRunValue == 0) {
-    /* Rtimers done: Let Contiki handle a few events.
-     * Sets simProcessRunValue */
-    cooja_mt_exec(&process_run_thread);
-  }
-
-  /* Let all simulation interfaces act before returning to java */
-  doActionsAfterTick();
-
-  /* Do we have any pending timers */
-  simEtimerPending = etimer_pending();
-
-  /* Save nearest expiration time */
-  simEtimerNextExpirationTime = etimer_next_expiration_time();
-
 }
 /*---------------------------------------------------------------------------*/
 /**
@@ -98,6 +98,9 @@ doInterfaceActionsBeforeTick(void)
 static void
 doInterfaceActionsAfterTick(void)
 {
+  if(simBeeped) {
+    simInterfaceChanged = 1;
+  }
 }
 /*-----------------------------------------------------------------------------------*/
 
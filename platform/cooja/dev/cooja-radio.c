@@ -64,6 +64,12 @@ int simLQI = 105;
 
 static const void *pending_data;
 
+/* The radio state that COOJA looks at after each tick */
+static char last_radio_hw_on;
+static char last_power;
+static int last_radio_channel;
+static int last_out_size;
+
 /* If we are in the polling mode, poll_mode is 1; otherwise 0 */
 static int poll_mode = 0; /* default 0, disabled */
 static int auto_ack = 0; /* AUTO_ACK is not supported; always 0 */
@@ -144,6 +150,11 @@ radio_off(void)
 static void
 doInterfaceActionsBeforeTick(void)
 {
+  last_radio_hw_on = simRadioHWOn;
+  last_power = simPower;
+  last_radio_channel = simRadioChannel;
+  last_out_size = simOutSize;
+
   if(!simRadioHWOn) {
     simInSize = 0;
     return;
@@ -161,6 +172,10 @@ doInterfaceActionsBeforeTick(void)
 static void
 doInterfaceActionsAfterTick(void)
 {
+  if(simRadioHWOn != last_radio_hw_on || simPower != last_power ||
+     simRadioChannel != last_radio_channel || simOutSize != last_out_size) {
+    simInterfaceChanged = 1;
+  }
 }
 /*---------------------------------------------------------------------------*/
 static int
@@ -92,6 +92,9 @@ doInterfaceActionsBeforeTick(void)
 static void
 doInterfaceActionsAfterTick(void)
 {
+  if(simEEPROMChanged) {
+    simInterfaceChanged = 1;
+  }
 }
 /*-----------------------------------------------------------------------------------*/
 
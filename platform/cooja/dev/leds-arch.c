@@ -48,6 +48,7 @@ unsigned char leds_arch_get() {
 void leds_arch_set(unsigned char leds) {
   if(leds != simLedsValue) {
     simLedsValue = leds;
+    simInterfaceChanged = 1;
   }
 }
 /*-----------------------------------------------------------------------------------*/
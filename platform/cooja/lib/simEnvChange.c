@@ -38,6 +38,9 @@ extern const struct simInterface *simInterfaces[];
 
 char simDontFallAsleep = 0;
 
+rtimer_clock_t simFastForwardUntil = 0;
+char simInterfaceChanged;
+
 int simProcessRunValue;
 int simEtimerPending;
 clock_time_t simEtimerNextExpirationTime;
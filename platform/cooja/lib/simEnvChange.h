@@ -44,10 +44,20 @@ extern int simProcessRunValue;
 extern int simEtimerPending;
 extern clock_time_t simEtimerNextExpirationTime;
 extern clock_time_t simCurrentTime;
+extern int simRtimerPending;
+extern rtimer_clock_t simRtimerNextExpirationTime;
+extern rtimer_clock_t simRtimerCurrentTicks;
 
 // Variable that when set to != 0, stops the mote from falling asleep next tick
 extern char simDontFallAsleep;
 
+// Simulation time (us) until which a tick may run the mote on its own, 0 if not
+extern rtimer_clock_t simFastForwardUntil;
+
+// Set by the interfaces when the mote has done something that the
+// simulator must see at the time it happens, such as logging output
+extern char simInterfaceChanged;
+
 // Definition for registering an interface
 #define SIM_INTERFACE(name, doActionsBeforeTick, doActionsAfterTick) \
 const struct simInterface name = { doActionsBeforeTick, doActionsAfterTick }
@@ -99,6 +99,9 @@ doInterfaceActionsBeforeTick(void)
 static void
 doInterfaceActionsAfterTick(void)
 {
+  if(simLoggedFlag) {
+    simInterfaceChanged = 1;
+  }
 }
 /*-----------------------------------------------------------------------------------*/
 static int log_putchar_with_slip;
@@ -44,9 +44,15 @@ struct select_callback {
 };
 int select_set_callback(int fd, const struct select_callback *callback);
 
+/* Wakes up the main loop, so that process_poll() works from signal
+   handlers and other threads while the main loop sleeps */
+void select_wakeup(void);
+#define PROCESS_CONF_POLL_NOTIFY() select_wakeup()
+
 #define CC_CONF_REGISTER_ARGS          1
 #define CC_CONF_FUNCTION_POINTER_ARGS  1
 #define CC_CONF_VA_ARGS                1
+#define CC_CONF_MEMORY_BARRIER()       __atomic_thread_fence(__ATOMIC_ACQ_REL)
 /*#define CC_CONF_INLINE                 inline*/
 
 #ifndef EEPROM_CONF_SIZE
@@ -43,8 +43,11 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/select.h>
 #include <errno.h>
 
@@ -75,12 +78,41 @@
 #ifdef SELECT_CONF_MAX
 #define SELECT_MAX SELECT_CONF_MAX
 #else
-#define SELECT_MAX 8
+#define SELECT_MAX 16
 #endif
 
+/* Wait with epoll instead of select. Either way, the main loop sleeps
+   until an fd is ready, the next etimer expires, or select_wakeup()
+   is called. */
+#ifdef SELECT_CONF_EPOLL
+#define SELECT_EPOLL SELECT_CONF_EPOLL
+#elif defined(__linux__)
+#define SELECT_EPOLL 1
+#else
+#define SELECT_EPOLL 0
+#endif
+
+#if SELECT_EPOLL
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif /* SELECT_EPOLL */
+
 static const struct select_callback *select_callback[SELECT_MAX];
 static int select_max = 0;
 
+/* An eventfd, or the read and write ends of a pipe without epoll */
+static int wakeup_fd[2] = { -1, -1 };
+static volatile int sleeping;
+
+#if SELECT_EPOLL
+static int epoll_fd = -1;
+/* The events each fd is registered for with epoll */
+static uint32_t epoll_events[SELECT_MAX];
+/* Files that epoll does not support, such as regular files. As with
+   select, they are always ready. */
+static fd_set epoll_unsupported;
+#endif /* SELECT_EPOLL */
+
 SENSORS(&pir_sensor, &vib_sensor, &button_sensor);
 
 static uint8_t serial_id[] = {0x01,0x02,0x03,0x04,0x05,0x06,0x07,0x08};
@@ -101,6 +133,15 @@ select_set_callback(int fd, const struct select_callback *callback)
 
     select_callback[fd] = callback;
 
+#if SELECT_EPOLL
+    /* The fd may have been closed and reopened since it was added */
+    if(epoll_events[fd] != 0 && !FD_ISSET(fd, &epoll_unsupported)) {
+      epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+    }
+    epoll_events[fd] = 0;
+    FD_CLR(fd, &epoll_unsupported);
+#endif /* SELECT_EPOLL */
+
     /* Update fd max */
     if(callback != NULL) {
       if(fd > select_max) {
@@ -120,6 +161,210 @@ select_set_callback(int fd, const struct select_callback *callback)
   return 0;
 }
 /*---------------------------------------------------------------------------*/
+void
+select_wakeup(void)
+{
+  static const uint64_t one = 1;
+
+  /* Pairs with the barrier in select_wait(): either it sees the poll
+     request before it sleeps, or we see that it sleeps. */
+  __sync_synchronize();
+  if(sleeping) {
+    /* A failed write means the fd is already readable */
+    if(write(wakeup_fd[1], &one, sizeof(one)) < 0) {
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+select_init(void)
+{
+#if SELECT_EPOLL
+  struct epoll_event ev;
+
+  epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  wakeup_fd[0] = wakeup_fd[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if(epoll_fd < 0 || wakeup_fd[0] < 0) {
+    perror("select_init");
+    exit(1);
+  }
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.fd = wakeup_fd[0];
+  epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wakeup_fd[0], &ev);
+#else /* SELECT_EPOLL */
+  if(pipe(wakeup_fd) < 0) {
+    perror("select_init");
+    exit(1);
+  }
+  fcntl(wakeup_fd[0], F_SETFL, O_NONBLOCK);
+  fcntl(wakeup_fd[1], F_SETFL, O_NONBLOCK);
+#endif /* SELECT_EPOLL */
+}
+/*---------------------------------------------------------------------------*/
+/* How long the main loop may sleep, in milliseconds, or -1 if nothing
+   but an fd or select_wakeup() can give it anything to do */
+static int
+sleep_time(void)
+{
+  clock_time_t now;
+  clock_time_t left;
+
+  if(process_nevents() > 0) {
+    return 0;
+  }
+  if(!etimer_pending()) {
+    return -1;
+  }
+
+  now = clock_time();
+  left = etimer_next_expiration_time() - now;
+  if(left == 0 || left > (clock_time_t)-1 / 2) {
+    /* Expires now or has already expired */
+    return 0;
+  }
+  if(left > (clock_time_t)INT_MAX / 1000) {
+    return INT_MAX;
+  }
+  return (left * 1000 + CLOCK_SECOND - 1) / CLOCK_SECOND;
+}
+/*---------------------------------------------------------------------------*/
+#if SELECT_EPOLL
+static void
+epoll_update(int fd, uint32_t events)
+{
+  struct epoll_event ev;
+
+  memset(&ev, 0, sizeof(ev));
+  ev.events = events;
+  ev.data.fd = fd;
+  if(FD_ISSET(fd, &epoll_unsupported)) {
+    /* Nothing to tell epoll */
+  } else if(events == 0) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+  } else if(epoll_events[fd] == 0 ||
+            (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev) < 0 &&
+             errno == ENOENT)) {
+    /* Closing an fd removes it from epoll, so it may be gone already */
+    if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+      if(errno == EPERM) {
+        FD_SET(fd, &epoll_unsupported);
+      } else {
+        perror("epoll_ctl");
+        events = 0;
+      }
+    }
+  }
+  epoll_events[fd] = events;
+}
+#endif /* SELECT_EPOLL */
+/*---------------------------------------------------------------------------*/
+/* Sleeps until there is something to do and calls the fd callbacks */
+static void
+select_wait(void)
+{
+  fd_set fdr;
+  fd_set fdw;
+  int maxfd;
+  int i;
+  int retval;
+  int timeout;
+  uint64_t drain;
+#if SELECT_EPOLL
+  struct epoll_event events[SELECT_MAX + 1];
+  int nevents;
+  int unsupported;
+  uint32_t ev;
+#else /* SELECT_EPOLL */
+  struct timeval tv;
+#endif /* SELECT_EPOLL */
+
+  FD_ZERO(&fdr);
+  FD_ZERO(&fdw);
+  maxfd = 0;
+  for(i = 0; i <= select_max; i++) {
+    if(select_callback[i] != NULL && select_callback[i]->set_fd(&fdr, &fdw)) {
+      maxfd = i;
+    }
+  }
+
+  sleeping = 1;
+  __sync_synchronize();
+  timeout = sleep_time();
+
+#if SELECT_EPOLL
+  for(i = 0; i < SELECT_MAX; i++) {
+    ev = (FD_ISSET(i, &fdr) ? EPOLLIN : 0) | (FD_ISSET(i, &fdw) ? EPOLLOUT : 0);
+    if(ev != epoll_events[i]) {
+      epoll_update(i, ev);
+    }
+    if(ev != 0 && FD_ISSET(i, &epoll_unsupported)) {
+      timeout = 0;
+    }
+  }
+
+  nevents = epoll_wait(epoll_fd, events, SELECT_MAX + 1, timeout);
+  sleeping = 0;
+
+  /* Fds epoll does not support are left set for their callbacks */
+  unsupported = 0;
+  for(i = 0; i < SELECT_MAX; i++) {
+    if(!FD_ISSET(i, &epoll_unsupported)) {
+      FD_CLR(i, &fdr);
+      FD_CLR(i, &fdw);
+    } else if(FD_ISSET(i, &fdr) || FD_ISSET(i, &fdw)) {
+      unsupported++;
+    }
+  }
+  for(i = 0; i < nevents; i++) {
+    if(events[i].data.fd == wakeup_fd[0]) {
+      while(read(wakeup_fd[0], &drain, sizeof(drain)) > 0);
+      continue;
+    }
+    /* Errors and hangups are reported to whichever side waits */
+    ev = events[i].events;
+    if(ev & (EPOLLERR | EPOLLHUP)) {
+      ev |= epoll_events[events[i].data.fd];
+    }
+    if(ev & EPOLLIN) {
+      FD_SET(events[i].data.fd, &fdr);
+    }
+    if(ev & EPOLLOUT) {
+      FD_SET(events[i].data.fd, &fdw);
+    }
+  }
+  retval = nevents < 0 ? nevents : nevents + unsupported;
+#else /* SELECT_EPOLL */
+  FD_SET(wakeup_fd[0], &fdr);
+  if(timeout >= 0) {
+    tv.tv_sec = timeout / 1000;
+    tv.tv_usec = (timeout % 1000) * 1000;
+  }
+
+  retval = select((maxfd > wakeup_fd[0] ? maxfd : wakeup_fd[0]) + 1,
+                  &fdr, &fdw, NULL, timeout >= 0 ? &tv : NULL);
+  sleeping = 0;
+
+  if(retval > 0 && FD_ISSET(wakeup_fd[0], &fdr)) {
+    while(read(wakeup_fd[0], &drain, sizeof(drain)) > 0);
+    FD_CLR(wakeup_fd[0], &fdr);
+  }
+#endif /* SELECT_EPOLL */
+
+  if(retval < 0) {
+    if(errno != EINTR) {
+      perror("select");
+    }
+  } else if(retval > 0) {
+    /* timeout => retval == 0 */
+    for(i = 0; i <= maxfd; i++) {
+      if(select_callback[i] != NULL) {
+        select_callback[i]->handle_fd(&fdr, &fdw);
+      }
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
 static int
 stdin_set_fd(fd_set *rset, fd_set *wset)
 {
@@ -130,9 +375,16 @@ static void
 stdin_handle_fd(fd_set *rset, fd_set *wset)
 {
   char c;
+  int n;
   if(FD_ISSET(STDIN_FILENO, rset)) {
-    if(read(STDIN_FILENO, &c, 1) > 0) {
+    n = read(STDIN_FILENO, &c, 1);
+    if(n > 0) {
       serial_line_input_byte(c);
+    } else if(!isatty(STDIN_FILENO) &&
+              (n == 0 || (errno != EAGAIN && errno != EINTR))) {
+      /* Input from a file or /dev/null has ended, and would otherwise
+         keep the main loop from ever sleeping */
+      select_set_callback(STDIN_FILENO, NULL);
     }
   }
 }
@@ -201,6 +453,7 @@ main(int argc, char **argv)
 #endif
 #endif
 
+  select_init();
   process_init();
   process_start(&etimer_process, NULL);
   ctimer_init();
@@ -251,40 +504,9 @@ main(int argc, char **argv)
 
   select_set_callback(STDIN_FILENO, &stdin_fd);
   while(1) {
-    fd_set fdr;
-    fd_set fdw;
-    int maxfd;
-    int i;
-    int retval;
-    struct timeval tv;
-
-    retval = process_run();
+    process_run();
 
-    tv.tv_sec = 0;
-    tv.tv_usec = retval ? 1 : 1000;
-
-    FD_ZERO(&fdr);
-    FD_ZERO(&fdw);
-    maxfd = 0;
-    for(i = 0; i <= select_max; i++) {
-      if(select_callback[i] != NULL && select_callback[i]->set_fd(&fdr, &fdw)) {
-        maxfd = i;
-      }
-    }
-
-    retval = select(maxfd + 1, &fdr, &fdw, NULL, &tv);
-    if(retval < 0) {
-      if(errno != EINTR) {
-        perror("select");
-      }
-    } else if(retval > 0) {
-      /* timeout => retval == 0 */
-      for(i = 0; i <= maxfd; i++) {
-        if(select_callback[i] != NULL) {
-          select_callback[i]->handle_fd(&fdr, &fdw);
-        }
-      }
-    }
+    select_wait();
 
     etimer_request_poll();
 
@@ -112,6 +112,10 @@ public class Simulation extends Observable implements Runnable {
   private boolean hasPollRequests = false;
   private ArrayDeque<Runnable> pollRequests = new ArrayDeque<Runnable>();
 
+  /* A mote that has run ahead of the simulation, see setRunAhead() */
+  private Runnable runAheadCatchUp = null;
+  private long runAheadTime;
+
 
   /**
    * Request poll from simulation thread.
@@ -192,9 +196,39 @@ public class Simulation extends Observable implements Runnable {
       /* TODO Strict scheduling from simulation thread */
       assert isSimulationThread() : "Scheduling event from non-simulation thread: " + e;
     }
+    if (runAheadCatchUp != null && time < runAheadTime) {
+      catchUpRunAhead();
+    }
     eventQueue.addEvent(e, time);
   }
 
+  /**
+   * Registers a mote that has run ahead of the simulation, up to a time
+   * before the next event. The mote is caught up before anything else
+   * can reach it: before an event is scheduled before that time, before
+   * poll requests are handled, and when the simulation stops.
+   * Since a mote runs ahead no further than the next event, only one
+   * mote at a time can be ahead.
+   *
+   * @param catchUp Brings the mote to the current time, or null when it is there
+   * @param time Time the mote has run ahead to
+   */
+  public void setRunAhead(Runnable catchUp, long time) {
+    if (catchUp != null) {
+      catchUpRunAhead();
+    }
+    runAheadCatchUp = catchUp;
+    runAheadTime = time;
+  }
+
+  private void catchUpRunAhead() {
+    Runnable r = runAheadCatchUp;
+    if (r != null) {
+      runAheadCatchUp = null;
+      r.run();
+    }
+  }
+
   private TimeEvent delayEvent = new TimeEvent(0) {
     public void execute(long t) {
       if (speedLimitNone) {
@@ -243,9 +277,21 @@ public class Simulation extends Observable implements Runnable {
     }
   };
 
+  /**
+   * @return Time of the next scheduled event, or -1 if none
+   */
+  public long getNextEventTime() {
+    TimeEvent e = eventQueue.peekFirst();
+    if (e == null) {
+      return -1;
+    }
+    return e.getTime();
+  }
+
   public void clearEvents() {
     eventQueue.removeAll();
     pollRequests.clear();
+    runAheadCatchUp = null;
   }
 
   public void run() {
@@ -264,6 +310,9 @@ public class Simulation extends Observable implements Runnable {
       while (isRunning) {
 
         /* Handle all poll requests */
+        if (hasPollRequests) {
+          catchUpRunAhead();
+        }
         while (hasPollRequests) {
           popSimulationInvokes().run();
         }
@@ -284,6 +333,7 @@ public class Simulation extends Observable implements Runnable {
           isRunning = false;
         }
       }
+      catchUpRunAhead();
     } catch (RuntimeException e) {
     	if ("MSPSim requested simulation stop".equals(e.getMessage())) {
     		/* XXX Should be*/
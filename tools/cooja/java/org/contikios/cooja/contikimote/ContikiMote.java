@@ -38,10 +38,16 @@ import org.jdom.Element;
 import org.contikios.cooja.Mote;
 import org.contikios.cooja.MoteInterface;
 import org.contikios.cooja.MoteInterfaceHandler;
+import org.contikios.cooja.MoteTimeEvent;
 import org.contikios.cooja.MoteType;
 import org.contikios.cooja.mote.memory.SectionMoteMemory;
 import org.contikios.cooja.Simulation;
+import org.contikios.cooja.TimeEvent;
+import org.contikios.cooja.contikimote.interfaces.ContikiRadio;
+import org.contikios.cooja.interfaces.Clock;
+import org.contikios.cooja.interfaces.Radio;
 import org.contikios.cooja.mote.memory.MemoryInterface;
+import org.contikios.cooja.mote.memory.VarMemory;
 import org.contikios.cooja.motes.AbstractWakeupMote;
 
 /**
@@ -57,6 +63,13 @@ import org.contikios.cooja.motes.AbstractWakeupMote;
  * memory to the core, lets the Contiki system handle one event,
  * fetches the updated memory and finally polls all interfaces again.
  *
+ * With FAST_FORWARD set in the mote type configuration, the Contiki
+ * system may go on handling events on its own until the next event in
+ * the simulation, as long as it does nothing that the interfaces must
+ * see. The interfaces are then polled at the time the mote got to.
+ * Should anything reach the mote before that time, it is run again
+ * from where it was, up to the current time.
+ *
  * @author      Fredrik Osterlind
  */
 public class ContikiMote extends AbstractWakeupMote implements Mote {
@@ -66,6 +79,46 @@ public class ContikiMote extends AbstractWakeupMote implements Mote {
   private SectionMoteMemory myMemory = null;
   private MoteInterfaceHandler myInterfaceHandler = null;
 
+  private boolean fastForward = false;
+
+  /* Time of the last tick while the interfaces of a mote that ran
+   * ahead are polled, -1 otherwise */
+  private long lateTickTime = -1;
+
+  /* The memory before the last tick, to run the mote again if it is
+   * caught up before the time it ran ahead to */
+  private SectionMoteMemory rollbackMemory = null;
+
+  private TimeEvent afterTickEvent = new MoteTimeEvent(this, 0) {
+    public void execute(long t) {
+      getSimulation().setRunAhead(null, 0);
+      pollInterfacesAfterTick(t);
+    }
+    public String toString() {
+      return "AFTER TICK " + ContikiMote.this;
+    }
+  };
+
+  private Runnable catchUp = new Runnable() {
+    public void run() {
+      if (!afterTickEvent.isScheduled()) {
+        /* Removed from the simulation */
+        return;
+      }
+      afterTickEvent.remove();
+
+      /* Run the mote again, up to but not including the current time */
+      long now = getSimulation().getSimulationTime();
+      new VarMemory(rollbackMemory).setInt64ValueOf("simFastForwardUntil", now);
+      myType.setCoreMemory(rollbackMemory);
+      myType.tick();
+      myType.getCoreMemory(myMemory);
+
+      pollInterfacesAfterTick(
+          new VarMemory(myMemory).getInt64ValueOf("simRtimerCurrentTicks"));
+    }
+  };
+
   /**
    * Creates a new mote of given type.
    * Both the initial mote memory and the interface handler
@@ -79,6 +132,7 @@ public class ContikiMote extends AbstractWakeupMote implements Mote {
     this.myType = moteType;
     this.myMemory = moteType.createInitialMemory();
     this.myInterfaceHandler = new MoteInterfaceHandler(this, moteType.getMoteInterfaceClasses());
+    this.fastForward = moteType.getConfig().getBooleanValue(ContikiMote.class, "FAST_FORWARD", false);
 
     requestImmediateWakeup();
   }
@@ -104,6 +158,7 @@ public class ContikiMote extends AbstractWakeupMote implements Mote {
 
   public void setMemory(SectionMoteMemory memory) {
     myMemory = memory;
+    rollbackMemory = null;
   }
 
   @Override
@@ -138,6 +193,17 @@ public class ContikiMote extends AbstractWakeupMote implements Mote {
       return;
     }
 
+    if (fastForward) {
+      long until = getFastForwardTime();
+      if (until <= simTime) {
+        until = 0;
+      }
+      new VarMemory(myMemory).setInt64ValueOf("simFastForwardUntil", until);
+      if (until != 0) {
+        saveRollbackMemory();
+      }
+    }
+
     /* Copy mote memory to Contiki */
     myType.setCoreMemory(myMemory);
 
@@ -147,12 +213,88 @@ public class ContikiMote extends AbstractWakeupMote implements Mote {
     /* Copy mote memory from Contiki */
     myType.getCoreMemory(myMemory);
 
+    if (fastForward) {
+      long moteTime = new VarMemory(myMemory).getInt64ValueOf("simRtimerCurrentTicks");
+      if (moteTime > simTime) {
+        /* The mote ran ahead: poll mote interfaces at the time it got to */
+        getSimulation().scheduleEvent(afterTickEvent, moteTime);
+        getSimulation().setRunAhead(catchUp, moteTime);
+        return;
+      }
+    }
+
+    pollInterfacesAfterTick();
+  }
+
+  private void pollInterfacesAfterTick() {
     /* Poll mote interfaces */
     myMemory.pollForMemoryChanges();
     myInterfaceHandler.doActiveActionsAfterTick();
     myInterfaceHandler.doPassiveActionsAfterTick();
   }
 
+  /**
+   * Polls the interfaces of a mote that ran ahead, at the time of its
+   * last tick. The clock schedules the next tick from that time.
+   *
+   * @param tickTime Time of the last tick
+   */
+  private void pollInterfacesAfterTick(long tickTime) {
+    Clock clock = myInterfaceHandler.getClock();
+    clock.setTime(tickTime + clock.getDrift());
+    lateTickTime = tickTime;
+    pollInterfacesAfterTick();
+    lateTickTime = -1;
+  }
+
+  /**
+   * Returns the time of the tick whose interfaces are being polled.
+   * This is the simulation time, except for a mote that ran ahead and
+   * has been caught up, whose last tick was before the current time.
+   *
+   * @return Simulation time of the last tick
+   */
+  public long getTickTime() {
+    if (lateTickTime >= 0) {
+      return lateTickTime;
+    }
+    return getSimulation().getSimulationTime();
+  }
+
+  private void saveRollbackMemory() {
+    if (rollbackMemory == null) {
+      rollbackMemory = myMemory.clone();
+      return;
+    }
+    for (String name : myMemory.getSections().keySet()) {
+      byte[] from = myMemory.getSection(name).getMemory();
+      System.arraycopy(from, 0, rollbackMemory.getSection(name).getMemory(), 0, from.length);
+    }
+  }
+
+  /**
+   * Returns the time until which the mote may run on its own: the
+   * next event in the simulation, or the end of an ongoing radio
+   * transmission, which the radio interface handles after the next tick.
+   *
+   * @return Simulation time, or 0 if the mote must not run on its own
+   */
+  private long getFastForwardTime() {
+    long until = getSimulation().getNextEventTime();
+    if (until < 0) {
+      return 0;
+    }
+
+    Radio radio = myInterfaceHandler.getRadio();
+    if (radio instanceof ContikiRadio) {
+      long end = ((ContikiRadio) radio).getTransmissionEndTime();
+      if (end >= 0 && end < until) {
+        until = end;
+      }
+    }
+    return until;
+  }
+
   /**
    * Returns the current Contiki mote config represented by XML elements.
    * This config also includes all mote interface configs.
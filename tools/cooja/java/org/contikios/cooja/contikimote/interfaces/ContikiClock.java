@@ -134,7 +134,9 @@ public class ContikiClock extends Clock implements ContikiMoteInterface, PolledB
   }
 
   public void doActionsAfterTick() {
-    long currentSimulationTime = mote.getSimulation().getSimulationTime();
+    /* The time of the tick, which is behind the simulation when the
+     * mote ran ahead and has been caught up */
+    long currentSimulationTime = mote.getTickTime();
 
     /* Always schedule for Rtimer if anything pending */
     if (moteMem.getIntValueOf("simRtimerPending") != 0) {
@@ -174,6 +174,16 @@ public class ContikiRadio extends Radio implements ContikiMoteInterface, PolledA
     return isInterfered;
   }
 
+  /**
+   * @return End time of the ongoing transmission, or -1 if not transmitting
+   */
+  public long getTransmissionEndTime() {
+    if (!isTransmitting) {
+      return -1;
+    }
+    return transmissionEndTime;
+  }
+
   public int getChannel() {
     return myMoteMemory.getIntValueOf("simRadioChannel");
   }
@@ -0,0 +1,418 @@
+/*
+ * Copyright (c) 2026, Contiki contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/*
+ * Loopback throughput test for tunslip6 that needs no hardware.
+ *
+ * A pseudo terminal stands in for the serial line. tunslip6 is started
+ * on the slave side, and this program plays the part of the mote on
+ * the master side: it sends SLIP encoded ICMPv6 echo requests to the
+ * address of the tun interface and counts the echo replies the host
+ * kernel sends back through tunslip6. Every reply has therefore crossed
+ * tunslip6 twice, serial->tun and tun->serial.
+ *
+ * Needs to run as root, like tunslip6 itself:
+ *
+ *   make tunslip6 tunslip6-loopback
+ *   sudo ./tunslip6-loopback -n 100000 -w 32 -s 64 -l
+ */
+
+#define _XOPEN_SOURCE 600
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+#include <err.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <arpa/inet.h>
+
+#define SLIP_END      0300
+#define SLIP_ESC      0333
+#define SLIP_ESC_END  0334
+#define SLIP_ESC_ESC  0335
+
+#define IPV6_HDR_LEN   40
+#define ICMP6_HDR_LEN  8
+#define MAX_PAYLOAD    1200
+
+#define ICMP6_ECHO_REQUEST 128
+#define ICMP6_ECHO_REPLY   129
+
+static const char *tunslip6 = "./tunslip6";
+static const char *tundev = "tun9";
+static const char *prefix = "fd00:5119::";
+static unsigned long frames = 10000;
+static unsigned long window = 16;
+static int payload_len = 64;
+static int verbose = 0;
+static int latency = 0;
+
+static struct in6_addr host_addr, mote_addr;
+static pid_t child = -1;
+
+static unsigned long sent, received, lost;
+static uint16_t echo_id;
+/*---------------------------------------------------------------------------*/
+static double
+now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+/*---------------------------------------------------------------------------*/
+static uint16_t
+chksum(uint32_t sum, const uint8_t *data, int len)
+{
+  int i;
+
+  for(i = 0; i + 1 < len; i += 2) {
+    sum += (data[i] << 8) | data[i + 1];
+  }
+  if(len & 1) {
+    sum += data[len - 1] << 8;
+  }
+  while(sum >> 16) {
+    sum = (sum & 0xffff) + (sum >> 16);
+  }
+  return sum;
+}
+/*---------------------------------------------------------------------------*/
+static int
+build_echo(uint8_t *pkt, uint16_t seq)
+{
+  int icmp_len = ICMP6_HDR_LEN + payload_len;
+  uint8_t *icmp = pkt + IPV6_HDR_LEN;
+  uint32_t sum;
+  uint16_t c;
+
+  memset(pkt, 0, IPV6_HDR_LEN);
+  pkt[0] = 0x60;
+  pkt[4] = icmp_len >> 8;
+  pkt[5] = icmp_len & 0xff;
+  pkt[6] = 58; /* ICMPv6 */
+  pkt[7] = 64;
+  memcpy(&pkt[8], &mote_addr, 16);
+  memcpy(&pkt[24], &host_addr, 16);
+
+  icmp[0] = ICMP6_ECHO_REQUEST;
+  icmp[1] = 0;
+  icmp[2] = icmp[3] = 0;
+  icmp[4] = echo_id >> 8;
+  icmp[5] = echo_id & 0xff;
+  icmp[6] = seq >> 8;
+  icmp[7] = seq & 0xff;
+  memset(&icmp[8], 0xc0, payload_len); /* Plenty of SLIP_END to escape */
+
+  /* Pseudo header: addresses, upper layer length, next header */
+  sum = chksum(0, &pkt[8], 32);
+  sum += icmp_len + 58;
+  c = ~chksum(sum, icmp, icmp_len);
+  icmp[2] = c >> 8;
+  icmp[3] = c & 0xff;
+
+  return IPV6_HDR_LEN + icmp_len;
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_frame(int fd, const uint8_t *pkt, int len)
+{
+  static uint8_t buf[2 * (IPV6_HDR_LEN + ICMP6_HDR_LEN + MAX_PAYLOAD) + 2];
+  int i, n = 0, w;
+
+  buf[n++] = SLIP_END;
+  for(i = 0; i < len; i++) {
+    if(pkt[i] == SLIP_END) {
+      buf[n++] = SLIP_ESC;
+      buf[n++] = SLIP_ESC_END;
+    } else if(pkt[i] == SLIP_ESC) {
+      buf[n++] = SLIP_ESC;
+      buf[n++] = SLIP_ESC_ESC;
+    } else {
+      buf[n++] = pkt[i];
+    }
+  }
+  buf[n++] = SLIP_END;
+
+  for(i = 0; i < n; i += w) {
+    w = write(fd, buf + i, n - i);
+    if(w == -1) {
+      if(errno == EAGAIN || errno == EINTR) {
+        struct pollfd p = { fd, POLLOUT, 0 };
+        poll(&p, 1, 100);
+        w = 0;
+        continue;
+      }
+      err(1, "write pty");
+    }
+  }
+  sent++;
+}
+/*---------------------------------------------------------------------------*/
+static void
+frame_input(const uint8_t *pkt, int len)
+{
+  if(len < IPV6_HDR_LEN + ICMP6_HDR_LEN || (pkt[0] & 0xf0) != 0x60) {
+    /* Debug output from tunslip6 or unrelated traffic */
+    return;
+  }
+  if(pkt[6] != 58 || pkt[IPV6_HDR_LEN] != ICMP6_ECHO_REPLY) {
+    return;
+  }
+  if(((pkt[IPV6_HDR_LEN + 4] << 8) | pkt[IPV6_HDR_LEN + 5]) != echo_id) {
+    return;
+  }
+  received++;
+}
+/*---------------------------------------------------------------------------*/
+static void
+read_frames(int fd)
+{
+  static uint8_t frame[2048];
+  static int framelen, esc;
+  uint8_t buf[4096];
+  int i, n;
+
+  n = read(fd, buf, sizeof(buf));
+  if(n == -1) {
+    if(errno == EAGAIN || errno == EINTR) {
+      return;
+    }
+    err(1, "read pty (did tunslip6 exit?)");
+  }
+  for(i = 0; i < n; i++) {
+    uint8_t c = buf[i];
+    if(esc) {
+      esc = 0;
+      c = c == SLIP_ESC_END ? SLIP_END : c == SLIP_ESC_ESC ? SLIP_ESC : c;
+    } else if(c == SLIP_ESC) {
+      esc = 1;
+      continue;
+    } else if(c == SLIP_END) {
+      if(framelen > 0) {
+        frame_input(frame, framelen);
+      }
+      framelen = 0;
+      continue;
+    }
+    if((size_t)framelen < sizeof(frame)) {
+      frame[framelen++] = c;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+stop_child(void)
+{
+  int status;
+
+  if(child > 0) {
+    /* tunslip6 prints its latency histograms (-l) when exiting */
+    kill(child, SIGINT);
+    waitpid(child, &status, 0);
+    child = -1;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+start_tunslip6(void)
+{
+  struct termios tty;
+  char addr[INET6_ADDRSTRLEN + 4];
+  char *slave;
+  int master, fd;
+
+  master = posix_openpt(O_RDWR | O_NOCTTY);
+  if(master == -1 || grantpt(master) == -1 || unlockpt(master) == -1) {
+    err(1, "posix_openpt");
+  }
+  slave = ptsname(master);
+
+  /* Raw mode until tunslip6 has configured the line itself */
+  fd = open(slave, O_RDWR | O_NOCTTY);
+  if(fd == -1 || tcgetattr(fd, &tty) == -1) {
+    err(1, "open %s", slave);
+  }
+  cfmakeraw(&tty);
+  tcsetattr(fd, TCSANOW, &tty);
+
+  inet_ntop(AF_INET6, &host_addr, addr, INET6_ADDRSTRLEN);
+  strcat(addr, "/64");
+
+  child = fork();
+  if(child == -1) {
+    err(1, "fork");
+  } else if(child == 0) {
+    if(!verbose) {
+      int null = open("/dev/null", O_WRONLY);
+      dup2(null, STDOUT_FILENO);
+    }
+    close(master);
+    execl(tunslip6, tunslip6, latency ? "-S" : "-v0", "-v0", "-s", slave,
+          "-t", tundev, addr, (char *)NULL);
+    err(1, "exec %s", tunslip6);
+  }
+
+  atexit(stop_child);
+  close(fd);
+  fcntl(master, F_SETFL, O_NONBLOCK);
+  return master;
+}
+/*---------------------------------------------------------------------------*/
+static void
+usage(const char *prog)
+{
+  fprintf(stderr, "usage: %s [options]\n", prog);
+  fprintf(stderr, " -n frames      Number of echo requests (default %lu)\n", frames);
+  fprintf(stderr, " -w window      Requests in flight (default %lu)\n", window);
+  fprintf(stderr, " -s size        ICMPv6 payload bytes (default %d, max %d)\n",
+          payload_len, MAX_PAYLOAD);
+  fprintf(stderr, " -p prefix      /64 prefix for the tun interface (default %s)\n", prefix);
+  fprintf(stderr, " -t tundev      Name of interface (default %s)\n", tundev);
+  fprintf(stderr, " -x path        tunslip6 binary (default %s)\n", tunslip6);
+  fprintf(stderr, " -l             Run tunslip6 with per-frame latency histograms\n");
+  fprintf(stderr, " -v             Show tunslip6 output\n");
+  exit(1);
+}
+/*---------------------------------------------------------------------------*/
+int
+main(int argc, char **argv)
+{
+  uint8_t pkt[IPV6_HDR_LEN + ICMP6_HDR_LEN + MAX_PAYLOAD];
+  struct pollfd pfd;
+  double start, deadline, elapsed;
+  int fd, c, len;
+
+  while((c = getopt(argc, argv, "n:w:s:p:t:x:lvh")) != -1) {
+    switch(c) {
+    case 'n':
+      frames = strtoul(optarg, NULL, 0);
+      break;
+    case 'w':
+      window = strtoul(optarg, NULL, 0);
+      break;
+    case 's':
+      payload_len = atoi(optarg);
+      break;
+    case 'p':
+      prefix = optarg;
+      break;
+    case 't':
+      tundev = optarg;
+      break;
+    case 'x':
+      tunslip6 = optarg;
+      break;
+    case 'l':
+      latency = 1;
+      break;
+    case 'v':
+      verbose = 1;
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  if(payload_len < 0 || payload_len > MAX_PAYLOAD || window == 0) {
+    usage(argv[0]);
+  }
+  if(inet_pton(AF_INET6, prefix, &host_addr) != 1) {
+    errx(1, "bad prefix %s", prefix);
+  }
+  memset(&host_addr.s6_addr[8], 0, 8);
+  mote_addr = host_addr;
+  host_addr.s6_addr[15] = 1;
+  mote_addr.s6_addr[15] = 2;
+  echo_id = getpid() & 0xffff;
+
+  signal(SIGINT, exit);
+  signal(SIGTERM, exit);
+
+  fd = start_tunslip6();
+  pfd.fd = fd;
+
+  /* Probe until the interface is configured and the host answers */
+  deadline = now() + 10;
+  while(received == 0) {
+    if(now() > deadline) {
+      errx(1, "no echo reply from %s, is tunslip6 running?", tundev);
+    }
+    len = build_echo(pkt, 0);
+    send_frame(fd, pkt, len);
+    pfd.events = POLLIN;
+    if(poll(&pfd, 1, 200) > 0) {
+      read_frames(fd);
+    }
+  }
+  /* Let late probe replies drain */
+  while(poll(&pfd, 1, 200) > 0) {
+    read_frames(fd);
+  }
+
+  sent = received = 0;
+  start = now();
+  while(received + lost < frames) {
+    if(sent < frames && sent - received - lost < window) {
+      len = build_echo(pkt, sent & 0xffff);
+      send_frame(fd, pkt, len);
+      continue;
+    }
+    pfd.events = POLLIN;
+    if(poll(&pfd, 1, 1000) > 0) {
+      read_frames(fd);
+    } else {
+      /* Nothing for a second: the outstanding requests are lost */
+      lost = sent - received;
+    }
+  }
+  elapsed = now() - start;
+
+  printf("%lu frames sent, %lu echoed, %lu lost in %.3f s, window %lu, %d byte payload\n",
+         sent, received, lost, elapsed, window, payload_len);
+  printf("%.0f frames/s per direction, %.0f frames/s through tunslip6\n",
+         received / elapsed, 2 * received / elapsed);
+  fflush(stdout);
+
+  stop_child();
+  return lost == 0 ? 0 : 1;
+}
+/*---------------------------------------------------------------------------*/
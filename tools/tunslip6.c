@@ -41,6 +41,8 @@
 #include <string.h>
 #include <time.h>
 #include <sys/types.h>
+#include <sys/time.h>
+#include <sys/uio.h>
 
 #include <unistd.h>
 #include <errno.h>
@@ -56,6 +58,14 @@
 
 #include <err.h>
 
+#ifdef linux
+#include <sys/epoll.h>
+#define USE_EPOLL 1
+#else
+#include <sys/select.h>
+#define USE_EPOLL 0
+#endif
+
 #include "tools-utils.h"
 
 #ifndef BAUDRATE
@@ -70,6 +80,7 @@ int slipfd = 0;
 uint16_t basedelay=0,delaymsec=0;
 uint32_t startsec,startmsec,delaystartsec,delaystartmsec;
 int timestamp = 0, flowcontrol=0, showprogress=0, flowcontrol_xonxoff=0;
+int latency_stats = 0;
 
 int ssystem(const char *fmt, ...)
      __attribute__((__format__ (__printf__, 1, 2)));
@@ -78,6 +89,18 @@ void write_to_serial(int outfd, void *inbuf, int len);
 void slip_send(int fd, unsigned char c);
 void slip_send_char(int fd, unsigned char c);
 
+/* Number of bytes requested from the serial line per read() */
+#define SERIAL_READ_SIZE 4096
+
+/* Max number of packets read from tun and sent as one serial write */
+#define TUN_BATCH 8
+
+/* Max number of iovec entries handed to one writev() */
+#define SLIP_IOV_MAX 256
+
+/* Latency histogram buckets: bucket i holds [2^(i-1), 2^i) us */
+#define LATENCY_BUCKETS 24
+
 #define PROGRESS(s) if(showprogress) fprintf(stderr, s)
 
 char tundev[1024] = { "" };
@@ -165,222 +188,398 @@ is_sensible_string(const unsigned char *s, int len)
 }
 
 /*
- * Read from serial, when we have a packet write it to tun. No output
- * buffering, input buffered by stdio.
+ * Per-frame latency histograms, enabled with -S. Serial to tun
+ * latency is measured from the read() that delivered the first byte
+ * of a frame until the frame has been written to tun. Tun to serial
+ * latency is measured from the read() from tun until the last byte
+ * of the encoded frame has been handed to the serial line.
  */
-void
-serial_to_tun(FILE *inslip, int outfd)
+struct latency_hist {
+  const char *name;
+  unsigned long count;
+  unsigned long long sum_us;
+  unsigned long long min_us;
+  unsigned long long max_us;
+  unsigned long bucket[LATENCY_BUCKETS];
+};
+
+static struct latency_hist rx_latency = { .name = "serial->tun" };
+static struct latency_hist tx_latency = { .name = "tun->serial" };
+
+static void
+latency_now(struct timespec *ts)
 {
-  static union {
-    unsigned char inbuf[2000];
-  } uip;
-  static int inbufptr = 0;
-  int ret,i;
-  unsigned char c;
+  clock_gettime(CLOCK_MONOTONIC, ts);
+}
 
-#ifdef linux
-  ret = fread(&c, 1, 1, inslip);
-  if(ret == -1 || ret == 0) err(1, "serial_to_tun: read");
-  goto after_fread;
-#endif
+static void
+latency_record(struct latency_hist *h, const struct timespec *start)
+{
+  struct timespec now;
+  unsigned long long us;
+  int i;
 
- read_more:
-  if(inbufptr >= sizeof(uip.inbuf)) {
-     if(timestamp) stamptime();
-     fprintf(stderr, "*** dropping large %d byte packet\n",inbufptr);
-	 inbufptr = 0;
+  latency_now(&now);
+  us = (now.tv_sec - start->tv_sec) * 1000000ULL;
+  us += now.tv_nsec / 1000;
+  us -= start->tv_nsec / 1000;
+
+  for(i = 0; i < LATENCY_BUCKETS - 1 && (us >> i) != 0; i++);
+  h->bucket[i]++;
+
+  if(h->count == 0 || us < h->min_us) {
+    h->min_us = us;
   }
-  ret = fread(&c, 1, 1, inslip);
-#ifdef linux
- after_fread:
-#endif
-  if(ret == -1) {
-    err(1, "serial_to_tun: read");
+  if(us > h->max_us) {
+    h->max_us = us;
   }
-  if(ret == 0) {
-    clearerr(inslip);
+  h->sum_us += us;
+  h->count++;
+}
+
+static void
+latency_print(const struct latency_hist *h)
+{
+  int i;
+
+  if(h->count == 0) {
+    fprintf(stderr, "*** %s latency: no frames\n", h->name);
     return;
   }
-  PROGRESS(".");
-  switch(c) {
-  case SLIP_END:
-    if(inbufptr > 0) {
-      if(uip.inbuf[0] == '!') {
-	if(uip.inbuf[1] == 'M') {
-	  /* Read gateway MAC address and autoconfigure tap0 interface */
-	  char macs[24];
-	  int i, pos;
-	  for(i = 0, pos = 0; i < 16; i++) {
-	    macs[pos++] = uip.inbuf[2 + i];
-	    if((i & 1) == 1 && i < 14) {
-	      macs[pos++] = ':';
-	    }
-	  }
-          if(timestamp) stamptime();
-	  macs[pos] = '\0';
-//	  printf("*** Gateway's MAC address: %s\n", macs);
-	  fprintf(stderr,"*** Gateway's MAC address: %s\n", macs);
-          if (timestamp) stamptime();
-	  ssystem("ifconfig %s down", tundev);
-          if (timestamp) stamptime();
-	  ssystem("ifconfig %s hw ether %s", tundev, &macs[6]);
-          if (timestamp) stamptime();
-	  ssystem("ifconfig %s up", tundev);
-	}
-      } else if(uip.inbuf[0] == '?') {
-	if(uip.inbuf[1] == 'P') {
-          /* Prefix info requested */
-          struct in6_addr addr;
-	  int i;
-	  char *s = strchr(ipaddr, '/');
-	  if(s != NULL) {
-	    *s = '\0';
-	  }
-          inet_pton(AF_INET6, ipaddr, &addr);
-          if(timestamp) stamptime();
-          fprintf(stderr,"*** Address:%s => %02x%02x:%02x%02x:%02x%02x:%02x%02x\n",
-		 ipaddr,
-		 addr.s6_addr[0], addr.s6_addr[1],
-		 addr.s6_addr[2], addr.s6_addr[3],
-		 addr.s6_addr[4], addr.s6_addr[5],
-		 addr.s6_addr[6], addr.s6_addr[7]);
-	  slip_send(slipfd, '!');
-	  slip_send(slipfd, 'P');
-	  for(i = 0; i < 8; i++) {
-	    /* need to call the slip_send_char for stuffing */
-	    slip_send_char(slipfd, addr.s6_addr[i]);
-	  }
-	  slip_send(slipfd, SLIP_END);
+  fprintf(stderr, "*** %s latency: %lu frames, min %llu us, avg %llu us, max %llu us\n",
+          h->name, h->count, h->min_us, h->sum_us / h->count, h->max_us);
+  for(i = 0; i < LATENCY_BUCKETS; i++) {
+    if(h->bucket[i] == 0) {
+      continue;
+    }
+    if(i == LATENCY_BUCKETS - 1) {
+      fprintf(stderr, "    >= %8lu us: %lu\n", 1UL << (i - 1), h->bucket[i]);
+    } else {
+      fprintf(stderr, "    < %9lu us: %lu\n", 1UL << i, h->bucket[i]);
+    }
+  }
+}
+
+static void
+latency_print_all(void)
+{
+  if(latency_stats) {
+    latency_print(&rx_latency);
+    latency_print(&tx_latency);
+  }
+}
+
+/*
+ * SLIP decoder state. Frames are decoded from whatever chunk the
+ * serial line returned, so a frame (or an escape sequence) may span
+ * several calls to serial_to_tun().
+ */
+static struct {
+  unsigned char inbuf[2000];
+} uip;
+static int inbufptr = 0;
+static int inbuf_esc = 0;
+static struct timespec inbuf_start;
+static struct timespec rx_time;
+
+static int
+slip_echo_mode(void)
+{
+  /* Echo lines as they are received for verbose=2,3,5+ */
+  /* Echo all printable characters for verbose==4 */
+  return verbose >= 2;
+}
+
+static void
+inbuf_check_overflow(void)
+{
+  if((size_t)inbufptr >= sizeof(uip.inbuf)) {
+    if(timestamp) stamptime();
+    fprintf(stderr, "*** dropping large %d byte packet\n", inbufptr);
+    inbufptr = 0;
+  }
+}
+
+static void
+inbuf_add_byte(unsigned char c)
+{
+  inbuf_check_overflow();
+  if(inbufptr == 0 && latency_stats) {
+    inbuf_start = rx_time;
+  }
+  uip.inbuf[inbufptr++] = c;
+
+  if((verbose==2) || (verbose==3) || (verbose>4)) {
+    if(c=='\n') {
+      if(is_sensible_string(uip.inbuf, inbufptr)) {
+        if (timestamp) stamptime();
+        fwrite(uip.inbuf, inbufptr, 1, stdout);
+        inbufptr=0;
+      }
+    }
+  } else if(verbose==4) {
+    if(c == 0 || c == '\r' || c == '\n' || c == '\t' || (c >= ' ' && c <= '~')) {
+      fwrite(&c, 1, 1, stdout);
+      if(c=='\n') if(timestamp) stamptime();
+    }
+  }
+}
+
+/*
+ * Append a run of bytes that contains no SLIP_END or SLIP_ESC.
+ */
+static void
+inbuf_add_span(const unsigned char *s, int len)
+{
+  int n;
+
+  if(slip_echo_mode()) {
+    while(len-- > 0) {
+      inbuf_add_byte(*s++);
+    }
+    return;
+  }
+
+  while(len > 0) {
+    inbuf_check_overflow();
+    if(inbufptr == 0 && latency_stats) {
+      inbuf_start = rx_time;
+    }
+    n = sizeof(uip.inbuf) - inbufptr;
+    if(n > len) {
+      n = len;
+    }
+    memcpy(&uip.inbuf[inbufptr], s, n);
+    inbufptr += n;
+    s += n;
+    len -= n;
+  }
+}
+
+static void
+inbuf_frame_done(int outfd)
+{
+  int i;
+
+  if(inbufptr == 0) {
+    return;
+  }
+
+  if(uip.inbuf[0] == '!') {
+    if(uip.inbuf[1] == 'M') {
+      /* Read gateway MAC address and autoconfigure tap0 interface */
+      char macs[24];
+      int i, pos;
+      for(i = 0, pos = 0; i < 16; i++) {
+        macs[pos++] = uip.inbuf[2 + i];
+        if((i & 1) == 1 && i < 14) {
+          macs[pos++] = ':';
         }
+      }
+      if(timestamp) stamptime();
+      macs[pos] = '\0';
+      fprintf(stderr,"*** Gateway's MAC address: %s\n", macs);
+      if (timestamp) stamptime();
+      ssystem("ifconfig %s down", tundev);
+      if (timestamp) stamptime();
+      ssystem("ifconfig %s hw ether %s", tundev, &macs[6]);
+      if (timestamp) stamptime();
+      ssystem("ifconfig %s up", tundev);
+    }
+  } else if(uip.inbuf[0] == '?') {
+    if(uip.inbuf[1] == 'P') {
+      /* Prefix info requested */
+      struct in6_addr addr;
+      int i;
+      char *s = strchr(ipaddr, '/');
+      if(s != NULL) {
+        *s = '\0';
+      }
+      inet_pton(AF_INET6, ipaddr, &addr);
+      if(timestamp) stamptime();
+      fprintf(stderr,"*** Address:%s => %02x%02x:%02x%02x:%02x%02x:%02x%02x\n",
+              ipaddr,
+              addr.s6_addr[0], addr.s6_addr[1],
+              addr.s6_addr[2], addr.s6_addr[3],
+              addr.s6_addr[4], addr.s6_addr[5],
+              addr.s6_addr[6], addr.s6_addr[7]);
+      slip_send(slipfd, '!');
+      slip_send(slipfd, 'P');
+      for(i = 0; i < 8; i++) {
+        /* need to call the slip_send_char for stuffing */
+        slip_send_char(slipfd, addr.s6_addr[i]);
+      }
+      slip_send(slipfd, SLIP_END);
+    }
 #define DEBUG_LINE_MARKER '\r'
-      } else if(uip.inbuf[0] == DEBUG_LINE_MARKER) {
-	fwrite(uip.inbuf + 1, inbufptr - 1, 1, stdout);
-      } else if(is_sensible_string(uip.inbuf, inbufptr)) {
-        if(verbose==1) {   /* strings already echoed below for verbose>1 */
-          if (timestamp) stamptime();
-          fwrite(uip.inbuf, inbufptr, 1, stdout);
-        }
-      } else {
-        if(verbose>2) {
-          if (timestamp) stamptime();
-          printf("Packet from SLIP of length %d - write TUN\n", inbufptr);
-          if (verbose>4) {
+  } else if(uip.inbuf[0] == DEBUG_LINE_MARKER) {
+    fwrite(uip.inbuf + 1, inbufptr - 1, 1, stdout);
+  } else if(is_sensible_string(uip.inbuf, inbufptr)) {
+    if(verbose==1) {   /* strings already echoed for verbose>1 */
+      if (timestamp) stamptime();
+      fwrite(uip.inbuf, inbufptr, 1, stdout);
+    }
+  } else {
+    if(verbose>2) {
+      if (timestamp) stamptime();
+      printf("Packet from SLIP of length %d - write TUN\n", inbufptr);
+      if (verbose>4) {
 #if WIRESHARK_IMPORT_FORMAT
-            printf("0000");
-	        for(i = 0; i < inbufptr; i++) printf(" %02x",uip.inbuf[i]);
+        printf("0000");
+        for(i = 0; i < inbufptr; i++) printf(" %02x",uip.inbuf[i]);
 #else
-            printf("         ");
-            for(i = 0; i < inbufptr; i++) {
-              printf("%02x", uip.inbuf[i]);
-              if((i & 3) == 3) printf(" ");
-              if((i & 15) == 15) printf("\n         ");
-            }
-#endif
-            printf("\n");
-          }
+        printf("         ");
+        for(i = 0; i < inbufptr; i++) {
+          printf("%02x", uip.inbuf[i]);
+          if((i & 3) == 3) printf(" ");
+          if((i & 15) == 15) printf("\n         ");
         }
-	if(write(outfd, uip.inbuf, inbufptr) != inbufptr) {
-	  err(1, "serial_to_tun: write");
-	}
+#endif
+        printf("\n");
       }
-      inbufptr = 0;
     }
-    break;
+    if(write(outfd, uip.inbuf, inbufptr) != inbufptr) {
+      err(1, "serial_to_tun: write");
+    }
+    if(latency_stats) {
+      latency_record(&rx_latency, &inbuf_start);
+    }
+  }
+  inbufptr = 0;
+}
 
-  case SLIP_ESC:
-    if(fread(&c, 1, 1, inslip) != 1) {
-      clearerr(inslip);
-      /* Put ESC back and give up! */
-      ungetc(SLIP_ESC, inslip);
+/*
+ * Read a chunk from serial and decode the SLIP frames in it; when we
+ * have a packet write it to tun. Runs of bytes between SLIP_END and
+ * SLIP_ESC are copied to the frame buffer in one go.
+ */
+void
+serial_to_tun(int infd, int outfd)
+{
+  static unsigned char rxbuf[SERIAL_READ_SIZE];
+  const unsigned char *p, *end, *run;
+  unsigned char c;
+  ssize_t ret;
+
+  ret = read(infd, rxbuf, sizeof(rxbuf));
+  if(ret == -1) {
+    if(errno == EAGAIN || errno == EINTR) {
       return;
     }
+    err(1, "serial_to_tun: read");
+  }
+  if(ret == 0) {
+#ifdef linux
+    errx(1, "serial_to_tun: read: end of file");
+#endif
+    return;
+  }
+  if(latency_stats) {
+    latency_now(&rx_time);
+  }
+  PROGRESS(".");
 
-    switch(c) {
-    case SLIP_ESC_END:
-      c = SLIP_END;
-      break;
-    case SLIP_ESC_ESC:
-      c = SLIP_ESC;
-      break;
-    case SLIP_ESC_XON:
-      c = XON;
-      break;
-    case SLIP_ESC_XOFF:
-      c = XOFF;
-      break;
-    }
-    /* FALLTHROUGH */
-  default:
-    uip.inbuf[inbufptr++] = c;
-
-    /* Echo lines as they are received for verbose=2,3,5+ */
-    /* Echo all printable characters for verbose==4 */
-    if((verbose==2) || (verbose==3) || (verbose>4)) {
-      if(c=='\n') {
-        if(is_sensible_string(uip.inbuf, inbufptr)) {
-          if (timestamp) stamptime();
-          fwrite(uip.inbuf, inbufptr, 1, stdout);
-          inbufptr=0;
-        }
-      }
-    } else if(verbose==4) {
-      if(c == 0 || c == '\r' || c == '\n' || c == '\t' || (c >= ' ' && c <= '~')) {
-	fwrite(&c, 1, 1, stdout);
-        if(c=='\n') if(timestamp) stamptime();
+  p = rxbuf;
+  end = rxbuf + ret;
+  while(p < end) {
+    if(inbuf_esc) {
+      inbuf_esc = 0;
+      c = *p++;
+      switch(c) {
+      case SLIP_ESC_END:
+        c = SLIP_END;
+        break;
+      case SLIP_ESC_ESC:
+        c = SLIP_ESC;
+        break;
+      case SLIP_ESC_XON:
+        c = XON;
+        break;
+      case SLIP_ESC_XOFF:
+        c = XOFF;
+        break;
       }
+      inbuf_add_byte(c);
+    } else if(*p == SLIP_END) {
+      p++;
+      inbuf_frame_done(outfd);
+    } else if(*p == SLIP_ESC) {
+      p++;
+      inbuf_esc = 1;
+    } else {
+      for(run = p; p < end && *p != SLIP_END && *p != SLIP_ESC; p++);
+      inbuf_add_span(run, p - run);
     }
-
-    break;
   }
-
-  goto read_more;
 }
 
-unsigned char slip_buf[2000];
+/*
+ * Serial output. Frames read from tun are SLIP encoded into an iovec
+ * list that points into the packet buffers and to the escape
+ * sequences below, and sent with writev(). Whatever the serial line
+ * does not accept immediately is copied to slip_buf and flushed when
+ * the line becomes writable again.
+ */
+unsigned char slip_buf[TUN_BATCH * 2 * 2000 + 64];
 int slip_end, slip_begin;
 
-void
-slip_send_char(int fd, unsigned char c)
+static const unsigned char slip_esc_end[] = { SLIP_ESC, SLIP_ESC_END };
+static const unsigned char slip_esc_esc[] = { SLIP_ESC, SLIP_ESC_ESC };
+static const unsigned char slip_esc_xon[] = { SLIP_ESC, SLIP_ESC_XON };
+static const unsigned char slip_esc_xoff[] = { SLIP_ESC, SLIP_ESC_XOFF };
+static const unsigned char slip_end_byte = SLIP_END;
+
+static struct iovec tx_iov[SLIP_IOV_MAX];
+static int tx_iovcnt;
+
+/* Read timestamps of the frames still sitting in slip_buf */
+static struct timespec tx_time[TUN_BATCH];
+static int tx_time_count;
+
+static const unsigned char *
+slip_escape(unsigned char c)
 {
   switch(c) {
   case SLIP_END:
-    slip_send(fd, SLIP_ESC);
-    slip_send(fd, SLIP_ESC_END);
-    break;
+    return slip_esc_end;
   case SLIP_ESC:
-    slip_send(fd, SLIP_ESC);
-    slip_send(fd, SLIP_ESC_ESC);
-    break;
+    return slip_esc_esc;
   case XON:
-    if(flowcontrol_xonxoff) {
-      slip_send(fd, SLIP_ESC);
-      slip_send(fd, SLIP_ESC_XON);
-    } else {
-      slip_send(fd, c);
-    }
-    break;
+    return flowcontrol_xonxoff ? slip_esc_xon : NULL;
   case XOFF:
-    if(flowcontrol_xonxoff) {
-      slip_send(fd, SLIP_ESC);
-      slip_send(fd, SLIP_ESC_XOFF);
-    } else {
-      slip_send(fd, c);
-    }
-    break;
+    return flowcontrol_xonxoff ? slip_esc_xoff : NULL;
   default:
+    return NULL;
+  }
+}
+
+static void
+slip_queue(const void *data, int len)
+{
+  if((size_t)(slip_end + len) > sizeof(slip_buf)) {
+    err(1, "slip_send overflow");
+  }
+  memcpy(slip_buf + slip_end, data, len);
+  slip_end += len;
+}
+
+void
+slip_send_char(int fd, unsigned char c)
+{
+  const unsigned char *esc;
+
+  esc = slip_escape(c);
+  if(esc != NULL) {
+    slip_queue(esc, 2);
+  } else {
     slip_send(fd, c);
-    break;
   }
 }
 
 void
 slip_send(int fd, unsigned char c)
 {
-  if(slip_end >= sizeof(slip_buf)) {
-    err(1, "slip_send overflow");
-  }
-  slip_buf[slip_end] = c;
-  slip_end++;
+  slip_queue(&c, 1);
 }
 
 int
@@ -389,6 +588,17 @@ slip_empty()
   return slip_end == 0;
 }
 
+static void
+tx_latency_flush(void)
+{
+  int i;
+
+  for(i = 0; i < tx_time_count; i++) {
+    latency_record(&tx_latency, &tx_time[i]);
+  }
+  tx_time_count = 0;
+}
+
 void
 slip_flushbuf(int fd)
 {
@@ -408,15 +618,71 @@ slip_flushbuf(int fd)
     slip_begin += n;
     if(slip_begin == slip_end) {
       slip_begin = slip_end = 0;
+      if(latency_stats) {
+        tx_latency_flush();
+      }
     }
   }
 }
 
+/*
+ * Send the pending iovec list. Anything that is not accepted by
+ * the serial line is copied to slip_buf, behind any data that is
+ * already queued there.
+ */
+static void
+slip_write_iov(int fd)
+{
+  ssize_t n = 0;
+  int i;
+
+  if(tx_iovcnt == 0) {
+    return;
+  }
+
+  if(slip_empty()) {
+    n = writev(fd, tx_iov, tx_iovcnt);
+    if(n == -1 && errno != EAGAIN) {
+      err(1, "slip_write_iov: writev");
+    } else if(n == -1) {
+      PROGRESS("Q");
+      n = 0;
+    }
+  }
+
+  for(i = 0; i < tx_iovcnt; i++) {
+    if((size_t)n >= tx_iov[i].iov_len) {
+      n -= tx_iov[i].iov_len;
+      continue;
+    }
+    slip_queue((unsigned char *)tx_iov[i].iov_base + n,
+               tx_iov[i].iov_len - n);
+    n = 0;
+  }
+  tx_iovcnt = 0;
+}
+
+static void
+slip_add_iov(int fd, const void *data, int len)
+{
+  if(tx_iovcnt == SLIP_IOV_MAX) {
+    slip_write_iov(fd);
+  }
+  tx_iov[tx_iovcnt].iov_base = (void *)data;
+  tx_iov[tx_iovcnt].iov_len = len;
+  tx_iovcnt++;
+}
+
+/*
+ * Add a SLIP encoded frame to the pending iovec list. The buffer
+ * must stay untouched until slip_write_iov() has been called.
+ */
 void
 write_to_serial(int outfd, void *inbuf, int len)
 {
   u_int8_t *p = inbuf;
-  int i;
+  const unsigned char *esc;
+  int i, run;
 
   if(verbose>2) {
     if (timestamp) stamptime();
@@ -440,59 +706,59 @@ write_to_serial(int outfd, void *inbuf, int len)
   /* It would be ``nice'' to send a SLIP_END here but it's not
    * really necessary.
    */
-  /* slip_send(outfd, SLIP_END); */
 
-  for(i = 0; i < len; i++) {
-    switch(p[i]) {
-    case SLIP_END:
-      slip_send(outfd, SLIP_ESC);
-      slip_send(outfd, SLIP_ESC_END);
-      break;
-    case SLIP_ESC:
-      slip_send(outfd, SLIP_ESC);
-      slip_send(outfd, SLIP_ESC_ESC);
-      break;
-    case XON:
-      if(flowcontrol_xonxoff) {
-        slip_send(outfd, SLIP_ESC);
-        slip_send(outfd, SLIP_ESC_XON);
-      } else {
-        slip_send(outfd, p[i]);
-      }
-      break;
-    case XOFF:
-      if(flowcontrol_xonxoff) {
-        slip_send(outfd, SLIP_ESC);
-        slip_send(outfd, SLIP_ESC_XOFF);
-      } else {
-        slip_send(outfd, p[i]);
+  for(i = 0, run = 0; i < len; i++) {
+    esc = slip_escape(p[i]);
+    if(esc != NULL) {
+      if(i > run) {
+        slip_add_iov(outfd, &p[run], i - run);
       }
-      break;
-    default:
-      slip_send(outfd, p[i]);
-      break;
+      slip_add_iov(outfd, esc, 2);
+      run = i + 1;
     }
   }
-  slip_send(outfd, SLIP_END);
+  if(len > run) {
+    slip_add_iov(outfd, &p[run], len - run);
+  }
+  slip_add_iov(outfd, &slip_end_byte, 1);
   PROGRESS("t");
 }
 
 
 /*
- * Read from tun, write to slip.
+ * Read from tun, write to slip. Up to TUN_BATCH packets that are
+ * already waiting on tun are sent with a single writev().
  */
 int
 tun_to_serial(int infd, int outfd)
 {
-  struct {
+  static struct {
     unsigned char inbuf[2000];
-  } uip;
-  int size;
+  } uip[TUN_BATCH];
+  int size, total, n, batch;
+
+  /* The inter-packet delay applies per packet, so do not batch. */
+  batch = basedelay ? 1 : TUN_BATCH;
 
-  if((size = read(infd, uip.inbuf, 2000)) == -1) err(1, "tun_to_serial: read");
+  for(n = 0, total = 0; n < batch; n++) {
+    if((size = read(infd, uip[n].inbuf, sizeof(uip[n].inbuf))) == -1) {
+      if(errno == EAGAIN || errno == EINTR) {
+        break;
+      }
+      err(1, "tun_to_serial: read");
+    }
+    if(latency_stats) {
+      latency_now(&tx_time[tx_time_count++]);
+    }
+    write_to_serial(outfd, uip[n].inbuf, size);
+    total += size;
+  }
 
-  write_to_serial(outfd, uip.inbuf, size);
-  return size;
+  slip_write_iov(outfd);
+  if(latency_stats && slip_empty()) {
+    tx_latency_flush();
+  }
+  return total;
 }
 
 void
@@ -536,8 +802,11 @@ stty_telos(int fd)
   tty.c_cflag |= CLOCAL;
   if(tcsetattr(fd, TCSAFLUSH, &tty) == -1) err(1, "tcsetattr");
 
+  /* Pseudo terminals (used for loopback testing) have no modem lines */
   i = TIOCM_DTR;
-  if(ioctl(fd, TIOCMBIS, &i) == -1) err(1, "ioctl");
+  if(ioctl(fd, TIOCMBIS, &i) == -1 && errno != ENOTTY && errno != EINVAL) {
+    err(1, "ioctl");
+  }
 #endif
 
   usleep(10*1000);		/* Wait for hardware 10ms. */
@@ -603,6 +872,7 @@ tun_alloc(char *dev, int tap)
 void
 cleanup(void)
 {
+  latency_print_all();
 #ifndef __APPLE__
   if (timestamp) stamptime();
   ssystem("ifconfig %s down", tundev);
@@ -638,6 +908,13 @@ sigcleanup(int signo)
 }
 
 static int got_sigalarm;
+static volatile sig_atomic_t got_sigusr1;
+
+void
+sigusr1(int signo)
+{
+  got_sigusr1 = 1;
+}
 
 void
 sigalarm(int signo)
@@ -742,14 +1019,116 @@ ifconf(const char *tundev, const char *ipaddr)
   ssystem("ifconfig %s\n", tundev);
 }
 
+/*
+ * Event loop. Only the serial line and tun are watched, so this is
+ * kept minimal: epoll on Linux, select() elsewhere.
+ */
+#define EV_READ  1
+#define EV_WRITE 2
+
+struct ev_fd {
+  int fd;
+  int want;
+  int ready;
+  int registered;
+};
+
+static struct ev_fd ev_slip, ev_tun;
+#if USE_EPOLL
+static int ev_epfd = -1;
+#endif
+
+static void
+ev_init(int sfd, int tfd)
+{
+  ev_slip.fd = sfd;
+  ev_tun.fd = tfd;
+#if USE_EPOLL
+  ev_epfd = epoll_create(2);
+  if(ev_epfd == -1) err(1, "epoll_create");
+#endif
+}
+
+static void
+ev_watch(struct ev_fd *e, int want)
+{
+#if USE_EPOLL
+  struct epoll_event ev;
+
+  if(e->registered && e->want == want) {
+    return;
+  }
+  memset(&ev, 0, sizeof(ev));
+  ev.events = ((want & EV_READ) ? EPOLLIN : 0) |
+    ((want & EV_WRITE) ? EPOLLOUT : 0);
+  ev.data.ptr = e;
+  if(epoll_ctl(ev_epfd, e->registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD,
+               e->fd, &ev) == -1) {
+    err(1, "epoll_ctl");
+  }
+  e->registered = 1;
+#endif
+  e->want = want;
+}
+
+/* Returns the number of ready fds, or -1 on EINTR. */
+static int
+ev_wait(int timeout_ms)
+{
+#if USE_EPOLL
+  struct epoll_event evs[2];
+  struct ev_fd *e;
+  int i, n;
+
+  ev_slip.ready = ev_tun.ready = 0;
+  n = epoll_wait(ev_epfd, evs, 2, timeout_ms);
+  if(n == -1) {
+    if(errno == EINTR) return -1;
+    err(1, "epoll_wait");
+  }
+  for(i = 0; i < n; i++) {
+    e = evs[i].data.ptr;
+    if(evs[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+      e->ready |= EV_READ;
+    }
+    if(evs[i].events & EPOLLOUT) {
+      e->ready |= EV_WRITE;
+    }
+    e->ready &= e->want;
+  }
+  return n;
+#else
+  fd_set rset, wset;
+  struct timeval tv;
+  int maxfd, n;
+
+  ev_slip.ready = ev_tun.ready = 0;
+  FD_ZERO(&rset);
+  FD_ZERO(&wset);
+  if(ev_slip.want & EV_READ) FD_SET(ev_slip.fd, &rset);
+  if(ev_slip.want & EV_WRITE) FD_SET(ev_slip.fd, &wset);
+  if(ev_tun.want & EV_READ) FD_SET(ev_tun.fd, &rset);
+  maxfd = ev_slip.fd > ev_tun.fd ? ev_slip.fd : ev_tun.fd;
+
+  tv.tv_sec = timeout_ms / 1000;
+  tv.tv_usec = (timeout_ms % 1000) * 1000;
+  n = select(maxfd + 1, &rset, &wset, NULL, timeout_ms < 0 ? NULL : &tv);
+  if(n == -1) {
+    if(errno == EINTR) return -1;
+    err(1, "select");
+  }
+  if(FD_ISSET(ev_slip.fd, &rset)) ev_slip.ready |= EV_READ;
+  if(FD_ISSET(ev_slip.fd, &wset)) ev_slip.ready |= EV_WRITE;
+  if(FD_ISSET(ev_tun.fd, &rset)) ev_tun.ready |= EV_READ;
+  return n;
+#endif
+}
+
 int
 main(int argc, char **argv)
 {
   int c;
-  int tunfd, maxfd;
-  int ret;
-  fd_set rset, wset;
-  FILE *inslip;
+  int tunfd;
   const char *siodev = NULL;
   const char *host = NULL;
   const char *port = NULL;
@@ -762,7 +1141,7 @@ main(int argc, char **argv)
   prog = argv[0];
   setvbuf(stdout, NULL, _IOLBF, 0); /* Line buffered output. */
 
-  while((c = getopt(argc, argv, "B:HILPhXM:s:t:v::d::a:p:T")) != -1) {
+  while((c = getopt(argc, argv, "B:HILPhXM:s:St:v::d::a:p:T")) != -1) {
     switch(c) {
     case 'B':
       baudrate = atoi(optarg);
@@ -798,6 +1177,10 @@ main(int argc, char **argv)
       }
       break;
 
+    case 'S':
+      latency_stats = 1;
+      break;
+
     case 'I':
       ipa_enable = 1;
       fprintf(stderr, "Will inquire about IP address using IPA=\n");
@@ -849,6 +1232,7 @@ fprintf(stderr," -I             Inquire IP address\n");
 fprintf(stderr," -X             Software XON/XOFF flow control (default disabled)\n");
 fprintf(stderr," -L             Log output format (adds time stamps)\n");
 fprintf(stderr," -s siodev      Serial device (default /dev/ttyUSB0)\n");
+fprintf(stderr," -S             Per-frame latency histograms, printed on exit and SIGUSR1\n");
 fprintf(stderr," -M             Interface MTU (default and min: 1280)\n");
 fprintf(stderr," -T             Make tap interface (default is tun interface)\n");
 fprintf(stderr," -t tundev      Name of interface (default tap0 or tun0)\n");
@@ -873,7 +1257,7 @@ exit(1);
   argv += (optind - 1);
 
   if(argc != 2 && argc != 3) {
-    err(1, "usage: %s [-B baudrate] [-H] [-L] [-s siodev] [-t tundev] [-T] [-v verbosity] [-d delay] [-a serveraddress] [-p serverport] ipaddress", prog);
+    err(1, "usage: %s [-B baudrate] [-H] [-L] [-s siodev] [-S] [-t tundev] [-T] [-v verbosity] [-d delay] [-a serveraddress] [-p serverport] ipaddress", prog);
   }
   ipaddr = argv[1];
 
@@ -957,11 +1341,10 @@ exit(1);
     stty_telos(slipfd);
   }
   slip_send(slipfd, SLIP_END);
-  inslip = fdopen(slipfd, "r");
-  if(inslip == NULL) err(1, "main: fdopen");
 
   tunfd = tun_alloc(tundev, tap);
   if(tunfd == -1) err(1, "main: open /dev/tun");
+  if(fcntl(tunfd, F_SETFL, O_NONBLOCK) == -1) err(1, "main: fcntl tun");
   if (timestamp) stamptime();
   fprintf(stderr, "opened %s device ``/dev/%s''\n",
           tap ? "tap" : "tun", tundev);
@@ -971,12 +1354,13 @@ exit(1);
   signal(SIGTERM, sigcleanup);
   signal(SIGINT, sigcleanup);
   signal(SIGALRM, sigalarm);
+  signal(SIGUSR1, sigusr1);
   ifconf(tundev, ipaddr);
 
+  ev_init(slipfd, tunfd);
+
   while(1) {
-    maxfd = 0;
-    FD_ZERO(&rset);
-    FD_ZERO(&wset);
+    int timeout = -1;
 
     if(got_sigalarm && ipa_enable) {
       /* Send "?IPA". */
@@ -988,57 +1372,51 @@ exit(1);
       got_sigalarm = 0;
     }
 
-    if(!slip_empty()) {		/* Anything to flush? */
-      FD_SET(slipfd, &wset);
+    if(got_sigusr1) {
+      latency_print_all();
+      got_sigusr1 = 0;
+    }
+
+    /* Optional delay between outgoing packets */
+    /* Base delay times number of 6lowpan fragments to be sent */
+    if(delaymsec) {
+      struct timeval tv;
+      int dmsec;
+      gettimeofday(&tv, NULL) ;
+      dmsec=(tv.tv_sec-delaystartsec)*1000+tv.tv_usec/1000-delaystartmsec;
+      if(dmsec<0) delaymsec=0;
+      if(dmsec>delaymsec) delaymsec=0;
+      if(delaymsec) timeout = delaymsec - dmsec + 1;
     }
 
-    FD_SET(slipfd, &rset);	/* Read from slip ASAP! */
-    if(slipfd > maxfd) maxfd = slipfd;
+    /* Read from slip ASAP! Flush if anything is queued. */
+    ev_watch(&ev_slip, EV_READ | (slip_empty() ? 0 : EV_WRITE));
+
+    /* We only have one batch of packets at a time queued for slip output. */
+    ev_watch(&ev_tun, (slip_empty() && delaymsec == 0) ? EV_READ : 0);
 
-    /* We only have one packet at a time queued for slip output. */
-    if(slip_empty()) {
-      FD_SET(tunfd, &rset);
-      if(tunfd > maxfd) maxfd = tunfd;
+    if(ev_wait(timeout) <= 0) {
+      continue;
     }
 
-    ret = select(maxfd + 1, &rset, &wset, NULL, NULL);
-    if(ret == -1 && errno != EINTR) {
-      err(1, "select");
-    } else if(ret > 0) {
-      if(FD_ISSET(slipfd, &rset)) {
-        serial_to_tun(inslip, tunfd);
-      }
+    if(ev_slip.ready & EV_READ) {
+      serial_to_tun(slipfd, tunfd);
+    }
 
-      if(FD_ISSET(slipfd, &wset)) {
-	slip_flushbuf(slipfd);
-	if(ipa_enable) sigalarm_reset();
-      }
+    if(ev_slip.ready & EV_WRITE) {
+      slip_flushbuf(slipfd);
+      if(ipa_enable) sigalarm_reset();
+    }
 
-      /* Optional delay between outgoing packets */
-      /* Base delay times number of 6lowpan fragments to be sent */
-      if(delaymsec) {
-       struct timeval tv;
-       int dmsec;
-       gettimeofday(&tv, NULL) ;
-       dmsec=(tv.tv_sec-delaystartsec)*1000+tv.tv_usec/1000-delaystartmsec;
-       if(dmsec<0) delaymsec=0;
-       if(dmsec>delaymsec) delaymsec=0;
-      }
-      if(delaymsec==0) {
-        int size;
-        if(slip_empty() && FD_ISSET(tunfd, &rset)) {
-          size=tun_to_serial(tunfd, slipfd);
-          slip_flushbuf(slipfd);
-          if(ipa_enable) sigalarm_reset();
-          if(basedelay) {
-            struct timeval tv;
-            gettimeofday(&tv, NULL) ;
- //         delaymsec=basedelay*(1+(size/120));//multiply by # of 6lowpan packets?
-            delaymsec=basedelay;
-            delaystartsec =tv.tv_sec;
-            delaystartmsec=tv.tv_usec/1000;
-          }
-        }
+    if(slip_empty() && (ev_tun.ready & EV_READ)) {
+      tun_to_serial(tunfd, slipfd);
+      if(ipa_enable) sigalarm_reset();
+      if(basedelay) {
+        struct timeval tv;
+        gettimeofday(&tv, NULL) ;
+        delaymsec=basedelay;
+        delaystartsec =tv.tv_sec;
+        delaystartmsec=tv.tv_usec/1000;
       }
     }
   }